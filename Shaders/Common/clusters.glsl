@@ -0,0 +1,57 @@
+//Clustered lighting: the view frustum split in CLUSTER_X * CLUSTER_Y screen tiles and CLUSTER_Z exponential depth slices,
+//each with the list of lights that reach it. Built every frame by Shaders/Lighting/clusterCull.comp.
+//std430, mirrored by src/LightClusters.h. Change both together. Needs uniforms.glsl first.
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define MAX_LIGHTS_PER_CLUSTER 256
+
+#define CLUSTER_POINT_LIGHT 0u
+#define CLUSTER_SPOT_LIGHT 1u
+
+struct ClusterLight {
+	vec3 position;
+	float range;
+	vec3 diffuse;
+	float intensity;
+	vec3 direction; //Spot lights only
+	float cutOff; //Cosines
+	float outerCutOff;
+	uint type;
+	int shadow; //lightShadow() index, -1 unshadowed
+};
+
+layout(std430, binding = 4) readonly buffer ClusterLights { ClusterLight clusterLights[]; };
+#ifdef CLUSTER_WRITE
+layout(std430, binding = 5) writeonly buffer ClusterCounts { uint clusterCounts[]; };
+layout(std430, binding = 6) writeonly buffer ClusterIndices { uint clusterIndices[]; }; //MAX_LIGHTS_PER_CLUSTER slots per cluster
+#else
+layout(std430, binding = 5) readonly buffer ClusterCounts { uint clusterCounts[]; };
+layout(std430, binding = 6) readonly buffer ClusterIndices { uint clusterIndices[]; };
+#endif
+
+//Slices are spaced exponentially so they stay roughly cube shaped, viewDepth is the positive distance along the view direction
+uint clusterSlice(float viewDepth){
+	return uint(clamp(log(viewDepth / nearPlane) / log(farPlane / nearPlane) * CLUSTER_Z, 0.0, CLUSTER_Z - 1.0));
+}
+float clusterSliceDepth(uint slice){
+	return nearPlane * pow(farPlane / nearPlane, float(slice) / CLUSTER_Z);
+}
+uint clusterIndex(vec2 fragCoord, float viewDepth){
+	uvec2 tile = min(uvec2(fragCoord * vec2(CLUSTER_X, CLUSTER_Y) * inverseScreenSize), uvec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+	return tile.x + CLUSTER_X * (tile.y + CLUSTER_Y * clusterSlice(viewDepth));
+}
+//Smoothly reaches 0 at range, so a light cut off by the culling leaves no seam at cluster borders
+float clusterRangeFalloff(float distance, float range){
+	float ratio = distance / range;
+	float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+	return window * window;
+}
+//Black for no lights, then blue to green to red at 32 and white for a full cluster(lights past MAX_LIGHTS_PER_CLUSTER are dropped)
+vec3 clusterHeatColor(uint count){
+	if(count == 0u) return vec3(0.0);
+	if(count >= MAX_LIGHTS_PER_CLUSTER) return vec3(1.0);
+
+	float t = min(float(count) / 32.0, 1.0);
+	return vec3(smoothstep(0.5, 1.0, t), 1.0 - abs(t * 2.0 - 1.0), smoothstep(0.5, 0.0, t));
+}
@@ -0,0 +1,48 @@
+//Packed G-buffer written by deferred.frag and read by the deferred resolves, 10 bytes per pixel plus depth. Mirrored by setupDeferredShading() in main.cpp:
+//albedoMetallic RGBA8(albedo stored with a 2.2 gamma for precision in the darks, metallic), normal RG16_SNORM(octahedral),
+//material RG8(roughness, ambient occlusion) and the depth texture, from which the position is rebuilt. Needs uniforms.glsl first.
+
+//With DEFERRED_MSAA every target is multisampled. deferredEdges.frag marks the pixels whose samples differ in the edge mask and the resolves
+//shade every sample of those, one elsewhere. texelFetch takes the sample where a single sampled target takes the level, so pass 0 without it
+#ifdef DEFERRED_MSAA
+#define gBufferSampler sampler2DMS
+uniform int gBufferSamples;
+#else
+#define gBufferSampler sampler2D
+#endif
+
+//Unit vector folded onto the octahedron and the octahedron's lower half unfolded over the upper one, so it fits a square
+vec2 signNotZero(vec2 v){
+	return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+vec2 encodeNormal(vec3 n){
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	return n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signNotZero(n.xy);
+}
+vec3 decodeNormal(vec2 e){
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if(n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * signNotZero(n.xy);
+	return normalize(n);
+}
+
+vec3 encodeAlbedo(vec3 albedo){
+	return pow(albedo, vec3(1.0 / 2.2));
+}
+vec3 decodeAlbedo(vec3 albedo){
+	return pow(albedo, vec3(2.2));
+}
+
+//Cleared depth, nothing was drawn there
+bool isSky(float depth){
+	return depth >= 1.0;
+}
+//uv is the screen position(0-1), depth the depth buffer value
+vec3 reconstructWorldPos(vec2 uv, float depth){
+	vec4 world = inverseProjView * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+	return world.xyz / world.w;
+}
+//Positive distance along the view direction of a depth buffer value
+float linearDepth(float depth){
+	float ndc = depth * 2.0 - 1.0;
+	return 2.0 * nearPlane * farPlane / (farPlane + nearPlane - ndc * (farPlane - nearPlane));
+}
@@ -0,0 +1,90 @@
+//Blinn-Phong model of the main shader, shared by its forward and deferred variants and by Shaders/Lighting/tiledDeferred.comp.
+//Needs uniforms.glsl, a vec3 viewDir global set before lighting and a shininessExponent uniform. DIR_SHADOWS needs shadows.glsl too
+#define ambientConst 0.1f
+#define specularConst 0.3f
+
+float spec(vec3 lightDir, vec3 aNormal){
+	vec3 halfwayDir = normalize(lightDir + viewDir);
+
+	return pow(max(dot(aNormal, halfwayDir), 0.0), shininessExponent);
+}
+vec3 CalcDirLight(DirLight light, vec3 normal, vec2 texCoord, float shininess, vec3 fragPos, vec3 albedo){
+	if(light.diffuse == vec3(0.f)) return vec3(0.f); //If empty just stop
+	
+	//Set important variables
+	vec3 lightDir = normalize(-light.direction);
+
+	vec3 ambient = albedo, diffuse = albedo;
+	float specular = shininess;
+
+	//Ambient lighting
+	ambient *= ambientConst;//light.ambient;
+
+	//Diffuse lighting
+	float diff = max(dot(normal, lightDir), 0.0);
+	diffuse *= light.diffuse * diff;
+
+	//Specular lighting
+	specular *= specularConst/*light.specular*/*spec(lightDir, normal);
+
+#ifdef DIR_SHADOWS
+	return ambient + (diffuse + specular) * dirShadow(fragPos, normal);
+#else
+	return (ambient + diffuse + specular);
+#endif
+}
+vec3 CalcPointLight(PointLight light, vec3 normal, vec2 texCoord, float shininess, vec3 fragPos, vec3 albedo){
+	if(light.diffuse == vec3(0.f)) return vec3(0.f); //If empty just stop
+	
+	//Set important variables
+	vec3 lightDir = normalize(light.position - fragPos);
+
+	vec3 ambient = albedo, diffuse = albedo;
+	float specular = shininess;
+
+	//Ambient lighting
+	ambient *= ambientConst;//light.ambient;
+
+	//Diffuse lighting
+	float diff = max(dot(lightDir, normal), 0.0);
+	diffuse *= light.diffuse * diff;
+
+	//Attenuation
+	float distance = length(light.position - fragPos);
+	float attenuation = 1.0 / (distance * distance);//(light.constant + light.linear * distance + light.quadratic * (distance * distance));
+	
+	//Specular lighting
+	specular *= specularConst/*light.specular*/ * spec(lightDir, normal);
+
+	return (ambient + diffuse + specular) * attenuation;
+}
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec2 texCoord, float shininess, vec3 fragPos, vec3 albedo){
+	if(light.diffuse == vec3(0.f)) return vec3(0.f); //If empty just stop
+	
+	//Set important variables
+	vec3 lightDir = normalize(light.position - fragPos);
+	
+	vec3 ambient = albedo, diffuse = albedo;
+	float specular = shininess;
+
+	//Ambient lighting
+	//ambient *= ambientConst;//light.ambient; //SpotLight doesn't have ambient lighting
+
+	//Diffuse lighting
+	float diff = max(dot(normal, lightDir), 0.0);
+	diffuse *= light.diffuse * diff;
+
+	//Specular lighting
+	specular *= specularConst/*light.specular*/ * spec(lightDir, normal);
+
+	//Attenuation
+	float distance = length(light.position - fragPos);
+	float attenuation = 1.0 / (distance * distance);//(light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+	
+	//Spotlight range
+	float theta = dot(lightDir, normalize(-light.direction)); 
+	float epsilon = light.cutOff - light.outerCutOff;
+	float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+
+	return (ambient + diffuse + specular) * attenuation * intensity;
+}
@@ -0,0 +1,198 @@
+//Shadow maps of the lights(see src/ShadowCascades.h and src/ShadowAtlas.h). Needs uniforms.glsl first.
+//std140, mirrored by ShadowsBlock in src/UniformBuffers.h. Change both together
+#define MAX_CASCADES 4
+#define MAX_SHADOWED_LIGHTS 64
+#define SHADOW_POINT_LIGHT 0u
+#define SHADOW_SPOT_LIGHT 1u
+#define SHADOW_FILTER_PCF 0
+#define SHADOW_FILTER_PCSS_BRUTE_FORCE 1
+#define SHADOW_FILTER_PCSS 2
+
+//A point light's six cube faces or a spot light's one tile in the atlas
+struct LightShadow {
+	mat4 matrix; //World to clip space, spot lights only
+	vec4 rects[6]; //Atlas UV offset and size of each face
+	vec3 position;
+	float nearPlane;
+	float farPlane;
+	uint type;
+	float texelScale; //World size of a texel per unit of distance from the light
+	float padding;
+};
+
+layout(std140, binding = 3) uniform Shadows {
+	mat4 cascadeMatrices[MAX_CASCADES]; //World to the clip space of each cascade
+	vec4 cascadeSplits; //View depth where each cascade ends
+	vec4 cascadeTexelSizes; //World size of a texel of each cascade
+	int cascadeCount;
+	float shadowNormalOffset; //In texels
+	float shadowDepthBias;
+	int spotLightShadow; //Index in lightShadows of the Lights block's spot light, -1 unshadowed
+	int shadowFilter; //SHADOW_FILTER_* of the cascades
+	float shadowLightSize; //Tangent of the directional light's angular radius
+	float shadowMaxPenumbra; //World units
+	int shadowPyramidLevels;
+	ivec4 pointLightShadows[MAX_POINT_LIGHTS / 4]; //Same for its point lights, packed four per element
+	LightShadow lightShadows[MAX_SHADOWED_LIGHTS];
+};
+
+//A layer per cascade, compared in hardware: each lookup returns the lit fraction of the 2x2 texels around it
+layout(binding = 14) uniform sampler2DArrayShadow cascadeShadowMap;
+//Every point and spot light's tiles
+layout(binding = 15) uniform sampler2DShadow shadowAtlas;
+//Nearest and farthest depth of each 2x2 texels of the cascades, halving per level. Only built for SHADOW_FILTER_PCSS
+layout(binding = 17) uniform sampler2DArray cascadeMinMax;
+//The cascades' depths again, read without the comparison by the PCSS blocker search
+layout(binding = 18) uniform sampler2DArray cascadeDepth;
+
+const vec2 poissonDisk[16] = vec2[](
+	vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725), vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760),
+	vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464), vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379),
+	vec2(0.44323325, -0.97511554), vec2(0.53742981, -0.47373420), vec2(-0.26496911, -0.41893023), vec2(0.79197514, 0.19090188),
+	vec2(-0.24188840, 0.99706507), vec2(-0.81409955, 0.91437590), vec2(0.19984126, 0.78641367), vec2(0.14383161, -0.14100790)
+);
+
+//Four bilinear lookups half a texel apart cover a 3x3 tent. position is in texels
+float cascadeTent(vec2 position, int cascade, float depth){
+	vec2 texel = 1.0 / vec2(textureSize(cascadeShadowMap, 0).xy);
+	float lit = 0.0;
+	for(int i = 0; i < 4; i++){
+		vec2 offset = vec2(i & 1, i >> 1) - 0.5;
+		lit += texture(cascadeShadowMap, vec4((position + offset) * texel, float(cascade), depth));
+	}
+	return lit * 0.25;
+}
+
+vec2 cascadeMinMaxAt(ivec2 texel, int cascade, int level){
+	ivec2 size = textureSize(cascadeMinMax, level).xy;
+	return texelFetch(cascadeMinMax, ivec3(clamp(texel, ivec2(0), size - 1), cascade), level).rg;
+}
+float cascadeDepthAt(ivec2 texel, int cascade){
+	ivec2 size = textureSize(cascadeDepth, 0).xy;
+	return texelFetch(cascadeDepth, ivec3(clamp(texel, ivec2(0), size - 1), cascade), 0).r;
+}
+
+//Percentage closer soft shadows. The blockers are searched for as far as the widest penumbra a caster between the cascade's near plane
+//and the receiver could cast, their average depth sets the filter's radius, so shadows harden where the caster touches the receiver.
+//hierarchical first reads the pyramid level where the search area falls in 2x2 texels and stops when the receiver is nearer than all of
+//it(lit) or farther(shadowed, the filter never reaches past the search). Past that both search the same depth texels, so they shade alike
+//and only differ in the pixels they skip. 16 Poisson samples each, rotated per texel against banding
+float cascadePCSS(vec2 position, int cascade, float depth, bool hierarchical){
+	float resolution = float(textureSize(cascadeShadowMap, 0).x);
+	float texelSize = cascadeTexelSizes[cascade];
+	float searchRadius = clamp(depth * resolution * shadowLightSize, 1.0, max(shadowMaxPenumbra / texelSize, 1.0)); //Texels
+
+	if(hierarchical){
+		int level = clamp(int(ceil(log2(searchRadius))), 0, shadowPyramidLevels - 1);
+		float scale = exp2(-float(level + 1)); //Level texels per shadow map texel
+		ivec2 low = ivec2(floor((position - searchRadius) * scale)), high = ivec2(floor((position + searchRadius) * scale));
+		if(all(lessThanEqual(high - low, ivec2(1)))){
+			vec2 a = cascadeMinMaxAt(low, cascade, level), b = cascadeMinMaxAt(ivec2(high.x, low.y), cascade, level);
+			vec2 c = cascadeMinMaxAt(ivec2(low.x, high.y), cascade, level), d = cascadeMinMaxAt(high, cascade, level);
+			if(depth <= min(min(a.x, b.x), min(c.x, d.x))) return 1.0;
+			if(depth > max(max(a.y, b.y), max(c.y, d.y))) return 0.0;
+		}
+	}
+
+	//Interleaved gradient noise of the shadow map texel, stays put on screen while the camera moves
+	float angle = 6.2831853 * fract(52.9829189 * fract(dot(floor(position), vec2(0.06711056, 0.00583715))));
+	mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+
+	float blockerSum = 0.0;
+	int blockers = 0;
+	for(int i = 0; i < 16; i++){
+		float blocker = cascadeDepthAt(ivec2(floor(position + rotation * poissonDisk[i] * searchRadius)), cascade);
+		if(blocker < depth){
+			blockerSum += blocker;
+			blockers++;
+		}
+	}
+	if(blockers == 0) return 1.0;
+
+	float penumbra = min((depth - blockerSum / float(blockers)) * resolution * shadowLightSize, searchRadius); //Texels
+	if(penumbra <= 1.0) return cascadeTent(position, cascade, depth); //Contact, as hard as the fixed filter
+
+	vec2 texel = 1.0 / vec2(resolution);
+	float lit = 0.0;
+	for(int i = 0; i < 16; i++)
+		lit += texture(cascadeShadowMap, vec4((position + rotation * poissonDisk[i] * penumbra) * texel, float(cascade), depth));
+	return lit / 16.0;
+}
+
+//How much of the directional light reaches worldPos, 0 in full shadow. The cascade is the first one whose split is past the point's
+//view depth, points past the last split are lit. normal pushes the lookup off the surface by a texel of that cascade against acne.
+//shadowFilter picks the fixed tent or PCSS
+float dirShadow(vec3 worldPos, vec3 normal){
+	float depth = dot(worldPos - viewPos, viewForward);
+	int cascade = 0;
+	while(cascade < cascadeCount && depth > cascadeSplits[cascade])
+		cascade++;
+	if(cascade == cascadeCount) return 1.0;
+
+	vec3 position = worldPos + normal * cascadeTexelSizes[cascade] * shadowNormalOffset;
+	vec3 coords = (cascadeMatrices[cascade] * vec4(position, 1.0)).xyz * 0.5 + 0.5;
+	vec2 texelPosition = coords.xy * vec2(textureSize(cascadeShadowMap, 0).xy);
+	float receiver = coords.z - shadowDepthBias;
+
+	if(shadowFilter == SHADOW_FILTER_PCF)
+		return cascadeTent(texelPosition, cascade, receiver);
+	return cascadePCSS(texelPosition, cascade, receiver, shadowFilter == SHADOW_FILTER_PCSS);
+}
+
+int pointLightShadow(int light){
+	return pointLightShadows[light >> 2][light & 3];
+}
+
+//Cube faces in the order and orientation of src/ShadowAtlas.h: +X -X +Y -Y +Z -Z
+const vec3 cubeFaceForward[6] = vec3[](vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1));
+const vec3 cubeFaceUp[6] = vec3[](vec3(0, -1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1), vec3(0, -1, 0), vec3(0, -1, 0));
+
+//How much of the light with the shadow index reaches worldPos, 1 for an unshadowed light(index -1) or without LIGHT_SHADOWS.
+//A point light's face is its major axis and projected the way the face was drawn, so no matrix is stored per face
+float lightShadow(int index, vec3 worldPos, vec3 normal){
+#ifdef LIGHT_SHADOWS
+	if(index < 0) return 1.0;
+
+	vec3 toPoint = worldPos - lightShadows[index].position;
+	toPoint += normal * lightShadows[index].texelScale * length(toPoint) * shadowNormalOffset;
+
+	vec3 ndc;
+	vec4 rect;
+	if(lightShadows[index].type == SHADOW_SPOT_LIGHT){
+		vec4 clip = lightShadows[index].matrix * vec4(lightShadows[index].position + toPoint, 1.0);
+		if(clip.w <= 0.0) return 1.0;
+		ndc = clip.xyz / clip.w;
+		rect = lightShadows[index].rects[0];
+	}
+	else{
+		vec3 axis = abs(toPoint);
+		int face = axis.x >= axis.y && axis.x >= axis.z ? (toPoint.x > 0.0 ? 0 : 1) : axis.y >= axis.z ? (toPoint.y > 0.0 ? 2 : 3) : (toPoint.z > 0.0 ? 4 : 5);
+		vec3 forward = cubeFaceForward[face];
+		vec3 side = cross(forward, cubeFaceUp[face]);
+		vec3 up = cross(side, forward);
+
+		//glm::perspective with a 90 degree fov and square aspect
+		float depth = dot(forward, toPoint);
+		float nearPlane = lightShadows[index].nearPlane, farPlane = lightShadows[index].farPlane;
+		float clipDepth = (farPlane + nearPlane) / (farPlane - nearPlane) * depth - 2.0 * farPlane * nearPlane / (farPlane - nearPlane);
+		ndc = vec3(dot(side, toPoint), dot(up, toPoint), clipDepth) / depth;
+		rect = lightShadows[index].rects[face];
+	}
+	if(abs(ndc.x) > 1.0 || abs(ndc.y) > 1.0) return 1.0; //Outside a spot light's cone
+	vec3 coords = ndc * 0.5 + 0.5;
+	coords.z = min(coords.z, 1.0); //Past the range, where the light is gone anyway
+
+	//Same tent as dirShadow(), kept a texel inside the tile so it never reads a neighbouring one. No constant depth bias, in a perspective
+	//tile it would grow with the distance, the draw's polygon offset and the normal offset keep the acne away
+	vec2 texel = 1.0 / vec2(textureSize(shadowAtlas, 0));
+	vec2 low = rect.xy + texel, high = rect.xy + rect.zw - texel;
+	float lit = 0.0;
+	for(int i = 0; i < 4; i++){
+		vec2 offset = vec2(i & 1, i >> 1) - 0.5;
+		lit += texture(shadowAtlas, vec3(clamp(rect.xy + coords.xy * rect.zw + offset * texel, low, high), coords.z));
+	}
+	return lit * 0.25;
+#else
+	return 1.0;
+#endif
+}
@@ -0,0 +1,48 @@
+//Blocks shared by every program, bound once to fixed binding points and updated once per frame.
+//std140, mirrored by the structs in src/UniformBuffers.h. Change both together.
+layout(std140, binding = 0) uniform Camera {
+	mat4 view;
+	mat4 proj;
+	mat4 projView;
+	vec3 viewPos;
+	float nearPlane;
+	vec3 viewForward;
+	float farPlane;
+	mat4 inverseProjView; //Screen back to world, rebuilds positions from depth
+};
+layout(std140, binding = 1) uniform Frame {
+	vec2 screenSize;
+	vec2 inverseScreenSize;
+	float time;
+	float deltaTime;
+	uint frameIndex;
+};
+
+struct DirLight {
+	vec3 direction;
+	float intensity;
+	vec3 diffuse;
+};
+struct PointLight {
+	vec3 position;
+	float intensity;
+	vec3 diffuse;
+	float range;
+};
+struct SpotLight {
+	vec3 position;
+	float intensity;
+	vec3 direction;
+	float cutOff; //Cosines
+	vec3 diffuse;
+	float outerCutOff;
+};
+
+#define MAX_POINT_LIGHTS 16
+
+layout(std140, binding = 2) uniform Lights {
+	DirLight dirLight;
+	SpotLight spotLight;
+	PointLight pointLights[MAX_POINT_LIGHTS];
+	int pointLightCount; //Which lights are on is compiled into the shader variant(DIR_LIGHT, POINT_LIGHTS, SPOT_LIGHT)
+};
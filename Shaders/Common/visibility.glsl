@@ -0,0 +1,116 @@
+//Visibility buffer(see src/VisibilityBuffer.h). A pixel holds the draw in its upper bits and the triangle of that draw's mesh in the lower
+//VISIBILITY_TRIANGLE_BITS, VISIBILITY_EMPTY where nothing was drawn. The vertices and indices of every mesh drawn are pooled in the buffers below.
+//std430, mirrored by src/VisibilityBuffer.h. Change both together. fetchSurface() needs uniforms.glsl first.
+//VISIBILITY_WRITE declares only the vertex pool to fill it, VISIBILITY_IDS none of the buffers
+#define VISIBILITY_TRIANGLE_BITS 20
+#define VISIBILITY_EMPTY 0xFFFFFFFFu
+#define VISIBILITY_MATERIAL_SLOTS 65535.0 //The material depth buffer is 16 bit
+
+struct VisibilityVertex {
+	vec4 positionU; //Texture coordinates in the w of the first two
+	vec4 normalV;
+	vec4 tangent; //w is the handedness
+};
+struct VisibilityDraw {
+	mat4 model;
+	mat4 normalMatrix;
+	uint firstVertex;
+	uint firstIndex; //Indices are relative to firstVertex
+	uint material; //Slot of the frame
+	uint padding;
+};
+
+#if defined(VISIBILITY_WRITE)
+layout(std430, binding = 7) writeonly buffer VisibilityVertices { VisibilityVertex visibilityVertices[]; };
+#elif !defined(VISIBILITY_IDS)
+layout(std430, binding = 7) readonly buffer VisibilityVertices { VisibilityVertex visibilityVertices[]; };
+layout(std430, binding = 8) readonly buffer VisibilityIndices { uint visibilityIndices[]; };
+layout(std430, binding = 9) readonly buffer VisibilityDraws { VisibilityDraw visibilityDraws[]; };
+#endif
+
+uint visibilityDraw(uint id){
+	return id >> VISIBILITY_TRIANGLE_BITS;
+}
+uint visibilityTriangle(uint id){
+	return id & ((1u << VISIBILITY_TRIANGLE_BITS) - 1u);
+}
+//Depth of a material slot in the material depth buffer
+float materialDepth(uint material){
+	return float(material) / VISIBILITY_MATERIAL_SLOTS;
+}
+
+#if !defined(VISIBILITY_WRITE) && !defined(VISIBILITY_IDS)
+//Perspective correct barycentrics of a point inside a triangle and how much they change one pixel right(ddx) and up(ddy)
+struct Barycentrics {
+	vec3 lambda;
+	vec3 ddx;
+	vec3 ddy;
+};
+//c0-c2 are the clip space corners, ndc the point. The screen space barycentrics are interpolated with 1/w and divided back,
+//the derivatives are the difference to the neighbouring pixels so textureGrad picks the mip a rasterized triangle would
+Barycentrics computeBarycentrics(vec4 c0, vec4 c1, vec4 c2, vec2 ndc){
+	Barycentrics result;
+	vec3 invW = 1.0 / vec3(c0.w, c1.w, c2.w);
+	vec2 ndc0 = c0.xy * invW.x;
+	vec2 ndc1 = c1.xy * invW.y;
+	vec2 ndc2 = c2.xy * invW.z;
+
+	float invDet = 1.0 / determinant(mat2(ndc2 - ndc1, ndc0 - ndc1));
+	result.ddx = vec3(ndc1.y - ndc2.y, ndc2.y - ndc0.y, ndc0.y - ndc1.y) * invDet * invW;
+	result.ddy = vec3(ndc2.x - ndc1.x, ndc0.x - ndc2.x, ndc1.x - ndc0.x) * invDet * invW;
+	float ddxSum = result.ddx.x + result.ddx.y + result.ddx.z;
+	float ddySum = result.ddy.x + result.ddy.y + result.ddy.z;
+
+	vec2 delta = ndc - ndc0;
+	float interpInvW = invW.x + delta.x * ddxSum + delta.y * ddySum;
+	result.lambda = (vec3(invW.x, 0.0, 0.0) + delta.x * result.ddx + delta.y * result.ddy) / interpInvW;
+
+	//From per NDC unit to per pixel
+	result.ddx *= 2.0 * inverseScreenSize.x;
+	result.ddy *= 2.0 * inverseScreenSize.y;
+	ddxSum *= 2.0 * inverseScreenSize.x;
+	ddySum *= 2.0 * inverseScreenSize.y;
+
+	result.ddx = (result.lambda * interpInvW + result.ddx) / (interpInvW + ddxSum) - result.lambda;
+	result.ddy = (result.lambda * interpInvW + result.ddy) / (interpInvW + ddySum) - result.lambda;
+	return result;
+}
+
+struct VisibilitySurface {
+	vec3 worldPos;
+	vec3 normal;
+	vec4 tangent; //World space, zero when the mesh has none
+	vec2 texCoord;
+	vec2 texCoordDx; //Per pixel, for textureGrad
+	vec2 texCoordDy;
+};
+//Interpolated attributes of the triangle id at the point ndc of the screen
+VisibilitySurface fetchSurface(uint id, vec2 ndc){
+	VisibilityDraw record = visibilityDraws[visibilityDraw(id)];
+	uint first = record.firstIndex + visibilityTriangle(id) * 3u;
+
+	VisibilityVertex corners[3];
+	vec4 world[3];
+	vec4 clip[3];
+	for(int i = 0; i < 3; i++){
+		corners[i] = visibilityVertices[record.firstVertex + visibilityIndices[first + uint(i)]];
+		world[i] = record.model * vec4(corners[i].positionU.xyz, 1.0);
+		clip[i] = projView * world[i];
+	}
+	Barycentrics b = computeBarycentrics(clip[0], clip[1], clip[2], ndc);
+
+	VisibilitySurface surface;
+	surface.worldPos = mat3(world[0].xyz, world[1].xyz, world[2].xyz) * b.lambda;
+
+	mat3x2 texCoords = mat3x2(vec2(corners[0].positionU.w, corners[0].normalV.w), vec2(corners[1].positionU.w, corners[1].normalV.w), vec2(corners[2].positionU.w, corners[2].normalV.w));
+	surface.texCoord = texCoords * b.lambda;
+	surface.texCoordDx = texCoords * b.ddx;
+	surface.texCoordDy = texCoords * b.ddy;
+
+	mat3 normalMatrix = mat3(record.normalMatrix);
+	surface.normal = normalize(normalMatrix * (mat3(corners[0].normalV.xyz, corners[1].normalV.xyz, corners[2].normalV.xyz) * b.lambda));
+	vec3 tangent = mat3(corners[0].tangent.xyz, corners[1].tangent.xyz, corners[2].tangent.xyz) * b.lambda;
+	surface.tangent = tangent == vec3(0.0) ? vec4(0.0) : vec4(normalize(normalMatrix * tangent), corners[0].tangent.w);
+	return surface;
+}
+#endif
@@ -0,0 +1,5 @@
+#version 420 core
+
+//Only depth testing matters for the occlusion query, color writes are masked
+void main(){
+}
\ No newline at end of file
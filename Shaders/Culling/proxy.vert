@@ -0,0 +1,10 @@
+#version 420 core
+layout (location = 0) in vec3 aPos; //Unit cube
+
+uniform mat4 PVMat;
+uniform vec3 boxMin;
+uniform vec3 boxMax;
+
+void main(){
+	gl_Position = PVMat * vec4(mix(boxMin, boxMax, aPos), 1.f);
+}
\ No newline at end of file
@@ -2,11 +2,28 @@
 layout (location = 0) out vec4 FragColor;
 layout (location = 1) out vec4 BrightColor;
 
+#ifdef VISIBILITY_RESOLVE
+//Fetched from the visibility buffer, the quad has no interpolated attributes of the surface
+vec2 texCoord;
+vec2 texCoordDx, texCoordDy;
+vec3 tint = vec3(1.f);
+vec3 worldPos;
+vec3 normal;
+mat3 TBN;
+#define sampleMap(map) textureGrad(map, texCoord, texCoordDx, texCoordDy)
+#else
 in vec2 texCoord;
+in vec3 tint;
+#ifdef DEFERRED_RESOLVE
+vec3 worldPos; //Rebuilt from the depth buffer
+#else
 in vec3 worldPos;
+#endif
 in vec3 normal;
 in mat3 TBN;
 in mat3 transposeModel;
+#define sampleMap(map) texture(map, texCoord)
+#endif
 
 layout(binding = 0) uniform sampler2D albedoTex;
 layout(binding = 1) uniform sampler2D normalTex;
@@ -17,56 +34,36 @@ layout(binding = 5) uniform samplerCube irradianceMap;
 layout(binding = 6) uniform samplerCube prefilterMap;
 layout(binding = 7) uniform sampler2D   brdfLUT;
 
-struct DirLight{
-	vec3 direction;
-	vec3 diffuse;
-
-	float intensity;
-};
-struct PointLight {
-	vec3 position;
-	vec3 diffuse;
-	
-	float intensity;
-};
-struct SpotLight {
-	vec3 position;
-	vec3 direction;
-	vec3 diffuse;
-
-	float cutOff;
-	float outerCutOff;
-	
-	float intensity;
-};
-
-#define NR_POINT_LIGHTS 1
-
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
-
-uniform bool dirLightEnabled;
-uniform bool pointLightEnabled;
-uniform bool spotLightEnabled;
-
-//IBL
-uniform vec3 viewPos;
-
-uniform bool iblEnabled;
-
-uniform bool transformSRGB;
-uniform bool bloomOn;
-
-uniform bool useAlbedo;
-uniform bool useNormalMap;
-uniform bool useMetallic;
-uniform bool useRoughness;
-uniform bool useAmbientMap;
-
-//Deferred
-uniform bool deferredEnabled;
-uniform int deferredState;
+#include "../Common/uniforms.glsl"
+#ifdef DEFERRED_RESOLVE
+#include "../Common/gBuffer.glsl"
+
+layout(binding = 8) uniform gBufferSampler depthBuffer;
+layout(binding = 9) uniform gBufferSampler normalBuffer;
+layout(binding = 10) uniform gBufferSampler albedoBuffer;
+layout(binding = 11) uniform gBufferSampler materialBuffer;
+layout(binding = 12) uniform sampler2D edgeMask; //DEFERRED_MSAA
+#endif
+#ifdef VISIBILITY_RESOLVE
+#include "../Common/visibility.glsl"
+
+layout(binding = 13) uniform usampler2D visibilityBuffer;
+#endif
+#ifdef CLUSTERED_LIGHTS
+#include "../Common/clusters.glsl"
+#endif
+#include "../Common/shadows.glsl"
+
+//Features are #defines injected per variant(see ShaderVariants.h): ALBEDO_MAP, NORMAL_MAP, METALLIC_MAP, ROUGHNESS_MAP, AO_MAP,
+//IBL, DIR_LIGHT, POINT_LIGHTS, SPOT_LIGHT, BLOOM, SRGB_TEXTURES, CLUSTERED_LIGHTS(every point and spot light from the fragment's cluster
+//instead of the Lights block ones), CLUSTER_HEATMAP, DEFERRED_RESOLVE(the material comes from the packed G-buffer instead of the maps)
+//DEFERRED_MSAA(a multisampled G-buffer), VISIBILITY_RESOLVE(the surface comes from the visibility buffer, the material from the maps)
+//DIR_SHADOWS(cascaded shadow maps on the directional light) and LIGHT_SHADOWS(the point and spot lights' atlas)
+
+//Material factors, multiply the textures
+uniform vec3 albedoFactor = vec3(1.f);
+uniform float metallicFactor = 1.f;
+uniform float roughnessFactor = 1.f;
 
 const float PI = 3.14159265359;
 
@@ -111,7 +108,7 @@ vec3 CalcPointLight(PointLight light, vec3 albedo, vec3 normal, float metallic,
 vec3 CalcSpotLight(SpotLight light, vec3 albedo, vec3 normal, float metallic, float roughness, float ao);
 vec3 CalcAmbient(vec3 albedo, vec3 normal, float metallic, float roughness, float ao);
 vec3 getNormalFromMap(){
-    vec3 tangentNormal = texture(normalTex, texCoord).xyz * 2.0 - 1.0;
+    vec3 tangentNormal = sampleMap(normalTex).xyz * 2.0 - 1.0;
 
     //vec3 Q1  = dFdx(worldPos);
     //vec3 Q2  = dFdy(worldPos);
@@ -132,62 +129,131 @@ vec3 viewDir;
 // of 0.04 and if it's a metal, use the albedo color as F0 (metallic workflow)
 vec3 F0 = vec3(0.04); 
 
-// reflectance equation
-vec3 Lo = vec3(0.0);
-
-void main(){
-	vec3 albedo;
-	vec3 aNormal;
-	float metallic;
-	float roughness;
-	float ao;
-
-	if(useAlbedo) albedo = texture(albedoTex, texCoord).rgb;
-	if(useMetallic) metallic = texture(metallicTex, texCoord).r;
-	if(useRoughness) roughness = texture(roughnessTex, texCoord).r;
-	else roughness = 1.f;
+#ifdef CLUSTERED_LIGHTS
+uint clusterLightCount = 0u; //Of the last shaded point, for the heatmap
+#endif
 
-	if(useAmbientMap) ao = texture(AOTex, texCoord).r;
-	else ao = 1.f;
-
-	if(transformSRGB) albedo = pow(albedo, vec3(2.2f));
-
-	if(!useNormalMap || texture(normalTex, texCoord).rgb == vec3(0.f) || TBN == mat3(0.f)) //If normalMap is empty or you cant transform a normal map to a normal vector just use the vertex normal vector
-		aNormal = normal;
-	else
-		aNormal = getNormalFromMap();
-	
+//Every enabled light on the surface point at worldPos
+vec3 shadeSurface(vec3 albedo, vec3 aNormal, float metallic, float roughness, float ao){
 	//normal = someNormal;
 	viewDir = normalize(viewPos - worldPos);
 
-	F0 = mix(F0, albedo, metallic);
+	F0 = mix(vec3(0.04), albedo, metallic);
 
 
-	vec3 result;
+	vec3 result = vec3(0.f);
 
-	if(dirLightEnabled)
-		result += CalcDirLight(dirLight, albedo, aNormal, metallic, roughness, ao);
-
-	if(pointLightEnabled){
-		for(int i = 0; i < NR_POINT_LIGHTS; i++){
-			result += CalcPointLight(pointLights[i], albedo, aNormal, metallic, roughness, ao);
-		}
+#ifdef DIR_LIGHT
+	result += CalcDirLight(dirLight, albedo, aNormal, metallic, roughness, ao);
+#endif
+#ifdef CLUSTERED_LIGHTS
+	uint cluster = clusterIndex(gl_FragCoord.xy, -(view * vec4(worldPos, 1.0)).z);
+	clusterLightCount = clusterCounts[cluster];
+	for(uint i = 0; i < clusterLightCount; i++){
+		ClusterLight light = clusterLights[clusterIndices[cluster * MAX_LIGHTS_PER_CLUSTER + i]];
+		float falloff = clusterRangeFalloff(length(light.position - worldPos), light.range) * lightShadow(light.shadow, worldPos, aNormal);
+		if(light.type == CLUSTER_SPOT_LIGHT)
+			result += falloff * CalcSpotLight(SpotLight(light.position, light.intensity, light.direction, light.cutOff, light.diffuse, light.outerCutOff), albedo, aNormal, metallic, roughness, ao);
+		else
+			result += falloff * CalcPointLight(PointLight(light.position, light.intensity, light.diffuse, light.range), albedo, aNormal, metallic, roughness, ao);
 	}
+#else
+#ifdef POINT_LIGHTS
+	for(int i = 0; i < pointLightCount; i++){
+		result += CalcPointLight(pointLights[i], albedo, aNormal, metallic, roughness, ao) * lightShadow(pointLightShadow(i), worldPos, aNormal);
+	}
+#endif
+#ifdef SPOT_LIGHT
+	result += CalcSpotLight(spotLight, albedo, aNormal, metallic, roughness, ao) * lightShadow(spotLightShadow, worldPos, aNormal);
+#endif
+#endif
+#ifdef IBL
+	result += CalcAmbient(albedo, aNormal, metallic, roughness, ao);
+#endif
+	return result;
+}
 
-	if(spotLightEnabled)
-		result += CalcSpotLight(spotLight, albedo, aNormal, metallic, roughness, ao);
-
-	
-	if(iblEnabled) result += CalcAmbient(albedo, aNormal, metallic, roughness, ao);
+void main(){
+	vec3 result = vec3(0.f);
+
+#ifdef DEFERRED_RESOLVE
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	int samples = 1;
+#ifdef DEFERRED_MSAA
+	if(texelFetch(edgeMask, pixel, 0).r != 0.0) samples = gBufferSamples; //Edges shade every sample, the rest only the first
+#endif
+	bool covered = false;
+	for(int i = 0; i < samples; i++){
+		float depth = texelFetch(depthBuffer, pixel, i).r;
+		if(isSky(depth)) continue; //Adds the black of the clear
+
+		covered = true;
+		worldPos = reconstructWorldPos(texCoord, depth);
+		vec4 albedoMetallic = texelFetch(albedoBuffer, pixel, i);
+		vec2 material = texelFetch(materialBuffer, pixel, i).rg;
+		vec3 aNormal = decodeNormal(texelFetch(normalBuffer, pixel, i).rg);
+		result += shadeSurface(decodeAlbedo(albedoMetallic.rgb), aNormal, albedoMetallic.a, material.r, material.g);
+	}
+	if(!covered) discard;
+	result /= float(samples);
+#else
+#ifdef VISIBILITY_RESOLVE
+	//Only the pixels of this material pass the depth test
+	VisibilitySurface surface = fetchSurface(texelFetch(visibilityBuffer, ivec2(gl_FragCoord.xy), 0).r, gl_FragCoord.xy * inverseScreenSize * 2.0 - 1.0);
+	worldPos = surface.worldPos;
+	normal = surface.normal;
+	texCoord = surface.texCoord;
+	texCoordDx = surface.texCoordDx;
+	texCoordDy = surface.texCoordDy;
+	if(surface.tangent.xyz == vec3(0.f))
+		TBN = mat3(0.f);
+	else{
+		vec3 T = normalize(surface.tangent.xyz - dot(surface.tangent.xyz, normal) * normal);
+		TBN = mat3(T, cross(normal, T) * surface.tangent.w, normal);
+	}
+#endif
+	vec3 albedo = vec3(1.f);
+	vec3 aNormal = normal;
+	float metallic = metallicFactor;
+	float roughness = roughnessFactor;
+	float ao = 1.f;
+
+#ifdef ALBEDO_MAP
+	albedo = sampleMap(albedoTex).rgb;
+#ifdef SRGB_TEXTURES
+	albedo = pow(albedo, vec3(2.2f));
+#endif
+#endif
+#ifdef METALLIC_MAP
+	metallic *= sampleMap(metallicTex).r;
+#endif
+#ifdef ROUGHNESS_MAP
+	roughness *= sampleMap(roughnessTex).r;
+#endif
+#ifdef AO_MAP
+	ao = sampleMap(AOTex).r;
+#endif
+	albedo *= tint * albedoFactor;
+
+#ifdef NORMAL_MAP
+	if(TBN != mat3(0.f)) //If you cant transform a normal map to a normal vector just use the vertex normal vector
+		aNormal = getNormalFromMap();
+#endif
+	result = shadeSurface(albedo, aNormal, metallic, roughness, ao);
+#endif
 
 	FragColor = vec4(result, 1.0);
+#if defined(CLUSTER_HEATMAP) && defined(CLUSTERED_LIGHTS)
+	FragColor = vec4(clusterHeatColor(clusterLightCount), 1.0);
+#endif
 
 	//Bloom
+	BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
+#ifdef BLOOM
 	float brightness = dot(FragColor.rgb, vec3(0.2126, 0.7152, 0.0722)); //Transform into a luminance value
-	if(brightness > 1.0 && bloomOn)
+	if(brightness > 1.0)
 		BrightColor = vec4(FragColor.rgb, 1.0);
-	else
-		BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
+#endif
 }
 vec3 CalcDirLight(DirLight light, vec3 albedo, vec3 normal, float metallic, float roughness, float ao){
 	if(light.diffuse == vec3(0.f)) return vec3(0.f); //If empty just stop
@@ -221,7 +287,10 @@ vec3 CalcDirLight(DirLight light, vec3 albedo, vec3 normal, float metallic, floa
 	float NdotL = max(dot(normal, lightDir), 0.0);
 
 	// add to outgoing radiance Lo
-	Lo += (kD * albedo / PI + specular) * radiance * NdotL * light.intensity; // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
+	vec3 Lo = (kD * albedo / PI + specular) * radiance * NdotL * light.intensity; // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
+#ifdef DIR_SHADOWS
+	Lo *= dirShadow(worldPos, normal);
+#endif
 	
 	return Lo;
 }
@@ -259,7 +328,7 @@ vec3 CalcPointLight(PointLight light, vec3 albedo, vec3 normal, float metallic,
 	float NdotL = max(dot(normal, lightDir), 0.0);
 
 	// add to outgoing radiance Lo
-	Lo += (kD * albedo / PI + specular) * radiance * NdotL * light.intensity; // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
+	vec3 Lo = (kD * albedo / PI + specular) * radiance * NdotL * light.intensity; // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
 	
 	return Lo;//texture(material.normal, texCoord).rgb;//(TBN * (texture(material.normal, texCoord).rgb*2.f-1.f))*0.5f + 0.5f;
 }
@@ -297,7 +366,7 @@ vec3 CalcSpotLight(SpotLight light, vec3 albedo, vec3 normal, float metallic, fl
 	float NdotL = max(dot(normal, lightDir), 0.0);
 
 	// add to outgoing radiance Lo
-	Lo += (kD * albedo / PI + specular) * radiance * NdotL * light.intensity; // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
+	vec3 Lo = (kD * albedo / PI + specular) * radiance * NdotL * light.intensity; // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
 	
 	//Spotlight range
 	float theta = dot(lightDir, normalize(-light.direction)); 
@@ -2,36 +2,51 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
-layout (location = 3) in vec3 aTangent;
+layout (location = 3) in vec4 aTangent; //w is the handedness
+layout (location = 4) in mat4 aInstanceModel; //Locations 4-7
+layout (location = 8) in vec3 aInstanceTint;
 
 out vec2 texCoord;
 
 out vec3 normal;
+out vec3 tint;
 out vec3 worldPos;
 
+#include "../Common/uniforms.glsl"
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
 
-uniform bool deferredEnabled;
+uniform bool instanced;
+
+//DEFERRED_RESOLVE and VISIBILITY_RESOLVE variants draw a fullscreen quad, the visibility one at the depth of its material's slot
+uniform float materialDepth;
 
 out mat3 TBN;
 
 void main(){
-	worldPos = vec3(model * vec4(aPos, 1.f));
-	gl_Position = deferredEnabled ? vec4(aPos, 1.f) : proj * view * vec4(worldPos, 1.f); //Todo multiply it in the cpu as the cpu can save some processing
+	mat4 modelMat = instanced ? aInstanceModel : model;
+	tint = instanced ? aInstanceTint : vec3(1.f);
+
+	worldPos = vec3(modelMat * vec4(aPos, 1.f));
+#if defined(DEFERRED_RESOLVE)
+	gl_Position = vec4(aPos, 1.f);
+#elif defined(VISIBILITY_RESOLVE)
+	gl_Position = vec4(aPos.xy, materialDepth * 2.f - 1.f, 1.f);
+#else
+	gl_Position = projView * vec4(worldPos, 1.f);
+#endif
 	texCoord = aTexCoord;
 
-	mat3 normalMatrix = transpose(inverse(mat3(model))); //Transpose is really expensive function
+	mat3 normalMatrix = transpose(inverse(mat3(modelMat))); //Transpose is really expensive function
 	normal = normalize(normalMatrix * aNormal);
 
-	if(aTangent == vec3(0.f))
+	if(aTangent.xyz == vec3(0.f))
 		TBN = mat3(0.f);
 	else{
-		vec3 T = normalize(normalMatrix * aTangent);
+		vec3 T = normalize(normalMatrix * aTangent.xyz);
 		
 		T = normalize(T - dot(T, normal) * normal);
-		vec3 B = cross(normal, T);
+		vec3 B = cross(normal, T) * aTangent.w;
 		
 		TBN = mat3(T, B, normal);
 	}
@@ -0,0 +1,28 @@
+#version 420 core
+#ifdef VIEWPORT_FROM_VERTEX
+#extension GL_ARB_shader_viewport_layer_array : require
+#endif
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 model;
+uniform mat4 faceMatrices[6]; //World to the clip space of each face of the light, only the first for a spot light
+
+//Point and spot light tiles of src/ShadowAtlas.h, every face has a viewport on its tile.
+//VIEWPORT_FROM_VERTEX draws a copy of the caster per face it reaches and picks that face's viewport here, otherwise a draw per face sets face
+#ifdef VIEWPORT_FROM_VERTEX
+uniform uint faceMask;
+#else
+uniform int face;
+#endif
+
+void main()
+{
+#ifdef VIEWPORT_FROM_VERTEX
+    //The copy n goes to the face of the n-th bit set in faceMask
+    int face = 0;
+    for(int seen = 0; face < 5; face++)
+        if((faceMask & (1u << face)) != 0u && seen++ == gl_InstanceID) break;
+    gl_ViewportIndex = face;
+#endif
+    gl_Position = faceMatrices[face] * model * vec4(aPos, 1.0);
+}
\ No newline at end of file
@@ -1,10 +1,10 @@
 #version 420 core
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 lightSpaceMatrix;
 uniform mat4 model;
 
+//World space, Shadow/cascades.geom projects it into each cascade
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+    gl_Position = model * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,18 @@
+#version 430 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoord;
+layout (location = 3) in vec4 aTangent; //w is the handedness
+
+#define VISIBILITY_WRITE
+#include "../Common/visibility.glsl"
+
+//Copies every vertex a mesh's VAO reads, whatever layout it has, into the vertex pool from firstVertex on.
+//Drawn as points with rasterization discarded, missing attributes read as zero
+
+uniform uint firstVertex;
+
+void main(){
+	visibilityVertices[firstVertex + uint(gl_VertexID)] = VisibilityVertex(vec4(aPos, aTexCoord.x), vec4(aNormal, aTexCoord.y), aTangent);
+	gl_Position = vec4(0.f);
+}
\ No newline at end of file
@@ -0,0 +1,16 @@
+#version 430 core
+
+#include "../Common/uniforms.glsl"
+#include "../Common/visibility.glsl"
+
+//Writes the material slot of each covered pixel as its depth, the material passes then draw at their slot's depth with GL_EQUAL
+//so early depth testing skips the pixels of every other material
+
+layout(binding = 0) uniform usampler2D visibilityBuffer;
+
+void main(){
+	uint id = texelFetch(visibilityBuffer, ivec2(gl_FragCoord.xy), 0).r;
+	if(id == VISIBILITY_EMPTY) discard;
+
+	gl_FragDepth = materialDepth(visibilityDraws[visibilityDraw(id)].material);
+}
\ No newline at end of file
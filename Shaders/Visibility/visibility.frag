@@ -0,0 +1,11 @@
+#version 430 core
+layout (location = 0) out uint VisibilityID;
+
+#define VISIBILITY_IDS
+#include "../Common/visibility.glsl"
+
+uniform uint drawID; //Index of the draw in the frame's draw buffer
+
+void main(){
+	VisibilityID = (drawID << VISIBILITY_TRIANGLE_BITS) | uint(gl_PrimitiveID); //Counts the triangles of the draw
+}
\ No newline at end of file
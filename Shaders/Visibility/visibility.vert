@@ -0,0 +1,12 @@
+#version 420 core
+layout (location = 0) in vec3 aPos;
+
+#include "../Common/uniforms.glsl"
+
+//Geometry pass of the visibility buffer, only the position is read
+
+uniform mat4 model;
+
+void main(){
+	gl_Position = projView * (model * vec4(aPos, 1.f));
+}
\ No newline at end of file
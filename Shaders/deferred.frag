@@ -1,10 +1,10 @@
 #version 420 core
-layout (location = 0) out vec3 gPosition;
-layout (location = 1) out vec3 gNormal;
-layout (location = 2) out vec4 gAlbedoSpec;
+layout (location = 0) out vec4 gAlbedoMetallic;
+layout (location = 1) out vec2 gNormal;
+layout (location = 2) out vec2 gMaterial;
 
 in vec2 texCoord;
-in vec3 worldPos;
+in vec3 tint;
 in vec3 normal;
 
 in mat3 TBN;
@@ -12,17 +12,49 @@ in mat3 TBN;
 layout(binding = 0) uniform sampler2D albedoTex;
 layout(binding = 1) uniform sampler2D normalTex;
 layout(binding = 2) uniform sampler2D metallicTex;
+layout(binding = 3) uniform sampler2D roughnessTex;
+layout(binding = 4) uniform sampler2D AOTex;
+
+#include "Common/uniforms.glsl"
+#include "Common/gBuffer.glsl"
+
+//Features are #defines injected per variant(see ShaderVariants.h): ALBEDO_MAP, NORMAL_MAP, METALLIC_MAP, ROUGHNESS_MAP, AO_MAP and SRGB_TEXTURES.
+//Fills the packed G-buffer(Common/gBuffer.glsl) with the PBR material, the Blinn-Phong resolve reads metallic as its specular
+
+//Material factors, multiply the textures
+uniform vec3 albedoFactor = vec3(1.f);
+uniform float metallicFactor = 1.f;
+uniform float roughnessFactor = 1.f;
 
 void main(){
-    // store the fragment position vector in the first gbuffer texture
-    gPosition = worldPos;
-    // also store the per-fragment normals into the gbuffer
-    if(texture(normalTex, texCoord).rgb == vec3(0.f) || TBN == mat3(0.f))
-        gNormal = normal;
-    else
-        gNormal = normalize(TBN * (texture(normalTex, texCoord).rgb * 2.f - 1.f));
-    // and the diffuse per-fragment color
-    gAlbedoSpec.rgb = texture(albedoTex, texCoord).rgb;
-    // store specular intensity in gAlbedoSpec's alpha component
-    gAlbedoSpec.a = texture(metallicTex, texCoord).r;
+	vec3 albedo = vec3(1.f);
+	vec3 aNormal = normal;
+	float metallic = metallicFactor;
+	float roughness = roughnessFactor;
+	float ao = 1.f;
+
+#ifdef ALBEDO_MAP
+	albedo = texture(albedoTex, texCoord).rgb;
+#ifdef SRGB_TEXTURES
+	albedo = pow(albedo, vec3(2.2f));
+#endif
+#endif
+#ifdef NORMAL_MAP
+	if(TBN != mat3(0.f)) //If you cant transform a normal map to a normal vector just use the vertex normal vector
+		aNormal = normalize(TBN * (texture(normalTex, texCoord).rgb * 2.f - 1.f));
+#endif
+#ifdef METALLIC_MAP
+	metallic *= texture(metallicTex, texCoord).r;
+#endif
+#ifdef ROUGHNESS_MAP
+	roughness *= texture(roughnessTex, texCoord).r;
+#endif
+#ifdef AO_MAP
+	ao = texture(AOTex, texCoord).r;
+#endif
+	albedo *= tint * albedoFactor;
+
+	gAlbedoMetallic = vec4(encodeAlbedo(clamp(albedo, 0.0, 1.0)), metallic);
+	gNormal = encodeNormal(normalize(aNormal));
+	gMaterial = vec2(roughness, ao);
 }
\ No newline at end of file
@@ -0,0 +1,40 @@
+#version 420 core
+out vec4 EdgeMask;
+
+in vec2 texCoord;
+
+#define DEFERRED_MSAA
+#include "Common/uniforms.glsl"
+#include "Common/gBuffer.glsl"
+
+//Classifies the pixels of the multisampled G-buffer. A pixel is an edge when its samples don't all see the same surface: some are sky,
+//or their depth or normal is too far from the first sample's. Edges write 1 to the mask, the rest are discarded so an occlusion query
+//around the pass counts the edges
+
+layout(binding = 0) uniform gBufferSampler depthBuffer;
+layout(binding = 1) uniform gBufferSampler normalBuffer;
+
+uniform float depthThreshold = 0.01; //Relative to the first sample's view depth
+uniform float normalThreshold = 0.95; //Cosine
+
+void main(){
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+
+	float depth = texelFetch(depthBuffer, pixel, 0).r;
+	float viewDepth = linearDepth(depth);
+	vec3 normal = decodeNormal(texelFetch(normalBuffer, pixel, 0).rg);
+
+	bool edge = false;
+	for(int i = 1; i < gBufferSamples && !edge; i++){
+		float sampleDepth = texelFetch(depthBuffer, pixel, i).r;
+		if(isSky(depth) || isSky(sampleDepth)){
+			edge = isSky(depth) != isSky(sampleDepth);
+			continue;
+		}
+		edge = abs(linearDepth(sampleDepth) - viewDepth) > depthThreshold * viewDepth ||
+			dot(decodeNormal(texelFetch(normalBuffer, pixel, i).rg), normal) < normalThreshold;
+	}
+	if(!edge) discard;
+
+	EdgeMask = vec4(1.0);
+}
\ No newline at end of file
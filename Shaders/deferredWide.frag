@@ -0,0 +1,33 @@
+#version 420 core
+//The G-buffer layout before the packed one of deferred.frag(position, normal, albedo + metallic: 20 bytes per pixel plus depth).
+//Only the G-buffer benchmark draws it, as the reference
+layout (location = 0) out vec3 gPosition;
+layout (location = 1) out vec3 gNormal;
+layout (location = 2) out vec4 gAlbedoSpec;
+
+in vec2 texCoord;
+in vec3 worldPos;
+in vec3 normal;
+
+in mat3 TBN;
+
+layout(binding = 0) uniform sampler2D albedoTex;
+layout(binding = 1) uniform sampler2D normalTex;
+layout(binding = 2) uniform sampler2D metallicTex;
+
+uniform vec3 albedoFactor = vec3(1.f);
+uniform float metallicFactor = 1.f;
+
+void main(){
+    // store the fragment position vector in the first gbuffer texture
+    gPosition = worldPos;
+    // also store the per-fragment normals into the gbuffer
+    if(texture(normalTex, texCoord).rgb == vec3(0.f) || TBN == mat3(0.f))
+        gNormal = normal;
+    else
+        gNormal = normalize(TBN * (texture(normalTex, texCoord).rgb * 2.f - 1.f));
+    // and the diffuse per-fragment color
+    gAlbedoSpec.rgb = texture(albedoTex, texCoord).rgb * albedoFactor;
+    // store specular intensity in gAlbedoSpec's alpha component
+    gAlbedoSpec.a = texture(metallicTex, texCoord).r * metallicFactor;
+}
\ No newline at end of file
@@ -1,8 +1,8 @@
 #version 420 core
 out vec4 FragColor;
 
-uniform vec3 diffuse;
+in vec3 boxColor;
 
 void main(){
-	FragColor = vec4(diffuse, 1.f);
+	FragColor = vec4(boxColor, 1.f);
 }
\ No newline at end of file
@@ -1,9 +1,24 @@
 #version 420 core
 layout (location = 0) in vec3 aPos;
+layout (location = 4) in mat4 aInstanceModel; //Locations 4-7
+layout (location = 8) in vec3 aInstanceTint;
+
+out vec3 boxColor;
 
 uniform vec3 pos;
-uniform mat4 PVMat;
+uniform vec3 diffuse;
+
+#include "Common/uniforms.glsl"
+
+uniform bool instanced;
 
 void main(){
-	gl_Position = PVMat * vec4((aPos * 0.2) + pos, 1.f);
+	if(instanced){
+		gl_Position = projView * aInstanceModel * vec4(aPos, 1.f);
+		boxColor = aInstanceTint;
+	}
+	else{
+		gl_Position = projView * vec4((aPos * 0.2) + pos, 1.f);
+		boxColor = diffuse;
+	}
 }
\ No newline at end of file
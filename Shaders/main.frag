@@ -2,13 +2,10 @@
 layout (location = 0) out vec4 FragColor;
 layout (location = 1) out vec4 BrightColor;
 
-/*Bloom*/
-uniform bool bloomOn;
-
 in vec3 normal;
 in vec3 worldPos;
 in vec2 texCoord;
-in vec4 fragPosLightSpace;
+in vec3 tint;
 
 in mat3 TBN;
 
@@ -17,159 +14,38 @@ layout(binding = 1) uniform sampler2D normalTex;
 layout(binding = 2) uniform sampler2D metallicTex;
 layout(binding = 3) uniform sampler2D roughnessTex;
 layout(binding = 4) uniform sampler2D AOTex;
-uniform float shininessExponent;
-
-layout(binding = 5) uniform sampler2D positionBuffer;
-layout(binding = 6) uniform sampler2D normalBuffer;
-layout(binding = 7) uniform sampler2D albedoBuffer;
-
-
-struct DirLight {
-	vec3 direction;
-
-	//vec3 ambient;
-	vec3 diffuse;
-	//vec3 specular;
-};
-struct PointLight {
-	vec3 position;
-	
-	float constant;
-	float linear;
-	float quadratic;
+uniform float shininessExponent = 32.0;
 
-	//vec3 ambient;
-	vec3 diffuse;
-	//vec3 specular;
-};
-struct SpotLight {
-	vec3 position;
-	vec3 direction;
+#include "Common/uniforms.glsl"
+#include "Common/shadows.glsl"
+#ifdef DEFERRED_RESOLVE
+#include "Common/gBuffer.glsl"
 
-	float constant;
-	float linear;
-	float quadratic;
+layout(binding = 5) uniform gBufferSampler depthBuffer;
+layout(binding = 6) uniform gBufferSampler normalBuffer;
+layout(binding = 7) uniform gBufferSampler albedoBuffer;
+layout(binding = 8) uniform sampler2D edgeMask; //DEFERRED_MSAA
+#endif
 
-	//vec3 ambient;
-	vec3 diffuse;
-	//vec3 specular;
-
-	float cutOff;
-	float outerCutOff;
-};
-#define NR_POINT_LIGHTS 1
-
-uniform vec3 viewPos;
-
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
-
-uniform bool dirLightEnabled;
-uniform bool pointLightEnabled;
-uniform bool spotLightEnabled;
+//Features are #defines injected per variant(see ShaderVariants.h): ALBEDO_MAP, NORMAL_MAP, METALLIC_MAP,
+//DIR_LIGHT, POINT_LIGHTS, SPOT_LIGHT, BLOOM, SRGB_TEXTURES, DEFERRED_RESOLVE, which shades the packed G-buffer(Common/gBuffer.glsl) instead of a mesh,
+//DEFERRED_MSAA for a multisampled one, DIR_SHADOWS(cascaded shadow maps on the directional light) and LIGHT_SHADOWS(the point and spot lights' atlas)
 
 //Deferred
-uniform bool deferredEnabled;
 uniform int deferredState = 4;
 
-uniform bool transformSRGB;
-
 //Global variables
 vec3 viewDir;
 
-//Methods
-float spec(vec3 lightDir, vec3 normal);
-vec3 CalcDirLight(DirLight light, vec3 normal, vec2 texCoord, float shininess, vec3 fragPos, vec3 albedo);
-vec3 CalcPointLight(PointLight light, vec3 normal, vec2 texCoord, float shininess, vec3 fragPos, vec3 albedo);
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec2 texCoord, float shininess, vec3 fragPos, vec3 albedo);
+#include "Common/phong.glsl"
+
 vec3 getNormalFromMap(){
     vec3 tangentNormal = texture(normalTex, texCoord).xyz * 2.0 - 1.0;
     return normalize(TBN * tangentNormal);
 }
 
-//uniform sampler2D shadowMap; //SHADOWS
-
-//uniform samplerCube depthMap; //SHADOWS(cubemap)
-//uniform float far_plane; //SHADOWS(cubemap)
-
 //uniform float height_scale; //Displacement map
 
-/*SHADOWS
-float ShadowCalculation(vec4 fragPosLightSpace, vec3 lightDir){
-	// perform perspective divide
-	vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
-	// transform to [0,1] range
-	projCoords = projCoords * 0.5 + 0.5;
-	// get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
-	float closestDepth = texture(shadowMap, projCoords.xy).r; 
-	// get depth of current fragment from light's perspective
-	float currentDepth = projCoords.z;
-	// check whether current frag pos is in shadow
-	//float shadow = currentDepth > closestDepth  ? 1.0 : 0.0;
-	
-	float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
-	//float shadow = currentDepth - bias > closestDepth ? 1.0 : 0.0;
-	
-	//PCF
-	float shadow = 0.f;
-	vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-	for(int x = -1; x <= 1; ++x)
-	{
-		for(int y = -1; y <= 1; ++y)
-		{
-			float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r; 
-			shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
-		}    
-	}
-	shadow /= 9.0;
-
-	if(projCoords.z > 1.0)
-		shadow = 0.0;
-	return shadow;
-}
-*/
-/*SHADOWS(cubemap)
-float ShadowCalculation(vec3 lightPos)
-{
-	// get vector between fragment position and light position
-	vec3 fragToLight = fragPos - lightPos;
-	// use the light to fragment vector to sample from the depth map    
-	float closestDepth = texture(depthMap, fragToLight).r;
-	// it is currently in linear range between [0,1]. Re-transform back to original value
-	closestDepth *= far_plane;
-	// now get current linear depth as the length between the fragment and light position
-	float currentDepth = length(fragToLight);
-	// now test for shadows
-
-	//PCF
-	vec3 sampleOffsetDirections[20] = vec3[]
-	(
-	vec3( 1,  1,  1), vec3( 1, -1,  1), vec3(-1, -1,  1), vec3(-1,  1,  1), 
-	vec3( 1,  1, -1), vec3( 1, -1, -1), vec3(-1, -1, -1), vec3(-1,  1, -1),
-	vec3( 1,  1,  0), vec3( 1, -1,  0), vec3(-1, -1,  0), vec3(-1,  1,  0),
-	vec3( 1,  0,  1), vec3(-1,  0,  1), vec3( 1,  0, -1), vec3(-1,  0, -1),
-	vec3( 0,  1,  1), vec3( 0, -1,  1), vec3( 0, -1, -1), vec3( 0,  1, -1)
-	);   
-
-	float shadow = 0.0;
-	float bias   = 0.15;
-	int samples  = 20;
-	float viewDistance = length(viewPos - fragPos);
-	float diskRadius = (1.0 + (viewDistance / far_plane)) / 25.0;  
-	for(int i = 0; i < samples; ++i)
-	{
-		float closestDepth = texture(depthMap, fragToLight + sampleOffsetDirections[i] * diskRadius).r;
-		closestDepth *= far_plane;   // undo mapping [0;1]
-		if(currentDepth - bias > closestDepth)
-			shadow += 1.0;
-	}
-	shadow /= float(samples); 
-
-	return shadow;
-}
-*/
-
 /*
 vec2 ParallaxMapping(vec2 texCoord, vec3 viewDir){
 	//float height = texture(material.texture_displacement1, texCoord).r;
@@ -219,39 +95,9 @@ vec2 ParallaxMapping(vec2 texCoord, vec3 viewDir){
 */
 
 
-#define ambientConst 0.1f
-#define specularConst 0.3f
-
-void main(){
-	//Set global variables
-	vec3 aWorldPos;
-	vec3 albedo;
-	float shininess;
-	vec3 aNormal;
-
-	if(deferredEnabled){
-		aWorldPos = texture(positionBuffer, texCoord).rgb;
-		albedo = texture(albedoBuffer, texCoord).rgb;
-		shininess = texture(albedoBuffer, texCoord).a;
-		aNormal = texture(normalBuffer, texCoord).rgb;
-
-		if(aNormal == vec3(0.f)) discard; //If empty just discard the pixel
-	}
-	else{
-		aWorldPos = worldPos;
-		albedo = texture(albedoTex, texCoord).rgb;
-		shininess = texture(metallicTex, texCoord).r;
-		//aNormal = texture(material.texture_normal1, texCoord).rgb;
-		//aNormal = normalize(aNormal * 2.0 - 1.0);
-		if(texture(normalTex, texCoord).rgb == vec3(0.f) || TBN == mat3(0.f)) //If normalMap is empty or you cant transform a normal map to a normal vector just use the vertex normal vector
-			aNormal = normal;
-		else
-			aNormal = getNormalFromMap();
-	}
-	if(transformSRGB) albedo = pow(albedo, vec3(2.2f));
-
+//Every enabled light on one surface point
+vec3 lightSurface(vec3 aWorldPos, vec3 aNormal, vec2 texCoord, float shininess, vec3 albedo){
 	viewDir = normalize(viewPos - aWorldPos);
-	
 
 	//vec2 updatedTexCoord = texCoord;//ParallaxMapping(texCoord,  viewDir); //Paralax Mapping
 	//if(texCoord.x > 1.0 || texCoord.y > 1.0 || texCoord.x < 0.0 || texCoord.y < 0.0) //Paralax Mapping
@@ -260,169 +106,88 @@ void main(){
 	//Combine lights
 	vec3 result = vec3(0.f);
 
-	if(dirLightEnabled) result += CalcDirLight(dirLight, aNormal, texCoord, shininess, aWorldPos, albedo);
+#ifdef DIR_LIGHT
+	result += CalcDirLight(dirLight, aNormal, texCoord, shininess, aWorldPos, albedo);
+#endif
+#ifdef POINT_LIGHTS
+	for(int i = 0; i < pointLightCount; i++)
+		result += CalcPointLight(pointLights[i], aNormal, texCoord, shininess, aWorldPos, albedo) * lightShadow(pointLightShadow(i), aWorldPos, aNormal);
+#endif
+#ifdef SPOT_LIGHT
+	result += CalcSpotLight(spotLight, aNormal, texCoord, shininess, aWorldPos, albedo) * lightShadow(spotLightShadow, aWorldPos, aNormal);
+#endif
+	return result;
+}
+
+void main(){
+	//Set global variables
+	vec3 aWorldPos;
+	vec3 albedo;
+	float shininess;
+	vec3 aNormal;
+	vec3 result = vec3(0.f);
 
-	if(pointLightEnabled){
-		for(int i = 0; i < NR_POINT_LIGHTS; i++)
-			result += CalcPointLight(pointLights[i], aNormal, texCoord, shininess, aWorldPos, albedo);
+#ifdef DEFERRED_RESOLVE
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	int samples = 1;
+#ifdef DEFERRED_MSAA
+	if(texelFetch(edgeMask, pixel, 0).r != 0.0) samples = gBufferSamples; //Edges shade every sample, the rest only the first
+#endif
+	bool covered = false;
+	for(int i = 0; i < samples; i++){
+		float depth = texelFetch(depthBuffer, pixel, i).r;
+		if(isSky(depth)) continue; //Adds the black of the clear
+
+		covered = true;
+		aWorldPos = reconstructWorldPos(texCoord, depth);
+		vec4 albedoMetallic = texelFetch(albedoBuffer, pixel, i);
+		albedo = decodeAlbedo(albedoMetallic.rgb); //Linear, the geometry pass applied SRGB_TEXTURES
+		shininess = albedoMetallic.a;
+		aNormal = decodeNormal(texelFetch(normalBuffer, pixel, i).rg);
+		result += lightSurface(aWorldPos, aNormal, texCoord, shininess, albedo);
 	}
-	
-	if(spotLightEnabled) result += CalcSpotLight(spotLight, aNormal, texCoord, shininess, aWorldPos, albedo);
+	if(!covered) discard; //If empty just discard the pixel
+	result /= float(samples);
+#else
+	aWorldPos = worldPos;
+	albedo = vec3(1.f);
+	shininess = 0.f;
+	aNormal = normal;
+#ifdef ALBEDO_MAP
+	albedo = texture(albedoTex, texCoord).rgb;
+#endif
+	albedo *= tint;
+#ifdef METALLIC_MAP
+	shininess = texture(metallicTex, texCoord).r;
+#endif
+#ifdef NORMAL_MAP
+	if(TBN != mat3(0.f)) //If you cant transform a normal map to a normal vector just use the vertex normal vector
+		aNormal = getNormalFromMap();
+#endif
+#ifdef SRGB_TEXTURES
+	albedo = pow(albedo, vec3(2.2f));
+#endif
+	result = lightSurface(aWorldPos, aNormal, texCoord, shininess, albedo);
+#endif
 	
 	//if(texColor.a < 0.1f) discard; //Transparency
 
 	FragColor = vec4(result, 1.f);
 
-	if(deferredEnabled){
-		if(deferredState == 0) FragColor = vec4(aWorldPos, 1.f);
-		if(deferredState == 1) FragColor = vec4(aNormal, 1.f);
-		if(deferredState == 2) FragColor = vec4(albedo, 1.f);
-		if(deferredState == 3) FragColor = vec4(shininess, shininess, shininess, 1.f);
-		if(deferredState == 4) FragColor = vec4(result, 1.f);
-	}
+#ifdef DEFERRED_RESOLVE //Of the last covered sample
+	if(deferredState == 0) FragColor = vec4(aWorldPos, 1.f);
+	if(deferredState == 1) FragColor = vec4(aNormal, 1.f);
+	if(deferredState == 2) FragColor = vec4(albedo, 1.f);
+	if(deferredState == 3) FragColor = vec4(shininess, shininess, shininess, 1.f);
+	if(deferredState == 4) FragColor = vec4(result, 1.f);
+#endif
 
 	/*Bloom*/
 	// check whether fragment output is higher than threshold, if so output as brightness color
+	BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
+#ifdef BLOOM
 	float brightness = dot(FragColor.rgb, vec3(0.2126, 0.7152, 0.0722)); //Transform into a luminance value
-	if(brightness > 1.0 && bloomOn)
+	if(brightness > 1.0)
 		BrightColor = vec4(FragColor.rgb, 1.0);
-	else
-		BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
-
-	/*SHADOWS
-	//Set important variables
-	DirLight light = dirLight;
-	
-	vec3 lightDir = normalize(-light.direction);
-	
-	vec3 ambient, diffuse, specular;
-	
-	//Ambient lighting
-	ambient = light.ambient;
-	
-	//Diffuse lighting
-	float diff = max(dot(normal, lightDir), 0.0);
-	diffuse = light.diffuse * diff;
-	
-	//Specular lighting
-	specular = light.specular * spec(lightDir);
-
-	float shadow = ShadowCalculation(fragPosLightSpace, lightDir);
-	vec3 lighting = (ambient + (1.0 - shadow) * (diffuse + specular)) * texture(material.texture_diffuse1, texCoord).rgb;
-	
-	FragColor = vec4(lighting, 1.0);
-	*/
-
-	/*SHADOWS(cubemap)
-	//Set important variables
-	PointLight light = pointLights[0];
-	
-	//Set important variables
-	vec3 lightDir = lightDir(light.position);
-
-	vec3 ambient, diffuse, specular;
-	ambient = diffuse = texture(material.texture_diffuse1, texCoord).rgb;
-	specular = texture(material.texture_specular1, texCoord).rgb;
-
-	//Ambient lighting
-	ambient *= light.ambient;
-
-	//Diffuse lighting
-	float diff = max(dot(lightDir, normal), 0.0);
-	diffuse *= light.diffuse * diff;
-
-	//Attenuation
-	float distance = length(light.position - fragPos);
-	float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
-	
-	//Specular lighting
-	specular *= light.specular * spec(lightDir);
-
-	float shadow = ShadowCalculation(light.position);
-	vec3 lighting = (ambient + (1.0 - shadow) * (diffuse + specular)) * attenuation * texture(material.texture_diffuse1, texCoord).rgb;
-	FragColor = vec4(lighting, 1.0);
-	*/
-}
-
-//vec3 lightDir(vec3 lightPos){ return normalize(lightPos - fragPos); }
-float spec(vec3 lightDir, vec3 aNormal){
-	vec3 halfwayDir = normalize(lightDir + viewDir);
-
-	return pow(max(dot(aNormal, halfwayDir), 0.0), shininessExponent);
-}
-vec3 CalcDirLight(DirLight light, vec3 normal, vec2 texCoord, float shininess, vec3 fragPos, vec3 albedo){
-	if(light.diffuse == vec3(0.f)) return vec3(0.f); //If empty just stop
-	
-	//Set important variables
-	vec3 lightDir = normalize(-light.direction);
-
-	vec3 ambient = albedo, diffuse = albedo;
-	float specular = shininess;
-
-	//Ambient lighting
-	ambient *= ambientConst;//light.ambient;
-
-	//Diffuse lighting
-	float diff = max(dot(normal, lightDir), 0.0);
-	diffuse *= light.diffuse * diff;
-
-	//Specular lighting
-	specular *= specularConst/*light.specular*/*spec(lightDir, normal);
-
-	return (ambient + diffuse + specular);
-}
-vec3 CalcPointLight(PointLight light, vec3 normal, vec2 texCoord, float shininess, vec3 fragPos, vec3 albedo){
-	if(light.diffuse == vec3(0.f)) return vec3(0.f); //If empty just stop
-	
-	//Set important variables
-	vec3 lightDir = normalize(light.position - fragPos);
-
-	vec3 ambient = albedo, diffuse = albedo;
-	float specular = shininess;
-
-	//Ambient lighting
-	ambient *= ambientConst;//light.ambient;
-
-	//Diffuse lighting
-	float diff = max(dot(lightDir, normal), 0.0);
-	diffuse *= light.diffuse * diff;
-
-	//Attenuation
-	float distance = length(light.position - fragPos);
-	float attenuation = 1.0 / (distance * distance);//(light.constant + light.linear * distance + light.quadratic * (distance * distance));
-	
-	//Specular lighting
-	specular *= specularConst/*light.specular*/ * spec(lightDir, normal);
-
-	return (ambient + diffuse + specular) * attenuation;
-}
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec2 texCoord, float shininess, vec3 fragPos, vec3 albedo){
-	if(light.diffuse == vec3(0.f)) return vec3(0.f); //If empty just stop
-	
-	//Set important variables
-	vec3 lightDir = normalize(light.position - fragPos);
-	
-	vec3 ambient = albedo, diffuse = albedo;
-	float specular = shininess;
-
-	//Ambient lighting
-	//ambient *= ambientConst;//light.ambient; //SpotLight doesn't have ambient lighting
-
-	//Diffuse lighting
-	float diff = max(dot(normal, lightDir), 0.0);
-	diffuse *= light.diffuse * diff;
-
-	//Specular lighting
-	specular *= specularConst/*light.specular*/ * spec(lightDir, normal);
-
-	//Attenuation
-	float distance = length(light.position - fragPos);
-	float attenuation = 1.0 / (distance * distance);//(light.constant + light.linear * distance + light.quadratic * (distance * distance));    
-	
-	//Spotlight range
-	float theta = dot(lightDir, normalize(-light.direction)); 
-	float epsilon = light.cutOff - light.outerCutOff;
-	float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
-
-	return (ambient + diffuse + specular) * attenuation * intensity;
+#endif
 }
\ No newline at end of file
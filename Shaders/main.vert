@@ -2,48 +2,55 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
-layout (location = 3) in vec3 aTangent;
+layout (location = 3) in vec4 aTangent; //w is the handedness
+layout (location = 4) in mat4 aInstanceModel; //Locations 4-7
+layout (location = 8) in vec3 aInstanceTint;
 
 out vec2 texCoord;
 
 out vec3 normal;
+out vec3 tint;
 out vec3 worldPos; 
-out vec4 fragPosLightSpace;
 
 out mat3 TBN;
 
+#include "Common/uniforms.glsl"
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
+
+uniform bool instanced;
 
 //uniform sampler2D normalMap;
-uniform mat4 lightSpaceMatrix; //SHADOWS
-uniform vec3 viewPos;
 
-uniform bool deferredEnabled;
+//DEFERRED_RESOLVE variants draw a fullscreen quad
 //Todo: for some operations im not sure if they will be faster making them in the cpu instead of the gpu because of: time for transfering data CPU->GPU, speed of calculation, parallelism, etc.
 //Todo: not sure if i should multiply normal by tbn or multiply the other uniform (Should research some more and check the normal mapping chapter again)
 void main(){
-	worldPos = vec3(model * vec4(aPos, 1.f));
+	mat4 modelMat = instanced ? aInstanceModel : model;
+	tint = instanced ? aInstanceTint : vec3(1.f);
+
+	worldPos = vec3(modelMat * vec4(aPos, 1.f));
 
-	if(deferredEnabled) gl_Position = vec4(aPos, 1.f);
-	else gl_Position = proj * view * vec4(worldPos, 1.f);//Todo multiply it in the cpu as the cpu can save some processing
+#ifdef DEFERRED_RESOLVE
+	gl_Position = vec4(aPos, 1.f);
+#else
+	gl_Position = projView * vec4(worldPos, 1.f);
+#endif
 
 	texCoord = aTexCoord;
 
-	mat3 normalMatrix = transpose(inverse(mat3(model))); //Transpose is really expensive function
+	mat3 normalMatrix = transpose(inverse(mat3(modelMat))); //Transpose is really expensive function
 	normal = normalize(normalMatrix * aNormal);
 
-	if(aTangent == vec3(0.f))
+	if(aTangent.xyz == vec3(0.f))
 		TBN = mat3(0.f);
 	else{
-		vec3 T = normalize(normalMatrix * aTangent);
+		vec3 T = normalize(normalMatrix * aTangent.xyz);
 		
 		T = normalize(T - dot(T, normal) * normal);
-		vec3 B = cross(normal, T);
+		vec3 B = cross(normal, T) * aTangent.w;
 		
 		TBN = mat3(T, B, normal);
 	}
-	//fragPosLightSpace = lightSpaceMatrix * vec4(worldPos, 1.0); //SHADOWS
 	
 }
@@ -24,7 +24,7 @@ uniform int tonemapMode;
 uniform float maxRadiance;
 
 uniform bool fxaaEnabled;
-uniform vec2 inverseScreenSize;
+#include "Common/uniforms.glsl"
 
 float luminance(vec3 v);
 vec3 changeLuminance(vec3 c_in, float l_out);
@@ -3,8 +3,7 @@ layout (location = 0) in vec3 aPos;
 
 out vec3 worldPos;
 
-uniform mat4 proj;
-uniform mat4 view;
+#include "Common/uniforms.glsl"
 
 void main(){
     worldPos = aPos;
@@ -0,0 +1,237 @@
+#pragma once
+#ifndef ASYNC_LOADER
+#define ASYNC_LOADER
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+template<typename T = void>
+class Task;
+
+struct TaskPromiseBase {
+	std::coroutine_handle<> continuation = std::noop_coroutine();
+	std::exception_ptr exception;
+
+	//Resumes whoever awaited the task, on the thread the task finished on
+	struct FinalAwaiter {
+		bool await_ready() noexcept { return false; }
+		template<typename Promise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept { return handle.promise().continuation; }
+		void await_resume() noexcept {}
+	};
+
+	std::suspend_always initial_suspend() noexcept { return {}; }
+	FinalAwaiter final_suspend() noexcept { return {}; }
+	void unhandled_exception() { exception = std::current_exception(); }
+};
+template<typename T>
+struct TaskPromise : TaskPromiseBase {
+	T value{};
+
+	Task<T> get_return_object();
+	void return_value(T value) { this->value = std::move(value); }
+};
+template<>
+struct TaskPromise<void> : TaskPromiseBase {
+	Task<void> get_return_object();
+	void return_void() {}
+};
+
+//Lazily started coroutine. It runs when co_awaited(the caller resumes once it's done) or when handed to AsyncScheduler::spawn()
+template<typename T>
+class Task {
+private:
+	std::coroutine_handle<TaskPromise<T>> handle;
+public:
+	using promise_type = TaskPromise<T>;
+
+	Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+	Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+	Task(const Task&) = delete;
+	Task& operator=(const Task&) = delete;
+	~Task() {
+		if (handle) handle.destroy();
+	}
+
+	bool await_ready() const noexcept { return false; }
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+		handle.promise().continuation = caller;
+		return handle;
+	}
+	T await_resume() {
+		if (handle.promise().exception)
+			std::rethrow_exception(handle.promise().exception);
+		if constexpr (!std::is_void_v<T>)
+			return std::move(handle.promise().value);
+	}
+};
+template<typename T>
+Task<T> TaskPromise<T>::get_return_object() { return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this)); }
+inline Task<void> TaskPromise<void>::get_return_object() { return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this)); }
+
+//Runs the IO and decode part of asset loads on worker threads. Anything touching GL has to hop back with co_await toMainThread(),
+//those continuations are resumed by pumpMainThread() on the GL thread within a time budget so a big load never stalls a frame.
+class AsyncScheduler {
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::coroutine_handle<>> workQueue;
+	std::deque<std::coroutine_handle<>> mainQueue;
+	std::mutex workMutex, mainMutex;
+	std::condition_variable workReady;
+	bool stopping = false;
+	std::vector<std::coroutine_handle<>> spawned; //Frames of the unfinished run()s, destroying one destroys the tasks it awaits
+	std::mutex spawnedMutex;
+
+	//Owns a spawned task until it finishes, then frees itself
+	struct DetachedTask {
+		struct promise_type {
+			DetachedTask get_return_object() { return {}; }
+			std::suspend_never initial_suspend() noexcept { return {}; }
+			std::suspend_never final_suspend() noexcept { return {}; }
+			void return_void() {}
+			void unhandled_exception() { std::terminate(); }
+		};
+	};
+
+	void workerLoop() {
+		while (true) {
+			std::coroutine_handle<> handle;
+			{
+				std::unique_lock<std::mutex> lock(workMutex);
+				workReady.wait(lock, [this]() { return stopping || !workQueue.empty(); });
+				if (stopping) return;
+
+				handle = workQueue.front();
+				workQueue.pop_front();
+			}
+			handle.resume();
+		}
+	}
+	//Records the frame awaiting it in spawned without suspending and hands it back
+	struct SpawnedAwaiter {
+		AsyncScheduler* scheduler;
+		std::coroutine_handle<> frame;
+
+		bool await_ready() const noexcept { return false; }
+		bool await_suspend(std::coroutine_handle<> handle) {
+			frame = handle;
+			std::lock_guard<std::mutex> lock(scheduler->spawnedMutex);
+			scheduler->spawned.push_back(handle);
+			return false;
+		}
+		std::coroutine_handle<> await_resume() noexcept { return frame; }
+	};
+	template<typename T>
+	DetachedTask run(Task<T> task) {
+		std::coroutine_handle<> self = co_await SpawnedAwaiter{ this, nullptr };
+		try {
+			co_await task;
+		}
+		catch (const std::exception& e) {
+			std::cout << "ERROR::ASYNCLOADER.H::TASK FAILED: " << e.what() << std::endl;
+		}
+		{
+			std::lock_guard<std::mutex> lock(spawnedMutex);
+			spawned.erase(std::find(spawned.begin(), spawned.end(), self));
+		}
+		activeTasks--;
+	}
+	void pushWork(std::coroutine_handle<> handle) {
+		{
+			std::lock_guard<std::mutex> lock(workMutex);
+			workQueue.push_back(handle);
+		}
+		workReady.notify_one();
+	}
+	void pushMain(std::coroutine_handle<> handle) {
+		std::lock_guard<std::mutex> lock(mainMutex);
+		mainQueue.push_back(handle);
+	}
+public:
+	struct WorkerAwaiter {
+		AsyncScheduler* scheduler;
+
+		bool await_ready() const noexcept { return scheduler->workers.empty(); } //Without workers it just runs inline
+		void await_suspend(std::coroutine_handle<> handle) { scheduler->pushWork(handle); }
+		void await_resume() noexcept {}
+	};
+	//Always suspends, even on the GL thread, so it's also the yield point between uploads
+	struct MainThreadAwaiter {
+		AsyncScheduler* scheduler;
+
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(std::coroutine_handle<> handle) { scheduler->pushMain(handle); }
+		void await_resume() noexcept {}
+	};
+
+	std::atomic<unsigned int> activeTasks = 0; //Spawned tasks that haven't finished
+
+	void start(unsigned int threadCount) {
+		stopping = false;
+		for (unsigned int i = 0; i < threadCount; i++)
+			workers.emplace_back(&AsyncScheduler::workerLoop, this);
+	}
+	//The job running on each worker is finished first. Every task still waiting in a queue is then destroyed from its spawned frame down,
+	//freeing what the frames hold(file buffers, loaders)
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(workMutex);
+			stopping = true;
+		}
+		workReady.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+		workers.clear();
+
+		for (std::coroutine_handle<> frame : spawned)
+			frame.destroy();
+		spawned.clear();
+		workQueue.clear();
+		mainQueue.clear();
+		activeTasks = 0;
+	}
+	~AsyncScheduler() {
+		stop();
+	}
+
+	WorkerAwaiter toWorker() { return WorkerAwaiter{ this }; }
+	MainThreadAwaiter toMainThread() { return MainThreadAwaiter{ this }; }
+
+	template<typename T>
+	void spawn(Task<T> task) {
+		activeTasks++;
+		run(std::move(task));
+	}
+
+	//Call once per frame on the GL thread. Resumes queued continuations until the budget(in ms) runs out, at least one always runs
+	void pumpMainThread(float budget) {
+		auto start = std::chrono::high_resolution_clock::now();
+		while (true) {
+			std::coroutine_handle<> handle;
+			{
+				std::lock_guard<std::mutex> lock(mainMutex);
+				if (mainQueue.empty()) return;
+
+				handle = mainQueue.front();
+				mainQueue.pop_front();
+			}
+			handle.resume();
+
+			if (std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count() >= budget)
+				return;
+		}
+	}
+};
+AsyncScheduler asyncScheduler;
+#endif
\ No newline at end of file
@@ -0,0 +1,373 @@
+#pragma once
+#ifndef BVH_H
+#define BVH_H
+
+#include <GLM/glm.hpp>
+
+#include "Bounds.h"
+#include "Culling.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cstdint>
+#include <future>
+#include <thread>
+#include <vector>
+
+struct BVHNode {
+	AABB box;
+	uint32_t first = 0; //Leaf: first index into primIndices. Inner: index of the left child, the right one is first + 1
+	uint32_t count = 0; //Primitives in the leaf, 0 for inner nodes
+
+	bool isLeaf() const { return count > 0; }
+};
+
+struct Ray {
+	glm::vec3 origin;
+	glm::vec3 dir;
+	glm::vec3 invDir;
+
+	Ray(glm::vec3 origin = glm::vec3(0.f), glm::vec3 dir = glm::vec3(0.f, 0.f, -1.f)) {
+		this->origin = origin;
+		this->dir = dir;
+		this->invDir = 1.f / dir;
+	}
+	//Slab test, returns the entry distance or FLT_MAX on a miss
+	float intersect(const AABB& box, float maxT = FLT_MAX) const {
+		glm::vec3 t0 = (box.min - origin) * invDir;
+		glm::vec3 t1 = (box.max - origin) * invDir;
+		glm::vec3 tMin = glm::min(t0, t1);
+		glm::vec3 tMax = glm::max(t0, t1);
+
+		float enter = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.f));
+		float exit = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, maxT));
+		return enter <= exit ? enter : FLT_MAX;
+	}
+};
+
+//Bounding volume hierarchy over primitive AABBs(one per instance). Built top-down with binned SAH, large subtrees are built on worker threads.
+//When the boxes move the tree is refit bottom-up, and rebuilt once the refit tree got too much worse than a fresh one.
+class BVH {
+private:
+	static const int binCount = 12;
+	static const uint32_t maxLeafSize = 4;
+
+	std::vector<glm::vec3> centroids;
+	std::atomic<uint32_t> nodesUsed{ 0 };
+	float builtCost = 0.f;
+
+	static float area(const AABB& box) {
+		if (!box.valid()) return 0.f;
+		glm::vec3 d = box.max - box.min;
+		return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+	void updateNodeBox(BVHNode& node) {
+		node.box = AABB();
+		for (uint32_t i = 0; i < node.count; i++)
+			node.box.expand(primBoxes[primIndices[node.first + i]]);
+	}
+	//Returns the SAH cost of the best split, axis and position through the out parameters.
+	//All three axes are binned in one pass over the primitives, the random access to primBoxes dominates large builds
+	float findSplit(const BVHNode& node, int& bestAxis, float& bestPos) const {
+		float bestCost = FLT_MAX;
+
+		AABB centroidBox;
+		for (uint32_t i = 0; i < node.count; i++)
+			centroidBox.expand(centroids[primIndices[node.first + i]]);
+
+		glm::vec3 extent = centroidBox.max - centroidBox.min;
+		glm::vec3 scale(0.f);
+		for (int axis = 0; axis < 3; axis++)
+			if (extent[axis] > 0.f) scale[axis] = binCount / extent[axis];
+
+		AABB binBoxes[3][binCount];
+		uint32_t binCounts[3][binCount] = {};
+
+		for (uint32_t i = 0; i < node.count; i++) {
+			uint32_t prim = primIndices[node.first + i];
+			const AABB& box = primBoxes[prim];
+			glm::vec3 offset = (centroids[prim] - centroidBox.min) * scale;
+
+			for (int axis = 0; axis < 3; axis++) {
+				int bin = std::min(binCount - 1, (int)offset[axis]);
+				binCounts[axis][bin]++;
+				binBoxes[axis][bin].expand(box);
+			}
+		}
+
+		for (int axis = 0; axis < 3; axis++) {
+			if (scale[axis] == 0.f) continue;
+
+			//Sweep from both sides so every split plane is evaluated in O(bins)
+			float leftArea[binCount - 1], rightArea[binCount - 1];
+			uint32_t leftCount[binCount - 1], rightCount[binCount - 1];
+			AABB leftBox, rightBox;
+			uint32_t leftSum = 0, rightSum = 0;
+
+			for (int i = 0; i < binCount - 1; i++) {
+				leftSum += binCounts[axis][i];
+				leftCount[i] = leftSum;
+				leftBox.expand(binBoxes[axis][i]);
+				leftArea[i] = area(leftBox);
+
+				rightSum += binCounts[axis][binCount - 1 - i];
+				rightCount[binCount - 2 - i] = rightSum;
+				rightBox.expand(binBoxes[axis][binCount - 1 - i]);
+				rightArea[binCount - 2 - i] = area(rightBox);
+			}
+
+			for (int i = 0; i < binCount - 1; i++) {
+				float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestPos = centroidBox.min[axis] + (i + 1) / scale[axis];
+				}
+			}
+		}
+		return bestCost;
+	}
+	void subdivide(uint32_t nodeIndex, int depth, int parallelDepth) {
+		BVHNode& node = nodes[nodeIndex];
+		if (node.count <= maxLeafSize) return;
+
+		int axis = 0;
+		float splitPos = 0.f;
+		float splitCost = findSplit(node, axis, splitPos);
+		if (splitCost >= node.count * area(node.box)) return; //Splitting isn't cheaper than intersecting everything
+
+		//Partition the primitive indices in place
+		uint32_t i = node.first;
+		uint32_t j = node.first + node.count - 1;
+		while (i <= j && j != UINT32_MAX) {
+			if (centroids[primIndices[i]][axis] < splitPos)
+				i++;
+			else
+				std::swap(primIndices[i], primIndices[j--]);
+		}
+		uint32_t leftCount = i - node.first;
+		if (leftCount == 0 || leftCount == node.count) return;
+
+		uint32_t leftIndex = nodesUsed.fetch_add(2);
+		nodes[leftIndex].first = node.first;
+		nodes[leftIndex].count = leftCount;
+		nodes[leftIndex + 1].first = i;
+		nodes[leftIndex + 1].count = node.count - leftCount;
+		node.first = leftIndex;
+		node.count = 0;
+
+		updateNodeBox(nodes[leftIndex]);
+		updateNodeBox(nodes[leftIndex + 1]);
+
+		//The two halves touch disjoint index ranges and nodes come from an atomic counter, so they can be built concurrently
+		if (depth < parallelDepth && nodes[leftIndex].count > 4096) {
+			std::future<void> left = std::async(std::launch::async, [this, leftIndex, depth, parallelDepth]() { subdivide(leftIndex, depth + 1, parallelDepth); });
+			subdivide(leftIndex + 1, depth + 1, parallelDepth);
+			left.get();
+		}
+		else {
+			subdivide(leftIndex, depth + 1, parallelDepth);
+			subdivide(leftIndex + 1, depth + 1, parallelDepth);
+		}
+	}
+	float computeCost() const {
+		if (nodes.empty() || !nodes[0].box.valid()) return 0.f;
+
+		//SAH cost of the whole tree relative to the root
+		float cost = 0.f;
+		for (uint32_t i = 0; i < nodesUsed; i++)
+			cost += nodes[i].isLeaf() ? area(nodes[i].box) * nodes[i].count : area(nodes[i].box);
+		return cost / area(nodes[0].box);
+	}
+public:
+	std::vector<BVHNode> nodes;
+	std::vector<AABB> primBoxes;
+	std::vector<uint32_t> primIndices;
+
+	unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+	float rebuildThreshold = 1.5f; //Rebuild once the refit tree costs this many times the freshly built one
+
+	size_t nodeCount() const { return nodesUsed; }
+	size_t size() const { return primBoxes.size(); }
+
+	void build(const std::vector<AABB>& boxes) {
+		primBoxes = boxes;
+		build();
+	}
+	void build() {
+		uint32_t count = (uint32_t)primBoxes.size();
+		nodes.assign(std::max(1u, 2 * count), BVHNode());
+		primIndices.resize(count);
+		centroids.resize(count);
+
+		for (uint32_t i = 0; i < count; i++) {
+			primIndices[i] = i;
+			centroids[i] = primBoxes[i].center();
+		}
+
+		nodes[0].first = 0;
+		nodes[0].count = count;
+		nodesUsed = 1;
+		if (count == 0) return;
+
+		updateNodeBox(nodes[0]);
+
+		int parallelDepth = 0;
+		while ((1u << parallelDepth) < threadCount) parallelDepth++;
+		subdivide(0, 0, parallelDepth);
+
+		builtCost = computeCost();
+	}
+	//Moves the boxes without changing the topology. Children always have larger indices than their parent so one reverse pass is enough
+	void refit(const std::vector<AABB>& boxes) {
+		primBoxes = boxes;
+		for (int64_t i = (int64_t)nodesUsed - 1; i >= 0; i--) {
+			BVHNode& node = nodes[i];
+			if (node.isLeaf())
+				updateNodeBox(node);
+			else {
+				node.box = nodes[node.first].box;
+				node.box.expand(nodes[node.first + 1].box);
+			}
+		}
+	}
+	//Refits when possible, rebuilds when the primitive count changed or the tree degraded too much. Returns true on a rebuild
+	bool update(const std::vector<AABB>& boxes) {
+		if (boxes.size() != primBoxes.size() || nodes.empty()) {
+			build(boxes);
+			return true;
+		}
+		refit(boxes);
+		if (computeCost() > builtCost * rebuildThreshold) {
+			build();
+			return true;
+		}
+		return false;
+	}
+
+	//Appends the primitives whose boxes intersect the frustum. Subtrees fully inside are added without further tests
+	void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& result) const {
+		if (primBoxes.empty()) return;
+
+		std::vector<uint32_t> stack;
+		stack.reserve(64);
+		stack.push_back(0);
+
+		while (!stack.empty()) {
+			const BVHNode& node = nodes[stack.back()];
+			stack.pop_back();
+
+			bool fullyInside = true;
+			bool outside = false;
+			glm::vec3 center = node.box.center();
+			glm::vec3 extents = node.box.extents();
+			for (const glm::vec4& plane : frustum.planes) {
+				float radius = glm::dot(extents, glm::abs(glm::vec3(plane)));
+				float dist = glm::dot(glm::vec3(plane), center) + plane.w;
+				if (dist < -radius) {
+					outside = true;
+					break;
+				}
+				if (dist < radius) fullyInside = false;
+			}
+			if (outside) continue;
+
+			if (fullyInside)
+				collect(node, result);
+			else if (node.isLeaf()) {
+				for (uint32_t i = 0; i < node.count; i++) {
+					uint32_t prim = primIndices[node.first + i];
+					if (frustum.testAABB(primBoxes[prim]))
+						result.push_back(prim);
+				}
+			}
+			else {
+				stack.push_back(node.first);
+				stack.push_back(node.first + 1);
+			}
+		}
+	}
+	//Appends every primitive under the node
+	void collect(const BVHNode& node, std::vector<uint32_t>& result) const {
+		if (node.isLeaf()) {
+			for (uint32_t i = 0; i < node.count; i++)
+				result.push_back(primIndices[node.first + i]);
+			return;
+		}
+		collect(nodes[node.first], result);
+		collect(nodes[node.first + 1], result);
+	}
+	//Returns the closest primitive hit by the ray or -1. Children are visited near to far so far subtrees get skipped
+	int raycast(const Ray& ray, float& hitT) const {
+		hitT = FLT_MAX;
+		if (primBoxes.empty() || ray.intersect(nodes[0].box) == FLT_MAX) return -1;
+
+		int hit = -1;
+		std::vector<uint32_t> stack;
+		stack.reserve(64);
+		stack.push_back(0);
+
+		while (!stack.empty()) {
+			const BVHNode& node = nodes[stack.back()];
+			stack.pop_back();
+
+			if (node.isLeaf()) {
+				for (uint32_t i = 0; i < node.count; i++) {
+					uint32_t prim = primIndices[node.first + i];
+					float t = ray.intersect(primBoxes[prim], hitT);
+					if (t < hitT) {
+						hitT = t;
+						hit = (int)prim;
+					}
+				}
+				continue;
+			}
+
+			uint32_t nearChild = node.first, farChild = node.first + 1;
+			float tNear = ray.intersect(nodes[nearChild].box, hitT);
+			float tFar = ray.intersect(nodes[farChild].box, hitT);
+			if (tFar < tNear) {
+				std::swap(nearChild, farChild);
+				std::swap(tNear, tFar);
+			}
+			if (tFar != FLT_MAX) stack.push_back(farChild);
+			if (tNear != FLT_MAX) stack.push_back(nearChild);
+		}
+		return hit;
+	}
+	//Appends the primitives whose boxes intersect the sphere
+	void querySphere(glm::vec3 center, float radius, std::vector<uint32_t>& result) const {
+		if (primBoxes.empty()) return;
+
+		float radiusSq = radius * radius;
+		auto overlaps = [&](const AABB& box) {
+			glm::vec3 closest = glm::clamp(center, box.min, box.max);
+			glm::vec3 d = closest - center;
+			return glm::dot(d, d) <= radiusSq;
+		};
+
+		std::vector<uint32_t> stack;
+		stack.reserve(64);
+		stack.push_back(0);
+
+		while (!stack.empty()) {
+			const BVHNode& node = nodes[stack.back()];
+			stack.pop_back();
+			if (!overlaps(node.box)) continue;
+
+			if (node.isLeaf()) {
+				for (uint32_t i = 0; i < node.count; i++) {
+					uint32_t prim = primIndices[node.first + i];
+					if (overlaps(primBoxes[prim]))
+						result.push_back(prim);
+				}
+			}
+			else {
+				stack.push_back(node.first);
+				stack.push_back(node.first + 1);
+			}
+		}
+	}
+};
+#endif
@@ -0,0 +1,517 @@
+#pragma once
+#ifndef BENCHMARKS
+#define BENCHMARKS
+
+#include <GLM/glm.hpp>
+#include <GLM/gtc/matrix_transform.hpp>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include "Scene.h"
+#include "Culling.h"
+#include "BVH.h"
+#include "Model.h"
+#include "Tangents.h"
+#include "Shader.h"
+#include "Light.h"
+#include "UniformBuffers.h"
+#include "ShaderBuildQueue.h"
+#include "ShaderVariants.h"
+#include "RenderQueue.h"
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+//CPU micro benchmarks run from the UI. Results are printed and kept for the benchmark header
+std::vector<std::string> benchmarkResults;
+
+void logBenchmark(const std::string& line) {
+	std::cout << "BENCHMARK::" << line << std::endl;
+	benchmarkResults.push_back(line);
+}
+template<typename Func>
+double timeMs(Func func) {
+	auto start = std::chrono::high_resolution_clock::now();
+	func();
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void benchmarkECS(unsigned int entityCount = 100000, unsigned int iterations = 100) {
+	std::mt19937 rng(1337);
+	std::uniform_real_distribution<float> posDist(-100.f, 100.f);
+
+	Scene scene;
+	scene.pool<Transform>().reserve(entityCount);
+	scene.pool<Spinner>().reserve(entityCount);
+
+	std::vector<Entity> entities;
+	entities.reserve(entityCount);
+
+	auto spawn = [&]() {
+		Entity entity = scene.create();
+		scene.add<Transform>(entity, Transform(glm::vec3(posDist(rng), posDist(rng), posDist(rng))));
+		scene.add<Spinner>(entity, Spinner{ true, 1.f });
+		if (entity % 4 == 0) scene.add<MeshRenderer>(entity);
+
+		return entity;
+	};
+
+	double createTime = timeMs([&]() {
+		for (unsigned int i = 0; i < entityCount; i++)
+			entities.push_back(spawn());
+	});
+
+	double iterateTime = timeMs([&]() {
+		for (unsigned int i = 0; i < iterations; i++)
+			scene.updateTransforms(1.f / 60.f);
+	}) / iterations;
+
+	//Churn: every iteration destroys 10% of the entities at random and spawns replacements
+	std::uniform_int_distribution<size_t> indexDist(0, entityCount - 1);
+	unsigned int churnCount = entityCount / 10;
+
+	double churnTime = timeMs([&]() {
+		for (unsigned int i = 0; i < iterations; i++) {
+			for (unsigned int j = 0; j < churnCount; j++) {
+				size_t index = indexDist(rng);
+				scene.destroy(entities[index]);
+				entities[index] = spawn();
+			}
+		}
+	}) / iterations;
+
+	logBenchmark("ECS " + std::to_string(entityCount) + " entities: create " + std::to_string(createTime) + " ms");
+	logBenchmark("ECS transform systems: " + std::to_string(iterateTime) + " ms/frame");
+	logBenchmark("ECS churn(" + std::to_string(churnCount) + " remove+add): " + std::to_string(churnTime) + " ms/frame");
+}
+//Sphere culling throughput: scalar, SIMD and SIMD across threads on the same random spheres
+void benchmarkCulling(unsigned int sphereCount = 1000000, unsigned int iterations = 20) {
+	std::mt19937 rng(1337);
+	std::uniform_real_distribution<float> posDist(-200.f, 200.f);
+	std::uniform_real_distribution<float> radiusDist(.1f, 5.f);
+
+	FrustumCuller culler;
+	culler.reserve(sphereCount);
+	for (unsigned int i = 0; i < sphereCount; i++) {
+		BoundingSphere sphere;
+		sphere.center = glm::vec3(posDist(rng), posDist(rng), posDist(rng));
+		sphere.radius = radiusDist(rng);
+		culler.add(sphere);
+	}
+	Frustum frustum(glm::perspective(glm::radians(45.f), 16.f / 9.f, .1f, 100.f) * glm::lookAt(glm::vec3(0.f), glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, 1.f, 0.f)));
+
+	auto run = [&](bool simd, unsigned int threads) {
+		culler.useSIMD = simd;
+		culler.threadCount = threads;
+		return timeMs([&]() {
+			for (unsigned int i = 0; i < iterations; i++)
+				culler.cull(frustum);
+		}) / iterations;
+	};
+	unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+
+	double scalarTime = run(false, 1);
+	double simdTime = run(true, 1);
+	double threadedTime = run(true, threads);
+
+	logBenchmark("Culling " + std::to_string(sphereCount) + " spheres(" + std::to_string(culler.visibleCount) + " visible): scalar " + std::to_string(scalarTime) + " ms");
+	logBenchmark("Culling SIMD(" + std::to_string(FrustumCuller::simdWidth) + "-wide): " + std::to_string(simdTime) + " ms");
+	logBenchmark("Culling SIMD x" + std::to_string(threads) + " threads: " + std::to_string(threadedTime) + " ms");
+}
+//BVH build, refit and query cost from 1k to 1M instances scattered in a cube that grows with the count
+void benchmarkBVH() {
+	std::mt19937 rng(1337);
+	Frustum frustum(glm::perspective(glm::radians(45.f), 16.f / 9.f, .1f, 100.f) * glm::lookAt(glm::vec3(0.f), glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, 1.f, 0.f)));
+
+	for (unsigned int count : { 1000u, 10000u, 100000u, 1000000u }) {
+		float extent = std::cbrt((float)count) * 4.f;
+		std::uniform_real_distribution<float> posDist(-extent, extent);
+		std::uniform_real_distribution<float> moveDist(-.5f, .5f);
+
+		std::vector<AABB> boxes(count);
+		for (AABB& box : boxes) {
+			glm::vec3 center(posDist(rng), posDist(rng), posDist(rng));
+			box.min = center - glm::vec3(1.f);
+			box.max = center + glm::vec3(1.f);
+		}
+
+		BVH bvh;
+		double buildTime = timeMs([&]() { bvh.build(boxes); });
+
+		for (AABB& box : boxes) {
+			glm::vec3 offset(moveDist(rng), moveDist(rng), moveDist(rng));
+			box.min += offset;
+			box.max += offset;
+		}
+		double refitTime = timeMs([&]() { bvh.refit(boxes); });
+
+		std::vector<uint32_t> result;
+		double frustumTime = timeMs([&]() { bvh.queryFrustum(frustum, result); });
+		size_t frustumHits = result.size();
+
+		std::uniform_real_distribution<float> dirDist(-1.f, 1.f);
+		const unsigned int rayCount = 1000;
+		double rayTime = timeMs([&]() {
+			for (unsigned int i = 0; i < rayCount; i++) {
+				float t;
+				bvh.raycast(Ray(glm::vec3(0.f), glm::normalize(glm::vec3(dirDist(rng), dirDist(rng), dirDist(rng)) + glm::vec3(0.f, 0.f, .001f))), t);
+			}
+		}) / rayCount;
+
+		result.clear();
+		double sphereTime = timeMs([&]() { bvh.querySphere(glm::vec3(0.f), 20.f, result); });
+
+		logBenchmark("BVH " + std::to_string(count) + ": build " + std::to_string(buildTime) + " ms, refit " + std::to_string(refitTime) + " ms, " + std::to_string(bvh.nodeCount()) + " nodes");
+		logBenchmark("    frustum " + std::to_string(frustumTime) + " ms(" + std::to_string(frustumHits) + " hits), ray " + std::to_string(rayTime * 1000.0) + " us, sphere " + std::to_string(sphereTime) + " ms(" + std::to_string(result.size()) + " hits)");
+	}
+}
+//Tangent generation on the bundled models: Assimp's aiProcess_CalcTangentSpace against TangentGenerator on one and all threads
+void benchmarkTangents(unsigned int iterations = 5) {
+	unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (const char* path : { "Objects/suzanne/scene.gltf", "Objects/Cerberus_by_Andrew_Maximov/Cerberus_LP.FBX", "Objects/SurvivalBackpack/Survival_BackPack_2.fbx" }) {
+		//Same import as Model, tangents are added on top so only their cost is timed
+		Assimp::Importer importer;
+		const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_OptimizeMeshes | aiProcess_OptimizeGraph);
+		if (!scene || !scene->mRootNode) {
+			logBenchmark(std::string("Tangents: failed to import ") + path);
+			continue;
+		}
+		double assimpTime = timeMs([&]() { importer.ApplyPostProcessing(aiProcess_CalcTangentSpace); });
+
+		Model model;
+		ModelData data;
+		model.importModel(path, data);
+
+		size_t vertexCount = 0, triangleCount = 0;
+		for (const MeshData& mesh : data.meshes) {
+			vertexCount += mesh.vertices.size();
+			triangleCount += (mesh.indices.empty() ? mesh.vertices.size() : mesh.indices.size()) / 3;
+		}
+
+		auto run = [&](unsigned int threadCount) {
+			TangentGenerator tangents;
+			tangents.threadCount = threadCount;
+			return timeMs([&]() {
+				for (unsigned int i = 0; i < iterations; i++)
+					for (MeshData& mesh : data.meshes)
+						tangents.generate(mesh.vertices, mesh.indices);
+			}) / iterations;
+		};
+		double singleTime = run(1);
+		double threadedTime = run(threads);
+
+		logBenchmark(std::string("Tangents ") + path + "(" + std::to_string(vertexCount) + " verts, " + std::to_string(triangleCount) + " tris)");
+		logBenchmark("    Assimp " + std::to_string(assimpTime) + " ms, ours " + std::to_string(singleTime) + " ms, ours x" + std::to_string(threads) + " threads " + std::to_string(threadedTime) + " ms");
+	}
+}
+//glTF load cost against just reading the files. The native loader should stay close to the read, Assimp converts the whole scene
+void benchmarkGLTF(const std::string& path = "Objects/suzanne/scene.gltf", unsigned int iterations = 20) {
+	size_t fileBytes = 0;
+	{
+		GLTFFile file;
+		if (!file.open(path)) {
+			logBenchmark("glTF: " + file.error);
+			return;
+		}
+		fileBytes = file.fileBytes;
+	}
+
+	std::string directory = path.substr(0, path.find_last_of('/') + 1);
+	double readTime = timeMs([&]() {
+		for (unsigned int i = 0; i < iterations; i++)
+			for (const std::string& name : { path, directory + "scene.bin" }) {
+				std::ifstream stream(name, std::ios::binary);
+				std::vector<char> bytes((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+			}
+	}) / iterations;
+
+	double nativeTime = timeMs([&]() {
+		for (unsigned int i = 0; i < iterations; i++) {
+			GLTFFile file;
+			file.open(path);
+		}
+	}) / iterations;
+
+	double uploadTime = timeMs([&]() {
+		for (unsigned int i = 0; i < iterations; i++) {
+			Model model;
+			model.loadModel(path);
+		}
+	}) / iterations;
+
+	double assimpTime = timeMs([&]() {
+		for (unsigned int i = 0; i < iterations; i++) {
+			Assimp::Importer importer;
+			importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_OptimizeMeshes | aiProcess_OptimizeGraph);
+		}
+	}) / iterations;
+
+	logBenchmark("glTF " + path + "(" + std::to_string(fileBytes / 1024) + " KB): file read " + std::to_string(readTime) + " ms");
+	logBenchmark("    native parse+validate " + std::to_string(nativeTime) + " ms, with GL upload " + std::to_string(uploadTime) + " ms, Assimp import " + std::to_string(assimpTime) + " ms");
+}
+//A draw's worth of PBR uniforms(model matrix, material factors and toggles) set the old way(std::string names and a glGetUniformLocation per set)
+//and through the reflected table, plus the single update of the shared camera/frame/light blocks that replaced the per-program light uniforms.
+//The program is bound for the run, so it's meant for a shader whose uniforms are set every frame anyway
+void benchmarkUniforms(Shader& shader, FrameUniforms& frameUniforms, unsigned int iterations = 10000) {
+	shader.use();
+
+	auto setVec3 = [&shader](const std::string& name, glm::vec3 value) {
+		int location = glGetUniformLocation(shader.ID, name.c_str());
+		if (location != -1) glUniform3f(location, value.x, value.y, value.z);
+	};
+	auto set1f = [&shader](const std::string& name, float value) {
+		int location = glGetUniformLocation(shader.ID, name.c_str());
+		if (location != -1) glUniform1f(location, value);
+	};
+	auto set1b = [&shader](const std::string& name, bool value) {
+		int location = glGetUniformLocation(shader.ID, name.c_str());
+		if (location != -1) glUniform1i(location, (int)value);
+	};
+	glm::mat4 model(1.f);
+
+	double stringTime = timeMs([&]() {
+		for (unsigned int i = 0; i < iterations; i++) {
+			model[3].x = (float)i;
+			int location = glGetUniformLocation(shader.ID, "model");
+			if (location != -1) glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(model));
+			setVec3("albedoFactor", glm::vec3(1.f));
+			set1f("metallicFactor", 1.f);
+			set1f("roughnessFactor", 1.f);
+			set1b("useAlbedo", true);
+			set1b("useNormalMap", true);
+			set1b("useMetallic", true);
+			set1b("useRoughness", true);
+		}
+	}) / iterations;
+
+	//Only the model matrix changes, the rest is skipped by the shadow copies
+	unsigned int skippedBefore = renderStats.uniformsSkipped;
+	double cachedTime = timeMs([&]() {
+		for (unsigned int i = 0; i < iterations; i++) {
+			model[3].x = (float)i;
+			shader.setMat4("model", model);
+			shader.setVec3("albedoFactor", glm::vec3(1.f));
+			shader.set1f("metallicFactor", 1.f);
+			shader.set1f("roughnessFactor", 1.f);
+			shader.set1b("useAlbedo", true);
+			shader.set1b("useNormalMap", true);
+			shader.set1b("useMetallic", true);
+			shader.set1b("useRoughness", true);
+		}
+	}) / iterations;
+	unsigned int skipped = renderStats.uniformsSkipped - skippedBefore;
+
+	UniformHandle<glm::mat4> modelHandle = shader.uniform<glm::mat4>("model");
+	double handleTime = timeMs([&]() {
+		for (unsigned int i = 0; i < iterations; i++) {
+			model[3].y = (float)i;
+			modelHandle = model;
+		}
+	}) / iterations;
+
+	double blockTime = timeMs([&]() {
+		for (unsigned int i = 0; i < iterations; i++)
+			frameUniforms.upload();
+	}) / iterations;
+
+	logBenchmark("Uniforms(8 per draw, " + std::to_string(shader.activeUniforms()) + " reflected): strings+glGetUniformLocation " + std::to_string(stringTime * 1000.0) + " us/draw");
+	logBenchmark("    reflected table " + std::to_string(cachedTime * 1000.0) + " us/draw(" + std::to_string(skipped / iterations) + " skipped per draw), model handle " + std::to_string(handleTime * 1000.0) + " us");
+	logBenchmark("    shared camera/frame/light blocks " + std::to_string(blockTime * 1000.0) + " us/frame");
+}
+//Builds the programs one by one, each status checked right after its compile and link(the old loadShader), then all through a ShaderBuildQueue.
+//The binary cache is off for the run and every pass adds its own #define, so neither this cache nor the driver's can serve a program
+void benchmarkShaderBuild(const std::vector<ProgramSources>& programs, unsigned int iterations = 3) {
+	bool cacheEnabled = programCache.enabled;
+	programCache.enabled = false;
+	unsigned int run = (unsigned int)std::chrono::steady_clock::now().time_since_epoch().count();
+
+	double serialTime = 0.0, queuedTime = 0.0;
+	for (unsigned int i = 0; i < iterations; i++) {
+		serialTime += timeMs([&]() {
+			std::string defines = "#define BENCHMARK_RUN " + std::to_string(run++) + "\n";
+			for (const ProgramSources& program : programs) {
+				Shader shader;
+				shader.loadShader(program.vertexPath, program.fragmentPath, program.geometryPath, defines);
+			}
+		});
+
+		queuedTime += timeMs([&]() {
+			std::string defines = "#define BENCHMARK_RUN " + std::to_string(run++) + "\n";
+			std::vector<std::unique_ptr<Shader>> shaders;
+			ShaderBuildQueue queue;
+			for (const ProgramSources& program : programs) {
+				shaders.push_back(std::make_unique<Shader>());
+				queue.submit(*shaders.back(), program, defines);
+			}
+			queue.wait();
+		});
+	}
+	programCache.enabled = cacheEnabled;
+
+	logBenchmark("Shader build(" + std::to_string(programs.size()) + " programs): one by one " + std::to_string(serialTime / iterations) + " ms, queued " + std::to_string(queuedTime / iterations) + " ms" +
+		(Shader::parallelCompileSupported() ? "(parallel compile)" : "(no parallel compile extension)"));
+}
+//The deferred geometry pass into the packed G-buffer(gBuffer, the variants of gBufferShaders) against the wide layout it replaced(world position and
+//normal in RGBA16F, albedo + metallic in RGBA8, 20 bytes per pixel plus depth), each drawing the scene iterations times. glFinish around each run
+//so the wall time is the GPU time
+void benchmarkGBuffer(Scene& scene, ShaderVariants& gBufferShaders, uint32_t features, uint32_t mapMask, GLuint gBuffer, unsigned int width, unsigned int height, int samples,
+	unsigned int iterations = 50) {
+	Shader wideShader;
+	wideShader.loadShader("Shaders/main.vert", "Shaders/deferredWide.frag");
+
+	GLuint wideFBO, wideTextures[3], wideDepth;
+	glGenFramebuffers(1, &wideFBO);
+	glGenTextures(3, wideTextures);
+	glGenRenderbuffers(1, &wideDepth);
+	glState.bindFramebuffer(GL_FRAMEBUFFER, wideFBO);
+	const GLenum formats[3] = { GL_RGBA16F, GL_RGBA16F, GL_RGBA8 };
+	GLenum target = samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D; //Same sample count as the packed one
+	for (int i = 0; i < 3; i++) {
+		glState.bindTexture(target, wideTextures[i]);
+		if (samples > 1)
+			glTexImage2DMultisample(target, samples, formats[i], width, height, GL_TRUE);
+		else {
+			glTexImage2D(target, 0, formats[i], width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+			glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		}
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, target, wideTextures[i], 0);
+	}
+	glBindRenderbuffer(GL_RENDERBUFFER, wideDepth);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples > 1 ? samples : 0, GL_DEPTH_COMPONENT24, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, wideDepth);
+	unsigned int attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+	glDrawBuffers(3, attachments);
+
+	auto run = [&](GLuint fbo, const std::function<void()>& draw) {
+		glState.bindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFinish();
+		double time = timeMs([&]() {
+			for (unsigned int i = 0; i < iterations; i++) {
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				draw();
+			}
+			glFinish();
+		});
+		return time / iterations;
+	};
+	double wideTime = run(wideFBO, [&]() { scene.draw(wideShader); });
+	double packedTime = run(gBuffer, [&]() { scene.draw(gBufferShaders, features, mapMask); });
+	glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glState.deleteFramebuffers(1, &wideFBO);
+	glState.deleteTextures(3, wideTextures);
+	glDeleteRenderbuffers(1, &wideDepth);
+
+	logBenchmark("G-buffer geometry pass " + std::to_string(width) + "x" + std::to_string(height) + (samples > 1 ? " MSAA x" + std::to_string(samples) : std::string()) +
+		": wide(24 B/px per sample) " + std::to_string(wideTime) + " ms, packed(14 B/px per sample) " + std::to_string(packedTime) + " ms");
+}
+//A way of rendering the frame(forward, deferred, ...)
+struct BenchmarkPipeline {
+	std::string name;
+	std::function<void()> render;
+};
+//Renders iterations frames with each pipeline for every scene setup, setup(i) puts one in place and returns its name(empty skips it).
+//Whole frames with glFinish at the end, and the CPU side of them. The pipelines time themselves with queries, so it can't run inside one
+void benchmarkPipelines(unsigned int setupCount, const std::function<std::string(unsigned int)>& setup, const std::vector<BenchmarkPipeline>& pipelines, unsigned int iterations = 50) {
+	for (unsigned int s = 0; s < setupCount; s++) {
+		std::string name = setup(s);
+		if (name.empty()) continue;
+
+		std::string line = "Pipelines on " + name + ":";
+		for (const BenchmarkPipeline& pipeline : pipelines) {
+			pipeline.render(); //Compiles the variants and uploads what it needs first
+			glFinish();
+
+			double cpuTime = 0.0;
+			double frameTime = timeMs([&]() {
+				for (unsigned int i = 0; i < iterations; i++)
+					cpuTime += timeMs(pipeline.render);
+				glFinish();
+			});
+			line += " " + pipeline.name + " " + std::to_string(frameTime / iterations) + " ms(CPU " + std::to_string(cpuTime / iterations) + ")";
+		}
+		logBenchmark(line);
+	}
+}
+//Renders iterations frames with render for every shadow setting, setup(i) puts one in place and returns its name. The first is the
+//baseline the others add to, so the difference is what the shadow lookups cost on the current view. Timed like benchmarkPipelines
+void benchmarkShadowFilters(unsigned int setupCount, const std::function<std::string(unsigned int)>& setup, const std::function<void()>& render, unsigned int iterations = 50) {
+	std::string line = "Shadow filters:";
+	double baseline = 0.0;
+	for (unsigned int s = 0; s < setupCount; s++) {
+		std::string name = setup(s);
+		render(); //Compiles the variants first
+		glFinish();
+
+		double frameTime = timeMs([&]() {
+			for (unsigned int i = 0; i < iterations; i++)
+				render();
+			glFinish();
+		}) / iterations;
+		if (s == 0) baseline = frameTime;
+		line += " " + name + " " + std::to_string(frameTime) + " ms" + (s ? "(+" + std::to_string(frameTime - baseline) + ")" : "");
+	}
+	logBenchmark(line);
+}
+//count packets over the meshes of model, each with the variant for its maps or without them and a random place in front of the camera.
+//Radix sort against std::sort on the same keys, then the submit in sorted and in submission order. Rasterization is discarded so only the CPU
+//and driver side of the submit is measured and nothing reaches the screen
+void benchmarkRenderQueue(Model& model, ShaderVariants& variants, uint32_t features, unsigned int count = 100000, unsigned int iterations = 10) {
+	if (model.meshes.empty()) {
+		logBenchmark("Render queue: the model has no meshes");
+		return;
+	}
+	std::vector<glm::mat4> matrices(count);
+	RenderQueue queue;
+	queue.reserve(count);
+	auto fill = [&]() {
+		std::mt19937 rng(1337);
+		std::uniform_int_distribution<size_t> meshDist(0, model.meshes.size() - 1);
+		std::uniform_real_distribution<float> posDist(-50.f, 50.f);
+		std::uniform_real_distribution<float> depthDist(0.f, 1.f);
+
+		queue.clear();
+		for (unsigned int i = 0; i < count; i++) {
+			MaterialMesh& mesh = model.meshes[meshDist(rng)];
+			Shader& shader = variants.get(features | (rng() & 1 ? mesh.currentMaterial->features() : 0));
+			float depth = depthDist(rng);
+			matrices[i] = glm::translate(glm::mat4(1.f), glm::vec3(posDist(rng), posDist(rng), -depth * 100.f));
+			queue.addMesh(DrawPass_opaque, shader, mesh, matrices[i], depth);
+		}
+	};
+	double fillTime = timeMs(fill);
+
+	double radixTime = 0.0, stdTime = 0.0;
+	for (unsigned int i = 0; i < iterations; i++) {
+		queue.sortComparison();
+		stdTime += queue.sortTime;
+		queue.sort();
+		radixTime += queue.sortTime;
+	}
+
+	glState.enable(GL_RASTERIZER_DISCARD);
+	glFinish(); //Each submit starts with an idle GPU
+	queue.submit();
+	float sortedTime = queue.submitTime;
+	std::string sortedChanges = std::to_string(queue.programChanges) + "/" + std::to_string(queue.materialChanges) + "/" + std::to_string(queue.meshChanges);
+
+	fill();
+	glFinish();
+	queue.submit(); //In submission order
+	glFinish();
+	glState.disable(GL_RASTERIZER_DISCARD);
+
+	logBenchmark("Render queue " + std::to_string(count) + " packets: build " + std::to_string(fillTime) + " ms, radix sort " + std::to_string(radixTime / iterations) + " ms, std::sort " + std::to_string(stdTime / iterations) + " ms");
+	logBenchmark("    submit sorted " + std::to_string(sortedTime) + " ms(program/material/mesh changes " + sortedChanges + "), unsorted " + std::to_string(queue.submitTime) + " ms(" +
+		std::to_string(queue.programChanges) + "/" + std::to_string(queue.materialChanges) + "/" + std::to_string(queue.meshChanges) + ")");
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,112 @@
+#pragma once
+#ifndef BOUNDS
+#define BOUNDS
+
+#include <GLM/glm.hpp>
+
+#include "Vertex.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+struct AABB {
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+
+	bool valid() const { return min.x <= max.x; }
+	glm::vec3 center() const { return (min + max) * .5f; }
+	glm::vec3 extents() const { return (max - min) * .5f; }
+
+	void expand(glm::vec3 point) {
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+	void expand(const AABB& other) {
+		if (!other.valid()) return;
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+	//Box that encloses this one after the transform(Arvo's method, no need to transform all 8 corners)
+	AABB transformed(const glm::mat4& mat) const {
+		if (!valid()) return *this;
+
+		glm::vec3 c = glm::vec3(mat * glm::vec4(center(), 1.f));
+		glm::vec3 e = extents();
+		glm::mat3 absMat(glm::abs(glm::vec3(mat[0])), glm::abs(glm::vec3(mat[1])), glm::abs(glm::vec3(mat[2])));
+		glm::vec3 newExtents = absMat * e;
+
+		AABB result;
+		result.min = c - newExtents;
+		result.max = c + newExtents;
+		return result;
+	}
+};
+
+struct BoundingSphere {
+	glm::vec3 center = glm::vec3(0.f);
+	float radius = -1.f; //Negative means empty
+
+	//Assumes the matrix has no shear so the largest axis scale bounds the radius
+	BoundingSphere transformed(const glm::mat4& mat) const {
+		BoundingSphere result;
+		result.center = glm::vec3(mat * glm::vec4(center, 1.f));
+
+		float maxScale = std::max(glm::dot(glm::vec3(mat[0]), glm::vec3(mat[0])), std::max(glm::dot(glm::vec3(mat[1]), glm::vec3(mat[1])), glm::dot(glm::vec3(mat[2]), glm::vec3(mat[2]))));
+		result.radius = radius * std::sqrt(maxScale);
+		return result;
+	}
+};
+
+struct Bounds {
+	AABB box;
+	BoundingSphere sphere;
+
+	//The sphere is centered on the box so it stays consistent with it. Slightly looser than Ritter's but one pass cheaper
+	void compute(const std::vector<Vertex>& vertices) {
+		box = AABB();
+		for (const Vertex& vertex : vertices)
+			box.expand(vertex.position);
+
+		if (!box.valid()) {
+			sphere = BoundingSphere();
+			return;
+		}
+
+		sphere.center = box.center();
+		float radiusSq = 0.f;
+		for (const Vertex& vertex : vertices) {
+			glm::vec3 d = vertex.position - sphere.center;
+			radiusSq = std::max(radiusSq, glm::dot(d, d));
+		}
+		sphere.radius = std::sqrt(radiusSq);
+	}
+	//When only the box is known, e.g. a glTF POSITION accessor's min/max
+	void compute(const AABB& box) {
+		this->box = box;
+		sphere = BoundingSphere();
+		if (!box.valid()) return;
+
+		sphere.center = box.center();
+		sphere.radius = glm::length(box.extents());
+	}
+	void merge(const Bounds& other) {
+		if (!box.valid()) {
+			*this = other;
+			return;
+		}
+		box.expand(other.box);
+		if (!box.valid()) return;
+
+		//Sphere around the merged box. Exact merging of spheres isn't worth it for culling
+		sphere.center = box.center();
+		sphere.radius = glm::length(box.extents());
+	}
+	Bounds transformed(const glm::mat4& mat) const {
+		Bounds result;
+		result.box = box.transformed(mat);
+		result.sphere = sphere.transformed(mat);
+		return result;
+	}
+};
+#endif
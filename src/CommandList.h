@@ -0,0 +1,212 @@
+#pragma once
+#ifndef COMMAND_LIST
+#define COMMAND_LIST
+
+#include <GLM/glm.hpp>
+
+#include "Shader.h"
+#include "Mesh.h"
+#include "Material.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+enum CommandType : uint8_t {
+	Command_useProgram,
+	Command_bindMaterial,
+	Command_setMat4,
+	Command_setVec3,
+	Command_set1f,
+	Command_set1i,
+	Command_updateBuffer,
+	Command_draw
+};
+struct Command {
+	CommandType type;
+	UniformName name; //Of uniform writes
+	uint32_t offset;  //Of the value in the list's payload
+	void* object;     //Shader, Material or Mesh
+	GLuint buffer = 0; //Buffer updates, size bytes written at bufferOffset
+	GLintptr bufferOffset = 0;
+	uint32_t size = 0;
+};
+
+//Draw work recorded without touching GL, so any thread can fill one. Commands name engine objects instead of GL calls and uniform values
+//are copied into the list, execute() on the GL thread turns them into the real binds, uploads and draws. Uniform block writes(e.g. a std140
+//struct of UniformBuffers.h) are recorded as buffer updates of the bytes.
+//A program or material already set earlier in the same list isn't recorded again.
+class CommandList {
+private:
+	std::vector<Command> commands;
+	std::vector<unsigned char> payload;
+	const Shader* program = nullptr;
+	const Material* material = nullptr;
+
+	template<typename T>
+	void write(CommandType type, UniformName name, const T& value) {
+		uint32_t offset = (uint32_t)payload.size();
+		payload.resize(offset + sizeof(T));
+		std::memcpy(payload.data() + offset, &value, sizeof(T));
+		commands.push_back({ type, name, offset, nullptr });
+	}
+	template<typename T>
+	T read(uint32_t offset) const {
+		T value;
+		std::memcpy(&value, payload.data() + offset, sizeof(T));
+		return value;
+	}
+public:
+	unsigned int drawCount = 0;
+
+	void clear() {
+		commands.clear();
+		payload.clear();
+		program = nullptr;
+		material = nullptr;
+		drawCount = 0;
+	}
+	size_t size() const { return commands.size(); }
+
+	void useProgram(Shader& shader) {
+		if (program == &shader) return;
+		program = &shader;
+		material = nullptr; //Material uniforms live in the program
+		commands.push_back({ Command_useProgram, UniformName(0u), 0, &shader });
+	}
+	void bindMaterial(Material& material) {
+		if (this->material == &material) return;
+		this->material = &material;
+		commands.push_back({ Command_bindMaterial, UniformName(0u), 0, &material });
+	}
+	void setMat4(UniformName name, const glm::mat4& value) { write(Command_setMat4, name, value); }
+	void setVec3(UniformName name, glm::vec3 value) { write(Command_setVec3, name, value); }
+	void set1f(UniformName name, float value) { write(Command_set1f, name, value); }
+	void set1i(UniformName name, int value) { write(Command_set1i, name, value); }
+	//Writes value at offset of a uniform buffer when executed, T has to match the block's layout
+	template<typename T>
+	void updateBuffer(GLuint buffer, GLintptr offset, const T& value) {
+		uint32_t payloadOffset = (uint32_t)payload.size();
+		payload.resize(payloadOffset + sizeof(T));
+		std::memcpy(payload.data() + payloadOffset, &value, sizeof(T));
+		commands.push_back({ Command_updateBuffer, UniformName(0u), payloadOffset, nullptr, buffer, offset, (uint32_t)sizeof(T) });
+	}
+	void draw(Mesh& mesh) {
+		commands.push_back({ Command_draw, UniformName(0u), 0, &mesh });
+		drawCount++;
+	}
+
+	//GL thread only. Uniform writes and material binds go to the program of the last useProgram
+	void execute() const {
+		Shader* shader = nullptr;
+		bool boundBuffer = false;
+		for (const Command& command : commands) {
+			switch (command.type) {
+			case Command_useProgram:
+				shader = (Shader*)command.object;
+				shader->use();
+				break;
+			case Command_bindMaterial:
+				((Material*)command.object)->bind(*shader);
+				break;
+			case Command_setMat4:
+				shader->setMat4(command.name, read<glm::mat4>(command.offset));
+				break;
+			case Command_setVec3:
+				shader->setVec3(command.name, read<glm::vec3>(command.offset));
+				break;
+			case Command_set1f:
+				shader->set1f(command.name, read<float>(command.offset));
+				break;
+			case Command_set1i:
+				shader->set1i(command.name, read<int>(command.offset));
+				break;
+			case Command_updateBuffer:
+				glBindBuffer(GL_UNIFORM_BUFFER, command.buffer);
+				glBufferSubData(GL_UNIFORM_BUFFER, command.bufferOffset, command.size, payload.data() + command.offset);
+				boundBuffer = true;
+				break;
+			case Command_draw:
+				((Mesh*)command.object)->draw();
+				break;
+			}
+		}
+		if (boundBuffer) glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+};
+
+//Splits a range of work(e.g. objects of the scene) in one chunk per thread, each recorded into its own list at the same time,
+//then replays the lists on the GL thread in chunk order so the result matches recording everything on one thread.
+class CommandRecorder {
+private:
+	std::vector<CommandList> lists;
+public:
+	//Ranges smaller than this are recorded on the calling thread
+	static const size_t parallelThreshold = 1024;
+
+	unsigned int threadCount = 1;
+
+	//Of the last record() and execute(), in ms. recordTimes has one entry per list
+	std::vector<float> recordTimes;
+	float recordTime = 0.f; //Wall time of the whole record()
+	float executeTime = 0.f;
+
+	//func(CommandList&, begin, end) records items [begin, end). It runs on worker threads and must not touch GL
+	template<typename Func>
+	void record(size_t count, Func func) {
+		auto start = std::chrono::high_resolution_clock::now();
+
+		unsigned int threads = count < parallelThreshold ? 1 : std::max(1u, threadCount);
+		size_t chunk = (count + threads - 1) / std::max(1u, threads);
+		lists.resize(threads);
+		recordTimes.assign(threads, 0.f);
+
+		auto recordChunk = [this, &func, count, chunk](unsigned int t) {
+			auto chunkStart = std::chrono::high_resolution_clock::now();
+
+			CommandList& list = lists[t];
+			list.clear();
+			size_t begin = std::min(count, t * chunk);
+			size_t end = std::min(count, begin + chunk);
+			if (begin < end)
+				func(list, begin, end);
+
+			recordTimes[t] = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - chunkStart).count();
+		};
+		std::vector<std::thread> workers;
+		for (unsigned int t = 1; t < threads; t++)
+			workers.emplace_back(recordChunk, t);
+		recordChunk(0);
+
+		for (std::thread& worker : workers)
+			worker.join();
+
+		recordTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+	void execute() {
+		auto start = std::chrono::high_resolution_clock::now();
+
+		for (const CommandList& list : lists)
+			list.execute();
+
+		executeTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	size_t commandCount() const {
+		size_t count = 0;
+		for (const CommandList& list : lists)
+			count += list.size();
+		return count;
+	}
+	unsigned int drawCount() const {
+		unsigned int count = 0;
+		for (const CommandList& list : lists)
+			count += list.drawCount;
+		return count;
+	}
+	size_t listCount() const { return lists.size(); }
+};
+#endif
\ No newline at end of file
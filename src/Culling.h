@@ -0,0 +1,210 @@
+#pragma once
+#ifndef CULLING
+#define CULLING
+
+#include <GLM/glm.hpp>
+#include <GLM/gtc/matrix_access.hpp>
+
+#include "Bounds.h"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+//View frustum as 6 normalized planes(ax + by + cz + d = 0, normals point inwards), extracted from proj * view(Gribb & Hartmann)
+struct Frustum {
+	glm::vec4 planes[6];
+
+	Frustum(const glm::mat4& PV = glm::mat4(1.f)) {
+		glm::vec4 row0 = glm::row(PV, 0);
+		glm::vec4 row1 = glm::row(PV, 1);
+		glm::vec4 row2 = glm::row(PV, 2);
+		glm::vec4 row3 = glm::row(PV, 3);
+
+		planes[0] = row3 + row0; //Left
+		planes[1] = row3 - row0; //Right
+		planes[2] = row3 + row1; //Bottom
+		planes[3] = row3 - row1; //Top
+		planes[4] = row3 + row2; //Near
+		planes[5] = row3 - row2; //Far
+
+		for (glm::vec4& plane : planes)
+			plane /= glm::length(glm::vec3(plane));
+	}
+
+	bool testSphere(const BoundingSphere& sphere) const {
+		for (const glm::vec4& plane : planes)
+			if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+				return false;
+		return true;
+	}
+	bool testAABB(const AABB& box) const {
+		glm::vec3 center = box.center();
+		glm::vec3 extents = box.extents();
+		for (const glm::vec4& plane : planes) {
+			float radius = glm::dot(extents, glm::abs(glm::vec3(plane)));
+			if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+				return false;
+		}
+		return true;
+	}
+};
+
+//Batched sphere vs frustum culling. Spheres are kept as SoA so one SIMD register holds the same coordinate of 4(SSE) or 8(AVX) spheres.
+//Usage: clear(), add() every sphere, cull(), then read visible[i] in the order they were added.
+class FrustumCuller {
+private:
+	std::vector<float> centerX, centerY, centerZ, radius;
+
+	void cullRangeScalar(const Frustum& frustum, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			bool inside = true;
+			for (int p = 0; p < 6 && inside; p++) {
+				const glm::vec4& plane = frustum.planes[p];
+				inside = plane.x * centerX[i] + plane.y * centerY[i] + plane.z * centerZ[i] + plane.w >= -radius[i];
+			}
+			visible[i] = inside;
+		}
+	}
+	//begin has to be a multiple of the SIMD width, leftovers are handled by the scalar path
+	void cullRange(const Frustum& frustum, size_t begin, size_t end) {
+		size_t i = begin;
+#if defined(__AVX__)
+		__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (int p = 0; p < 6; p++) {
+			planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+			planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+			planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+			planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+		}
+		__m256 zero = _mm256_setzero_ps();
+
+		for (; i + 8 <= end; i += 8) {
+			__m256 x = _mm256_loadu_ps(&centerX[i]);
+			__m256 y = _mm256_loadu_ps(&centerY[i]);
+			__m256 z = _mm256_loadu_ps(&centerZ[i]);
+			__m256 negRadius = _mm256_sub_ps(zero, _mm256_loadu_ps(&radius[i]));
+
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (int p = 0; p < 6; p++) {
+				__m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)), _mm256_add_ps(_mm256_mul_ps(planeZ[p], z), planeW[p]));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(dist, negRadius, _CMP_GE_OQ));
+			}
+
+			int mask = _mm256_movemask_ps(inside);
+			for (int j = 0; j < 8; j++)
+				visible[i + j] = (mask >> j) & 1;
+		}
+#else
+		__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (int p = 0; p < 6; p++) {
+			planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+			planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+			planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+			planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+		}
+		__m128 zero = _mm_setzero_ps();
+
+		for (; i + 4 <= end; i += 4) {
+			__m128 x = _mm_loadu_ps(&centerX[i]);
+			__m128 y = _mm_loadu_ps(&centerY[i]);
+			__m128 z = _mm_loadu_ps(&centerZ[i]);
+			__m128 negRadius = _mm_sub_ps(zero, _mm_loadu_ps(&radius[i]));
+
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int p = 0; p < 6; p++) {
+				__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)), _mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, negRadius));
+			}
+
+			int mask = _mm_movemask_ps(inside);
+			for (int j = 0; j < 4; j++)
+				visible[i + j] = (mask >> j) & 1;
+		}
+#endif
+		cullRangeScalar(frustum, i, end);
+	}
+public:
+#if defined(__AVX__)
+	static const size_t simdWidth = 8;
+#else
+	static const size_t simdWidth = 4;
+#endif
+	//Batches smaller than this are culled on the calling thread, spawning workers costs more than it saves
+	static const size_t parallelThreshold = 1 << 16;
+
+	std::vector<uint8_t> visible;
+	unsigned int threadCount = 1;
+	bool useSIMD = true;
+
+	//Results of the last cull() call
+	unsigned int visibleCount = 0;
+	unsigned int culledCount = 0;
+	float cullTime = 0.f; //In ms
+
+	void reserve(size_t count) {
+		centerX.reserve(count);
+		centerY.reserve(count);
+		centerZ.reserve(count);
+		radius.reserve(count);
+		visible.reserve(count);
+	}
+	void clear() {
+		centerX.clear();
+		centerY.clear();
+		centerZ.clear();
+		radius.clear();
+	}
+	size_t size() const { return radius.size(); }
+
+	void add(const BoundingSphere& sphere) {
+		centerX.push_back(sphere.center.x);
+		centerY.push_back(sphere.center.y);
+		centerZ.push_back(sphere.center.z);
+		radius.push_back(sphere.radius);
+	}
+
+	void cull(const Frustum& frustum) {
+		auto start = std::chrono::high_resolution_clock::now();
+
+		size_t count = size();
+		visible.resize(count);
+
+		unsigned int threads = count < parallelThreshold ? 1 : std::max(1u, threadCount);
+		if (threads == 1) {
+			if (useSIMD) cullRange(frustum, 0, count);
+			else cullRangeScalar(frustum, 0, count);
+		}
+		else {
+			//Chunks are rounded to the SIMD width so no two threads write the same batch
+			size_t chunk = ((count + threads - 1) / threads + simdWidth - 1) / simdWidth * simdWidth;
+			std::vector<std::thread> workers;
+			for (unsigned int t = 1; t < threads; t++) {
+				size_t begin = std::min(count, t * chunk);
+				size_t end = std::min(count, begin + chunk);
+				if (begin < end)
+					workers.emplace_back([this, &frustum, begin, end]() {
+						if (useSIMD) cullRange(frustum, begin, end);
+						else cullRangeScalar(frustum, begin, end);
+					});
+			}
+			if (useSIMD) cullRange(frustum, 0, std::min(count, chunk));
+			else cullRangeScalar(frustum, 0, std::min(count, chunk));
+
+			for (std::thread& worker : workers)
+				worker.join();
+		}
+
+		visibleCount = 0;
+		for (size_t i = 0; i < count; i++)
+			visibleCount += visible[i];
+		culledCount = (unsigned int)count - visibleCount;
+
+		cullTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+};
+#endif
@@ -4,6 +4,8 @@
 
 #include "Shader.h"
 
+#include <cstdint>
+
 enum PostProcFlag {
 	PostProcFlag_none = 0,
 	PostProcFlag_hdr = 1 << 0, //For removal
@@ -24,39 +26,87 @@ enum PostProcFlag {
 	PostProcFlag_16 = 1 << 15,
 };
 
-class PostProcFlags{
+//Bit set over one of the flag enums in this file
+template<typename Flag, typename Storage = uint32_t>
+class FlagSet {
 public:
     //Sets flag to true
-    void setFlag(PostProcFlag flag){
-        flagValue |= (int)flag;
+    void setFlag(Flag flag){
+        flagValue |= (Storage)flag;
+    }
+    void setFlag(Flag flag, bool value){
+        if (value) setFlag(flag);
+        else unsetFlag(flag);
     }
 
     //Sets flag to false
-    void unsetFlag(PostProcFlag flag){
-        flagValue &= ~(int)flag;
+    void unsetFlag(Flag flag){
+        flagValue &= ~(Storage)flag;
     }
 
     //Sets a flag value from true to false and vice versa
-    void flipFlag(PostProcFlag flag){
-        flagValue ^= (int)flag;
+    void flipFlag(Flag flag){
+        flagValue ^= (Storage)flag;
     }
-    bool hasFlag(PostProcFlag flag) {
-        return (flagValue & (int)flag) == (int)flag;
+    bool hasFlag(Flag flag) const {
+        return (flagValue & (Storage)flag) == (Storage)flag;
     }
-    bool getFlags(){
+    Storage getFlags() const {
         return flagValue;
     }
-    void set(Shader& shader, const char* name) {
+
+    FlagSet(Storage flags) {
+        flagValue = flags;
+    }
+    FlagSet() {};
+
+    Storage flagValue = 0;
+};
+
+class PostProcFlags : public FlagSet<PostProcFlag, uint16_t> {
+public:
+    void set(Shader& shader, UniformName name) {
         shader.use();
         shader.set1ui(name, flagValue);
     }
 
-    PostProcFlags(uint16_t flags) {
-        flagValue = flags;
-    }
+    PostProcFlags(uint16_t flags) : FlagSet(flags) {}
     PostProcFlags() {};
+};
 
-    uint16_t flagValue = 0;
+//Compile time features of the surface shaders(main and PBR). Each one is a #define in the variant compiled for it, see ShaderVariants.h
+enum ShaderFeature : uint32_t {
+    ShaderFeature_none = 0,
+    ShaderFeature_albedoMap = 1 << 0,
+    ShaderFeature_normalMap = 1 << 1,
+    ShaderFeature_metallicMap = 1 << 2,
+    ShaderFeature_roughnessMap = 1 << 3,
+    ShaderFeature_AOMap = 1 << 4,
+    ShaderFeature_IBL = 1 << 5,
+    ShaderFeature_dirLight = 1 << 6,
+    ShaderFeature_pointLights = 1 << 7,
+    ShaderFeature_spotLight = 1 << 8,
+    ShaderFeature_bloom = 1 << 9,
+    ShaderFeature_SRGBTextures = 1 << 10, //Albedo maps stored in sRGB without an sRGB format
+    ShaderFeature_deferredResolve = 1 << 11, //Lights the G-buffer on a fullscreen quad instead of a mesh
+    ShaderFeature_clusteredLights = 1 << 12, //Point and spot lights come from the light clusters instead of the Lights block
+    ShaderFeature_clusterHeatmap = 1 << 13, //Shows the light count of each cluster instead of the shading
+    ShaderFeature_deferredMSAA = 1 << 14, //The resolved G-buffer is multisampled, edge pixels are shaded per sample
+    ShaderFeature_visibilityResolve = 1 << 15, //Shades the pixels of one material of the visibility buffer on a fullscreen quad
+    ShaderFeature_dirShadows = 1 << 16, //The directional light is shadowed by the cascaded shadow maps
+    ShaderFeature_lightShadows = 1 << 17, //Point and spot lights are shadowed by their tiles of the shadow atlas
+
+    ShaderFeature_materialMaps = ShaderFeature_albedoMap | ShaderFeature_normalMap | ShaderFeature_metallicMap | ShaderFeature_roughnessMap | ShaderFeature_AOMap
+};
+//Indexed by bit
+const char* const shaderFeatureDefines[] = {
+    "ALBEDO_MAP", "NORMAL_MAP", "METALLIC_MAP", "ROUGHNESS_MAP", "AO_MAP",
+    "IBL", "DIR_LIGHT", "POINT_LIGHTS", "SPOT_LIGHT", "BLOOM", "SRGB_TEXTURES", "DEFERRED_RESOLVE",
+    "CLUSTERED_LIGHTS", "CLUSTER_HEATMAP", "DEFERRED_MSAA", "VISIBILITY_RESOLVE", "DIR_SHADOWS", "LIGHT_SHADOWS"
 };
+const unsigned int shaderFeatureCount = sizeof(shaderFeatureDefines) / sizeof(shaderFeatureDefines[0]);
+static_assert(ShaderFeature_lightShadows == 1u << (shaderFeatureCount - 1), "Every ShaderFeature needs its define");
+
+using ShaderFeatures = FlagSet<ShaderFeature>;
 //unsetting a flag can be done by flags &= ~flag
 #endif
\ No newline at end of file
@@ -0,0 +1,190 @@
+#pragma once
+#ifndef GL_STATE
+#define GL_STATE
+
+#include "Stats.h"
+
+//Shadow of the GL state the renderer touches the most. Every bind or toggle goes through here and is dropped when GL already has that value,
+//so draw code can set what it needs without caring what the previous draw left behind. Unknown values(after invalidate()) always go through.
+//Code that changes this state behind its back(raw GL calls, other libraries) has to call invalidate() afterwards.
+//Deleting a bound object resets the binding in GL, use the delete functions here so a recycled name isn't mistaken for the old one.
+class GLState {
+private:
+	static const unsigned int maxUnits = 32;
+	static const GLuint unknown = 0xFFFFFFFF;
+
+	//Texture targets tracked per unit, other targets are always issued
+	static const unsigned int targetCount = 4;
+	static int targetIndex(GLenum target) {
+		switch (target) {
+		case GL_TEXTURE_2D: return 0;
+		case GL_TEXTURE_CUBE_MAP: return 1;
+		case GL_TEXTURE_2D_ARRAY: return 2;
+		case GL_TEXTURE_2D_MULTISAMPLE: return 3;
+		default: return -1;
+		}
+	}
+	//Capabilities tracked by glEnable/glDisable, others are always issued
+	static const unsigned int capCount = 6;
+	static int capIndex(GLenum cap) {
+		switch (cap) {
+		case GL_DEPTH_TEST: return 0;
+		case GL_BLEND: return 1;
+		case GL_CULL_FACE: return 2;
+		case GL_STENCIL_TEST: return 3;
+		case GL_SCISSOR_TEST: return 4;
+		case GL_MULTISAMPLE: return 5;
+		default: return -1;
+		}
+	}
+
+	GLuint program;
+	GLuint vertexArray;
+	GLuint activeUnit;
+	GLuint textures[maxUnits][targetCount];
+	GLuint drawFramebuffer, readFramebuffer;
+	int caps[capCount]; //-1 unknown
+	GLenum depthFunction, cullMode, blendSource, blendDestination;
+	int depthWrite; //-1 unknown
+
+	//True when the call has to reach GL
+	static bool issue(bool changed) {
+		if (changed) renderStats.stateCalls++;
+		else renderStats.stateCallsFiltered++;
+		return changed;
+	}
+	template<typename T>
+	static bool update(T& current, T value) {
+		if (!issue(current != value)) return false;
+		current = value;
+		return true;
+	}
+public:
+	GLState() { invalidate(); }
+
+	//Forgets everything, the next call of each kind goes through
+	void invalidate() {
+		program = vertexArray = activeUnit = unknown;
+		for (auto& unit : textures)
+			for (GLuint& texture : unit)
+				texture = unknown;
+		drawFramebuffer = readFramebuffer = unknown;
+		for (int& cap : caps)
+			cap = -1;
+		depthFunction = cullMode = blendSource = blendDestination = unknown;
+		depthWrite = -1;
+	}
+
+	void useProgram(GLuint id) {
+		if (update(program, id)) glUseProgram(id);
+	}
+	void bindVertexArray(GLuint id) {
+		if (update(vertexArray, id)) glBindVertexArray(id);
+	}
+
+	//unit is GL_TEXTURE0 + n like glActiveTexture
+	void activeTexture(GLenum unit) {
+		if (update(activeUnit, (GLuint)(unit - GL_TEXTURE0))) glActiveTexture(unit);
+	}
+	//Binds to the active unit, like glBindTexture
+	void bindTexture(GLenum target, GLuint id) {
+		int index = targetIndex(target);
+		if (index < 0 || activeUnit >= maxUnits) {
+			issue(true);
+			glBindTexture(target, id);
+		}
+		else if (update(textures[activeUnit][index], id))
+			glBindTexture(target, id);
+	}
+	//Selects the unit only when the binding changes
+	void bindTexture(GLenum unit, GLenum target, GLuint id) {
+		int index = targetIndex(target);
+		GLuint n = unit - GL_TEXTURE0;
+		if (index >= 0 && n < maxUnits && textures[n][index] == id) {
+			issue(false);
+			return;
+		}
+		activeTexture(unit);
+		bindTexture(target, id);
+	}
+
+	//GL_FRAMEBUFFER sets both the draw and the read binding
+	void bindFramebuffer(GLenum target, GLuint id) {
+		bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+		bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+		bool changed = (draw && drawFramebuffer != id) || (read && readFramebuffer != id);
+		if (!issue(changed)) return;
+
+		if (draw) drawFramebuffer = id;
+		if (read) readFramebuffer = id;
+		glBindFramebuffer(target, id);
+	}
+
+	void enable(GLenum cap) {
+		int index = capIndex(cap);
+		if (index < 0) {
+			issue(true);
+			glEnable(cap);
+		}
+		else if (update(caps[index], 1))
+			glEnable(cap);
+	}
+	void disable(GLenum cap) {
+		int index = capIndex(cap);
+		if (index < 0) {
+			issue(true);
+			glDisable(cap);
+		}
+		else if (update(caps[index], 0))
+			glDisable(cap);
+	}
+	void setEnabled(GLenum cap, bool enabled) {
+		if (enabled) enable(cap);
+		else disable(cap);
+	}
+
+	void depthFunc(GLenum func) {
+		if (update(depthFunction, func)) glDepthFunc(func);
+	}
+	void depthMask(GLboolean flag) {
+		if (update(depthWrite, (int)flag)) glDepthMask(flag);
+	}
+	void cullFace(GLenum mode) {
+		if (update(cullMode, mode)) glCullFace(mode);
+	}
+	void blendFunc(GLenum source, GLenum destination) {
+		if (!issue(blendSource != source || blendDestination != destination)) return;
+
+		blendSource = source;
+		blendDestination = destination;
+		glBlendFunc(source, destination);
+	}
+
+	//Deleting what's bound makes GL bind 0
+	void deleteTextures(GLsizei count, const GLuint* ids) {
+		for (GLsizei i = 0; i < count; i++)
+			for (auto& unit : textures)
+				for (GLuint& texture : unit)
+					if (texture == ids[i]) texture = 0;
+		glDeleteTextures(count, ids);
+	}
+	void deleteVertexArrays(GLsizei count, const GLuint* ids) {
+		for (GLsizei i = 0; i < count; i++)
+			if (vertexArray == ids[i]) vertexArray = 0;
+		glDeleteVertexArrays(count, ids);
+	}
+	void deleteFramebuffers(GLsizei count, const GLuint* ids) {
+		for (GLsizei i = 0; i < count; i++) {
+			if (drawFramebuffer == ids[i]) drawFramebuffer = 0;
+			if (readFramebuffer == ids[i]) readFramebuffer = 0;
+		}
+		glDeleteFramebuffers(count, ids);
+	}
+	//A deleted program stays current until another one is used, so only the name is forgotten
+	void deleteProgram(GLuint id) {
+		if (program == id) program = unknown;
+		glDeleteProgram(id);
+	}
+};
+GLState glState;
+#endif
\ No newline at end of file
@@ -0,0 +1,599 @@
+#pragma once
+#ifndef GLTF_LOADER
+#define GLTF_LOADER
+
+#include <GLAD/gl.h>
+
+#include <GLM/glm.hpp>
+#include <SOIL2/stb_image.h>
+
+#include "Json.h"
+#include "MappedFile.h"
+#include "Mesh.h"
+#include "Material.h"
+#include "Texture.h"
+#include "Tangents.h"
+#include "Bounds.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+//glTF 2.0(.gltf + .bin or .glb) without Assimp. Buffers are memory mapped, every accessor a primitive uses is validated against its
+//buffer view, then the views are uploaded as they are and the attributes point into them with the file's offsets and strides,
+//so nothing is re-interleaved. Split like Model's loading: open() does the IO, parsing, validation and image decoding on any thread,
+//uploadPrimitive() the GL work. Node transforms are ignored like Model's Assimp path does, every primitive becomes a MaterialMesh.
+class GLTFFile {
+public:
+	struct BufferView {
+		int buffer = -1;
+		size_t byteOffset = 0;
+		size_t byteLength = 0;
+		size_t byteStride = 0; //0 is tightly packed
+	};
+	struct Accessor {
+		int bufferView = -1;
+		size_t byteOffset = 0;
+		GLenum componentType = 0;
+		bool normalized = false;
+		size_t count = 0;
+		int components = 0;
+		bool sparse = false;
+		AABB bounds; //min/max, POSITION only
+
+		size_t componentSize() const {
+			switch (componentType) {
+			case GL_BYTE: case GL_UNSIGNED_BYTE: return 1;
+			case GL_SHORT: case GL_UNSIGNED_SHORT: return 2;
+			case GL_UNSIGNED_INT: case GL_FLOAT: return 4;
+			default: return 0;
+			}
+		}
+		size_t elementSize() const { return componentSize() * components; }
+	};
+	struct TextureRef {
+		int image = -1;
+		int channel = -1; //Swizzled into red for the single channel slots, -1 keeps RGB
+	};
+	struct MaterialInfo {
+		glm::vec4 baseColor = glm::vec4(1.f);
+		float metallic = 1.f;
+		float roughness = 1.f;
+		TextureRef albedo, normal, metallicMap, roughnessMap, AO;
+	};
+	struct Primitive {
+		int position = -1, normal = -1, texCoord = -1, tangent = -1, indices = -1;
+		int material = -1;
+		std::vector<glm::vec4> tangents; //Generated when the file has none and the material has a normal map
+	};
+
+	std::string error;
+	std::vector<Primitive> primitives;
+	size_t fileBytes = 0; //Bytes mapped, for load speed stats
+private:
+	struct Span {
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+	};
+
+	MappedFile file;
+	JsonValue json;
+	std::vector<MappedFile> externalBuffers;
+	std::vector<std::vector<uint8_t>> embeddedBuffers; //Base64 data URIs
+	std::vector<Span> buffers;
+	std::vector<BufferView> views;
+	std::vector<Accessor> accessors;
+	std::vector<MaterialInfo> materials;
+	std::vector<ImageData> images;
+	std::string directory;
+
+	//GL side, shared between primitives
+	std::vector<GLuint> viewBuffers;
+	std::map<int, Texture*> uploadedTextures; //image * 4 + channel + 1, -1 is the white fallback. Owned by the meshes
+
+	bool fail(const std::string& message) {
+		if (error.empty()) error = message;
+		return false;
+	}
+
+	static std::string decodeURI(const std::string& uri) {
+		std::string result;
+		for (size_t i = 0; i < uri.size(); i++) {
+			if (uri[i] == '%' && i + 2 < uri.size()) {
+				result += (char)std::strtol(uri.substr(i + 1, 2).c_str(), nullptr, 16);
+				i += 2;
+			}
+			else
+				result += uri[i];
+		}
+		return result;
+	}
+	static bool decodeBase64(const std::string& text, size_t start, std::vector<uint8_t>& out) {
+		auto value = [](char c) -> int {
+			if (c >= 'A' && c <= 'Z') return c - 'A';
+			if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+			if (c >= '0' && c <= '9') return c - '0' + 52;
+			if (c == '+') return 62;
+			if (c == '/') return 63;
+			return -1;
+		};
+
+		out.clear();
+		out.reserve((text.size() - start) / 4 * 3);
+		uint32_t bits = 0;
+		int bitCount = 0;
+		for (size_t i = start; i < text.size() && text[i] != '='; i++) {
+			int v = value(text[i]);
+			if (v < 0) return false;
+
+			bits = (bits << 6) | v;
+			bitCount += 6;
+			if (bitCount >= 8) {
+				bitCount -= 8;
+				out.push_back((uint8_t)(bits >> bitCount));
+			}
+		}
+		return true;
+	}
+	//data:[mime];base64,... or a path relative to the .gltf
+	bool loadURI(const std::string& uri, Span& span) {
+		if (uri.compare(0, 5, "data:") == 0) {
+			size_t comma = uri.find(',');
+			if (comma == std::string::npos || uri.rfind(";base64", comma) == std::string::npos) return fail("Unsupported data URI");
+
+			embeddedBuffers.emplace_back();
+			if (!decodeBase64(uri, comma + 1, embeddedBuffers.back())) return fail("Bad base64 data URI");
+			span.data = embeddedBuffers.back().data();
+			span.size = embeddedBuffers.back().size();
+			return true;
+		}
+
+		externalBuffers.emplace_back();
+		if (!externalBuffers.back().open(directory + decodeURI(uri))) return fail("Can't open " + directory + uri);
+		span.data = externalBuffers.back().data();
+		span.size = externalBuffers.back().size();
+		fileBytes += span.size;
+		return true;
+	}
+
+	bool parseGLB(Span& text, Span& binary) {
+		const uint8_t* data = file.data();
+		size_t size = file.size();
+
+		uint32_t header[3]; //magic, version, length
+		std::memcpy(header, data, sizeof(header));
+		if (header[1] != 2) return fail("Unsupported GLB version " + std::to_string(header[1]));
+		size = std::min(size, (size_t)header[2]);
+
+		size_t offset = 12;
+		while (offset + 8 <= size) {
+			uint32_t chunk[2]; //length, type
+			std::memcpy(chunk, data + offset, sizeof(chunk));
+			offset += 8;
+			if (chunk[0] > size - offset) return fail("GLB chunk out of bounds");
+
+			if (chunk[1] == 0x4E4F534A && !text.data) //JSON
+				text = { data + offset, chunk[0] };
+			else if (chunk[1] == 0x004E4942 && !binary.data) //BIN
+				binary = { data + offset, chunk[0] };
+			offset += (chunk[0] + 3) & ~3u;
+		}
+		return text.data || fail("GLB has no JSON chunk");
+	}
+	bool parseBuffers(Span binary) {
+		const JsonValue& list = json["buffers"];
+		for (size_t i = 0; i < list.size(); i++) {
+			const JsonValue& buffer = list[i];
+			Span span;
+
+			if (buffer.has("uri")) {
+				if (!loadURI(buffer["uri"].asString(), span)) return false;
+			}
+			else if (i == 0 && binary.data)
+				span = binary;
+			else
+				return fail("Buffer " + std::to_string(i) + " has no data");
+
+			size_t byteLength = buffer["byteLength"].asSize();
+			if (byteLength > span.size) return fail("Buffer " + std::to_string(i) + " is smaller than its byteLength");
+			span.size = byteLength;
+			buffers.push_back(span);
+		}
+
+		const JsonValue& viewList = json["bufferViews"];
+		views.resize(viewList.size());
+		for (size_t i = 0; i < viewList.size(); i++) {
+			BufferView& view = views[i];
+			view.buffer = viewList[i]["buffer"].asInt();
+			view.byteOffset = viewList[i]["byteOffset"].asSize();
+			view.byteLength = viewList[i]["byteLength"].asSize();
+			view.byteStride = viewList[i]["byteStride"].asSize();
+
+			if (view.buffer < 0 || view.buffer >= (int)buffers.size()) return fail("Buffer view " + std::to_string(i) + " has a bad buffer");
+			if (view.byteOffset > buffers[view.buffer].size || view.byteLength > buffers[view.buffer].size - view.byteOffset) return fail("Buffer view " + std::to_string(i) + " is out of bounds");
+			if (view.byteStride && (view.byteStride < 4 || view.byteStride > 252)) return fail("Buffer view " + std::to_string(i) + " has a bad stride");
+		}
+		viewBuffers.assign(views.size(), 0);
+		return true;
+	}
+	bool parseAccessors() {
+		const JsonValue& list = json["accessors"];
+		accessors.resize(list.size());
+		for (size_t i = 0; i < list.size(); i++) {
+			const JsonValue& value = list[i];
+			Accessor& accessor = accessors[i];
+
+			accessor.bufferView = value["bufferView"].asInt();
+			accessor.byteOffset = value["byteOffset"].asSize();
+			accessor.componentType = (GLenum)value["componentType"].asInt(0);
+			accessor.normalized = value["normalized"].asBool();
+			accessor.count = value["count"].asSize();
+			accessor.sparse = value.has("sparse");
+
+			const std::string& type = value["type"].asString();
+			accessor.components = type == "SCALAR" ? 1 : type == "VEC2" ? 2 : type == "VEC3" ? 3 : type == "VEC4" ? 4 : type == "MAT2" ? 4 : type == "MAT3" ? 9 : type == "MAT4" ? 16 : 0;
+
+			if (value["min"].size() == 3 && value["max"].size() == 3)
+				for (int c = 0; c < 3; c++) {
+					accessor.bounds.min[c] = value["min"][c].asFloat();
+					accessor.bounds.max[c] = value["max"][c].asFloat();
+				}
+		}
+		return true;
+	}
+	//Everything a draw could read has to be inside the view
+	bool validateAccessor(int index, std::initializer_list<GLenum> types, std::initializer_list<int> components, const char* usage) {
+		std::string name = std::string(usage) + " accessor " + std::to_string(index);
+		if (index < 0 || index >= (int)accessors.size()) return fail(name + " doesn't exist");
+
+		const Accessor& accessor = accessors[index];
+		if (accessor.sparse) return fail(name + " is sparse, not supported");
+		if (accessor.bufferView < 0 || accessor.bufferView >= (int)views.size()) return fail(name + " has no buffer view");
+		if (std::find(types.begin(), types.end(), accessor.componentType) == types.end()) return fail(name + " has an unsupported component type");
+		if (std::find(components.begin(), components.end(), accessor.components) == components.end()) return fail(name + " has an unsupported type");
+
+		const BufferView& view = views[accessor.bufferView];
+		size_t elementSize = accessor.elementSize();
+		size_t stride = view.byteStride ? view.byteStride : elementSize;
+		if (accessor.byteOffset % accessor.componentSize() || stride % accessor.componentSize()) return fail(name + " is misaligned");
+		if (accessor.count && accessor.byteOffset + stride * (accessor.count - 1) + elementSize > view.byteLength) return fail(name + " is out of bounds");
+		return true;
+	}
+
+	const uint8_t* element(const Accessor& accessor, size_t index) const {
+		const BufferView& view = views[accessor.bufferView];
+		size_t stride = view.byteStride ? view.byteStride : accessor.elementSize();
+		return buffers[view.buffer].data + view.byteOffset + accessor.byteOffset + index * stride;
+	}
+	float readFloat(const Accessor& accessor, size_t index, int component) const {
+		const uint8_t* data = element(accessor, index) + component * accessor.componentSize();
+		switch (accessor.componentType) {
+		case GL_FLOAT: { float v; std::memcpy(&v, data, 4); return v; }
+		case GL_UNSIGNED_BYTE: return accessor.normalized ? *data / 255.f : *data;
+		case GL_BYTE: return accessor.normalized ? std::max(*(const int8_t*)data / 127.f, -1.f) : *(const int8_t*)data;
+		case GL_UNSIGNED_SHORT: { uint16_t v; std::memcpy(&v, data, 2); return accessor.normalized ? v / 65535.f : v; }
+		case GL_SHORT: { int16_t v; std::memcpy(&v, data, 2); return accessor.normalized ? std::max(v / 32767.f, -1.f) : v; }
+		default: return 0.f;
+		}
+	}
+	uint32_t readIndex(const Accessor& accessor, size_t index) const {
+		const uint8_t* data = element(accessor, index);
+		switch (accessor.componentType) {
+		case GL_UNSIGNED_BYTE: return *data;
+		case GL_UNSIGNED_SHORT: { uint16_t v; std::memcpy(&v, data, 2); return v; }
+		default: { uint32_t v; std::memcpy(&v, data, 4); return v; }
+		}
+	}
+
+	TextureRef parseTextureRef(const JsonValue& info, int channel) {
+		TextureRef ref;
+		if (info.isNull()) return ref;
+
+		const JsonValue& texture = json["textures"][info["index"].asSize(SIZE_MAX)];
+		ref.image = texture["source"].asInt();
+		if (ref.image >= (int)json["images"].size()) ref.image = -1;
+		ref.channel = channel;
+		return ref;
+	}
+	void parseMaterials() {
+		const JsonValue& list = json["materials"];
+		materials.resize(list.size());
+		for (size_t i = 0; i < list.size(); i++) {
+			const JsonValue& pbr = list[i]["pbrMetallicRoughness"];
+			MaterialInfo& material = materials[i];
+
+			const JsonValue& color = pbr["baseColorFactor"];
+			if (color.size() == 4)
+				material.baseColor = glm::vec4(color[0].asFloat(1.f), color[1].asFloat(1.f), color[2].asFloat(1.f), color[3].asFloat(1.f));
+			material.metallic = pbr["metallicFactor"].asFloat(1.f);
+			material.roughness = pbr["roughnessFactor"].asFloat(1.f);
+
+			//Metallic is in blue and roughness in green of the same texture, AO in red of its own(often the same one too)
+			material.albedo = parseTextureRef(pbr["baseColorTexture"], -1);
+			material.metallicMap = parseTextureRef(pbr["metallicRoughnessTexture"], 2);
+			material.roughnessMap = parseTextureRef(pbr["metallicRoughnessTexture"], 1);
+			material.normal = parseTextureRef(list[i]["normalTexture"], -1);
+			material.AO = parseTextureRef(list[i]["occlusionTexture"], 0);
+		}
+	}
+	bool parsePrimitives() {
+		const JsonValue& meshes = json["meshes"];
+		for (size_t m = 0; m < meshes.size(); m++) {
+			const JsonValue& list = meshes[m]["primitives"];
+			for (size_t p = 0; p < list.size(); p++) {
+				const JsonValue& value = list[p];
+				std::string name = "Mesh " + std::to_string(m) + " primitive " + std::to_string(p);
+				if (value["mode"].asInt(4) != 4) {
+					std::cout << "WARNING::GLTFLOADER.H::" << name << " isn't a triangle list, skipped" << std::endl;
+					continue;
+				}
+
+				const JsonValue& attributes = value["attributes"];
+				Primitive primitive;
+				primitive.position = attributes["POSITION"].asInt();
+				primitive.normal = attributes["NORMAL"].asInt();
+				primitive.texCoord = attributes["TEXCOORD_0"].asInt();
+				primitive.tangent = attributes["TANGENT"].asInt();
+				primitive.indices = value["indices"].asInt();
+				primitive.material = value["material"].asInt();
+				if (primitive.material >= (int)materials.size()) primitive.material = -1;
+
+				if (!validateAccessor(primitive.position, { GL_FLOAT }, { 3 }, "POSITION")) return false;
+				size_t vertexCount = accessors[primitive.position].count;
+
+				if (primitive.normal >= 0 && !validateAccessor(primitive.normal, { GL_FLOAT }, { 3 }, "NORMAL")) return false;
+				if (primitive.texCoord >= 0 && !validateAccessor(primitive.texCoord, { GL_FLOAT, GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT }, { 2 }, "TEXCOORD_0")) return false;
+				if (primitive.tangent >= 0 && !validateAccessor(primitive.tangent, { GL_FLOAT }, { 4 }, "TANGENT")) return false;
+				for (int attribute : { primitive.normal, primitive.texCoord, primitive.tangent })
+					if (attribute >= 0 && accessors[attribute].count != vertexCount)
+						return fail(name + " has attributes of different lengths");
+
+				if (primitive.indices >= 0) {
+					if (!validateAccessor(primitive.indices, { GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT, GL_UNSIGNED_INT }, { 1 }, "Index")) return false;
+
+					const Accessor& indices = accessors[primitive.indices];
+					if (views[indices.bufferView].byteStride) return fail(name + " has strided indices");
+					for (size_t i = 0; i < indices.count; i++)
+						if (readIndex(indices, i) >= vertexCount)
+							return fail(name + " indexes past its vertices");
+				}
+
+				//min/max is required on POSITION but not every exporter writes it
+				Accessor& position = accessors[primitive.position];
+				if (!position.bounds.valid())
+					for (size_t i = 0; i < vertexCount; i++)
+						position.bounds.expand(glm::vec3(readFloat(position, i, 0), readFloat(position, i, 1), readFloat(position, i, 2)));
+
+				primitives.push_back(std::move(primitive));
+			}
+		}
+		return primitives.size() || fail("No triangle primitives");
+	}
+	//Only where a normal map needs them and the file has none. The rest of the vertex data stays in the mapped buffers
+	void generateTangents() {
+		TangentGenerator generator;
+		generator.threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+		std::vector<Vertex> vertices;
+		std::vector<unsigned int> indices;
+		for (Primitive& primitive : primitives) {
+			if (primitive.tangent >= 0 || primitive.normal < 0 || primitive.texCoord < 0) continue;
+			if (primitive.material < 0 || materials[primitive.material].normal.image < 0) continue;
+
+			const Accessor& position = accessors[primitive.position];
+			const Accessor& normal = accessors[primitive.normal];
+			const Accessor& texCoord = accessors[primitive.texCoord];
+
+			vertices.resize(position.count);
+			for (size_t i = 0; i < position.count; i++) {
+				vertices[i].position = glm::vec3(readFloat(position, i, 0), readFloat(position, i, 1), readFloat(position, i, 2));
+				vertices[i].normal = glm::vec3(readFloat(normal, i, 0), readFloat(normal, i, 1), readFloat(normal, i, 2));
+				vertices[i].texCoord = glm::vec2(readFloat(texCoord, i, 0), readFloat(texCoord, i, 1));
+			}
+			indices.clear();
+			if (primitive.indices >= 0) {
+				const Accessor& indexAccessor = accessors[primitive.indices];
+				indices.resize(indexAccessor.count);
+				for (size_t i = 0; i < indexAccessor.count; i++)
+					indices[i] = readIndex(indexAccessor, i);
+			}
+
+			generator.generate(vertices, indices);
+			primitive.tangents.resize(vertices.size());
+			for (size_t i = 0; i < vertices.size(); i++)
+				primitive.tangents[i] = vertices[i].tangent;
+		}
+	}
+	void decodeImages() {
+		const JsonValue& list = json["images"];
+		images.resize(list.size());
+
+		std::vector<uint8_t> used(list.size(), 0);
+		for (const MaterialInfo& material : materials)
+			for (const TextureRef* ref : { &material.albedo, &material.normal, &material.metallicMap, &material.roughnessMap, &material.AO })
+				if (ref->image >= 0) used[ref->image] = 1;
+
+		for (size_t i = 0; i < list.size(); i++) {
+			if (!used[i]) continue;
+			const JsonValue& image = list[i];
+
+			if (image.has("uri") && image["uri"].asString().compare(0, 5, "data:") != 0) {
+				images[i] = Texture::decodeImage(directory + decodeURI(image["uri"].asString()));
+				continue;
+			}
+
+			//Embedded: a buffer view(GLB) or a data URI
+			Span span;
+			if (image.has("uri")) {
+				if (!loadURI(image["uri"].asString(), span)) {
+					std::cout << "ERROR::GLTFLOADER.H::" << error << std::endl;
+					error.clear();
+					continue;
+				}
+			}
+			else {
+				int viewIndex = image["bufferView"].asInt();
+				if (viewIndex < 0 || viewIndex >= (int)views.size()) continue;
+				span = { buffers[views[viewIndex].buffer].data + views[viewIndex].byteOffset, views[viewIndex].byteLength };
+			}
+
+			int channels;
+			images[i].path = directory + "#image" + std::to_string(i);
+			images[i].pixels = stbi_load_from_memory(span.data, (int)span.size, &images[i].width, &images[i].height, &channels, 3);
+			if (!images[i].pixels)
+				std::cout << "ERROR::GLTFLOADER.H::FAILED TO DECODE IMAGE " << i << ": " << stbi_failure_reason() << std::endl;
+		}
+	}
+
+	GLuint viewBuffer(int index, std::vector<GLuint>& ownedBuffers) {
+		if (viewBuffers[index]) return viewBuffers[index];
+
+		const BufferView& view = views[index];
+		glGenBuffers(1, &viewBuffers[index]);
+		glBindBuffer(GL_ARRAY_BUFFER, viewBuffers[index]);
+		glBufferData(GL_ARRAY_BUFFER, view.byteLength, buffers[view.buffer].data + view.byteOffset, GL_STATIC_DRAW);
+		ownedBuffers.push_back(viewBuffers[index]);
+		return viewBuffers[index];
+	}
+	void setupAttribute(Mesh& mesh, GLuint location, int accessorIndex, std::vector<GLuint>& ownedBuffers) {
+		const Accessor& accessor = accessors[accessorIndex];
+		const BufferView& view = views[accessor.bufferView];
+		mesh.setupAttribute(location, viewBuffer(accessor.bufferView, ownedBuffers), accessor.components, accessor.componentType, accessor.normalized, (GLsizei)view.byteStride, accessor.byteOffset);
+	}
+	//Textures are shared between slots and meshes that use the same image and channel
+	void loadSlot(Texture& slot, const TextureRef& ref, bool whiteFallback) {
+		static unsigned char whitePixel[3] = { 255, 255, 255 };
+		static const ImageData white = { whiteTexturePath, whitePixel, 1, 1 };
+
+		bool hasImage = ref.image >= 0 && images[ref.image].pixels;
+		if (!hasImage && !whiteFallback) return;
+
+		int key = hasImage ? ref.image * 4 + ref.channel + 1 : -1;
+		auto uploaded = uploadedTextures.find(key);
+		if (uploaded != uploadedTextures.end()) {
+			slot.share(*uploaded->second);
+			return;
+		}
+
+		slot.loadFromImage(hasImage ? images[ref.image] : white);
+		if (hasImage && ref.channel >= 0) {
+			glState.bindTexture(GL_TEXTURE_2D, slot.id);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_RED + ref.channel);
+			glState.bindTexture(GL_TEXTURE_2D, 0);
+		}
+		uploadedTextures[key] = &slot;
+	}
+public:
+	GLTFFile() {};
+	GLTFFile(const GLTFFile&) = delete;
+	GLTFFile& operator=(const GLTFFile&) = delete;
+	~GLTFFile() {
+		for (ImageData& image : images)
+			image.release();
+	}
+
+	static bool isGLTF(const std::string& path) {
+		std::string extension = path.substr(path.find_last_of('.') + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		return extension == "gltf" || extension == "glb";
+	}
+
+	//CPU side, any thread
+	bool open(const std::string& path) {
+		error.clear();
+		directory = path.substr(0, std::max((int)path.find_last_of('/'), (int)path.find_last_of('\\')) + 1);
+
+		if (!file.open(path)) return fail("Can't open " + path);
+		fileBytes = file.size();
+
+		Span text = { file.data(), file.size() };
+		Span binary;
+		if (file.size() >= 12 && std::memcmp(file.data(), "glTF", 4) == 0) {
+			text = Span();
+			if (!parseGLB(text, binary)) return false;
+		}
+
+		JsonParser parser;
+		if (!parser.parse((const char*)text.data, text.size, json)) return fail("JSON: " + parser.error);
+		if (json["asset"]["version"].asString().compare(0, 2, "2.") != 0) return fail("Only glTF 2.x is supported");
+
+		const JsonValue& required = json["extensionsRequired"];
+		if (required.size())
+			return fail("Required extension " + required[0].asString() + " isn't supported");
+
+		if (!parseBuffers(binary) || !parseAccessors()) return false;
+		parseMaterials();
+		if (!parsePrimitives()) return false;
+
+		generateTangents();
+		decodeImages();
+		return true;
+	}
+
+	//GL side. The mesh vector must have room for every primitive(reserve) since textures are shared by pointer between its meshes.
+	//Buffers created for it are added to ownedBuffers
+	MaterialMesh& uploadPrimitive(size_t index, std::vector<MaterialMesh>& meshes, std::vector<GLuint>& ownedBuffers) {
+		const Primitive& primitive = primitives[index];
+		const Accessor& position = accessors[primitive.position];
+
+		meshes.emplace_back();
+		MaterialMesh& mesh = meshes.back();
+		mesh.VBO = 0;
+		mesh.EBO = 0;
+		mesh.vertexCount = (unsigned int)position.count;
+		mesh.bounds.compute(position.bounds);
+
+		glGenVertexArrays(1, &mesh.VAO);
+		glState.bindVertexArray(mesh.VAO);
+
+		setupAttribute(mesh, 0, primitive.position, ownedBuffers);
+		if (primitive.normal >= 0) setupAttribute(mesh, 1, primitive.normal, ownedBuffers);
+		if (primitive.texCoord >= 0) setupAttribute(mesh, 2, primitive.texCoord, ownedBuffers);
+
+		if (primitive.tangent >= 0)
+			setupAttribute(mesh, 3, primitive.tangent, ownedBuffers);
+		else if (!primitive.tangents.empty()) {
+			GLuint tangentBuffer;
+			glGenBuffers(1, &tangentBuffer);
+			glBindBuffer(GL_ARRAY_BUFFER, tangentBuffer);
+			glBufferData(GL_ARRAY_BUFFER, primitive.tangents.size() * sizeof(glm::vec4), primitive.tangents.data(), GL_STATIC_DRAW);
+			ownedBuffers.push_back(tangentBuffer);
+			mesh.setupAttribute(3, tangentBuffer, 4, GL_FLOAT, false, 0, 0);
+		}
+		//Without either the attribute stays disabled and reads as a zero tangent, the shaders fall back to the vertex normal
+
+		//Indices straight from the mapped file, one element buffer per primitive so the draws need no offset
+		if (primitive.indices >= 0) {
+			const Accessor& indices = accessors[primitive.indices];
+			glGenBuffers(1, &mesh.EBO);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.EBO);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.count * indices.componentSize(), element(indices, 0), GL_STATIC_DRAW);
+			ownedBuffers.push_back(mesh.EBO);
+
+			mesh.indexCount = (unsigned int)indices.count;
+			mesh.indexType = indices.componentType;
+		}
+		glState.bindVertexArray(0);
+
+		MaterialInfo info = primitive.material >= 0 ? materials[primitive.material] : MaterialInfo();
+		Material& material = mesh.material;
+		material.albedoFactor = glm::vec3(info.baseColor);
+		material.metallicFactor = info.metallic;
+		material.roughnessFactor = info.roughness;
+
+		loadSlot(material.albedo, info.albedo, true);
+		loadSlot(material.normal, info.normal, false);
+		loadSlot(material.metallic, info.metallicMap, true);
+		loadSlot(material.roughness, info.roughnessMap, true);
+		loadSlot(material.AO, info.AO, true);
+		material.initialized = true;
+
+		return mesh;
+	}
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,309 @@
+#pragma once
+#ifndef HIZ_CULLING
+#define HIZ_CULLING
+
+#include <GLEW/glew.h>
+#include <GLAD/gl.h>
+
+#include <GLM/glm.hpp>
+
+#include "Shader.h"
+#include "Mesh.h"
+#include "Bounds.h"
+#include "Culling.h"
+#include "InstanceBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//GPU driven occlusion culling. Instances are tested on the GPU against a depth pyramid(Hi-Z) and the survivors are compacted into a buffer
+//that feeds indirect draws, so nothing is read back. Two phases per frame:
+//  1. Draw the instances that were visible last frame(frustum tested only)
+//  2. Build the pyramid from that depth, test everything against it and draw what phase 1 missed. The result is kept for the next frame
+class HiZCuller {
+private:
+	static const unsigned int commandSize = 5; //uints per command, DrawElementsIndirectCommand. DrawArraysIndirectCommand uses the first 4 with the same stride
+
+	Shader pyramidShader;
+	Shader cullShader;
+
+	GLuint depthFBO = 0;
+	GLuint depthTexture = 0;
+	GLenum depthFormat = 0;
+
+	std::vector<GLuint> commandTemplate;
+	std::vector<const Mesh*> meshes;
+
+	GLuint timestampQueries[2][4] = {};
+	bool timestampsIssued[2] = { false, false };
+	unsigned int queryFrame = 0;
+
+	//The blit needs matching depth formats so the copy target follows whatever the current framebuffer uses
+	GLenum queryDepthFormat(GLuint fbo) {
+		if (!fbo) return GL_DEPTH24_STENCIL8;
+
+		GLint type = GL_NONE, name = 0, format = GL_DEPTH_COMPONENT;
+		glState.bindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+		glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type);
+		glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &name);
+
+		if (type == GL_RENDERBUFFER) {
+			glBindRenderbuffer(GL_RENDERBUFFER, name);
+			glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_INTERNAL_FORMAT, &format);
+			glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		}
+		else if (type == GL_TEXTURE) {
+			glState.bindTexture(GL_TEXTURE_2D, name);
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+			glState.bindTexture(GL_TEXTURE_2D, 0);
+		}
+		return (GLenum)format;
+	}
+	void setupDepthCopy(GLenum format) {
+		depthFormat = format;
+		bool stencil = format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8 || format == GL_DEPTH_STENCIL;
+
+		if (!depthFBO) glGenFramebuffers(1, &depthFBO);
+		if (depthTexture) glState.deleteTextures(1, &depthTexture);
+
+		glGenTextures(1, &depthTexture);
+		glState.bindTexture(GL_TEXTURE_2D, depthTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, stencil ? GL_DEPTH_STENCIL : GL_DEPTH_COMPONENT, stencil ? GL_UNSIGNED_INT_24_8 : GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+		glState.bindTexture(GL_TEXTURE_2D, 0);
+
+		glState.bindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::HIZ_CULLING.H::DEPTH COPY FRAMEBUFFER NOT COMPLETE" << std::endl;
+		glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+	void timestamp(unsigned int index) {
+		glQueryCounter(timestampQueries[queryFrame][index], GL_TIMESTAMP);
+	}
+public:
+	GLuint hiZTexture = 0;
+	GLuint outputBuffer = 0; //Compacted instances, phase 0 in the first half and phase 1 in the second
+	GLuint visibilityBuffer = 0;
+	GLuint commandBuffer = 0;
+
+	unsigned int width = 0, height = 0, levels = 0;
+	unsigned int capacity = 0;
+	bool occlusionEnabled = true;
+	float gpuTime = 0.f; //Culling + pyramid build, in ms, a frame late
+
+	static bool supported() {
+		return GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object && GLEW_ARB_multi_draw_indirect && GLEW_ARB_shader_image_load_store;
+	}
+
+	void init(unsigned int width, unsigned int height, unsigned int capacity) {
+		pyramidShader.loadComputeShader("Shaders/Culling/hiZ.comp");
+		cullShader.loadComputeShader("Shaders/Culling/occlusionCull.comp");
+
+		this->capacity = capacity;
+
+		glGenBuffers(1, &outputBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, outputBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)capacity * 2 * sizeof(InstanceData), NULL, GL_DYNAMIC_COPY);
+
+		glGenBuffers(1, &visibilityBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibilityBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)capacity * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+		resetVisibility();
+
+		glGenBuffers(1, &commandBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		glGenQueries(8, &timestampQueries[0][0]);
+
+		resize(width, height);
+	}
+	~HiZCuller() {
+		if (!outputBuffer) return;
+
+		glDeleteBuffers(1, &outputBuffer);
+		glDeleteBuffers(1, &visibilityBuffer);
+		glDeleteBuffers(1, &commandBuffer);
+		glState.deleteTextures(1, &hiZTexture);
+		glState.deleteTextures(1, &depthTexture);
+		glState.deleteFramebuffers(1, &depthFBO);
+		glDeleteQueries(8, &timestampQueries[0][0]);
+	}
+
+	void resize(unsigned int width, unsigned int height) {
+		this->width = std::max(1u, width);
+		this->height = std::max(1u, height);
+		levels = (unsigned int)std::floor(std::log2((float)std::max(this->width, this->height))) + 1;
+
+		if (hiZTexture) glState.deleteTextures(1, &hiZTexture);
+		glGenTextures(1, &hiZTexture);
+		glState.bindTexture(GL_TEXTURE_2D, hiZTexture);
+		glTexStorage2D(GL_TEXTURE_2D, levels, GL_R32F, this->width, this->height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glState.bindTexture(GL_TEXTURE_2D, 0);
+
+		depthFormat = 0; //Reallocated on the next pyramid build
+	}
+	//Everything is treated as hidden so the next frame draws it all in phase 2
+	void resetVisibility() {
+		GLuint zero = 0;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibilityBuffer);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+	//One command per mesh. Meshes have their own VAOs so each is drawn with its own glMultiDraw*Indirect call
+	void setMeshes(const std::vector<const Mesh*>& meshes) {
+		if (meshes == this->meshes) return;
+		this->meshes = meshes;
+
+		commandTemplate.assign(meshes.size() * 2 * commandSize, 0);
+		for (unsigned int phase = 0; phase < 2; phase++)
+			for (size_t i = 0; i < meshes.size(); i++) {
+				GLuint* command = &commandTemplate[(phase * meshes.size() + i) * commandSize];
+				if (!meshes[i]->indexCount) { //count, instanceCount, first, baseInstance
+					command[0] = meshes[i]->vertexCount;
+					command[3] = phase * capacity;
+				}
+				else { //count, instanceCount, firstIndex, baseVertex, baseInstance
+					command[0] = meshes[i]->indexCount;
+					command[4] = phase * capacity;
+				}
+			}
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, commandTemplate.size() * sizeof(GLuint), commandTemplate.data(), GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+		resetVisibility();
+	}
+	GLintptr commandOffset(unsigned int phase, size_t mesh) const {
+		return (GLintptr)((phase * meshes.size() + mesh) * commandSize * sizeof(GLuint));
+	}
+
+	//Tests count instances of the current region of input against the frustum(and the pyramid in phase 1) and writes the indirect commands
+	void cull(unsigned int phase, InstanceBuffer& input, unsigned int count, const glm::mat4& PV, const AABB& localBox) {
+		if (meshes.empty()) return;
+		count = std::min(count, capacity);
+		timestamp(phase * 2);
+
+		//Reset this phase's instance counts, the rest of the command stays as set up
+		size_t phaseStart = phase * meshes.size() * commandSize;
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, phaseStart * sizeof(GLuint), meshes.size() * commandSize * sizeof(GLuint), &commandTemplate[phaseStart]);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, input.id);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, outputBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, visibilityBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, commandBuffer);
+
+		glState.activeTexture(GL_TEXTURE16); //Past the units the surface shaders keep bound
+		glState.bindTexture(GL_TEXTURE_2D, hiZTexture);
+
+		Frustum frustum(PV);
+		cullShader.use();
+		for (int i = 0; i < 6; i++)
+			cullShader.setVec4("planes[" + std::to_string(i) + "]", frustum.planes[i]);
+		cullShader.setMat4("PV", PV);
+		cullShader.setVec3("localMin", localBox.min);
+		cullShader.setVec3("localMax", localBox.max);
+		cullShader.setVec2("hiZSize", glm::vec2(width, height));
+		cullShader.set1i("hiZLevels", levels);
+		cullShader.set1ui("instanceCount", count);
+		cullShader.set1ui("inputOffset", input.baseInstance());
+		cullShader.set1ui("outputOffset", phase * capacity);
+		cullShader.set1ui("firstCommand", (unsigned int)(phase * meshes.size()));
+		cullShader.set1ui("meshCount", (unsigned int)meshes.size());
+		cullShader.set1i("phase", phase);
+		cullShader.set1b("occlusionEnabled", occlusionEnabled);
+
+		cullShader.set1b("finalize", false);
+		glDispatchCompute((count + 63) / 64, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		cullShader.set1b("finalize", true);
+		glDispatchCompute(((unsigned int)meshes.size() + 63) / 64, 1, 1);
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+		if (phase == 1) {
+			timestamp(3);
+			timestampsIssued[queryFrame] = true;
+			readTimings();
+		}
+		else
+			timestamp(1);
+	}
+	//Builds the pyramid from the depth of the framebuffer currently bound for drawing
+	void buildPyramid() {
+		timestamp(2);
+
+		GLint drawFBO = 0, readFBO = 0;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFBO);
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFBO);
+
+		GLenum format = queryDepthFormat(drawFBO);
+		if (format != depthFormat)
+			setupDepthCopy(format);
+
+		glState.bindFramebuffer(GL_READ_FRAMEBUFFER, drawFBO);
+		glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFBO);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFBO);
+		glState.bindFramebuffer(GL_READ_FRAMEBUFFER, readFBO);
+
+		pyramidShader.use();
+		glState.activeTexture(GL_TEXTURE16);
+		glState.bindTexture(GL_TEXTURE_2D, depthTexture);
+
+		unsigned int levelWidth = width, levelHeight = height;
+		for (unsigned int level = 0; level < levels; level++) {
+			unsigned int srcWidth = levelWidth, srcHeight = levelHeight;
+			if (level > 0) {
+				levelWidth = std::max(1u, levelWidth / 2);
+				levelHeight = std::max(1u, levelHeight / 2);
+				glBindImageTexture(0, hiZTexture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+			}
+			glBindImageTexture(1, hiZTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+			pyramidShader.set1i("level", level);
+			pyramidShader.setVec2i("srcSize", glm::ivec2(srcWidth, srcHeight));
+			pyramidShader.setVec2i("dstSize", glm::ivec2(levelWidth, levelHeight));
+			glDispatchCompute((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		}
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		glState.activeTexture(GL_TEXTURE0);
+	}
+	//Issues the indirect draws of one phase for every mesh. Instance attributes are read from outputBuffer
+	template<typename MeshType>
+	void draw(unsigned int phase, MeshType* drawMeshes, size_t count, Shader& shader) {
+		for (size_t i = 0; i < count; i++)
+			drawMeshes[i].DrawIndirect(shader, outputBuffer, commandBuffer, commandOffset(phase, i));
+	}
+
+	//Reads last frame's timestamps, never waits on the GPU
+	void readTimings() {
+		unsigned int previous = queryFrame ^ 1;
+		queryFrame = previous;
+
+		if (!timestampsIssued[previous]) return;
+
+		GLint available = 0;
+		glGetQueryObjectiv(timestampQueries[previous][3], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) return;
+
+		GLuint64 stamps[4];
+		for (int i = 0; i < 4; i++)
+			glGetQueryObjectui64v(timestampQueries[previous][i], GL_QUERY_RESULT, &stamps[i]);
+		gpuTime = ((stamps[1] - stamps[0]) + (stamps[3] - stamps[2])) / 1000000.f;
+	}
+};
+#endif
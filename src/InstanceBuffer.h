@@ -0,0 +1,142 @@
+#pragma once
+#ifndef INSTANCE_BUFFER
+#define INSTANCE_BUFFER
+
+#include <GLEW/glew.h>
+#include <GLAD/gl.h>
+
+#include <GLM/glm.hpp>
+
+#include <iostream>
+#include <vector>
+
+//Per-instance vertex data. Bound to attribute locations 4-7 (model), 8 (tint) and 9 (material index)
+struct InstanceData {
+	glm::mat4 model;
+	glm::vec3 tint;
+	unsigned int materialIndex;
+
+	InstanceData(glm::mat4 model = glm::mat4(1.f), glm::vec3 tint = glm::vec3(1.f), unsigned int materialIndex = 0) {
+		this->model = model;
+		this->tint = tint;
+		this->materialIndex = materialIndex;
+	}
+};
+
+//Stream buffer for instance data. The buffer is split into frameCount regions so the CPU writes into one region while the GPU still reads the others.
+//When ARB_buffer_storage is available the buffer is persistently mapped, otherwise the data is staged on the CPU and uploaded with glBufferSubData.
+class InstanceBuffer {
+private:
+	InstanceData* mappedPtr = nullptr;
+	std::vector<InstanceData> staging;
+	GLsync fences[3] = { 0, 0, 0 };
+
+	void waitForFence(unsigned int region) {
+		if (!fences[region]) return;
+
+		GLenum result = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); //1ms
+		while (result == GL_TIMEOUT_EXPIRED)
+			result = glClientWaitSync(fences[region], 0, 1000000);
+
+		glDeleteSync(fences[region]);
+		fences[region] = 0;
+	}
+public:
+	static const unsigned int frameCount = 3;
+
+	GLuint id = 0;
+	unsigned int capacity = 0; //Max instances per region
+	unsigned int count = 0; //Instances written in the current region
+	unsigned int currentRegion = 0;
+	bool persistent = false;
+
+	void loadBuffer(unsigned int capacity) {
+		deleteBuffer();
+
+		this->capacity = capacity;
+		this->count = 0;
+		this->currentRegion = 0;
+
+		GLsizeiptr size = (GLsizeiptr)capacity * frameCount * sizeof(InstanceData);
+
+		glGenBuffers(1, &id);
+		glBindBuffer(GL_ARRAY_BUFFER, id);
+
+		persistent = GLEW_ARB_buffer_storage;
+		if (persistent) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+			mappedPtr = (InstanceData*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+
+			if (!mappedPtr) {
+				std::cout << "ERROR::INSTANCE_BUFFER.H::PERSISTENT MAPPING FAILED, FALLING BACK TO glBufferSubData" << std::endl;
+				persistent = false;
+
+				//Immutable storage can't be respecified so start over with a fresh buffer
+				glDeleteBuffers(1, &id);
+				glGenBuffers(1, &id);
+				glBindBuffer(GL_ARRAY_BUFFER, id);
+			}
+		}
+		if (!persistent) {
+			glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+			staging.resize(capacity);
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	InstanceBuffer(unsigned int capacity) {
+		loadBuffer(capacity);
+	}
+	InstanceBuffer() {};
+	~InstanceBuffer() {
+		deleteBuffer();
+	}
+
+	void deleteBuffer() {
+		if (!id) return;
+
+		for (unsigned int i = 0; i < frameCount; i++)
+			if (fences[i]) {
+				glDeleteSync(fences[i]);
+				fences[i] = 0;
+			}
+
+		if (persistent) {
+			glBindBuffer(GL_ARRAY_BUFFER, id);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+		glDeleteBuffers(1, &id);
+
+		id = 0;
+		mappedPtr = nullptr;
+		staging.clear();
+	}
+
+	//Returns the memory for the current region. Blocks only if the GPU is still reading the region from frameCount frames ago
+	InstanceData* map() {
+		waitForFence(currentRegion);
+		count = 0;
+
+		return persistent ? mappedPtr + (size_t)currentRegion * capacity : staging.data();
+	}
+	//Finishes writing the current region
+	void unmap(unsigned int count) {
+		this->count = count > capacity ? capacity : count;
+
+		if (!persistent && this->count) {
+			glBindBuffer(GL_ARRAY_BUFFER, id);
+			glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)baseInstance() * sizeof(InstanceData), this->count * sizeof(InstanceData), staging.data());
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+	}
+	//Call after every draw that reads the current region was issued
+	void endFrame() {
+		fences[currentRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		currentRegion = (currentRegion + 1) % frameCount;
+	}
+
+	unsigned int baseInstance() const { return currentRegion * capacity; }
+};
+#endif
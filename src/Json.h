@@ -0,0 +1,260 @@
+#pragma once
+#ifndef JSON
+#define JSON
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+//Small DOM JSON reader, enough for glTF. Missing keys and out of range indices return a null value so lookups can be chained
+struct JsonValue {
+	enum Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+
+	Type type = NUL;
+	bool boolean = false;
+	double number = 0.0;
+	std::string string;
+	std::vector<JsonValue> array;
+	std::vector<std::pair<std::string, JsonValue>> object;
+
+	bool isNull() const { return type == NUL; }
+	bool isNumber() const { return type == NUMBER; }
+	bool isString() const { return type == STRING; }
+	bool isArray() const { return type == ARRAY; }
+	bool isObject() const { return type == OBJECT; }
+
+	size_t size() const { return type == ARRAY ? array.size() : type == OBJECT ? object.size() : 0; }
+	bool has(const std::string& key) const { return !(*this)[key].isNull(); }
+
+	const JsonValue& operator[](const std::string& key) const {
+		for (const auto& member : object)
+			if (member.first == key)
+				return member.second;
+		return null();
+	}
+	const JsonValue& operator[](size_t index) const {
+		return index < array.size() ? array[index] : null();
+	}
+
+	double asNumber(double fallback = 0.0) const { return type == NUMBER ? number : fallback; }
+	float asFloat(float fallback = 0.f) const { return type == NUMBER ? (float)number : fallback; }
+	int asInt(int fallback = -1) const { return type == NUMBER ? (int)number : fallback; }
+	size_t asSize(size_t fallback = 0) const { return type == NUMBER && number >= 0.0 ? (size_t)number : fallback; }
+	bool asBool(bool fallback = false) const { return type == BOOLEAN ? boolean : fallback; }
+	const std::string& asString() const { return type == STRING ? string : null().string; }
+
+	static const JsonValue& null() {
+		static const JsonValue value;
+		return value;
+	}
+};
+
+class JsonParser {
+private:
+	const char* begin = nullptr;
+	const char* current = nullptr;
+	const char* end = nullptr;
+	unsigned int depth = 0;
+
+	static const unsigned int maxDepth = 256;
+
+	bool fail(const std::string& message) {
+		if (error.empty())
+			error = message + " at byte " + std::to_string(current - begin);
+		return false;
+	}
+	void skipWhitespace() {
+		while (current < end && (*current == ' ' || *current == '\t' || *current == '\n' || *current == '\r'))
+			current++;
+	}
+	bool consume(const char* literal) {
+		const char* p = current;
+		for (; *literal; literal++, p++)
+			if (p >= end || *p != *literal)
+				return false;
+		current = p;
+		return true;
+	}
+	static void appendUTF8(std::string& out, uint32_t codepoint) {
+		if (codepoint < 0x80)
+			out += (char)codepoint;
+		else if (codepoint < 0x800) {
+			out += (char)(0xC0 | (codepoint >> 6));
+			out += (char)(0x80 | (codepoint & 0x3F));
+		}
+		else if (codepoint < 0x10000) {
+			out += (char)(0xE0 | (codepoint >> 12));
+			out += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+			out += (char)(0x80 | (codepoint & 0x3F));
+		}
+		else {
+			out += (char)(0xF0 | (codepoint >> 18));
+			out += (char)(0x80 | ((codepoint >> 12) & 0x3F));
+			out += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+			out += (char)(0x80 | (codepoint & 0x3F));
+		}
+	}
+	bool parseHex4(uint32_t& value) {
+		if (end - current < 4) return fail("Truncated \\u escape");
+		value = 0;
+		for (int i = 0; i < 4; i++, current++) {
+			char c = *current;
+			value <<= 4;
+			if (c >= '0' && c <= '9') value |= c - '0';
+			else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+			else return fail("Bad \\u escape");
+		}
+		return true;
+	}
+	bool parseString(std::string& out) {
+		current++; //Opening quote
+		while (current < end && *current != '"') {
+			char c = *current++;
+			if (c != '\\') {
+				out += c;
+				continue;
+			}
+			if (current >= end) break;
+
+			switch (*current++) {
+			case '"': out += '"'; break;
+			case '\\': out += '\\'; break;
+			case '/': out += '/'; break;
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u': {
+				uint32_t codepoint;
+				if (!parseHex4(codepoint)) return false;
+				if (codepoint >= 0xD800 && codepoint < 0xDC00 && consume("\\u")) { //Surrogate pair
+					uint32_t low;
+					if (!parseHex4(low)) return false;
+					codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+				}
+				appendUTF8(out, codepoint);
+				break;
+			}
+			default:
+				return fail("Bad escape");
+			}
+		}
+		if (current >= end) return fail("Unterminated string");
+		current++; //Closing quote
+		return true;
+	}
+	bool parseNumber(double& out) {
+		const char* start = current;
+		if (current < end && *current == '-') current++;
+		while (current < end && ((*current >= '0' && *current <= '9') || *current == '.' || *current == 'e' || *current == 'E' || *current == '+' || *current == '-'))
+			current++;
+
+		std::string text(start, current);
+		char* parsedEnd = nullptr;
+		out = std::strtod(text.c_str(), &parsedEnd);
+		if (text.empty() || parsedEnd != text.c_str() + text.size()) {
+			current = start;
+			return fail("Bad number");
+		}
+		return true;
+	}
+	bool parseValue(JsonValue& value) {
+		skipWhitespace();
+		if (current >= end) return fail("Unexpected end");
+		if (++depth > maxDepth) return fail("Nested too deep");
+
+		bool result = true;
+		switch (*current) {
+		case '{': {
+			value.type = JsonValue::OBJECT;
+			current++;
+			skipWhitespace();
+			if (current < end && *current == '}') {
+				current++;
+				break;
+			}
+			while (true) {
+				skipWhitespace();
+				if (current >= end || *current != '"') { result = fail("Expected key"); break; }
+
+				value.object.emplace_back();
+				if (!parseString(value.object.back().first)) { result = false; break; }
+
+				skipWhitespace();
+				if (current >= end || *current != ':') { result = fail("Expected ':'"); break; }
+				current++;
+				if (!parseValue(value.object.back().second)) { result = false; break; }
+
+				skipWhitespace();
+				if (current < end && *current == ',') { current++; continue; }
+				if (current < end && *current == '}') { current++; break; }
+				result = fail("Expected ',' or '}'");
+				break;
+			}
+			break;
+		}
+		case '[': {
+			value.type = JsonValue::ARRAY;
+			current++;
+			skipWhitespace();
+			if (current < end && *current == ']') {
+				current++;
+				break;
+			}
+			while (true) {
+				value.array.emplace_back();
+				if (!parseValue(value.array.back())) { result = false; break; }
+
+				skipWhitespace();
+				if (current < end && *current == ',') { current++; continue; }
+				if (current < end && *current == ']') { current++; break; }
+				result = fail("Expected ',' or ']'");
+				break;
+			}
+			break;
+		}
+		case '"':
+			value.type = JsonValue::STRING;
+			result = parseString(value.string);
+			break;
+		case 't':
+			value.type = JsonValue::BOOLEAN;
+			value.boolean = true;
+			result = consume("true") || fail("Bad literal");
+			break;
+		case 'f':
+			value.type = JsonValue::BOOLEAN;
+			result = consume("false") || fail("Bad literal");
+			break;
+		case 'n':
+			result = consume("null") || fail("Bad literal");
+			break;
+		default:
+			value.type = JsonValue::NUMBER;
+			result = parseNumber(value.number);
+			break;
+		}
+
+		depth--;
+		return result;
+	}
+public:
+	std::string error;
+
+	bool parse(const char* text, size_t length, JsonValue& root) {
+		begin = current = text;
+		end = text + length;
+		depth = 0;
+		error.clear();
+		root = JsonValue();
+
+		if (!parseValue(root)) return false;
+		skipWhitespace();
+		return current == end || fail("Trailing characters");
+	}
+};
+#endif
\ No newline at end of file
@@ -5,9 +5,19 @@
 #include<GLM/glm.hpp>
 #include "Shader.h"
 
+#include <algorithm>
+#include <cmath>
+
+//set() takes the struct's uniform name, the member names only extend its hash so nothing is allocated per call
 struct Light {
     glm::vec3 diffuse;
     float intensity;
+
+    //Distance where the inverse square falloff drops below 1/256 of the brightest channel
+    float range() const {
+        float brightest = std::max(diffuse.r, std::max(diffuse.g, diffuse.b)) * intensity;
+        return std::sqrt(brightest * 256.f);
+    }
 };
 class DirLight : public Light {
 public:
@@ -22,7 +32,7 @@ public:
 
         this->intensity = intensity;
     }
-    void set(Shader& shader, std::string lightName) {
+    void set(Shader& shader, UniformName lightName) {
         shader.setVec3(lightName + ".direction", dir);
 
         //shader.setVec3(lightName + ".ambient", ambient);
@@ -53,7 +63,7 @@ public:
 
         this->intensity = intensity;
     }
-    void set(Shader& shader, std::string lightName) {
+    void set(Shader& shader, UniformName lightName) {
         shader.setVec3(lightName + ".position", pos);
 
         //shader.setVec3(lightName + ".ambient", ambient);
@@ -112,7 +122,7 @@ public:
             std::cout << "WARNING::LIGHT.H::SPOTLIGHT::Inner cut off is bigger than the outer cut off!" << std::endl;
         cosOuterCutOff = glm::cos(glm::radians(outerCutOff)); 
     }
-    void set(Shader& shader, std::string lightName) {
+    void set(Shader& shader, UniformName lightName) {
         shader.setVec3(lightName + ".position", pos);
         shader.setVec3(lightName + ".direction", dir);
 
@@ -0,0 +1,162 @@
+#pragma once
+#ifndef LIGHT_CLUSTERS
+#define LIGHT_CLUSTERS
+
+#include <GLEW/glew.h>
+#include <GLAD/gl.h>
+
+#include <GLM/glm.hpp>
+
+#include "Shader.h"
+#include "Light.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//Storage buffer binding points of Shaders/Common/clusters.glsl and visibility.glsl. HiZCuller uses 0-3 while it culls
+enum StorageBinding : GLuint {
+	CLUSTER_LIGHTS_BINDING = 4,
+	CLUSTER_COUNTS_BINDING = 5,
+	CLUSTER_INDICES_BINDING = 6,
+	VISIBILITY_VERTICES_BINDING = 7,
+	VISIBILITY_INDICES_BINDING = 8,
+	VISIBILITY_DRAWS_BINDING = 9
+};
+
+//std430 mirror of ClusterLight
+struct ClusterLightData {
+	glm::vec3 position;
+	float range;
+	glm::vec3 diffuse;
+	float intensity;
+	glm::vec3 direction;
+	float cutOff; //Cosines
+	float outerCutOff;
+	uint32_t type;
+	int32_t shadow; //Index in the Shadows block's lightShadows, -1 unshadowed
+	float padding;
+
+	static const uint32_t pointType = 0, spotType = 1;
+
+	ClusterLightData(const PointLight& light, int32_t shadow) : position(light.pos), range(light.range()), diffuse(light.diffuse), intensity(light.intensity),
+		direction(0.f), cutOff(-1.f), outerCutOff(-1.f), type(pointType), shadow(shadow), padding(0.f) {}
+	ClusterLightData(const SpotLight& light, int32_t shadow) : position(light.pos), range(light.range()), diffuse(light.diffuse), intensity(light.intensity),
+		direction(light.dir), cutOff(light.cosCutOff), outerCutOff(light.cosOuterCutOff), type(spotType), shadow(shadow), padding(0.f) {}
+};
+static_assert(sizeof(ClusterLightData) == 64 && offsetof(ClusterLightData, direction) == 32 && offsetof(ClusterLightData, shadow) == 56, "ClusterLightData doesn't match std430");
+
+//Clustered light culling on the GPU. Every frame the lights are uploaded to a storage buffer and a compute shader fills each cluster of the
+//view frustum(screen tiles times exponential depth slices) with the lights whose range touches it. Shaders with CLUSTERED_LIGHTS then only
+//loop over their cluster's list, so the shading cost follows the lights near a pixel instead of the lights in the scene.
+class LightClusters {
+private:
+	Shader cullShader;
+	GLuint lightBuffer = 0, countBuffer = 0, indexBuffer = 0;
+	size_t lightCapacity = 0;
+	std::vector<ClusterLightData> lights;
+
+	GLuint timestampQueries[2][2] = {}; //Before and after the dispatch, two frames in flight
+	bool timestampsIssued[2] = { false, false };
+	unsigned int queryFrame = 0;
+
+	//Reads the other frame's timestamps, never waits on the GPU
+	void readTimings() {
+		queryFrame ^= 1;
+		if (!timestampsIssued[queryFrame]) return;
+
+		GLint available = 0;
+		glGetQueryObjectiv(timestampQueries[queryFrame][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) return;
+
+		GLuint64 stamps[2];
+		for (int i = 0; i < 2; i++)
+			glGetQueryObjectui64v(timestampQueries[queryFrame][i], GL_QUERY_RESULT, &stamps[i]);
+		gpuTime = (stamps[1] - stamps[0]) / 1000000.f;
+	}
+public:
+	//CLUSTER_X, CLUSTER_Y, CLUSTER_Z and MAX_LIGHTS_PER_CLUSTER in clusters.glsl
+	static const unsigned int gridX = 16, gridY = 9, gridZ = 24;
+	static const unsigned int clusterCount = gridX * gridY * gridZ;
+	static const unsigned int maxLightsPerCluster = 256;
+	static const unsigned int threads = 128; //CLUSTER_THREADS in clusterCull.comp
+
+	float gpuTime = 0.f; //Culling dispatch in ms, a frame late
+
+	static bool supported() {
+		return GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object;
+	}
+
+	void init() {
+		cullShader.loadComputeShader("Shaders/Lighting/clusterCull.comp");
+
+		glGenBuffers(1, &countBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, clusterCount * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+
+		glGenBuffers(1, &indexBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)clusterCount * maxLightsPerCluster * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+
+		glGenBuffers(1, &lightBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		reserve(1024);
+
+		glGenQueries(4, &timestampQueries[0][0]);
+	}
+	~LightClusters() {
+		if (!lightBuffer) return;
+
+		glDeleteBuffers(1, &lightBuffer);
+		glDeleteBuffers(1, &countBuffer);
+		glDeleteBuffers(1, &indexBuffer);
+		glDeleteQueries(4, &timestampQueries[0][0]);
+	}
+	//Grows the light buffer, never shrinks
+	void reserve(size_t count) {
+		if (count <= lightCapacity) return;
+		lightCapacity = std::max(count, lightCapacity * 2);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, lightCapacity * sizeof(ClusterLightData), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	void clear() { lights.clear(); }
+	void add(const PointLight& light, int32_t shadow = -1) { lights.emplace_back(light, shadow); }
+	void add(const SpotLight& light, int32_t shadow = -1) { lights.emplace_back(light, shadow); }
+	size_t lightCount() const { return lights.size(); }
+
+	//Uploads the lights added since clear() and binds them to CLUSTER_LIGHTS_BINDING, for passes that cull them on their own
+	void upload() {
+		reserve(lights.size());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, lightCapacity * sizeof(ClusterLightData), NULL, GL_DYNAMIC_DRAW); //Orphaned so last frame's draws keep theirs
+		if (!lights.empty())
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, lights.size() * sizeof(ClusterLightData), lights.data());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_LIGHTS_BINDING, lightBuffer);
+	}
+	//Uploads the lights added since clear() and rebuilds the clusters for proj(the view comes from the Camera block).
+	//Leaves the buffers bound for the shading passes
+	void update(const glm::mat4& proj) {
+		upload();
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_COUNTS_BINDING, countBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_INDICES_BINDING, indexBuffer);
+
+		readTimings();
+		glQueryCounter(timestampQueries[queryFrame][0], GL_TIMESTAMP);
+
+		cullShader.use();
+		cullShader.setMat4("inverseProj", glm::inverse(proj));
+		cullShader.set1ui("lightCount", (GLuint)lights.size());
+		glDispatchCompute((clusterCount + threads - 1) / threads, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		glQueryCounter(timestampQueries[queryFrame][1], GL_TIMESTAMP);
+		timestampsIssued[queryFrame] = true;
+	}
+};
+#endif
\ No newline at end of file
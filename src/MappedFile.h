@@ -0,0 +1,108 @@
+#pragma once
+#ifndef MAPPED_FILE
+#define MAPPED_FILE
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+//Read-only memory mapped file. Pages are read by the OS on first touch, so parsing or uploading from it skips the copy into a heap buffer
+class MappedFile {
+private:
+	const uint8_t* bytes = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#endif
+public:
+	MappedFile() {};
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept {
+		*this = std::move(other);
+	}
+	MappedFile& operator=(MappedFile&& other) noexcept {
+		if (this == &other) return *this;
+
+		close();
+		bytes = std::exchange(other.bytes, nullptr);
+		length = std::exchange(other.length, 0);
+#ifdef _WIN32
+		file = std::exchange(other.file, INVALID_HANDLE_VALUE);
+		mapping = std::exchange(other.mapping, nullptr);
+#endif
+		return *this;
+	}
+	~MappedFile() {
+		close();
+	}
+
+	const uint8_t* data() const { return bytes; }
+	size_t size() const { return length; }
+
+	bool open(const std::string& path) {
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE) return false;
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+			close();
+			return false;
+		}
+		length = (size_t)fileSize.QuadPart;
+
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping)
+			bytes = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd == -1) return false;
+
+		struct stat info;
+		if (fstat(fd, &info) == 0 && info.st_size > 0) {
+			length = (size_t)info.st_size;
+			void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapped != MAP_FAILED)
+				bytes = (const uint8_t*)mapped;
+		}
+		::close(fd); //The mapping keeps the file alive
+#endif
+		if (!bytes) {
+			close();
+			return false;
+		}
+		return true;
+	}
+	void close() {
+#ifdef _WIN32
+		if (bytes) UnmapViewOfFile(bytes);
+		if (mapping) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+		mapping = nullptr;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (bytes) munmap((void*)bytes, length);
+#endif
+		bytes = nullptr;
+		length = 0;
+	}
+};
+#endif
\ No newline at end of file
@@ -4,7 +4,9 @@
 #include <iostream>
 
 #include "Shader.h"
+#include "Flags.h"
 #include "Texture.h"
+#include "AsyncLoader.h"
 
 class Material {
 public:
@@ -15,6 +17,11 @@ public:
 	Texture AO; //Ambient occlusion
 	float shininessExponent = 32.f;
 
+	//Multiply the textures, glTF's metallic-roughness factors. Slots without a texture get a white one when these matter
+	glm::vec3 albedoFactor = glm::vec3(1.f);
+	float metallicFactor = 1.f;
+	float roughnessFactor = 1.f;
+
 	bool initialized = false;
 
 	Material(std::string albedo, std::string normal = "", std::string metallic = "", std::string roughness = "", std::string AO = "") {
@@ -48,6 +55,22 @@ public:
 		AO.bind(4);
 
 		shader.set1f("shininessExponent", shininessExponent);
+		shader.setVec3("albedoFactor", albedoFactor);
+		shader.set1f("metallicFactor", metallicFactor);
+		shader.set1f("roughnessFactor", roughnessFactor);
+	}
+	//ShaderFeature map bits of the slots holding a real texture, the variant compiled for them samples only those
+	uint32_t features() const {
+		uint32_t result = 0;
+		if (hasMap(albedo)) result |= ShaderFeature_albedoMap;
+		if (hasMap(normal)) result |= ShaderFeature_normalMap;
+		if (hasMap(metallic)) result |= ShaderFeature_metallicMap;
+		if (hasMap(roughness)) result |= ShaderFeature_roughnessMap;
+		if (hasMap(AO)) result |= ShaderFeature_AOMap;
+		return result;
+	}
+	static bool hasMap(const Texture& texture) {
+		return texture.id && texture.path != whiteTexturePath;
 	}
 	void unbind() {
 		albedo.unbind(0); //If it was loaded then you can bind it
@@ -63,6 +86,24 @@ public:
 		this->roughness.loadTexture(roughness);
 		this->AO.loadTexture(AO);
 
+		this->initialized = true;
+	}
+	//Same as loadTextures but the files are decoded on a worker, only the uploads happen on the GL thread
+	Task<void> loadTexturesAsync(std::string albedo = "", std::string normal = "", std::string metallic = "", std::string roughness = "", std::string AO = "") {
+		std::string paths[5] = { albedo, normal, metallic, roughness, AO };
+		Texture* textures[5] = { &this->albedo, &this->normal, &this->metallic, &this->roughness, &this->AO };
+		ImageData images[5];
+
+		co_await asyncScheduler.toWorker();
+		for (int i = 0; i < 5; i++)
+			images[i] = Texture::decodeImage(paths[i]);
+
+		co_await asyncScheduler.toMainThread();
+		for (int i = 0; i < 5; i++) {
+			textures[i]->loadFromImage(images[i]);
+			images[i].release();
+		}
+
 		this->initialized = true;
 	}
 };
@@ -8,10 +8,16 @@
 #include <GLM/gtc/matrix_transform.hpp>
 
 #include "Shader.h"
+#include "ShaderVariants.h"
 #include "Texture.h"
 #include "Vertex.h"
 #include "Material.h"
+#include "Bounds.h"
+#include "InstanceBuffer.h"
+#include "Stats.h"
 
+#include <algorithm>
+#include <climits>
 #include <string>
 #include <vector>
 
@@ -64,13 +70,25 @@ public:
 	std::vector<Vertex>       vertices;
 	std::vector<unsigned int> indices;
 	unsigned int VAO, VBO, EBO;
+	unsigned int instanceBufferID = 0; //Instance buffer currently attached to the VAO
+	Bounds bounds; //Model space
+
+	//What the draws use, meshes uploaded straight from a file keep no CPU copy of their vertices
+	unsigned int vertexCount = 0;
+	unsigned int indexCount = 0; //0 draws non-indexed
+	GLenum indexType = GL_UNSIGNED_INT;
 
 	void setupMesh(){
+		bounds.compute(vertices);
+		vertexCount = (unsigned int)vertices.size();
+		indexCount = (unsigned int)indices.size();
+		indexType = GL_UNSIGNED_INT;
+
 		glGenVertexArrays(1, &VAO);
 		glGenBuffers(1, &VBO);
 		glGenBuffers(1, &EBO);
 
-		glBindVertexArray(VAO);
+		glState.bindVertexArray(VAO);
 
 		glBindBuffer(GL_ARRAY_BUFFER, VBO);
 		
@@ -83,13 +101,87 @@ public:
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
 		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
 		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
-		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, tangent));
+		glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, tangent));
 		
 		glEnableVertexAttribArray(0);
 		glEnableVertexAttribArray(1);
 		glEnableVertexAttribArray(2);
 		glEnableVertexAttribArray(3);
 	}
+	//Points an attribute at a range of a buffer in whatever layout it came in(glTF buffer views). The VAO has to be bound
+	void setupAttribute(GLuint location, GLuint buffer, GLint components, GLenum type, bool normalized, GLsizei stride, size_t offset) {
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glVertexAttribPointer(location, components, type, normalized, stride, (void*)offset);
+		glEnableVertexAttribArray(location);
+	}
+	//Attaches the per-instance attributes(locations 4-9) to the VAO. Only done when the buffer changes
+	void setupInstanceAttributes(unsigned int instanceBuffer) {
+		if (instanceBufferID == instanceBuffer) return;
+		instanceBufferID = instanceBuffer;
+
+		glState.bindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+
+		for (unsigned int i = 0; i < 4; i++) { //A mat4 takes 4 attribute locations
+			glVertexAttribPointer(4 + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offsetof(InstanceData, model) + i * sizeof(glm::vec4)));
+			glEnableVertexAttribArray(4 + i);
+			glVertexAttribDivisor(4 + i, 1);
+		}
+		glVertexAttribPointer(8, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offsetof(InstanceData, tint));
+		glEnableVertexAttribArray(8);
+		glVertexAttribDivisor(8, 1);
+
+		glVertexAttribIPointer(9, 1, GL_UNSIGNED_INT, sizeof(InstanceData), (void*)offsetof(InstanceData, materialIndex));
+		glEnableVertexAttribArray(9);
+		glVertexAttribDivisor(9, 1);
+
+		glState.bindVertexArray(0);
+	}
+	//Draws the whole mesh with the bound program and textures
+	void draw() {
+		glState.bindVertexArray(VAO);
+
+		if (!indexCount)
+			glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+		else
+			glDrawElements(GL_TRIANGLES, indexCount, indexType, 0);
+		renderStats.drawCalls++;
+	}
+	//Draws the whole mesh count times with the bound program, which tells the copies apart by gl_InstanceID
+	void drawCopies(unsigned int count) {
+		glState.bindVertexArray(VAO);
+
+		if (!indexCount)
+			glDrawArraysInstanced(GL_TRIANGLES, 0, vertexCount, count);
+		else
+			glDrawElementsInstanced(GL_TRIANGLES, indexCount, indexType, 0, count);
+		renderStats.drawCalls++;
+		renderStats.instances += count;
+	}
+	//Draws count instances of the current region of the buffer starting at first(all of them by default). The VAO has to be bound
+	void drawInstances(InstanceBuffer& instances, unsigned int first = 0, unsigned int count = UINT_MAX) {
+		if (first >= instances.count) return;
+		count = std::min(count, instances.count - first);
+
+		if (!indexCount)
+			glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, vertexCount, count, instances.baseInstance() + first);
+		else
+			glDrawElementsInstancedBaseInstance(GL_TRIANGLES, indexCount, indexType, 0, count, instances.baseInstance() + first);
+
+		renderStats.drawCalls++;
+		renderStats.instances += count;
+	}
+	//Draws with the command at offset in commandBuffer, written on the GPU. The VAO has to be bound
+	void drawIndirect(GLuint commandBuffer, GLintptr offset) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+		if (!indexCount)
+			glMultiDrawArraysIndirect(GL_TRIANGLES, (void*)offset, 1, 5 * sizeof(GLuint));
+		else
+			glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, (void*)offset, 1, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+		renderStats.drawCalls++;
+	}
 };
 class ClassicMesh : public Mesh {
 public:
@@ -103,14 +195,23 @@ public:
 
 	void Draw(Shader& shader) {
 		shader.use();
-		glBindVertexArray(VAO);
+		draw();
+	}
+	void DrawInstanced(Shader& shader, InstanceBuffer& instances, unsigned int first = 0, unsigned int count = UINT_MAX) {
+		if (!instances.count) return;
+
+		shader.use();
+		setupInstanceAttributes(instances.id);
+		glState.bindVertexArray(VAO);
 
-		if (indices.empty())
-			glDrawArrays(GL_TRIANGLES, 0, vertices.size());
-		else
-			glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+		drawInstances(instances, first, count);
+	}
+	void DrawIndirect(Shader& shader, GLuint instanceBuffer, GLuint commandBuffer, GLintptr offset) {
+		shader.use();
+		setupInstanceAttributes(instanceBuffer);
+		glState.bindVertexArray(VAO);
 
-		glBindVertexArray(0);
+		drawIndirect(commandBuffer, offset);
 	}
 };
 class MaterialMesh : public Mesh {
@@ -137,15 +238,34 @@ public:
 		shader.use();
 
 		currentMaterial->bind(shader);
-		glBindVertexArray(VAO);
-		
-		if (indices.empty())
-			glDrawArrays(GL_TRIANGLES, 0, vertices.size());
-		else
-			glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+		draw();
+	}
+	//Draws with the variant for features plus the maps of the material that mapMask lets through
+	void Draw(ShaderVariants& variants, uint32_t features, uint32_t mapMask, const glm::mat4& model) {
+		Shader& shader = variants.get(features | (currentMaterial->features() & mapMask));
+		shader.use();
+		shader.setMat4("model", model);
+		Draw(shader);
+	}
+	void DrawInstanced(Shader& shader, InstanceBuffer& instances, unsigned int first = 0, unsigned int count = UINT_MAX) {
+		if (!instances.count) return;
 
-		glBindVertexArray(0);
-		currentMaterial->unbind();
+		shader.use();
+
+		currentMaterial->bind(shader);
+		setupInstanceAttributes(instances.id);
+		glState.bindVertexArray(VAO);
+
+		drawInstances(instances, first, count);
+	}
+	void DrawIndirect(Shader& shader, GLuint instanceBuffer, GLuint commandBuffer, GLintptr offset) {
+		shader.use();
+
+		currentMaterial->bind(shader);
+		setupInstanceAttributes(instanceBuffer);
+		glState.bindVertexArray(VAO);
+
+		drawIndirect(commandBuffer, offset);
 	}
 };
 class Skybox { //TODO: EVERYTHING HERE IS MESSED UP AND HAS TO BE FIXED
@@ -156,7 +276,7 @@ private:
 		glGenVertexArrays(1, &VAO);
 		glGenBuffers(1, &VBO);
 
-		glBindVertexArray(VAO);
+		glState.bindVertexArray(VAO);
 
 		glBindBuffer(GL_ARRAY_BUFFER, VBO);
 
@@ -185,23 +305,23 @@ public:
 
 		texture.bind(thisID);
 
-		glDepthMask(GL_FALSE);
-		glDepthFunc(GL_LEQUAL);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, thisID);
+		glState.depthMask(GL_FALSE);
+		glState.depthFunc(GL_LEQUAL);
+		glState.bindTexture(GL_TEXTURE_CUBE_MAP, thisID);
 
 		shader.use();
 		shader.setMat4("view", glm::mat4(glm::mat3(view)));
 		shader.setMat4("proj", proj);
 
 		// draw mesh
-		glBindVertexArray(VAO);
+		glState.bindVertexArray(VAO);
 		glDrawArrays(GL_TRIANGLES, 0, 36);
-		glBindVertexArray(0);
-		glActiveTexture(GL_TEXTURE0);
+		renderStats.drawCalls++;
+		glState.activeTexture(GL_TEXTURE0);
 
 		//Default the options
-		glDepthMask(GL_TRUE);
-		glDepthFunc(GL_LESS);
+		glState.depthMask(GL_TRUE);
+		glState.depthFunc(GL_LESS);
 	}
 };
 class HDRSkybox{
@@ -225,7 +345,7 @@ public:
 		glGenVertexArrays(1, &VAO);
 		glGenBuffers(1, &VBO);
 
-		glBindVertexArray(VAO);
+		glState.bindVertexArray(VAO);
 
 		glBindBuffer(GL_ARRAY_BUFFER, VBO);
 
@@ -236,19 +356,17 @@ public:
 		glEnableVertexAttribArray(0);
 	}
 	void Draw(Shader& shader) {
-		glDepthFunc(GL_LEQUAL);
+		glState.depthFunc(GL_LEQUAL);
 
 		shader.use();
 
 		texturePtr->bind(0);
-		glBindVertexArray(VAO);
+		glState.bindVertexArray(VAO);
 		
 		glDrawArrays(GL_TRIANGLES, 0, 36);
+		renderStats.drawCalls++;
 
-		glBindVertexArray(0);
-		texturePtr->unbind(0);
-
-		glDepthFunc(GL_LESS);
+		glState.depthFunc(GL_LESS);
 	}
 };
 class RenderQuad : public Mesh{
@@ -265,21 +383,19 @@ public:
 		// draw mesh
 		shader.use();
 
-		for(int i = 0; i < textureIDs.size(); i++){
-			glActiveTexture(GL_TEXTURE0 + i + offset);
-			glBindTexture(GL_TEXTURE_2D, textureIDs[i]);
-		}
+		for(int i = 0; i < textureIDs.size(); i++)
+			glState.bindTexture(GL_TEXTURE0 + i + offset, GL_TEXTURE_2D, textureIDs[i]);
 
-		glDepthFunc(GL_ALWAYS);
-		glBindVertexArray(VAO);
+		glState.depthFunc(GL_ALWAYS);
+		glState.bindVertexArray(VAO);
 
-		if (indices.empty())
-			glDrawArrays(GL_TRIANGLES, 0, vertices.size());
+		if (!indexCount)
+			glDrawArrays(GL_TRIANGLES, 0, vertexCount);
 		else
-			glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+			glDrawElements(GL_TRIANGLES, indexCount, indexType, 0);
+		renderStats.drawCalls++;
 
-		glDepthFunc(GL_LESS);
-		glBindVertexArray(0);
+		glState.depthFunc(GL_LESS);
 	}
 };
 #endif
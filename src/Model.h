@@ -16,6 +16,10 @@
 #include "Texture.h"
 #include "Vertex.h"
 #include "Material.h"
+#include "Bounds.h"
+#include "AsyncLoader.h"
+#include "Tangents.h"
+#include "GLTFLoader.h"
 
 #include <string>
 #include <fstream>
@@ -24,15 +28,38 @@
 #include <map>
 #include <vector>
 #include <algorithm>
+#include <thread>
 
 using namespace std;
 
+//CPU side of a mesh, built on a worker before anything is uploaded
+struct MeshData {
+	vector<Vertex> vertices;
+	vector<unsigned int> indices;
+	string texturePaths[5]; //Albedo, normal, metallic, roughness, AO
+	bool hasMaterial = false;
+	bool hasTexCoords = false; //Tangents need UVs
+};
+struct ModelData {
+	vector<MeshData> meshes;
+	map<string, ImageData> images; //Decoded pixels by path
+	map<string, Texture*> textures; //Already uploaded, owned by the first mesh using them
+
+	void releaseImages() {
+		for (auto& image : images)
+			image.second.release();
+		images.clear();
+	}
+};
+
 class Model{
 public:
 	vector<Texture> textures_loaded;
 	vector<Texture*> loadedTextures;
 	vector<MaterialMesh>    meshes;
+	vector<GLuint> buffers; //Shared by the meshes, glTF buffer views
 	string directory;
+	Bounds bounds; //Union of the mesh bounds, model space
 
 	//glm::mat4 localModelMat;
 
@@ -47,6 +74,9 @@ public:
 		for (int i = 0; i < loadedTextures.size(); i++) {
 			delete loadedTextures[i];
 		}
+
+		if (!buffers.empty())
+			glDeleteBuffers((GLsizei)buffers.size(), buffers.data());
 	}
 	Model() {};
 
@@ -54,31 +84,133 @@ public:
 		for (unsigned int i = 0; i < meshes.size(); i++)
 			meshes[i].Draw(shader);
 	}
+	void Draw(ShaderVariants& variants, uint32_t features, uint32_t mapMask, const glm::mat4& model) {
+		for (unsigned int i = 0; i < meshes.size(); i++)
+			meshes[i].Draw(variants, features, mapMask, model);
+	}
+	void DrawInstanced(Shader& shader, InstanceBuffer& instances, unsigned int first = 0, unsigned int count = UINT_MAX) {
+		for (unsigned int i = 0; i < meshes.size(); i++)
+			meshes[i].DrawInstanced(shader, instances, first, count);
+	}
+	//Material maps every mesh has, for drawing the whole model with one variant(instancing, indirect draws)
+	uint32_t commonFeatures() const {
+		if (meshes.empty()) return 0;
+
+		uint32_t features = ShaderFeature_materialMaps;
+		for (const MaterialMesh& mesh : meshes)
+			features &= mesh.currentMaterial->features();
+		return features;
+	}
+	//Bounds of the meshes held now, loads merge theirs in from there so a reload doesn't keep stale extents
+	void resetBounds() {
+		bounds = Bounds();
+		for (const MaterialMesh& mesh : meshes)
+			bounds.merge(mesh.bounds);
+	}
 	void loadModel(string const& path){
+		resetBounds();
+		if (GLTFFile::isGLTF(path)) {
+			GLTFFile file;
+			if (!file.open(path)) {
+				cout << "ERROR::GLTFLOADER.H::" << file.error << " in " << path << endl;
+				return;
+			}
+
+			meshes.reserve(meshes.size() + file.primitives.size());
+			for (size_t i = 0; i < file.primitives.size(); i++)
+				bounds.merge(file.uploadPrimitive(i, meshes, buffers).bounds);
+			return;
+		}
+
+		ModelData data;
+		if (!importModel(path, data)) return;
+
+		decodeImages(data);
+		meshes.reserve(meshes.size() + data.meshes.size());
+		for (MeshData& mesh : data.meshes)
+			uploadMesh(mesh, data);
+		data.releaseImages();
+	}
+	//Same result as loadModel. Assimp and the image decoding run on a worker, then the meshes are uploaded on the GL thread one per step
+	//so a frame never waits for the whole model. The model must stay alive and unused until the task completes
+	Task<bool> loadModelAsync(string path) {
+		resetBounds();
+		if (GLTFFile::isGLTF(path))
+			co_return co_await loadGLTFAsync(path);
+
+		co_await asyncScheduler.toWorker();
+		ModelData data;
+		bool imported = importModel(path, data);
+		if (imported)
+			decodeImages(data);
+
+		co_await asyncScheduler.toMainThread();
+		if (!imported) co_return false;
+
+		meshes.reserve(meshes.size() + data.meshes.size());
+		for (MeshData& mesh : data.meshes) {
+			uploadMesh(mesh, data);
+			co_await asyncScheduler.toMainThread(); //Yield, the rest waits for the next frame if the upload budget ran out
+		}
+		data.releaseImages();
+		co_return true;
+	}
+
+	//glTF files skip Assimp, see GLTFFile
+	Task<bool> loadGLTFAsync(string path) {
+		co_await asyncScheduler.toWorker();
+		GLTFFile file;
+		bool opened = file.open(path);
+
+		co_await asyncScheduler.toMainThread();
+		if (!opened) {
+			cout << "ERROR::GLTFLOADER.H::" << file.error << " in " << path << endl;
+			co_return false;
+		}
+
+		meshes.reserve(meshes.size() + file.primitives.size());
+		for (size_t i = 0; i < file.primitives.size(); i++) {
+			bounds.merge(file.uploadPrimitive(i, meshes, buffers).bounds);
+			co_await asyncScheduler.toMainThread();
+		}
+		co_return true;
+	}
+
+	//CPU side of loading, doesn't touch GL so it can run on any thread
+	bool importModel(string const& path, ModelData& data){
 		Assimp::Importer importer;
-		const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace | aiProcess_OptimizeMeshes | aiProcess_OptimizeGraph); //aiProcess_OptimizeMeshes | aiProcess_OptimizeGraph
+		const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_OptimizeMeshes | aiProcess_OptimizeGraph); //aiProcess_OptimizeMeshes | aiProcess_OptimizeGraph
 		
 		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode){
 			cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-			return;
+			return false;
 		}
 		directory = path.substr(0, max((int)path.find_last_of('/'), (int)path.find_last_of('\\')));
 
-		processNode(scene->mRootNode, scene);
+		processNode(scene->mRootNode, scene, data);
+
+		//Tangents are ours instead of aiProcess_CalcTangentSpace: MikkTSpace rules, handedness kept and multithreaded
+		TangentGenerator tangents;
+		tangents.threadCount = std::max(1u, std::thread::hardware_concurrency());
+		for (MeshData& mesh : data.meshes)
+			if (mesh.hasTexCoords)
+				tangents.generate(mesh.vertices, mesh.indices);
+		return true;
 	}
-	void processNode(aiNode* node, const aiScene* scene){
+	void processNode(aiNode* node, const aiScene* scene, ModelData& data){
 		for (unsigned int i = 0; i < node->mNumMeshes; i++){
 			aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-			meshes.push_back(processMesh(mesh, scene, node));
+			data.meshes.push_back(processMesh(mesh, scene, node));
 		}
 		for (unsigned int i = 0; i < node->mNumChildren; i++){
-			processNode(node->mChildren[i], scene);
+			processNode(node->mChildren[i], scene, data);
 		}
 	}
-	MaterialMesh processMesh(aiMesh* mesh, const aiScene* scene, aiNode* node){
-		vector<Vertex> vertices;
-		vector<unsigned int> indices;
-
+	MeshData processMesh(aiMesh* mesh, const aiScene* scene, aiNode* node){
+		MeshData data;
+		data.hasTexCoords = mesh->mTextureCoords[0] != nullptr;
+		vector<Vertex>& vertices = data.vertices;
+		vector<unsigned int>& indices = data.indices;
 		for (unsigned int i = 0; i < mesh->mNumVertices; i++){
 			Vertex vertex;
 			glm::vec3 vector;
@@ -99,11 +231,6 @@ public:
 				vec.x = mesh->mTextureCoords[0][i].x;
 				vec.y = mesh->mTextureCoords[0][i].y;
 				vertex.texCoord = vec;
-
-				vector.x = mesh->mTangents[i].x;
-				vector.y = mesh->mTangents[i].y;
-				vector.z = mesh->mTangents[i].z;
-				vertex.tangent = vector;
 			}
 			else
 				vertex.texCoord = glm::vec2(0.0f, 0.0f);
@@ -116,18 +243,16 @@ public:
 				indices.push_back(face.mIndices[j]);
 		}
 
-		MaterialMesh finalMesh(vertices, indices);
-
 		if (scene->HasMaterials()) {
 			aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
 
-			loadMaterial(finalMesh.material.albedo, material, aiTextureType_DIFFUSE);
-			loadMaterial(finalMesh.material.normal, material, aiTextureType_HEIGHT);
-			loadMaterial(finalMesh.material.metallic, material, aiTextureType_METALNESS);
-			loadMaterial(finalMesh.material.roughness, material, aiTextureType_DIFFUSE_ROUGHNESS);
-			loadMaterial(finalMesh.material.AO, material, aiTextureType_LIGHTMAP);
+			data.texturePaths[0] = materialPath(material, aiTextureType_DIFFUSE);
+			data.texturePaths[1] = materialPath(material, aiTextureType_HEIGHT);
+			data.texturePaths[2] = materialPath(material, aiTextureType_METALNESS);
+			data.texturePaths[3] = materialPath(material, aiTextureType_DIFFUSE_ROUGHNESS);
+			data.texturePaths[4] = materialPath(material, aiTextureType_LIGHTMAP);
 
-			finalMesh.material.initialized = true;
+			data.hasMaterial = true;
 		}
 		/*
 		for (size_t row = 0; row < 4; row++) {
@@ -137,7 +262,7 @@ public:
 		}
 		*/
 
-		return finalMesh;
+		return data;
 	}
 	/*vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName) {
 		vector<Texture> textures;
@@ -169,27 +294,45 @@ public:
 		return textures;
 	}
 	*/
-	void loadMaterial(Texture& materialTexture, aiMaterial* material, aiTextureType type) {
+	string materialPath(aiMaterial* material, aiTextureType type) {
 		aiString texturePath;
-		if (material->GetTexture(type, 0, &texturePath) == -1) return;
+		if (material->GetTexture(type, 0, &texturePath) == -1) return "";
 
-		std::string path = this->directory + "/" + texturePath.C_Str();
+		return this->directory + "/" + texturePath.C_Str();
+	}
+	//Every texture file used by the model is decoded once, meshes sharing it share the GL texture too
+	void decodeImages(ModelData& data) {
+		for (const MeshData& mesh : data.meshes)
+			for (const string& path : mesh.texturePaths)
+				if (path != "" && !data.images.count(path))
+					data.images[path] = Texture::decodeImage(path);
+	}
+	//GL side of loading. Meshes are built in place, copying a MaterialMesh would copy its textures' ownership
+	void uploadMesh(MeshData& data, ModelData& model) {
+		meshes.emplace_back(std::move(data.vertices), std::move(data.indices));
+		MaterialMesh& mesh = meshes.back();
+		bounds.merge(mesh.bounds);
 
-		bool skip = false;
+		if (!data.hasMaterial) return;
 
-		for (int i = 0; i < textures_loaded.size(); i++) {
-			if (textures_loaded[i].path == path) {
-				skip = true;
+		Texture* textures[5] = { &mesh.material.albedo, &mesh.material.normal, &mesh.material.metallic, &mesh.material.roughness, &mesh.material.AO };
+		for (int i = 0; i < 5; i++)
+			loadMaterial(*textures[i], data.texturePaths[i], model);
 
-				materialTexture = textures_loaded[i];
+		mesh.material.initialized = true;
+	}
+	void loadMaterial(Texture& materialTexture, const string& path, ModelData& model) {
+		if (path == "") return;
 
-				break;
-			}
-		}
-		if (!skip) { // && std::strcmp(texturePath.C_Str(), "") != 0
-			materialTexture.loadTexture(path);
-			textures_loaded.push_back(materialTexture);
+		auto loaded = model.textures.find(path);
+		if (loaded != model.textures.end()) {
+			materialTexture.share(*loaded->second);
+			return;
 		}
+
+		materialTexture.loadFromImage(model.images[path]);
+		if (materialTexture.id)
+			model.textures[path] = &materialTexture;
 	}
 };
-#endif
+#endif
\ No newline at end of file
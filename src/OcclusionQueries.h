@@ -0,0 +1,159 @@
+#pragma once
+#ifndef OCCLUSION_QUERIES
+#define OCCLUSION_QUERIES
+
+#include <GLEW/glew.h>
+#include <GLAD/gl.h>
+
+#include <GLM/glm.hpp>
+
+#include "Shader.h"
+#include "Query.h"
+#include "Bounds.h"
+
+#include <cstdint>
+#include <vector>
+
+//Occlusion culling with hardware queries, for GPUs without the compute path. Each object keeps the visibility of its latest available result:
+//  visible objects are drawn inside a query over their real geometry, so the result says whether they're still visible
+//  hidden objects render a bounding box proxy into a query and the real draw is predicated on it with conditional rendering
+//Results are read frames later through a QueryPool so the CPU never waits, the same frame decision happens on the GPU.
+//Per frame: beginFrame(), drawVisible() for every object, drawProxies(), drawConditional() for every object.
+class OcclusionQueryCuller {
+private:
+	QueryPool pool;
+	Shader proxyShader;
+	GLuint VAO = 0, VBO = 0, EBO = 0;
+
+	std::vector<unsigned int> proxyQueries; //Query each hidden object's proxy used this frame, 0 if none
+	std::vector<AABB> proxyBoxes;
+	std::vector<uint8_t> needsProxy; //Hidden objects submitted this frame, the others are outside the frustum
+
+	void setupProxyMesh() {
+		//Unit cube, the vertex shader stretches it over the box
+		float vertices[] = {
+			0.f, 0.f, 0.f,  1.f, 0.f, 0.f,  1.f, 1.f, 0.f,  0.f, 1.f, 0.f,
+			0.f, 0.f, 1.f,  1.f, 0.f, 1.f,  1.f, 1.f, 1.f,  0.f, 1.f, 1.f
+		};
+		unsigned int indices[] = {
+			0, 2, 1,  0, 3, 2, //Back
+			4, 5, 6,  4, 6, 7, //Front
+			0, 4, 7,  0, 7, 3, //Left
+			1, 2, 6,  1, 6, 5, //Right
+			0, 1, 5,  0, 5, 4, //Bottom
+			3, 7, 6,  3, 6, 2  //Top
+		};
+
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &EBO);
+
+		glState.bindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
+		glState.bindVertexArray(0);
+	}
+public:
+	std::vector<uint8_t> visible;
+
+	//Stats of the current frame
+	unsigned int proxiesDrawn = 0;
+	unsigned int conditionalDraws = 0;
+
+	static unsigned int queryType() {
+		//Conservative queries are cheaper and only need core 4.3 or ES3 compatibility, the exact ones are core 3.3
+		return GLEW_ARB_ES3_compatibility ? GL_ANY_SAMPLES_PASSED_CONSERVATIVE : GL_ANY_SAMPLES_PASSED;
+	}
+
+	void init() {
+		proxyShader.loadShader("Shaders/Culling/proxy.vert", "Shaders/Culling/proxy.frag");
+		pool.loadPool(queryType());
+		setupProxyMesh();
+	}
+	~OcclusionQueryCuller() {
+		if (!VAO) return;
+
+		glState.deleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+	}
+
+	//Collects the results that are ready. New objects start visible so they are drawn and queried right away
+	void beginFrame(size_t objectCount) {
+		if (visible.size() != objectCount)
+			visible.assign(objectCount, 1);
+
+		pool.beginFrame([this](unsigned int owner, unsigned int result) {
+			if (owner < visible.size())
+				visible[owner] = result != 0;
+		});
+
+		proxyQueries.assign(objectCount, 0);
+		proxyBoxes.resize(objectCount);
+		needsProxy.assign(objectCount, 0);
+		proxiesDrawn = 0;
+		conditionalDraws = 0;
+	}
+	//Pass 1: objects visible last time are drawn for real and become the occluders. Hidden ones only remember their box for the proxy pass
+	template<typename Func>
+	void drawVisible(unsigned int id, const AABB& box, const glm::vec3& camPos, Func draw) {
+		//From inside the box the proxy's faces get clipped, so just draw it
+		if (glm::all(glm::greaterThanEqual(camPos, box.min)) && glm::all(glm::lessThanEqual(camPos, box.max)))
+			visible[id] = 1;
+
+		if (!visible[id]) {
+			proxyBoxes[id] = box;
+			needsProxy[id] = 1;
+			return;
+		}
+
+		unsigned int query = pool.acquire(id);
+		glBeginQuery(pool.type, query);
+		draw();
+		glEndQuery(pool.type);
+	}
+	//Pass 2: depth tested boxes of every hidden object, no color or depth writes
+	void drawProxies(const glm::mat4& PV) {
+		proxyShader.use();
+		proxyShader.setMat4("PVMat", PV);
+
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glState.depthMask(GL_FALSE);
+		glState.disable(GL_CULL_FACE);
+		glState.bindVertexArray(VAO);
+
+		for (unsigned int id = 0; id < visible.size(); id++) {
+			if (!needsProxy[id]) continue;
+
+			proxyShader.setVec3("boxMin", proxyBoxes[id].min);
+			proxyShader.setVec3("boxMax", proxyBoxes[id].max);
+
+			proxyQueries[id] = pool.acquire(id);
+			glBeginQuery(pool.type, proxyQueries[id]);
+			glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+			glEndQuery(pool.type);
+			proxiesDrawn++;
+		}
+
+		glState.bindVertexArray(0);
+		glState.enable(GL_CULL_FACE);
+		glState.depthMask(GL_TRUE);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	}
+	//Pass 3: the real draw of hidden objects, skipped by the GPU when no proxy sample passed
+	template<typename Func>
+	void drawConditional(unsigned int id, Func draw) {
+		if (!proxyQueries[id]) return;
+
+		glBeginConditionalRender(proxyQueries[id], GL_QUERY_WAIT);
+		draw();
+		glEndConditionalRender();
+		conditionalDraws++;
+	}
+};
+#endif
@@ -0,0 +1,142 @@
+#pragma once
+#ifndef PROGRAM_CACHE
+#define PROGRAM_CACHE
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//Linked programs saved with glGetProgramBinary so later launches skip compiling and linking.
+//The key hashes every stage's final source(includes expanded, defines injected) with the driver's vendor, renderer and version,
+//so an edited shader, another variant or a driver update simply misses. A binary the driver rejects is a miss too, the caller compiles instead.
+class ProgramCache {
+private:
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;
+		uint32_t format;
+		uint32_t length;
+	};
+	static const uint32_t magic = 0x42505347; //"GSPB"
+	static const uint32_t fileVersion = 1;
+
+	std::string driver;
+	int supportedState = -1; //-1 until asked
+
+	std::string path(uint64_t key) const {
+		char name[17];
+		std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+		return directory + name + ".bin";
+	}
+public:
+	std::string directory = "ShaderCache/";
+	bool enabled = true;
+
+	//Since launch
+	unsigned int hits = 0;
+	unsigned int misses = 0;
+	unsigned int rejected = 0; //Found but the driver refused it
+
+	//FNV-1a, 64 bit so thousands of variants don't collide
+	static uint64_t hash(const std::string& text, uint64_t hash = 14695981039346656037ull) {
+		for (unsigned char c : text)
+			hash = (hash ^ c) * 1099511628211ull;
+		return hash;
+	}
+
+	//Needs a current context. Drivers may expose the entry points with zero formats, which means there is nothing to cache
+	bool supported() {
+		if (supportedState < 0) {
+			GLint formats = 0;
+			if (GLEW_ARB_get_program_binary)
+				glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+			supportedState = formats > 0;
+
+			driver = std::string((const char*)glGetString(GL_VENDOR)) + "|" + (const char*)glGetString(GL_RENDERER) + "|" + (const char*)glGetString(GL_VERSION);
+		}
+		return enabled && supportedState == 1;
+	}
+
+	//Stages in a fixed order, an empty string for a missing stage still moves the hash so vertex+fragment can't match fragment+geometry
+	uint64_t key(std::initializer_list<const std::string*> sources) {
+		supported();
+		uint64_t result = hash(driver);
+		for (const std::string* source : sources)
+			result = hash("\x1f", hash(*source, result));
+		return result;
+	}
+
+	//Tells GL to keep the binary around, call before glLinkProgram
+	void prepare(GLuint program) {
+		if (supported())
+			glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
+	//Links program from the cached binary. On false the program is untouched(or unlinked) and has to be compiled
+	bool load(GLuint program, uint64_t key) {
+		if (!supported()) return false;
+
+		std::ifstream file(path(key), std::ios::binary);
+		Header header{};
+		if (!file.is_open() || !file.read((char*)&header, sizeof(header)) || header.magic != magic || header.version != fileVersion || header.key != key) {
+			misses++;
+			return false;
+		}
+
+		std::vector<char> binary(header.length);
+		if (!file.read(binary.data(), binary.size())) {
+			misses++;
+			return false;
+		}
+
+		glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+		GLint success = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (!success) {
+			rejected++;
+			return false;
+		}
+
+		hits++;
+		return true;
+	}
+	//Saves a linked program, failures only cost the next launch a compile
+	void store(GLuint program, uint64_t key) {
+		if (!supported()) return;
+
+		GLint linked = 0, length = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (!linked || length <= 0) return;
+
+		std::vector<char> binary(length);
+		GLenum format = 0;
+		glGetProgramBinary(program, length, &length, &format, binary.data());
+
+		std::error_code error;
+		std::filesystem::create_directories(directory, error);
+		std::ofstream file(path(key), std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			std::cout << "ERROR::PROGRAMCACHE.H::COULDN'T WRITE " << path(key) << std::endl;
+			return;
+		}
+
+		Header header{ magic, fileVersion, key, format, (uint32_t)length };
+		file.write((const char*)&header, sizeof(header));
+		file.write(binary.data(), length);
+	}
+
+	//Deletes every cached binary, the next loads recompile
+	void clear() {
+		std::error_code error;
+		std::filesystem::remove_all(directory, error);
+	}
+};
+ProgramCache programCache;
+#endif
\ No newline at end of file
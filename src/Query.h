@@ -6,6 +6,7 @@
 #include <GLFW/glfw3.h>
 
 #include <iostream>
+#include <vector>
 
 class Query {
 public:
@@ -107,4 +108,68 @@ public:
 		glGetQueryObjectiv(this->id, GL_QUERY_RESULT, &this->result);
 	}
 };
+//Query objects recycled over a few frames so results are only read once the GPU is done with them.
+//acquire() hands out a query for this frame, beginFrame() reports the results of the oldest frame that are available and never waits for the rest
+class QueryPool {
+public:
+	static const unsigned int frameLatency = 3;
+private:
+	std::vector<unsigned int> queries[frameLatency];
+	std::vector<unsigned int> owners[frameLatency];
+	unsigned int used[frameLatency] = {};
+	unsigned int frame = 0;
+public:
+	unsigned int type = 0;
+	unsigned int pending = 0; //Results dropped because they weren't ready after frameLatency frames
+
+	void loadPool(unsigned int type) {
+		deletePool();
+		this->type = type;
+	}
+	QueryPool(unsigned int type) {
+		loadPool(type);
+	}
+	QueryPool() {};
+	~QueryPool() {
+		deletePool();
+	}
+	void deletePool() {
+		for (unsigned int i = 0; i < frameLatency; i++) {
+			if (!queries[i].empty())
+				glDeleteQueries((int)queries[i].size(), queries[i].data());
+			queries[i].clear();
+			owners[i].clear();
+			used[i] = 0;
+		}
+	}
+
+	//onResult(owner, result) is called for every available query of the frame being recycled
+	template<typename Func>
+	void beginFrame(Func onResult) {
+		frame = (frame + 1) % frameLatency;
+
+		for (unsigned int i = 0; i < used[frame]; i++) {
+			int available = 0;
+			glGetQueryObjectiv(queries[frame][i], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) {
+				pending++;
+				continue;
+			}
+			unsigned int result = 0;
+			glGetQueryObjectuiv(queries[frame][i], GL_QUERY_RESULT, &result);
+			onResult(owners[frame][i], result);
+		}
+		used[frame] = 0;
+	}
+	unsigned int acquire(unsigned int owner) {
+		if (used[frame] == queries[frame].size()) {
+			unsigned int id;
+			glGenQueries(1, &id);
+			queries[frame].push_back(id);
+			owners[frame].push_back(owner);
+		}
+		owners[frame][used[frame]] = owner;
+		return queries[frame][used[frame]++];
+	}
+};
 #endif
\ No newline at end of file
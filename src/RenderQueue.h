@@ -0,0 +1,187 @@
+#pragma once
+#ifndef RENDER_QUEUE
+#define RENDER_QUEUE
+
+#include <GLM/glm.hpp>
+
+#include "Shader.h"
+#include "Mesh.h"
+#include "Material.h"
+#include "GLState.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+//Passes in submission order, the top bits of every sort key
+enum DrawPass : uint8_t {
+	DrawPass_opaque = 0,
+	DrawPass_sky = 1 //After the opaque geometry so depth testing rejects the covered sky
+};
+
+//Draws that aren't a material mesh(the skybox, instanced batches). Gets the packet's data
+typedef void (*DrawCallback)(void* data);
+
+//Everything submit() needs for one draw. Plain data, pointers have to stay valid until submit()
+struct DrawPacket {
+	uint64_t key;
+	Shader* shader;
+	MaterialMesh* mesh;
+	const glm::mat4* model;
+	DrawCallback callback; //Drawn instead of mesh when set
+	void* data;
+};
+static_assert(std::is_trivially_copyable<DrawPacket>::value, "DrawPacket has to stay POD");
+
+//Draws of a frame collected as packets, radix sorted on their 64 bit key and submitted in that order.
+//Key from the highest bit: pass(4) | program(12) | material(16) | mesh(12) | depth(20), so a pass runs each program once, material and mesh binds
+//only change within it, and opaque draws sharing all three go front to back. The IDs are GL names cut to their field, a collision only costs order.
+class RenderQueue {
+private:
+	struct SortItem {
+		uint64_t key;
+		uint32_t packet;
+		uint32_t padding;
+	};
+	std::vector<DrawPacket> packets;
+	std::vector<SortItem> items, scratch;
+	bool sorted = false;
+
+	static uint64_t field(uint32_t value, unsigned int bits, unsigned int shift) {
+		return (uint64_t(value) & ((1ull << bits) - 1)) << shift;
+	}
+	void buildItems() {
+		items.resize(packets.size());
+		for (size_t i = 0; i < packets.size(); i++)
+			items[i] = { packets[i].key, (uint32_t)i, 0 };
+	}
+public:
+	static const unsigned int passBits = 4, programBits = 12, materialBits = 16, meshBits = 12, depthBits = 20;
+
+	//Of the last sort() and submit()
+	float sortTime = 0.f; //In ms
+	float submitTime = 0.f;
+	unsigned int programChanges = 0;
+	unsigned int materialChanges = 0;
+	unsigned int meshChanges = 0;
+
+	//depth is 0(near) to 1(far), outside is clamped
+	static uint64_t makeKey(uint8_t pass, uint32_t program, uint32_t material, uint32_t mesh, float depth) {
+		uint32_t quantized = (uint32_t)(std::clamp(depth, 0.f, 1.f) * float((1u << depthBits) - 1));
+		return field(pass, passBits, 60) | field(program, programBits, 48) | field(material, materialBits, 32) | field(mesh, meshBits, 20) | field(quantized, depthBits, 0);
+	}
+
+	void clear() {
+		packets.clear();
+		sorted = false;
+	}
+	void reserve(size_t count) {
+		packets.reserve(count);
+		items.reserve(count);
+		scratch.reserve(count);
+	}
+	void add(const DrawPacket& packet) {
+		packets.push_back(packet);
+		sorted = false;
+	}
+	//Materials are keyed by their albedo texture, the binds materials share are filtered by GLState anyway
+	void addMesh(uint8_t pass, Shader& shader, MaterialMesh& mesh, const glm::mat4& model, float depth) {
+		add({ makeKey(pass, shader.ID, mesh.currentMaterial->albedo.id, mesh.VAO, depth), &shader, &mesh, &model, nullptr, nullptr });
+	}
+	//program groups it with the packets of that program
+	void addCallback(uint8_t pass, DrawCallback callback, void* data = nullptr, uint32_t program = 0, float depth = 0.f) {
+		add({ makeKey(pass, program, 0, 0, depth), nullptr, nullptr, nullptr, callback, data });
+	}
+	size_t size() const { return packets.size(); }
+
+	//LSD radix sort, a byte per pass. All 8 histograms come from one read and bytes every key shares are skipped, usually the pass and program ones
+	void sort() {
+		auto start = std::chrono::high_resolution_clock::now();
+
+		buildItems();
+		size_t count = items.size();
+		scratch.resize(count);
+
+		uint32_t histograms[8][256] = {};
+		for (const SortItem& item : items)
+			for (unsigned int byte = 0; byte < 8; byte++)
+				histograms[byte][(item.key >> (byte * 8)) & 0xFF]++;
+
+		SortItem* source = items.data();
+		SortItem* destination = scratch.data();
+		for (unsigned int byte = 0; byte < 8 && count; byte++) {
+			uint32_t* histogram = histograms[byte];
+			unsigned int shift = byte * 8;
+			if (histogram[(source[0].key >> shift) & 0xFF] == count) continue;
+
+			uint32_t offset = 0;
+			for (unsigned int i = 0; i < 256; i++) {
+				uint32_t bucket = histogram[i];
+				histogram[i] = offset;
+				offset += bucket;
+			}
+			for (size_t i = 0; i < count; i++)
+				destination[histogram[(source[i].key >> shift) & 0xFF]++] = source[i];
+			std::swap(source, destination);
+		}
+		if (source != items.data())
+			items.swap(scratch);
+
+		sorted = true;
+		sortTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+	//std::sort on the same items, for comparison
+	void sortComparison() {
+		auto start = std::chrono::high_resolution_clock::now();
+
+		buildItems();
+		std::sort(items.begin(), items.end(), [](const SortItem& a, const SortItem& b) { return a.key < b.key; });
+
+		sorted = true;
+		sortTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	//Draws every packet in key order(in the order they were added when not sorted), binding a program, material or mesh only when it changes
+	void submit() {
+		auto start = std::chrono::high_resolution_clock::now();
+		if (!sorted) buildItems();
+
+		programChanges = materialChanges = meshChanges = 0;
+		Shader* shader = nullptr;
+		Material* material = nullptr;
+		GLuint VAO = 0;
+		for (const SortItem& item : items) {
+			const DrawPacket& packet = packets[item.packet];
+			if (packet.callback) {
+				packet.callback(packet.data);
+				shader = nullptr; //Callbacks bind what they like
+				material = nullptr;
+				VAO = 0;
+				continue;
+			}
+
+			if (packet.shader != shader) {
+				shader = packet.shader;
+				shader->use();
+				material = nullptr; //Material uniforms live in the program
+				programChanges++;
+			}
+			if (packet.mesh->currentMaterial != material) {
+				material = packet.mesh->currentMaterial;
+				material->bind(*shader);
+				materialChanges++;
+			}
+			if (packet.mesh->VAO != VAO) {
+				VAO = packet.mesh->VAO;
+				meshChanges++;
+			}
+			shader->setMat4("model", *packet.model);
+			packet.mesh->draw();
+		}
+
+		submitTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+};
+#endif
\ No newline at end of file
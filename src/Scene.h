@@ -0,0 +1,390 @@
+#pragma once
+#ifndef SCENE
+#define SCENE
+
+#include <GLM/glm.hpp>
+#include <GLM/gtc/matrix_transform.hpp>
+
+#include "Shader.h"
+#include "Model.h"
+#include "Bounds.h"
+#include "Culling.h"
+#include "BVH.h"
+#include "RenderQueue.h"
+#include "VisibilityBuffer.h"
+#include "ShadowCascades.h"
+#include "ShadowAtlas.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+//Entity handle: lower 24 bits are the index, upper 8 bits the generation so stale handles to recycled indices can be detected
+typedef uint32_t Entity;
+const Entity nullEntity = 0xFFFFFFFF;
+
+inline uint32_t entityIndex(Entity entity) { return entity & 0x00FFFFFF; }
+inline uint32_t entityGeneration(Entity entity) { return entity >> 24; }
+
+//Components
+struct Transform {
+	glm::vec3 position = glm::vec3(0.f);
+	glm::vec3 rotation = glm::vec3(0.f); //Euler angles in degrees
+	glm::vec3 scale = glm::vec3(1.f);
+	glm::mat4 spin = glm::mat4(1.f); //Extra rotation around the world Y axis, written by the spinner system
+
+	glm::mat4 matrix = glm::mat4(1.f); //Cached world matrix
+	bool dirty = true;
+
+	Transform(glm::vec3 position = glm::vec3(0.f), glm::vec3 rotation = glm::vec3(0.f), glm::vec3 scale = glm::vec3(1.f)) {
+		this->position = position;
+		this->rotation = rotation;
+		this->scale = scale;
+	}
+	void updateMatrix() {
+		glm::mat4 rotMat(1.f);
+		if (rotation != glm::vec3(0.f)) {
+			rotMat = glm::rotate(rotMat, glm::radians(rotation.x), glm::vec3(1.f, 0.f, 0.f));
+			rotMat = glm::rotate(rotMat, glm::radians(rotation.y), glm::vec3(0.f, 1.f, 0.f));
+			rotMat = glm::rotate(rotMat, glm::radians(rotation.z), glm::vec3(0.f, 0.f, 1.f));
+		}
+		matrix = glm::translate(glm::mat4(1.f), position) * spin * rotMat * glm::scale(glm::mat4(1.f), scale);
+		dirty = false;
+	}
+};
+struct Spinner {
+	bool enabled = false;
+	float speed = .75f; //Radians per second
+};
+struct MeshRenderer {
+	Model* model = nullptr;
+
+	//Correction applied in model space before the entity's transform(e.g. FBX files that are rotated or in centimeters)
+	Transform local;
+	glm::mat4 worldMatrix = glm::mat4(1.f);
+	bool visible = true; //Written by the culling system
+
+	MeshRenderer(Model* model = nullptr, Transform local = Transform()) {
+		this->model = model;
+		this->local = local;
+	}
+};
+
+//Sparse set storage. Components of one type are packed in a dense array so systems iterate them linearly
+class BasePool {
+public:
+	virtual ~BasePool() {};
+	virtual void remove(Entity entity) = 0;
+	virtual bool has(Entity entity) const = 0;
+	virtual size_t size() const = 0;
+};
+template<typename T>
+class ComponentPool : public BasePool {
+public:
+	static const uint32_t invalidIndex = 0xFFFFFFFF;
+
+	std::vector<T> components;     //Dense
+	std::vector<Entity> entities;  //Dense, entities[i] owns components[i]
+	std::vector<uint32_t> sparse;  //Entity index -> dense index
+
+	void reserve(size_t count) {
+		components.reserve(count);
+		entities.reserve(count);
+	}
+	T& add(Entity entity, const T& component) {
+		uint32_t index = entityIndex(entity);
+		if (index >= sparse.size())
+			sparse.resize(index + 1, invalidIndex);
+
+		if (sparse[index] != invalidIndex) { //Already has the component so just overwrite it
+			entities[sparse[index]] = entity;
+			return components[sparse[index]] = component;
+		}
+
+		sparse[index] = (uint32_t)components.size();
+		entities.push_back(entity);
+		components.push_back(component);
+
+		return components.back();
+	}
+	void remove(Entity entity) override {
+		if (!has(entity)) return;
+
+		//Swap with the last element to keep the array packed
+		uint32_t removed = sparse[entityIndex(entity)];
+		uint32_t last = (uint32_t)components.size() - 1;
+
+		if (removed != last) {
+			components[removed] = std::move(components[last]);
+			entities[removed] = entities[last];
+			sparse[entityIndex(entities[removed])] = removed;
+		}
+		components.pop_back();
+		entities.pop_back();
+		sparse[entityIndex(entity)] = invalidIndex;
+	}
+	bool has(Entity entity) const override {
+		uint32_t index = entityIndex(entity);
+		return index < sparse.size() && sparse[index] != invalidIndex && entities[sparse[index]] == entity;
+	}
+	T& get(Entity entity) { return components[sparse[entityIndex(entity)]]; }
+	size_t size() const override { return components.size(); }
+};
+
+class Registry {
+private:
+	std::vector<uint8_t> generations;
+	std::vector<uint32_t> freeIndices;
+	std::vector<std::unique_ptr<BasePool>> pools; //Indexed by component type ID
+
+	static size_t nextTypeID() {
+		static size_t counter = 0;
+		return counter++;
+	}
+	template<typename T>
+	static size_t typeID() {
+		static size_t id = nextTypeID();
+		return id;
+	}
+public:
+	size_t aliveCount = 0;
+
+	Entity create() {
+		uint32_t index;
+		if (!freeIndices.empty()) {
+			index = freeIndices.back();
+			freeIndices.pop_back();
+		}
+		else {
+			index = (uint32_t)generations.size();
+			generations.push_back(0);
+		}
+		aliveCount++;
+
+		return (Entity(generations[index]) << 24) | index;
+	}
+	void destroy(Entity entity) {
+		if (!valid(entity)) return;
+
+		for (auto& pool : pools)
+			if (pool) pool->remove(entity);
+
+		uint32_t index = entityIndex(entity);
+		generations[index]++;
+		freeIndices.push_back(index);
+		aliveCount--;
+	}
+	bool valid(Entity entity) const {
+		uint32_t index = entityIndex(entity);
+		return entity != nullEntity && index < generations.size() && generations[index] == entityGeneration(entity);
+	}
+	void clear() {
+		generations.clear();
+		freeIndices.clear();
+		pools.clear();
+		aliveCount = 0;
+	}
+
+	template<typename T>
+	ComponentPool<T>& pool() {
+		size_t id = typeID<T>();
+		if (id >= pools.size())
+			pools.resize(id + 1);
+		if (!pools[id])
+			pools[id] = std::make_unique<ComponentPool<T>>();
+
+		return *static_cast<ComponentPool<T>*>(pools[id].get());
+	}
+	template<typename T>
+	T& add(Entity entity, const T& component = T()) { return pool<T>().add(entity, component); }
+	template<typename T>
+	void remove(Entity entity) { pool<T>().remove(entity); }
+	template<typename T>
+	bool has(Entity entity) { return pool<T>().has(entity); }
+	template<typename T>
+	T& get(Entity entity) { return pool<T>().get(entity); }
+
+	//Calls func(entity, component) for every component of type T
+	template<typename T, typename Func>
+	void each(Func func) {
+		ComponentPool<T>& p = pool<T>();
+		for (size_t i = 0; i < p.components.size(); i++)
+			func(p.entities[i], p.components[i]);
+	}
+	//Calls func(entity, a, b) for every entity that has both components. Iterates the dense array of A so put the rarer component first
+	template<typename A, typename B, typename Func>
+	void view(Func func) {
+		ComponentPool<A>& a = pool<A>();
+		ComponentPool<B>& b = pool<B>();
+		for (size_t i = 0; i < a.components.size(); i++) {
+			Entity entity = a.entities[i];
+			if (b.has(entity))
+				func(entity, a.components[i], b.get(entity));
+		}
+	}
+};
+
+class Scene : public Registry {
+private:
+	std::vector<AABB> bvhBoxes;
+	std::vector<uint32_t> queryResult;
+public:
+	//Acceleration structure over the world boxes of every entity with Bounds. bvhEntities[prim] maps a BVH primitive back to its entity
+	BVH bvh;
+	std::vector<Entity> bvhEntities;
+	bool bvhRebuilt = false; //Whether the last updateBVH() rebuilt instead of refitting
+
+	//Systems
+	void updateTransforms(float deltaTime) {
+		view<Spinner, Transform>([deltaTime](Entity, Spinner& spinner, Transform& transform) {
+			if (!spinner.enabled) return;
+
+			transform.spin = glm::rotate(transform.spin, spinner.speed * deltaTime, glm::vec3(0.f, 1.f, 0.f));
+			transform.dirty = true;
+		});
+		each<Transform>([](Entity, Transform& transform) {
+			if (transform.dirty) transform.updateMatrix();
+		});
+		ComponentPool<Bounds>& bounds = pool<Bounds>();
+		view<MeshRenderer, Transform>([&bounds](Entity entity, MeshRenderer& renderer, Transform& transform) {
+			if (renderer.local.dirty) renderer.local.updateMatrix();
+			renderer.worldMatrix = transform.matrix * renderer.local.matrix;
+
+			if (renderer.model && bounds.has(entity))
+				bounds.get(entity) = renderer.model->bounds.transformed(renderer.worldMatrix);
+		});
+	}
+	//Tests the world bounds of every renderer against the frustum. Renderers without a Bounds component are always drawn
+	void cull(const Frustum& frustum, FrustumCuller& culler) {
+		culler.clear();
+		each<Bounds>([&culler](Entity, Bounds& bounds) {
+			culler.add(bounds.sphere);
+		});
+		culler.cull(frustum);
+
+		ComponentPool<Bounds>& bounds = pool<Bounds>();
+		ComponentPool<MeshRenderer>& renderers = pool<MeshRenderer>();
+		for (size_t i = 0; i < bounds.entities.size(); i++)
+			if (renderers.has(bounds.entities[i]))
+				renderers.get(bounds.entities[i]).visible = culler.visible[i];
+	}
+	//Same as cull() but walks the BVH so whole subtrees outside the frustum are skipped. The counts are of renderers, not BVH primitives
+	void cullBVH(const Frustum& frustum, unsigned int& visibleCount, unsigned int& culledCount) {
+		ComponentPool<MeshRenderer>& renderers = pool<MeshRenderer>();
+		for (Entity entity : bvhEntities)
+			if (renderers.has(entity))
+				renderers.get(entity).visible = false;
+
+		queryResult.clear();
+		bvh.queryFrustum(frustum, queryResult);
+		for (uint32_t prim : queryResult)
+			if (renderers.has(bvhEntities[prim]))
+				renderers.get(bvhEntities[prim]).visible = true;
+
+		visibleCount = culledCount = 0;
+		for (Entity entity : bvhEntities)
+			if (renderers.has(entity))
+				(renderers.get(entity).visible ? visibleCount : culledCount)++;
+	}
+	void resetVisibility() {
+		each<MeshRenderer>([](Entity, MeshRenderer& renderer) {
+			renderer.visible = true;
+		});
+	}
+	//Refits the BVH to the current world bounds, rebuilds it when entities were added or removed
+	void updateBVH() {
+		ComponentPool<Bounds>& bounds = pool<Bounds>();
+
+		bool changed = bounds.entities != bvhEntities;
+		bvhEntities = bounds.entities;
+		bvhBoxes.resize(bounds.components.size());
+		for (size_t i = 0; i < bounds.components.size(); i++)
+			bvhBoxes[i] = bounds.components[i].box;
+
+		if (changed) {
+			bvh.build(bvhBoxes);
+			bvhRebuilt = true;
+		}
+		else
+			bvhRebuilt = bvh.update(bvhBoxes);
+	}
+	//Closest entity whose world box is hit by the ray, nullEntity on a miss
+	Entity pick(const Ray& ray) {
+		float t;
+		int prim = bvh.raycast(ray, t);
+		return prim < 0 ? nullEntity : bvhEntities[prim];
+	}
+	//Entities whose world box touches the sphere(e.g. the objects a point light reaches)
+	void querySphere(glm::vec3 center, float radius, std::vector<Entity>& result) {
+		queryResult.clear();
+		bvh.querySphere(center, radius, queryResult);
+		for (uint32_t prim : queryResult)
+			result.push_back(bvhEntities[prim]);
+	}
+	void draw(Shader& shader) {
+		shader.use();
+		UniformHandle<glm::mat4> model = shader.uniform<glm::mat4>("model");
+		each<MeshRenderer>([&shader, &model](Entity, MeshRenderer& renderer) {
+			if (!renderer.model || !renderer.visible) return;
+
+			model = renderer.worldMatrix;
+			renderer.model->Draw(shader);
+		});
+	}
+	//Each mesh gets the variant for features plus its material's maps(the ones in mapMask)
+	void draw(ShaderVariants& variants, uint32_t features, uint32_t mapMask) {
+		each<MeshRenderer>([&variants, features, mapMask](Entity, MeshRenderer& renderer) {
+			if (!renderer.model || !renderer.visible) return;
+
+			renderer.model->Draw(variants, features, mapMask, renderer.worldMatrix);
+		});
+	}
+	//Same draws as packets for queue, keyed by the distance of each mesh's center along viewForward(farPlane is depth 1)
+	void submit(RenderQueue& queue, ShaderVariants& variants, uint32_t features, uint32_t mapMask, glm::vec3 viewPos, glm::vec3 viewForward, float farPlane) {
+		each<MeshRenderer>([&](Entity, MeshRenderer& renderer) {
+			if (!renderer.model || !renderer.visible) return;
+
+			for (MaterialMesh& mesh : renderer.model->meshes) {
+				Shader& shader = variants.get(features | (mesh.currentMaterial->features() & mapMask));
+				glm::vec3 center = renderer.worldMatrix * glm::vec4(mesh.bounds.sphere.center, 1.f);
+				queue.addMesh(DrawPass_opaque, shader, mesh, renderer.worldMatrix, glm::dot(center - viewPos, viewForward) / farPlane);
+			}
+		});
+	}
+	//Same draws into the visibility buffer's list
+	void submit(VisibilityBuffer& buffer) {
+		each<MeshRenderer>([&buffer](Entity, MeshRenderer& renderer) {
+			if (!renderer.model || !renderer.visible) return;
+
+			for (MaterialMesh& mesh : renderer.model->meshes)
+				buffer.add(mesh, renderer.worldMatrix);
+		});
+	}
+	//Every mesh as a shadow caster, culled per cascade instead of by the camera
+	void submit(ShadowCascades& cascades) {
+		each<MeshRenderer>([&cascades](Entity, MeshRenderer& renderer) {
+			if (!renderer.model) return;
+
+			for (MaterialMesh& mesh : renderer.model->meshes)
+				cascades.add(mesh, renderer.worldMatrix);
+		});
+	}
+	//Casters of each light atlas.allocate() kept, the meshes the BVH finds in its range
+	void submit(ShadowAtlas& atlas) {
+		std::vector<Entity> entities;
+		for (size_t i = 0; i < atlas.lightCount(); i++) {
+			BoundingSphere range = atlas.lightRange(i);
+			entities.clear();
+			querySphere(range.center, range.radius, entities);
+			for (Entity entity : entities) {
+				if (!has<MeshRenderer>(entity)) continue;
+				MeshRenderer& renderer = get<MeshRenderer>(entity);
+				if (!renderer.model) continue;
+
+				for (MaterialMesh& mesh : renderer.model->meshes)
+					atlas.addCaster(i, mesh, renderer.worldMatrix);
+			}
+		}
+	}
+};
+#endif
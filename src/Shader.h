@@ -5,11 +5,170 @@
 #include<fstream>
 #include<sstream>
 #include<iostream>
+#include<cstdint>
+#include<cstring>
+#include<vector>
+#include<algorithm>
+#include<type_traits>
 #include<GLM/glm.hpp>
+#include<GLM/gtc/type_ptr.hpp>
+
+#include "Stats.h"
+#include "ProgramCache.h"
+#include "GLState.h"
+
+//FNV-1a. constexpr so names written as literals are hashed by the compiler
+constexpr uint32_t uniformHash(const char* text, size_t length, uint32_t hash = 2166136261u) {
+	for (size_t i = 0; i < length; i++)
+		hash = (hash ^ (uint8_t)text[i]) * 16777619u;
+	return hash;
+}
+
+//A uniform name reduced to its hash. Literals are hashed at compile time, names built at runtime("planes[" + i + "]") on the call
+struct UniformName {
+	uint32_t hash;
+#ifdef _DEBUG
+	//Debug builds keep the text too so Shader::findSlot can catch a hash collision. length is -1 when only the hash is known or it didn't fit
+	char text[64] = {};
+	int length = -1;
+
+	constexpr void append(const char* suffix, size_t count) {
+		if (length < 0 || length + count >= sizeof(text)) {
+			length = -1;
+			return;
+		}
+		for (size_t i = 0; i < count; i++)
+			text[length + i] = suffix[i];
+		length += (int)count;
+	}
+#endif
+
+	template<size_t N>
+	consteval UniformName(const char(&name)[N]) : hash(uniformHash(name, N - 1)) {
+#ifdef _DEBUG
+		length = 0;
+		append(name, N - 1);
+#endif
+	}
+	UniformName(const std::string& name) : hash(uniformHash(name.data(), name.size())) {
+#ifdef _DEBUG
+		length = 0;
+		append(name.data(), name.size());
+#endif
+	}
+	constexpr explicit UniformName(uint32_t hash) : hash(hash) {}
+
+	//Continues the hash for struct members and array elements without building a string: lightName + ".position"
+	template<size_t N>
+	constexpr UniformName operator+(const char(&suffix)[N]) const {
+		UniformName result(uniformHash(suffix, N - 1, hash));
+#ifdef _DEBUG
+		for (size_t i = 0; i < sizeof(text); i++)
+			result.text[i] = text[i];
+		result.length = length;
+		result.append(suffix, N - 1);
+#endif
+		return result;
+	}
+};
+
+template<typename T>
+class UniformHandle;
 
 //Note: Shaders remove inactive uniforms i.e. uniforms that don't contribute to the final result.
 class Shader {
 private:
+	struct UniformSlot {
+		uint32_t hash = 0;
+		int location = -1; //-1 marks an empty slot
+		GLenum type = 0;
+		bool shadowed = false; //value holds what the program has
+		alignas(16) unsigned char value[64];
+#ifdef _DEBUG
+		std::string name; //Checked against the looked up name, a different one with the same hash would write here
+#endif
+	};
+	std::vector<UniformSlot> uniforms; //Open addressing on the name hash, power of two sized
+	size_t activeCount = 0;
+	unsigned int generation = 0; //Bumped on every link so handles re-resolve
+
+	void insertUniform(const std::string& name, int location, GLenum type) {
+		uint32_t hash = uniformHash(name.data(), name.size());
+		size_t mask = uniforms.size() - 1;
+		size_t i = hash & mask;
+		for (; uniforms[i].location >= 0; i = (i + 1) & mask) {
+			if (uniforms[i].hash == hash) {
+				std::cout << "WARNING::SHADER.H::Uniform name hash collision on '" << name << "', rename it" << std::endl;
+				return;
+			}
+		}
+		uniforms[i].hash = hash;
+#ifdef _DEBUG
+		uniforms[i].name = name;
+#endif
+		uniforms[i].location = location;
+		uniforms[i].type = type;
+		activeCount++;
+	}
+	//Reads every active uniform once after link. Arrays get one entry per element plus the bare name, like glGetUniformLocation accepts
+	void reflectUniforms() {
+		generation++;
+		uniforms.clear();
+		activeCount = 0;
+
+		GLint success = 0, count = 0, maxLength = 0;
+		glGetProgramiv(ID, GL_LINK_STATUS, &success);
+		if (!success) return;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+		std::vector<std::pair<std::string, GLint>> active;
+		std::vector<GLenum> types;
+		std::vector<char> buffer(std::max(maxLength, 1));
+		size_t entries = 0;
+		for (GLint i = 0; i < count; i++) {
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveUniform(ID, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+			active.emplace_back(std::string(buffer.data(), length), size);
+			types.push_back(type);
+			entries += size + 1;
+		}
+
+		size_t capacity = 16;
+		while (capacity < entries * 2) capacity *= 2;
+		uniforms.assign(capacity, UniformSlot());
+
+		for (size_t i = 0; i < active.size(); i++) {
+			const std::string& name = active[i].first;
+			int location = glGetUniformLocation(ID, name.c_str());
+			if (location < 0) continue; //Uniform block members
+
+			size_t bracket = name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0 ? name.size() - 3 : std::string::npos;
+			if (bracket == std::string::npos) {
+				insertUniform(name, location, types[i]);
+				continue;
+			}
+			std::string base = name.substr(0, bracket);
+			insertUniform(base, location, types[i]);
+			for (GLint element = 0; element < active[i].second; element++) {
+				std::string elementName = base + "[" + std::to_string(element) + "]";
+				insertUniform(elementName, glGetUniformLocation(ID, elementName.c_str()), types[i]);
+			}
+		}
+	}
+
+	static void upload(int location, int value) { glUniform1i(location, value); }
+	static void upload(int location, unsigned int value) { glUniform1ui(location, value); }
+	static void upload(int location, float value) { glUniform1f(location, value); }
+	static void upload(int location, const glm::vec2& value) { glUniform2f(location, value.x, value.y); }
+	static void upload(int location, const glm::ivec2& value) { glUniform2i(location, value.x, value.y); }
+	static void upload(int location, const glm::vec3& value) { glUniform3f(location, value.x, value.y, value.z); }
+	static void upload(int location, const glm::vec4& value) { glUniform4f(location, value.x, value.y, value.z, value.w); }
+	static void upload(int location, const glm::mat3& value) { glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
+	static void upload(int location, const glm::mat4& value) { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
+
 	void checkCompileErrors(GLuint shader, std::string type) {
 		GLint success;
 		GLchar infoLog[1024];
@@ -28,182 +187,278 @@ private:
 			}
 		}
 	}
+	//Stages of a load between beginLoad() and finishLoad()
+	struct PendingStage {
+		GLuint id;
+		const char* type;
+	};
+	std::vector<PendingStage> pendingStages;
+	uint64_t pendingKey = 0;
+	bool pending = false;
+
+	void compileStage(GLenum stage, const std::string& source, const char* type) {
+		const char* content = source.c_str();
+		GLuint id = glCreateShader(stage);
+		glShaderSource(id, 1, &content, NULL);
+		glCompileShader(id);
+		glAttachShader(ID, id);
+		pendingStages.push_back({ id, type });
+	}
+	void link() {
+		programCache.prepare(ID);
+		glLinkProgram(ID);
+	}
 public:
 	unsigned int ID = 0;
-	void loadShader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr) {
-		std::string vertexContent;
-		std::string fragmentContent;
-		std::string geometryContent;
-		std::ifstream vShaderFile;
-		std::ifstream fShaderFile;
-		std::ifstream gShaderFile;
-
-		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		try {
-			vShaderFile.open(vertexPath);
-			fShaderFile.open(fragmentPath);
-
-			std::stringstream vShaderStream, fShaderStream;
-
-			vShaderStream << vShaderFile.rdbuf();
-			fShaderStream << fShaderFile.rdbuf();
-
-			vShaderFile.close();
-			fShaderFile.close();
-
-			vertexContent = vShaderStream.str();
-			fragmentContent = fShaderStream.str();
-
-			if (geometryPath != nullptr){
-				gShaderFile.open(geometryPath);
-				std::stringstream gShaderStream;
-				gShaderStream << gShaderFile.rdbuf();
-				gShaderFile.close();
-				geometryContent = gShaderStream.str();
-			}
-		}
-		catch (std::ifstream::failure e) {
-			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+
+	//Reads a shader file, replacing every #include "file" line(path relative to the including file) with that file's source
+	static std::string readSource(const std::string& path, unsigned int depth = 0) {
+		std::ifstream file(path);
+		if (!file.is_open() || depth > 16) {
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+			return std::string();
 		}
 
-		//Define shaders
-		const char* vShaderContent = vertexContent.c_str();
-		const char* fShaderContent = fragmentContent.c_str();
-		const char* gShaderContent = geometryContent.c_str();
-
-		GLuint vertex = glCreateShader(GL_VERTEX_SHADER);
-		GLuint fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		GLuint geometry = (geometryPath != nullptr) ? glCreateShader(GL_GEOMETRY_SHADER) : 0;
-		int success;
-		char infoLog[512];
-
-		//Vertex Shader
-		glShaderSource(vertex, 1, &vShaderContent, NULL);
-		glCompileShader(vertex);
-		checkCompileErrors(vertex, "VERTEX");
-
-		//Fragment Shader
-		glShaderSource(fragment, 1, &fShaderContent, NULL);
-		glCompileShader(fragment);
-		checkCompileErrors(fragment, "FRAGMENT");
-
-		if (geometryPath != nullptr) {
-			const char* gShaderCode = geometryContent.c_str();
-			geometry = glCreateShader(GL_GEOMETRY_SHADER);
-			glShaderSource(geometry, 1, &gShaderCode, NULL);
-			glCompileShader(geometry);
-			checkCompileErrors(geometry, "GEOMETRY");
+		std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+		std::stringstream source;
+		std::string line;
+		while (std::getline(file, line)) {
+			size_t start = line.find_first_not_of(" \t");
+			if (start != std::string::npos && line.compare(start, 8, "#include") == 0) {
+				size_t open = line.find('"', start);
+				size_t close = line.find('"', open + 1);
+				if (open != std::string::npos && close != std::string::npos) {
+					source << readSource(directory + line.substr(open + 1, close - open - 1), depth + 1);
+					continue;
+				}
+			}
+			source << line << '\n';
 		}
+		return source.str();
+	}
+	//Puts the lines of defines right after #version, which has to stay the first statement. #extension lines go first in defines
+	static std::string injectDefines(const std::string& source, const std::string& defines) {
+		if (defines.empty()) return source;
+
+		size_t version = source.find("#version");
+		size_t insertAt = version == std::string::npos ? 0 : source.find('\n', version);
+		insertAt = insertAt == std::string::npos ? source.size() : insertAt + 1;
+		return source.substr(0, insertAt) + defines + source.substr(insertAt);
+	}
+	//Issues the compiles and the link without asking for any status, so the driver can build many programs at once(see ShaderBuildQueue.h).
+	//The program isn't usable until finishLoad(). defines is prepended to every stage, e.g. "#define NORMAL_MAP\n"
+	void beginLoad(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const std::string& defines = "") {
+		finishLoad(); //A load still in flight is completed first
+
+		std::string vertexContent = injectDefines(readSource(vertexPath), defines);
+		std::string fragmentContent = injectDefines(readSource(fragmentPath), defines);
+		std::string geometryContent = geometryPath != nullptr ? injectDefines(readSource(geometryPath), defines) : std::string();
 
 		//Define shader program
 		if(!ID) ID = glCreateProgram(); //If it doesn't have an ID just give it
 
-		glAttachShader(ID, vertex);
-		glAttachShader(ID, fragment);
-		if (geometryPath != nullptr) glAttachShader(ID, geometry);
-		glLinkProgram(ID);
+		//A binary from an earlier launch skips compiling and linking
+		pendingKey = programCache.key({ &vertexContent, &fragmentContent, &geometryContent });
+		pendingStages.clear();
+		pending = true;
+		if (programCache.load(ID, pendingKey))
+			return;
 
-		//Check for errors
-		glGetProgramiv(ID, GL_LINK_STATUS, &success);
-		if (!success) {
-			glGetProgramInfoLog(ID, 512, NULL, infoLog);
-			std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED" << std::endl << infoLog << std::endl;
+		compileStage(GL_VERTEX_SHADER, vertexContent, "VERTEX");
+		compileStage(GL_FRAGMENT_SHADER, fragmentContent, "FRAGMENT");
+		if (geometryPath != nullptr) compileStage(GL_GEOMETRY_SHADER, geometryContent, "GEOMETRY");
+		link();
+	}
+	//Compute programs(GL 4.3). Uses the same program ID so a reload keeps every reference valid
+	void beginLoadCompute(const char* computePath, const std::string& defines = "") {
+		finishLoad(); //A load still in flight is completed first
+
+		std::string computeContent = injectDefines(readSource(computePath), defines);
+
+		if (!ID) ID = glCreateProgram();
+
+		pendingKey = programCache.key({ &computeContent });
+		pendingStages.clear();
+		pending = true;
+		if (programCache.load(ID, pendingKey))
+			return;
+
+		compileStage(GL_COMPUTE_SHADER, computeContent, "COMPUTE");
+		link();
+	}
+	//True once the driver finished compiling and linking. Without parallel compile support it can't tell and says yes, finishLoad() then blocks
+	bool loadCompleted() const {
+		if (!pending || pendingStages.empty() || !parallelCompileSupported()) return true;
+
+		GLint completed = GL_TRUE;
+		glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &completed);
+		return completed == GL_TRUE;
+	}
+	//Reports the errors, frees the stages, stores the binary and reflects the uniforms. Blocks if the driver is still busy
+	void finishLoad() {
+		if (!pending) return;
+		pending = false;
+
+		if (!pendingStages.empty()) {
+			for (const PendingStage& stage : pendingStages)
+				checkCompileErrors(stage.id, stage.type);
+
+			//Check for errors
+			int success;
+			char infoLog[512];
+			glGetProgramiv(ID, GL_LINK_STATUS, &success);
+			if (!success) {
+				glGetProgramInfoLog(ID, 512, NULL, infoLog);
+				std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED" << std::endl << infoLog << std::endl;
+			}
+			else
+				programCache.store(ID, pendingKey);
+
+			//Clear the shader after they are linked
+			for (const PendingStage& stage : pendingStages) {
+				glDetachShader(ID, stage.id);
+				glDeleteShader(stage.id);
+			}
+			pendingStages.clear();
 		}
 
-		//Clear the shader after they are linked
-		glDetachShader(ID, vertex);
-		glDetachShader(ID, fragment);
-		if (geometryPath != nullptr) glDetachShader(ID, geometry);
+		reflectUniforms();
+	}
+	bool isLoading() const { return pending; }
 
-		glDeleteShader(vertex);
-		glDeleteShader(fragment);
-		if (geometryPath != nullptr) glDeleteShader(geometry);
+	void loadShader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const std::string& defines = "") {
+		beginLoad(vertexPath, fragmentPath, geometryPath, defines);
+		finishLoad();
+	}
+	void loadComputeShader(const char* computePath, const std::string& defines = "") {
+		beginLoadCompute(computePath, defines);
+		finishLoad();
 	}
-	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr) {
-		loadShader(vertexPath, fragmentPath, geometryPath);
+
+	//GL_KHR_parallel_shader_compile or its ARB twin(same enums): compiles run on driver threads and GL_COMPLETION_STATUS can be polled
+	static bool parallelCompileSupported() {
+		return GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+	}
+	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const std::string& defines = "") {
+		loadShader(vertexPath, fragmentPath, geometryPath, defines);
 	};
 	Shader() {};
 	~Shader() { deleteProgram(); };
 
 	int getID() { return ID; };
-	void use() { glUseProgram(ID); };
-	void unuse() { glUseProgram(0); };
-	void deleteProgram() { glDeleteProgram(ID); };
+	void use() { glState.useProgram(ID); };
+	void unuse() { glState.useProgram(0); };
+	void deleteProgram() { glState.deleteProgram(ID); };
 
-	void set1b(const std::string& name, bool value) {
-		int location = glGetUniformLocation(ID, name.c_str());
+	void set1b(UniformName name, bool value) { setUniform(name, (int)value); }
+	void set1i(UniformName name, int value) { setUniform(name, value); }
+	void set1ui(UniformName name, unsigned int value) { setUniform(name, value); }
+	void set1f(UniformName name, float value) { setUniform(name, value); }
+	void setMat3(UniformName name, const glm::mat3& mat3) { setUniform(name, mat3); }
+	void setMat4(UniformName name, const glm::mat4& mat4) { setUniform(name, mat4); }
+	void setVec2(UniformName name, glm::vec2 vec2) { setUniform(name, vec2); }
+	void setVec2i(UniformName name, glm::ivec2 vec2) { setUniform(name, vec2); }
+	void setVec3(UniformName name, glm::vec3 vec3) { setUniform(name, vec3); }
+	void setVec4(UniformName name, glm::vec4 vec4) { setUniform(name, vec4); }
 
-		if (location != -1)
-			glUniform1i(location, (int)value);
-		else
-			return;// std::cout << "WARNING::SHADER.H::An active uniform corresponding to the name '" << name << "' was not found!\n";
+	//Inactive or unknown uniforms are silently ignored, like glUniform does with location -1
+	template<typename T>
+	void setUniform(UniformName name, const T& value) {
+		int slot = findSlot(name);
+		if (slot >= 0) setSlot(slot, value);
 	}
-	void set1i(const std::string& name, int value) {
-		int location = glGetUniformLocation(ID, name.c_str());
-
-		if (location != -1)
-			glUniform1i(location, (int)value);
-		else
-			return; //std::cout << "WARNING::SHADER.H::An active uniform corresponding to the name '" << name << "' was not found!\n";
+	//Location of an active uniform, -1 if the program doesn't have it
+	int getLocation(UniformName name) {
+		int slot = findSlot(name);
+		return slot >= 0 ? uniforms[slot].location : -1;
 	}
-	void set1ui(const std::string& name, unsigned int value) {
-		int location = glGetUniformLocation(ID, name.c_str());
+	//Resolves once, later sets skip the hash lookup. Stays valid across reloads of the program
+	template<typename T>
+	UniformHandle<T> uniform(UniformName name);
 
-		if (location != -1)
-			glUniform1ui(location, (int)value);
-		else
-			return; //std::cout << "WARNING::SHADER.H::An active uniform corresponding to the name '" << name << "' was not found!\n";
-	}
-	void set1f(const std::string& name, float value) {
-		int location = glGetUniformLocation(ID, name.c_str());
+	int findSlot(const UniformName& name) const {
+		if (uniforms.empty()) return -1;
 
-		if (location != -1)
-			glUniform1f(location, (float)value);
-		else
-			return;// std::cout << "WARNING::SHADER.H::An active uniform corresponding to the name '" << name << "' was not found!\n";
+		size_t mask = uniforms.size() - 1;
+		for (size_t i = name.hash & mask; ; i = (i + 1) & mask) {
+			if (uniforms[i].location < 0) return -1;
+			if (uniforms[i].hash != name.hash) continue;
+#ifdef _DEBUG
+			if (name.length >= 0 && uniforms[i].name.compare(0, std::string::npos, name.text, name.length) != 0) {
+				std::cout << "WARNING::SHADER.H::Uniform '" << std::string(name.text, name.length) << "' has the hash of '" << uniforms[i].name << "', rename it" << std::endl;
+				return -1;
+			}
+#endif
+			return (int)i;
+		}
 	}
-	void setMat3(const std::string& name, glm::mat3 mat3) {
-		int location = glGetUniformLocation(ID, name.c_str());
+	//Uploads only when the value differs from what the program already holds. The program has to be bound, like with glUniform
+	template<typename T>
+	void setSlot(int slot, const T& value) {
+		static_assert(sizeof(T) <= sizeof(UniformSlot::value), "Uniform type too big for the shadow copy");
 
-		if (location != -1)
-			glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(mat3));
-		else
-			return; //std::cout << "WARNING::SHADER.H::An active uniform corresponding to the name '" << name << "' was not found!\n";
+		UniformSlot& uniform = uniforms[slot];
+		if (uniform.shadowed && std::memcmp(uniform.value, &value, sizeof(T)) == 0) {
+			renderStats.uniformsSkipped++;
+			return;
+		}
+		std::memcpy(uniform.value, &value, sizeof(T));
+		uniform.shadowed = true;
+		upload(uniform.location, value);
+		renderStats.uniformUploads++;
 	}
-	void setMat4(const std::string& name, glm::mat4 mat4) {
-		int location = glGetUniformLocation(ID, name.c_str());
-
-		if (location != -1)
-			glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(mat4));
-		else
-			return; //std::cout << "WARNING::SHADER.H::An active uniform corresponding to the name '" << name << "' was not found!\n";
+	GLenum getType(int slot) const { return slot >= 0 ? uniforms[slot].type : 0; }
+	//Whether values of T can be uploaded to a uniform of this GLSL type
+	template<typename T>
+	static bool compatible(GLenum type) {
+		if constexpr (std::is_same_v<T, float>) return type == GL_FLOAT;
+		else if constexpr (std::is_same_v<T, glm::vec2>) return type == GL_FLOAT_VEC2;
+		else if constexpr (std::is_same_v<T, glm::vec3>) return type == GL_FLOAT_VEC3;
+		else if constexpr (std::is_same_v<T, glm::vec4>) return type == GL_FLOAT_VEC4;
+		else if constexpr (std::is_same_v<T, glm::mat3>) return type == GL_FLOAT_MAT3;
+		else if constexpr (std::is_same_v<T, glm::mat4>) return type == GL_FLOAT_MAT4;
+		else if constexpr (std::is_same_v<T, glm::ivec2>) return type == GL_INT_VEC2 || type == GL_BOOL_VEC2;
+		else if constexpr (std::is_same_v<T, unsigned int>) return type == GL_UNSIGNED_INT || type == GL_BOOL;
+		else return type != GL_FLOAT && type != GL_UNSIGNED_INT && !(type >= GL_FLOAT_VEC2 && type <= GL_FLOAT_MAT4); //int, bool and samplers
 	}
-	void setVec2(const std::string& name, glm::vec2 vec2) {
-		int location = glGetUniformLocation(ID, name.c_str());
+	unsigned int getGeneration() const { return generation; }
+	size_t activeUniforms() const { return activeCount; }
+};
 
-		if (location != -1)
-			glUniform2f(location, vec2.x, vec2.y);
-		else
-			return; //std::cout << "WARNING::SHADER.H::An active uniform corresponding to the name '" << name << "' was not found!\n";
-	}
-	void setVec3(const std::string& name, glm::vec3 vec3) {
-		int location = glGetUniformLocation(ID, name.c_str());
+//Typed reference to one uniform of a program: shader.uniform<glm::mat4>("model") once, then model = worldMatrix per draw
+template<typename T>
+class UniformHandle {
+private:
+	Shader* shader = nullptr;
+	UniformName name = UniformName(0u);
+	int slot = -1;
+	unsigned int generation = 0;
 
-		if (location != -1)
-			glUniform3f(glGetUniformLocation(ID, name.c_str()), vec3.x, vec3.y, vec3.z);
-		else
-			return; //std::cout << "WARNING::SHADER.H::An active uniform corresponding to the name '" << name << "' was not found!\n";
+	int resolve() {
+		if (shader && generation != shader->getGeneration()) { //Reloaded, the slots moved
+			slot = shader->findSlot(name);
+			generation = shader->getGeneration();
+		}
+		return slot;
+	}
+public:
+	UniformHandle() {}
+	UniformHandle(Shader& shader, UniformName name) : shader(&shader), name(name) {
+		resolve();
+		if (slot >= 0 && !Shader::compatible<T>(shader.getType(slot)))
+			std::cout << "WARNING::SHADER.H::Uniform handle type doesn't match the GLSL type 0x" << std::hex << shader.getType(slot) << std::dec << std::endl;
 	}
-	void setVec4(const std::string& name, glm::vec4 vec4) {
-		int location = glGetUniformLocation(ID, name.c_str());
 
-		if (location != -1)
-			glUniform4f(glGetUniformLocation(ID, name.c_str()), vec4.x, vec4.y, vec4.z, vec4.w);
-		else
-			return; //std::cout << "WARNING::SHADER.H::An active uniform corresponding to the name '" << name << "' was not found!\n";
+	bool valid() { return resolve() >= 0; }
+	void set(const T& value) {
+		if (resolve() >= 0) shader->setSlot(slot, value);
+	}
+	UniformHandle& operator=(const T& value) {
+		set(value);
+		return *this;
 	}
 };
+template<typename T>
+UniformHandle<T> Shader::uniform(UniformName name) { return UniformHandle<T>(*this, name); }
 
 #endif
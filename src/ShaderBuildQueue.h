@@ -0,0 +1,100 @@
+#pragma once
+#ifndef SHADER_BUILD_QUEUE
+#define SHADER_BUILD_QUEUE
+
+#include "Shader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+//Stage files of a graphics program
+struct ProgramSources {
+	const char* vertexPath;
+	const char* fragmentPath;
+	const char* geometryPath = nullptr;
+};
+
+//A program handed out by ShaderBuildQueue before it's built. ready() polls without blocking, get() finishes it(blocking if it has to)
+class ShaderFuture {
+private:
+	Shader* shader = nullptr;
+public:
+	ShaderFuture(Shader& shader) : shader(&shader) {}
+	ShaderFuture() {};
+
+	bool valid() const { return shader != nullptr; }
+	bool ready() const { return !shader->isLoading() || shader->loadCompleted(); }
+	Shader& get() {
+		shader->finishLoad();
+		return *shader;
+	}
+};
+
+//Submits every compile and link up front and only asks GL about them once they're done, so the driver compiles on its own threads
+//(GL_KHR_parallel_shader_compile) instead of serializing on each status query. Without the extension the compiles are still issued
+//back to back, which lets drivers that defer work overlap them.
+class ShaderBuildQueue {
+private:
+	std::vector<Shader*> pending;
+	std::chrono::high_resolution_clock::time_point start;
+
+	void track(Shader& shader) {
+		if (pending.empty()) {
+			start = std::chrono::high_resolution_clock::now();
+			buildTime = 0.f;
+			built = 0;
+		}
+		if (std::find(pending.begin(), pending.end(), &shader) == pending.end())
+			pending.push_back(&shader);
+	}
+	void finish(Shader& shader) {
+		shader.finishLoad();
+		built++;
+		buildTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+public:
+	float buildTime = 0.f; //In ms, from the first submit of a batch to the last program finished
+	unsigned int built = 0;
+
+	//Lets the driver use as many compiler threads as it wants, call once after the context is made
+	static void init() {
+		if (GLEW_KHR_parallel_shader_compile)
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		else if (GLEW_ARB_parallel_shader_compile)
+			glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+	}
+
+	ShaderFuture submit(Shader& shader, const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const std::string& defines = "") {
+		track(shader);
+		shader.beginLoad(vertexPath, fragmentPath, geometryPath, defines);
+		return ShaderFuture(shader);
+	}
+	ShaderFuture submit(Shader& shader, const ProgramSources& sources, const std::string& defines = "") {
+		return submit(shader, sources.vertexPath, sources.fragmentPath, sources.geometryPath, defines);
+	}
+	ShaderFuture submitCompute(Shader& shader, const char* computePath, const std::string& defines = "") {
+		track(shader);
+		shader.beginLoadCompute(computePath, defines);
+		return ShaderFuture(shader);
+	}
+
+	//Finishes the programs the driver is done with, returns how many are still building. Call once a frame to never block on a compile
+	size_t poll() {
+		pending.erase(std::remove_if(pending.begin(), pending.end(), [this](Shader* shader) {
+			if (!shader->loadCompleted()) return false;
+
+			finish(*shader);
+			return true;
+		}), pending.end());
+		return pending.size();
+	}
+	//Finishes everything, in submission order
+	void wait() {
+		for (Shader* shader : pending)
+			finish(*shader);
+		pending.clear();
+	}
+	size_t pendingCount() const { return pending.size(); }
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,101 @@
+#pragma once
+#ifndef SHADER_VARIANTS
+#define SHADER_VARIANTS
+
+#include "Shader.h"
+#include "Flags.h"
+#include "ShaderBuildQueue.h"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+//One program source compiled into a variant per combination of ShaderFeature bits, each with only the code those features need.
+//Variants are compiled the first time a combination is asked for and kept, so switching materials or toggles never branches on the GPU.
+//Features the source doesn't implement are masked out first, so they can't create duplicate variants.
+class ShaderVariants {
+private:
+	std::string vertexPath, fragmentPath;
+	uint32_t supported = 0;
+	std::unordered_map<uint32_t, std::unique_ptr<Shader>> variants;
+
+	Shader& compile(uint32_t features) {
+		auto start = std::chrono::high_resolution_clock::now();
+
+		std::unique_ptr<Shader>& variant = variants[features];
+		if (!variant) variant = std::make_unique<Shader>();
+		variant->loadShader(vertexPath.c_str(), fragmentPath.c_str(), nullptr, defines(features));
+
+		float time = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		compileTime += time;
+		totalCompileTime += time;
+		totalCompiled++;
+		return *variant;
+	}
+public:
+	float compileTime = 0.f; //In ms, every compile of this set including reloads
+
+	//Across every set
+	static inline unsigned int totalCompiled = 0;
+	static inline float totalCompileTime = 0.f;
+
+	void load(const char* vertexPath, const char* fragmentPath, uint32_t supported) {
+		this->vertexPath = vertexPath;
+		this->fragmentPath = fragmentPath;
+		this->supported = supported;
+		variants.clear();
+	}
+	ShaderVariants(const char* vertexPath, const char* fragmentPath, uint32_t supported) {
+		load(vertexPath, fragmentPath, supported);
+	}
+	ShaderVariants() {};
+
+	//#define lines for the bits of features. The variants reading storage buffers(Common/clusters.glsl, Common/visibility.glsl) also get the
+	//extension line, their #version 420 shaders don't have them in core
+	static std::string defines(uint32_t features) {
+		std::string result;
+		if (features & (ShaderFeature_clusteredLights | ShaderFeature_visibilityResolve))
+			result += "#extension GL_ARB_shader_storage_buffer_object : require\n";
+		for (unsigned int i = 0; i < shaderFeatureCount; i++)
+			if (features & (1u << i))
+				result += std::string("#define ") + shaderFeatureDefines[i] + "\n";
+		return result;
+	}
+
+	uint32_t mask(uint32_t features) const { return features & supported; }
+	Shader& get(uint32_t features) {
+		features = mask(features);
+		auto variant = variants.find(features);
+		if (variant == variants.end()) return compile(features);
+
+		variant->second->finishLoad(); //No-op unless it was requested through a queue
+		return *variant->second;
+	}
+	//Starts building a variant without waiting for it, e.g. the ones the first frame will need. get() finishes it
+	ShaderFuture request(uint32_t features, ShaderBuildQueue& queue) {
+		features = mask(features);
+		std::unique_ptr<Shader>& variant = variants[features];
+		if (!variant) {
+			variant = std::make_unique<Shader>();
+			queue.submit(*variant, vertexPath.c_str(), fragmentPath.c_str(), nullptr, defines(features));
+			totalCompiled++;
+		}
+		return ShaderFuture(*variant);
+	}
+	bool has(uint32_t features) const { return variants.count(mask(features)) != 0; }
+
+	//Recompiles the variants already in use in place, their IDs and handles stay valid
+	void reload() {
+		for (auto& variant : variants)
+			compile(variant.first);
+	}
+	//For uniforms every variant needs(e.g. after a reload)
+	void forEach(const std::function<void(uint32_t, Shader&)>& func) {
+		for (auto& variant : variants)
+			func(variant.first, *variant.second);
+	}
+	size_t count() const { return variants.size(); }
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,490 @@
+#pragma once
+#ifndef SHADOW_ATLAS
+#define SHADOW_ATLAS
+
+#include <GLEW/glew.h>
+#include <GLAD/gl.h>
+
+#include <GLM/glm.hpp>
+#include <GLM/gtc/matrix_transform.hpp>
+
+#include "Shader.h"
+#include "Mesh.h"
+#include "Bounds.h"
+#include "Culling.h"
+#include "Light.h"
+#include "UniformBuffers.h"
+#include "GLState.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//Shadow maps of the point and spot lights, all tiles of one depth texture of a fixed size. Every frame the lights the camera can see
+//are ranked by how big their range looks on screen and the top maxLights get square tiles sized to match(six for a point light's
+//cube faces, one for a spot light). Tiles come from a quadtree buddy allocator, a light keeps its tiles while its size stays close
+//and when the atlas is full the least recently shadowed lights are evicted, then the ones still missing space get smaller tiles.
+//A light's tiles are only redrawn when the light, its tiles or the casters inside its range change. A point light draws its faces in
+//one pass, each caster instanced once per face it reaches with the vertex shader picking the face's viewport(Shaders/Shadow/atlas.vert),
+//or a pass per face without GL_ARB_shader_viewport_layer_array.
+class ShadowAtlas {
+public:
+	static const unsigned int maxLights = maxShadowedLights;
+	static const unsigned int maxTileSize = 1024, minTileSize = 64;
+	static const int maxLevels = 8; //Level 0 is the whole atlas, each level halves the tile size
+private:
+	struct Request {
+		const Light* light;
+		uint32_t type;
+		glm::vec3 position, direction;
+		float range, cosOuterCutOff;
+		float level; //Tile level its screen size asks for, fractional
+	};
+	struct Entry { //Tiles a light holds across frames
+		glm::uvec2 tiles[6]; //Texel offsets
+		unsigned int faceCount = 0; //0 while it has none
+		int level = 0;
+		unsigned int lastUsed = 0; //Frame it was last shadowed
+		int index = -1; //In lightShadows, while lastUsed is this frame
+		uint64_t renderedHash = 0;
+		bool valid = false;
+	};
+	struct Caster {
+		Mesh* mesh;
+		glm::mat4 model;
+		uint32_t faceMask; //Faces it reaches
+	};
+	struct Shadowed { //A light with tiles this frame
+		Request request;
+		Entry* entry;
+		glm::mat4 faceMatrices[6];
+		float nearPlane;
+		float tanHalfAngle; //Of a face's field of view
+		size_t firstCaster = 0, casterCount = 0;
+		uint64_t hash = 0;
+		bool dirty = false;
+	};
+
+	Shader depthShader;
+	bool viewportFromVertex = false;
+	GLuint FBO = 0, depthTexture = 0;
+
+	std::vector<glm::uvec2> freeTiles[maxLevels];
+	std::unordered_map<const Light*, Entry> entries;
+	std::vector<Request> requests;
+	std::vector<Shadowed> shadowed;
+	std::vector<Caster> casters; //Grouped by light
+	std::vector<LightShadowData> records;
+	unsigned int frame = 0;
+
+	GLuint timestampQueries[2][2] = {}; //Before and after the pass, two frames in flight
+	bool rendered[2] = { false, false };
+	unsigned int queryFrame = 0;
+
+	//FNV-1a, folds in the bytes of value
+	template<typename T>
+	static void hash(uint64_t& state, const T& value) {
+		unsigned char bytes[sizeof(T)];
+		std::memcpy(bytes, &value, sizeof(T));
+		for (unsigned char byte : bytes)
+			state = (state ^ byte) * 1099511628211ull;
+	}
+
+	int levelOf(unsigned int tileSize) const { return (int)std::log2(size / (float)tileSize); }
+	unsigned int tileSize(int level) const { return size >> level; }
+
+	//Takes a free tile of level, splitting a bigger one when there is none
+	bool allocate(int level, glm::uvec2& tile) {
+		if (!freeTiles[level].empty()) {
+			tile = freeTiles[level].back();
+			freeTiles[level].pop_back();
+			return true;
+		}
+		glm::uvec2 parent;
+		if (level == 0 || !allocate(level - 1, parent)) return false;
+
+		unsigned int half = tileSize(level);
+		freeTiles[level].push_back(parent + glm::uvec2(half, 0));
+		freeTiles[level].push_back(parent + glm::uvec2(0, half));
+		freeTiles[level].push_back(parent + glm::uvec2(half, half));
+		tile = parent;
+		return true;
+	}
+	//Gives the tile back, merged with its three buddies into their parent when they are all free
+	void release(int level, glm::uvec2 tile) {
+		std::vector<glm::uvec2>& list = freeTiles[level];
+		if (level > 0) {
+			unsigned int half = tileSize(level);
+			glm::uvec2 parent = tile / (2 * half) * (2 * half);
+			size_t buddies[3];
+			int found = 0;
+			for (size_t i = 0; i < list.size() && found < 3; i++)
+				if (list[i] / (2 * half) * (2 * half) == parent)
+					buddies[found++] = i;
+			if (found == 3) {
+				std::sort(buddies, buddies + 3);
+				for (int i = 2; i >= 0; i--) {
+					list[buddies[i]] = list.back();
+					list.pop_back();
+				}
+				release(level - 1, parent);
+				return;
+			}
+		}
+		list.push_back(tile);
+	}
+	bool allocateTiles(Entry& entry, unsigned int faces, int level) {
+		for (unsigned int i = 0; i < faces; i++)
+			if (!allocate(level, entry.tiles[i])) {
+				while (i--) release(level, entry.tiles[i]);
+				return false;
+			}
+		entry.faceCount = faces;
+		entry.level = level;
+		entry.valid = false;
+		return true;
+	}
+	void releaseTiles(Entry& entry) {
+		for (unsigned int i = 0; i < entry.faceCount; i++)
+			release(entry.level, entry.tiles[i]);
+		entry.faceCount = 0;
+		entry.valid = false;
+	}
+	//Frees the tiles of the light shadowed longest ago, never one of this frame
+	bool evictOldest() {
+		auto oldest = entries.end();
+		for (auto it = entries.begin(); it != entries.end(); ++it)
+			if (it->second.faceCount && it->second.lastUsed != frame && (oldest == entries.end() || it->second.lastUsed < oldest->second.lastUsed))
+				oldest = it;
+		if (oldest == entries.end()) return false;
+
+		releaseTiles(oldest->second);
+		entries.erase(oldest);
+		evictions++;
+		return true;
+	}
+
+	//Reads the other frame's timestamps, never waits on the GPU
+	void readTimings() {
+		queryFrame ^= 1;
+		if (!rendered[queryFrame]) {
+			gpuTime = 0.f; //Everything was cached
+			return;
+		}
+
+		GLint available = 0;
+		glGetQueryObjectiv(timestampQueries[queryFrame][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) return;
+
+		GLuint64 start, end;
+		glGetQueryObjectui64v(timestampQueries[queryFrame][0], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(timestampQueries[queryFrame][1], GL_QUERY_RESULT, &end);
+		gpuTime = (end - start) / 1000000.f;
+	}
+public:
+	unsigned int size = 0; //Of the atlas, set by init()/resize()
+	float tileScale = 1.f; //Tile texels per pixel of the light's range on screen
+	bool caching = true;
+	float slopeBias = 2.f, constantBias = 4.f; //glPolygonOffset while drawing
+
+	//Of the last update()/render()
+	unsigned int shadowedLights = 0, redrawnLights = 0, redrawnFaces = 0, unshadowedLights = 0;
+	unsigned int evictions = 0; //Since init()
+	float gpuTime = 0.f; //Of the last render() in ms, a frame late
+
+	void init(unsigned int size) {
+		viewportFromVertex = GLEW_ARB_shader_viewport_layer_array;
+		depthShader.loadShader("Shaders/Shadow/atlas.vert", "Shaders/Shadow/shadow.frag", nullptr, viewportFromVertex ? "#define VIEWPORT_FROM_VERTEX\n" : "");
+
+		glGenFramebuffers(1, &FBO);
+		glGenTextures(1, &depthTexture);
+		glGenQueries(4, &timestampQueries[0][0]);
+		resize(size);
+	}
+	~ShadowAtlas() {
+		if (!FBO) return;
+
+		glState.deleteFramebuffers(1, &FBO);
+		glState.deleteTextures(1, &depthTexture);
+		glDeleteQueries(4, &timestampQueries[0][0]);
+	}
+	//Reallocates the atlas, every light gets new tiles
+	void resize(unsigned int size) {
+		this->size = size;
+
+		glState.bindTexture(GL_TEXTURE_2D, depthTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT16, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+		glState.bindFramebuffer(GL_FRAMEBUFFER, FBO);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::SHADOWATLAS.H::FRAMEBUFFER IS NOT COMPLETE" << std::endl;
+		glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		entries.clear();
+		for (std::vector<glm::uvec2>& list : freeTiles)
+			list.clear();
+		freeTiles[0].push_back(glm::uvec2(0));
+	}
+
+	//Lights of the next allocate()
+	void clear() {
+		frame++;
+		requests.clear();
+		shadowed.clear();
+		casters.clear();
+	}
+	void add(const PointLight& light) {
+		requests.push_back({ &light, LightShadowData::pointType, light.pos, glm::vec3(0.f), light.range(), -1.f, 0.f });
+	}
+	void add(const SpotLight& light) {
+		if (glm::dot(light.dir, light.dir) == 0.f) return;
+		requests.push_back({ &light, LightShadowData::spotType, light.pos, glm::normalize(light.dir), light.range(), light.cosOuterCutOff, 0.f });
+	}
+
+	//Picks the lights to shadow for the camera(projView, position, vertical fov in radians, screen height in pixels), biggest on screen
+	//first, and gives each tiles of its size, keeping the ones it had when they are close enough
+	void allocate(const glm::mat4& projView, glm::vec3 viewPos, float fov, unsigned int screenHeight) {
+		Frustum frustum(projView);
+		float tanHalf = std::tan(fov * .5f);
+		int minLevel = levelOf(std::min(maxTileSize, size)), maxLevel = std::min(levelOf(minTileSize), maxLevels - 1);
+
+		size_t visible = 0;
+		for (Request& request : requests) {
+			BoundingSphere range{ request.position, request.range };
+			if (!frustum.testSphere(range)) continue;
+
+			//Pixels the range's diameter spans on screen, the whole screen once the camera is inside it
+			float distance = glm::length(request.position - viewPos);
+			float screenSize = distance <= request.range ? 1.f : std::min(1.f, request.range / (distance * tanHalf));
+			float pixels = std::max(1.f, screenSize * screenHeight * tileScale);
+			request.level = std::log2(size / pixels);
+			requests[visible++] = request;
+		}
+		requests.resize(visible);
+		std::sort(requests.begin(), requests.end(), [](const Request& a, const Request& b) { return a.level < b.level; });
+		unshadowedLights = 0;
+		if (requests.size() > maxLights) {
+			unshadowedLights = (unsigned int)(requests.size() - maxLights);
+			requests.resize(maxLights);
+		}
+
+		//Marked first so they can't evict each other
+		for (const Request& request : requests)
+			entries[request.light].lastUsed = frame;
+
+		for (const Request& request : requests) {
+			Entry& entry = entries[request.light];
+			unsigned int faces = request.type == LightShadowData::pointType ? 6 : 1;
+			float wanted = std::clamp(request.level, (float)minLevel, (float)maxLevel);
+			if (entry.faceCount != faces || std::abs(wanted - entry.level) > .75f) { //Hysteresis so a light at a level's edge doesn't flip
+				releaseTiles(entry);
+				int level = (int)std::round(wanted);
+				while (!allocateTiles(entry, faces, level)) {
+					if (evictOldest()) continue;
+					if (level == maxLevel) break;
+					level++; //Smaller tiles for the ones that don't fit
+				}
+			}
+			if (!entry.faceCount) {
+				unshadowedLights++;
+				continue;
+			}
+
+			Shadowed light;
+			light.request = request;
+			light.entry = &entry;
+			if (request.type == LightShadowData::pointType) {
+				//Faces in the usual cube map orientation, shadows.glsl picks and projects them the same way
+				static const glm::vec3 forward[6] = { glm::vec3(1.f, 0.f, 0.f), glm::vec3(-1.f, 0.f, 0.f), glm::vec3(0.f, 1.f, 0.f), glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, 0.f, 1.f), glm::vec3(0.f, 0.f, -1.f) };
+				static const glm::vec3 up[6] = { glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, 0.f, 1.f), glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, -1.f, 0.f) };
+				light.nearPlane = std::max(.05f, request.range * .02f);
+				light.tanHalfAngle = 1.f;
+				glm::mat4 projection = glm::perspective(glm::half_pi<float>(), 1.f, light.nearPlane, request.range);
+				for (int f = 0; f < 6; f++)
+					light.faceMatrices[f] = projection * glm::lookAt(request.position, request.position + forward[f], up[f]);
+			}
+			else {
+				light.nearPlane = std::max(.05f, request.range * .01f);
+				float angle = std::clamp(2.f * std::acos(request.cosOuterCutOff) + glm::radians(2.f), glm::radians(2.f), glm::radians(170.f));
+				light.tanHalfAngle = std::tan(angle * .5f);
+				glm::vec3 up = std::abs(request.direction.y) > .99f ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f);
+				light.faceMatrices[0] = glm::perspective(angle, 1.f, light.nearPlane, request.range) * glm::lookAt(request.position, request.position + request.direction, up);
+			}
+			shadowed.push_back(light);
+		}
+
+		//Lights that lost their tiles aren't kept around
+		for (auto it = entries.begin(); it != entries.end();)
+			it = it->second.faceCount ? std::next(it) : entries.erase(it);
+	}
+	size_t lightCount() const { return shadowed.size(); }
+	//Range of the i-th shadowed light, where its casters are looked for
+	BoundingSphere lightRange(size_t i) const { return { shadowed[i].request.position, shadowed[i].request.range }; }
+	//Casters of the i-th shadowed light, add them light by light in order
+	void addCaster(size_t i, Mesh& mesh, const glm::mat4& model) {
+		Shadowed& light = shadowed[i];
+		if (!light.casterCount) light.firstCaster = casters.size();
+
+		BoundingSphere sphere = mesh.bounds.sphere.transformed(model);
+		unsigned int faces = light.request.type == LightShadowData::pointType ? 6 : 1;
+		uint32_t mask = 0;
+		for (unsigned int f = 0; f < faces; f++)
+			if (Frustum(light.faceMatrices[f]).testSphere(sphere))
+				mask |= 1u << f;
+		if (!mask) return;
+
+		casters.push_back({ &mesh, model, mask });
+		light.casterCount++;
+	}
+
+	//Marks the lights whose tiles no longer match and lays out the lightShadows records
+	void update() {
+		records.resize(shadowed.size());
+		shadowedLights = (unsigned int)shadowed.size();
+		for (size_t i = 0; i < shadowed.size(); i++) {
+			Shadowed& light = shadowed[i];
+			Entry& entry = *light.entry;
+			entry.index = (int)i;
+
+			light.hash = 14695981039346656037ull;
+			hash(light.hash, light.request.type);
+			hash(light.hash, light.request.position);
+			hash(light.hash, light.request.direction);
+			hash(light.hash, light.request.range);
+			hash(light.hash, light.request.cosOuterCutOff);
+			hash(light.hash, entry.level);
+			for (unsigned int f = 0; f < entry.faceCount; f++)
+				hash(light.hash, entry.tiles[f]);
+			for (size_t c = light.firstCaster; c < light.firstCaster + light.casterCount; c++) {
+				hash(light.hash, casters[c].mesh);
+				hash(light.hash, casters[c].model);
+			}
+			light.dirty = !caching || !entry.valid || light.hash != entry.renderedHash;
+
+			LightShadowData& record = records[i];
+			float tile = (float)tileSize(entry.level);
+			record.matrix = light.faceMatrices[0];
+			for (unsigned int f = 0; f < 6; f++)
+				record.rects[f] = f < entry.faceCount ? glm::vec4(glm::vec2(entry.tiles[f]) / (float)size, glm::vec2(tile / size)) : glm::vec4(0.f);
+			record.position = light.request.position;
+			record.nearPlane = light.nearPlane;
+			record.farPlane = light.request.range;
+			record.type = light.request.type;
+			record.texelScale = 2.f * light.tanHalfAngle / tile;
+			record.padding = 0.f;
+		}
+	}
+	//Index in lightShadows of the last update(), -1 for a light without tiles
+	int shadowIndex(const Light& light) const {
+		auto it = entries.find(&light);
+		return it != entries.end() && it->second.lastUsed == frame && it->second.faceCount ? it->second.index : -1;
+	}
+	//The lights' records of the Shadows block, the caller fills in the indices of the Lights block ones
+	void fill(ShadowsBlock& block) const {
+		if (!records.empty())
+			std::memcpy(block.lightShadows, records.data(), records.size() * sizeof(LightShadowData));
+	}
+
+	//Clears and redraws the tiles of the lights update() marked. Leaves FBO bound
+	void render() {
+		readTimings();
+		rendered[queryFrame] = false;
+		redrawnLights = redrawnFaces = 0;
+
+		bool dirty = false;
+		for (const Shadowed& light : shadowed)
+			dirty |= light.dirty;
+		if (!dirty) return;
+
+		glState.bindFramebuffer(GL_FRAMEBUFFER, FBO);
+		glState.depthMask(GL_TRUE);
+		glQueryCounter(timestampQueries[queryFrame][0], GL_TIMESTAMP);
+
+		//Only the redrawn tiles are cleared, the cached ones keep their depth
+		glState.enable(GL_SCISSOR_TEST);
+		for (const Shadowed& light : shadowed) {
+			if (!light.dirty) continue;
+			GLsizei tile = tileSize(light.entry->level);
+			for (unsigned int f = 0; f < light.entry->faceCount; f++) {
+				glScissor(light.entry->tiles[f].x, light.entry->tiles[f].y, tile, tile);
+				glClear(GL_DEPTH_BUFFER_BIT);
+			}
+		}
+		glState.disable(GL_SCISSOR_TEST);
+
+		glState.enable(GL_DEPTH_CLAMP); //Casters behind the near plane still block the light
+		glState.enable(GL_POLYGON_OFFSET_FILL);
+		glPolygonOffset(slopeBias, constantBias);
+
+		depthShader.use();
+		UniformHandle<glm::mat4> model = depthShader.uniform<glm::mat4>("model");
+		UniformHandle<GLuint> faceMask = depthShader.uniform<GLuint>("faceMask");
+		UniformHandle<GLint> face = depthShader.uniform<GLint>("face");
+		for (Shadowed& light : shadowed) {
+			if (!light.dirty) continue;
+			Entry& entry = *light.entry;
+			float tile = (float)tileSize(entry.level);
+			for (unsigned int f = 0; f < entry.faceCount; f++)
+				depthShader.setMat4("faceMatrices[" + std::to_string(f) + "]", light.faceMatrices[f]);
+
+			if (viewportFromVertex) {
+				//A viewport per face, each caster drawn once per face it reaches
+				for (unsigned int f = 0; f < entry.faceCount; f++)
+					glViewportIndexedf(f, (float)entry.tiles[f].x, (float)entry.tiles[f].y, tile, tile);
+				for (size_t c = light.firstCaster; c < light.firstCaster + light.casterCount; c++) {
+					faceMask = casters[c].faceMask;
+					model = casters[c].model;
+					casters[c].mesh->drawCopies(std::popcount(casters[c].faceMask));
+				}
+			}
+			else
+				for (unsigned int f = 0; f < entry.faceCount; f++) {
+					glViewport(entry.tiles[f].x, entry.tiles[f].y, (GLsizei)tile, (GLsizei)tile);
+					face = (GLint)f;
+					for (size_t c = light.firstCaster; c < light.firstCaster + light.casterCount; c++) {
+						if (!(casters[c].faceMask & (1u << f))) continue;
+						model = casters[c].model;
+						casters[c].mesh->draw();
+					}
+				}
+
+			entry.renderedHash = light.hash;
+			entry.valid = true;
+			light.dirty = false;
+			redrawnLights++;
+			redrawnFaces += entry.faceCount;
+		}
+		glQueryCounter(timestampQueries[queryFrame][1], GL_TIMESTAMP);
+		rendered[queryFrame] = true;
+
+		glState.disable(GL_POLYGON_OFFSET_FILL);
+		glState.disable(GL_DEPTH_CLAMP);
+	}
+
+	//Fraction of the atlas held by lights
+	float occupancy() const {
+		double free = 0.0;
+		for (int level = 0; level < maxLevels; level++)
+			free += freeTiles[level].size() / std::pow(4.0, level);
+		return 1.f - (float)free;
+	}
+	bool instancedFaces() const { return viewportFromVertex; }
+	GLuint depth() const { return depthTexture; }
+	size_t bytes() const { return (size_t)size * size * 2; }
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,421 @@
+#pragma once
+#ifndef SHADOW_CASCADES
+#define SHADOW_CASCADES
+
+#include <GLEW/glew.h>
+#include <GLAD/gl.h>
+
+#include <GLM/glm.hpp>
+#include <GLM/gtc/matrix_transform.hpp>
+
+#include "Shader.h"
+#include "Mesh.h"
+#include "Bounds.h"
+#include "Light.h"
+#include "UniformBuffers.h"
+#include "GLState.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+//SHADOW_FILTER_* in shadows.glsl
+enum ShadowFilter {
+	ShadowFilter_PCF = 0, //Fixed 3x3 tent
+	ShadowFilter_PCSSBruteForce = 1, //Contact hardening, every pixel searches the depth texels for blockers
+	ShadowFilter_PCSS = 2 //Same, the min/max pyramid skips the search where the area is wholly lit or shadowed
+};
+
+//Cascaded shadow maps of the directional light. The view up to distance is split into cascadeCount slices(splitLambda blends logarithmic
+//and uniform splits), each covered by an orthographic light view around the slice's bounding sphere. The sphere doesn't change with the
+//camera's rotation and its center is snapped to whole texels, so the shadow edges stay put while the camera moves.
+//Each cascade is a layer of one depth array texture and every layer that needs it is drawn in a single pass, a geometry shader invocation
+//per cascade(Shaders/Shadow/cascades.geom). A layer is kept while its matrix and the casters inside it stay the same, so the far cascades,
+//whose texels are large, are redrawn once in a while and a still scene draws no shadows at all.
+//The PCSS filters search the raw depths for blockers. ShadowFilter_PCSS also reads a min/max depth pyramid of each layer
+//(Shaders/Shadow/minMax.comp), rebuilt with the layer, so a pixel whose whole search area is nearer or farther than every caster in it
+//costs four fetches, and only the penumbrae run the rotated Poisson blocker search and filter.
+class ShadowCascades {
+public:
+	static const unsigned int maxCascades = maxShadowCascades;
+	static const unsigned int maxPyramidLevels = 7; //Level 0 is half the resolution, the last covers 128x128 texels
+
+	struct Cascade {
+		glm::mat4 matrix = glm::mat4(1.f);
+		float nearDepth = 0.f, farDepth = 0.f; //View depths it covers
+		float texelSize = 0.f; //World units
+
+		//Of the last update()
+		unsigned int casters = 0;
+		unsigned int triangles = 0;
+		bool dirty = true; //Redrawn by the next render()
+		unsigned int cachedFrames = 0; //Since it was last drawn
+		float gpuTime = 0.f; //Of its last draw in ms, only measured with timeCascades
+
+		//What its layer holds
+		glm::mat4 renderedMatrix = glm::mat4(0.f);
+		uint64_t casterHash = 0, renderedHash = 0;
+		bool valid = false;
+	};
+private:
+	struct Caster {
+		Mesh* mesh;
+		glm::mat4 model;
+		BoundingSphere sphere; //World
+	};
+
+	Shader depthShader;
+	GLuint FBO = 0, depthArray = 0;
+	std::vector<Caster> casters;
+	std::vector<uint32_t> casterMasks; //Bit per cascade the caster reaches
+
+	Shader pyramidShader;
+	GLuint minMaxArray = 0; //RG32F, allocated when the pyramid filter is first used
+	GLuint depthSampler = 0; //Reads the depth array without the comparison, for the pyramid build and the PCSS blocker search
+	unsigned int pyramidLevels = 0;
+	uint32_t stalePyramids = 0; //Layers drawn since their pyramid was built
+
+	static const int wholePass = -1, pyramidBatch = -2;
+	GLuint timestampQueries[2][maxCascades + 2] = {}; //Before the pass and after each batch, two frames in flight
+	int batchCascades[2][maxCascades + 1] = {}; //Cascade a batch was timed for, wholePass or pyramidBatch
+	unsigned int batchCounts[2] = {};
+	unsigned int queryFrame = 0;
+
+	//FNV-1a, folds in the bytes of value
+	template<typename T>
+	static void hash(uint64_t& state, const T& value) {
+		unsigned char bytes[sizeof(T)];
+		std::memcpy(bytes, &value, sizeof(T));
+		for (unsigned char byte : bytes)
+			state = (state ^ byte) * 1099511628211ull;
+	}
+
+	//Reads the other frame's timestamps, never waits on the GPU
+	void readTimings() {
+		queryFrame ^= 1;
+		unsigned int batches = batchCounts[queryFrame];
+		if (!batches) {
+			gpuTime = 0.f; //Everything was cached
+			return;
+		}
+
+		GLint available = 0;
+		glGetQueryObjectiv(timestampQueries[queryFrame][batches], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) return;
+
+		GLuint64 stamps[maxCascades + 2];
+		for (unsigned int i = 0; i <= batches; i++)
+			glGetQueryObjectui64v(timestampQueries[queryFrame][i], GL_QUERY_RESULT, &stamps[i]);
+		gpuTime = (stamps[batches] - stamps[0]) / 1000000.f;
+		pyramidTime = 0.f;
+		for (unsigned int i = 0; i < batches; i++) {
+			float time = (stamps[i + 1] - stamps[i]) / 1000000.f;
+			if (batchCascades[queryFrame][i] == pyramidBatch)
+				pyramidTime = time;
+			else if (batchCascades[queryFrame][i] >= 0)
+				cascades[batchCascades[queryFrame][i]].gpuTime = time;
+		}
+	}
+
+	static unsigned int levelsFor(unsigned int resolution) {
+		return std::min(maxPyramidLevels, (unsigned int)std::log2(resolution / 2) + 1);
+	}
+	void allocatePyramid() {
+		pyramidLevels = levelsFor(resolution);
+		glGenTextures(1, &minMaxArray);
+		glState.bindTexture(GL_TEXTURE_2D_ARRAY, minMaxArray);
+		for (unsigned int level = 0; level < pyramidLevels; level++)
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RG32F, (resolution / 2) >> level, (resolution / 2) >> level, maxCascades, 0, GL_RG, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, pyramidLevels - 1);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		stalePyramids = (1u << maxCascades) - 1;
+	}
+	//Rebuilds the pyramid of the layers in mask from their depth
+	void buildPyramids(uint32_t layers) {
+		pyramidShader.use();
+		pyramidShader.set1ui("layerMask", layers);
+		glState.bindTexture(GL_TEXTURE16, GL_TEXTURE_2D_ARRAY, depthArray);
+		glBindSampler(16, depthSampler);
+
+		for (unsigned int level = 0; level < pyramidLevels; level++) {
+			unsigned int size = (resolution / 2) >> level;
+			if (level > 0)
+				glBindImageTexture(0, minMaxArray, level - 1, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);
+			glBindImageTexture(1, minMaxArray, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_RG32F);
+
+			pyramidShader.set1i("level", level);
+			glDispatchCompute((size + 7) / 8, (size + 7) / 8, activeCount);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		}
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		glBindSampler(16, 0);
+		stalePyramids &= ~layers;
+	}
+public:
+	Cascade cascades[maxCascades];
+	int cascadeCount = 4;
+	int activeCount = 0; //Of the last update(), none without a light direction
+	float distance = 50.f; //Shadowed view depth
+	float splitLambda = .75f; //0 uniform splits, 1 logarithmic
+	unsigned int resolution = 0; //Of every layer, set by init()/resize()
+
+	bool caching = true;
+	bool timeCascades = false; //Draws the cascades one by one so each gets its own timing
+	float normalOffset = 1.5f; //In texels
+	float depthBias = .0005f;
+	float slopeBias = 2.f, constantBias = 2.f; //glPolygonOffset while drawing
+
+	int filter = ShadowFilter_PCF; //ShadowFilter, ShadowFilter_PCSS needs pyramidSupported()
+	float lightSize = .02f; //Tangent of the light's angular radius: penumbra width per unit of distance between blocker and receiver
+	float maxPenumbra = 1.f; //World units, bounds the blocker search
+
+	float gpuTime = 0.f; //Of the last render() in ms, a frame late
+	float pyramidTime = 0.f; //Part of it spent building the pyramids
+
+	static bool pyramidSupported() {
+		return GLEW_ARB_compute_shader && GLEW_ARB_shader_image_load_store;
+	}
+
+	void init(unsigned int resolution) {
+		depthShader.loadShader("Shaders/Shadow/shadow.vert", "Shaders/Shadow/shadow.frag", "Shaders/Shadow/cascades.geom");
+		if (pyramidSupported()) {
+			pyramidShader.loadComputeShader("Shaders/Shadow/minMax.comp");
+			filter = ShadowFilter_PCSS;
+		}
+
+		glGenFramebuffers(1, &FBO);
+		glGenTextures(1, &depthArray);
+		glGenSamplers(1, &depthSampler);
+		glSamplerParameteri(depthSampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glSamplerParameteri(depthSampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glSamplerParameteri(depthSampler, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+		glGenQueries(2 * (maxCascades + 2), &timestampQueries[0][0]);
+		resize(resolution);
+	}
+	~ShadowCascades() {
+		if (!FBO) return;
+
+		glState.deleteFramebuffers(1, &FBO);
+		glState.deleteTextures(1, &depthArray);
+		if (minMaxArray) glState.deleteTextures(1, &minMaxArray);
+		glDeleteSamplers(1, &depthSampler);
+		glDeleteQueries(2 * (maxCascades + 2), &timestampQueries[0][0]);
+	}
+	//Reallocates the layers, every cascade is drawn again
+	void resize(unsigned int resolution) {
+		this->resolution = resolution;
+
+		glState.bindTexture(GL_TEXTURE_2D_ARRAY, depthArray);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, maxCascades, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+		glState.bindFramebuffer(GL_FRAMEBUFFER, FBO);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::SHADOWCASCADES.H::FRAMEBUFFER IS NOT COMPLETE" << std::endl;
+		glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		for (Cascade& cascade : cascades)
+			cascade.valid = false;
+		if (minMaxArray) { //Reallocated at the new size when a PCSS filter needs it
+			glState.deleteTextures(1, &minMaxArray);
+			minMaxArray = 0;
+		}
+	}
+
+	//Casters of the next update(), whether the camera sees them or not
+	void clear() { casters.clear(); }
+	void add(Mesh& mesh, const glm::mat4& model) {
+		casters.push_back({ &mesh, model, mesh.bounds.sphere.transformed(model) });
+	}
+
+	//Fits the cascades to the camera(view matrix, vertical fov in radians, aspect and near plane) and the light, assigns the casters
+	//to the cascades they reach and marks the cascades whose layer no longer matches
+	void update(const DirLight& light, const glm::mat4& view, float fov, float aspect, float nearPlane) {
+		cascadeCount = std::clamp(cascadeCount, 1, (int)maxCascades);
+		activeCount = glm::dot(light.dir, light.dir) == 0.f ? 0 : cascadeCount;
+		if (!activeCount) return;
+
+		glm::vec3 lightDir = glm::normalize(light.dir);
+		glm::vec3 up = std::abs(lightDir.y) > .99f ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f);
+		glm::mat4 lightView = glm::lookAt(glm::vec3(0.f), lightDir, up); //Only a rotation, so snapping in it is snapping in the world
+
+		glm::mat4 camera = glm::inverse(view);
+		glm::vec3 cameraPos(camera[3]), cameraForward(-camera[2]);
+		float tanHalf = std::tan(fov * .5f);
+		float cornerSlope = tanHalf * tanHalf * (1.f + aspect * aspect); //Squared distance of a frustum corner from the view axis per depth squared
+
+		//Practical split scheme
+		float splits[maxCascades + 1];
+		splits[0] = nearPlane;
+		for (int i = 1; i <= cascadeCount; i++) {
+			float part = i / (float)cascadeCount;
+			float logarithmic = nearPlane * std::pow(distance / nearPlane, part);
+			float uniform = nearPlane + (distance - nearPlane) * part;
+			splits[i] = splitLambda * logarithmic + (1.f - splitLambda) * uniform;
+		}
+
+		casterMasks.assign(casters.size(), 0);
+		for (int i = 0; i < cascadeCount; i++) {
+			Cascade& cascade = cascades[i];
+			float nearDepth = splits[i], farDepth = splits[i + 1];
+
+			//Smallest sphere through the slice's corners, centered on the view axis. Only depends on the depths, fov and aspect
+			float centerDepth = std::min(farDepth, (farDepth + nearDepth) * (1.f + cornerSlope) * .5f);
+			float radius = std::sqrt((farDepth - centerDepth) * (farDepth - centerDepth) + farDepth * farDepth * cornerSlope);
+			radius = std::ceil(radius * 16.f) / 16.f; //Float noise can't change the texel size
+
+			float texelSize = 2.f * radius / resolution;
+			glm::vec3 center = glm::vec3(lightView * glm::vec4(cameraPos + cameraForward * centerDepth, 1.f));
+			center.x = std::floor(center.x / texelSize) * texelSize;
+			center.y = std::floor(center.y / texelSize) * texelSize;
+
+			//Casters nearer the light than the box are flattened onto its near plane by depth clamping
+			glm::mat4 projection = glm::ortho(center.x - radius, center.x + radius, center.y - radius, center.y + radius, -center.z - radius, -center.z + radius);
+			cascade.matrix = projection * lightView;
+			cascade.nearDepth = nearDepth;
+			cascade.farDepth = farDepth;
+			cascade.texelSize = texelSize;
+
+			cascade.casters = cascade.triangles = 0;
+			cascade.casterHash = 14695981039346656037ull;
+			for (size_t c = 0; c < casters.size(); c++) {
+				const BoundingSphere& sphere = casters[c].sphere;
+				glm::vec3 lightSpace = glm::vec3(lightView * glm::vec4(sphere.center, 1.f));
+				float reach = radius + sphere.radius;
+				if (std::abs(lightSpace.x - center.x) > reach || std::abs(lightSpace.y - center.y) > reach || -lightSpace.z - sphere.radius > -center.z + radius)
+					continue;
+
+				casterMasks[c] |= 1u << i;
+				cascade.casters++;
+				cascade.triangles += (casters[c].mesh->indexCount ? casters[c].mesh->indexCount : casters[c].mesh->vertexCount) / 3;
+				hash(cascade.casterHash, casters[c].mesh);
+				hash(cascade.casterHash, casters[c].model);
+			}
+
+			cascade.dirty = !caching || !cascade.valid || cascade.matrix != cascade.renderedMatrix || cascade.casterHash != cascade.renderedHash;
+			if (cascade.dirty) cascade.cachedFrames = 0;
+			else cascade.cachedFrames++;
+		}
+	}
+	//The Shadows block of the last update()
+	void fill(ShadowsBlock& block) const {
+		block.cascadeCount = activeCount;
+		block.normalOffset = normalOffset;
+		block.depthBias = depthBias;
+		block.filter = filter == ShadowFilter_PCSS && !pyramidSupported() ? ShadowFilter_PCSSBruteForce : filter;
+		block.lightSize = lightSize;
+		block.maxPenumbra = maxPenumbra;
+		block.pyramidLevels = levelsFor(resolution);
+		for (int i = 0; i < activeCount; i++) {
+			block.cascadeMatrices[i] = cascades[i].matrix;
+			block.cascadeSplits[i] = cascades[i].farDepth;
+			block.cascadeTexelSizes[i] = cascades[i].texelSize;
+		}
+	}
+
+	//Draws the casters of the dirty cascades into their layers, reading the matrices from the Shadows block, so it has to be uploaded
+	//after update(), then rebuilds their min/max pyramids for ShadowFilter_PCSS. Leaves FBO bound with the viewport of a layer
+	void render() {
+		readTimings();
+		batchCounts[queryFrame] = 0;
+
+		uint32_t dirty = 0;
+		for (int i = 0; i < activeCount; i++)
+			if (cascades[i].dirty) dirty |= 1u << i;
+
+		bool pyramids = filter == ShadowFilter_PCSS && pyramidSupported();
+		if (pyramids && !minMaxArray)
+			allocatePyramid();
+		stalePyramids |= dirty;
+		uint32_t rebuild = pyramids ? stalePyramids & ((1u << activeCount) - 1) : 0;
+		if (!dirty && !rebuild) return;
+
+		unsigned int batchCount = 0;
+		glQueryCounter(timestampQueries[queryFrame][0], GL_TIMESTAMP);
+		if (dirty) {
+			glState.bindFramebuffer(GL_FRAMEBUFFER, FBO);
+			glViewport(0, 0, resolution, resolution);
+			glState.depthMask(GL_TRUE);
+
+			//Only the layers being redrawn are cleared, the cached ones keep their depth
+			for (int i = 0; i < activeCount; i++) {
+				if (!(dirty & (1u << i))) continue;
+				glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0, i);
+				glClear(GL_DEPTH_BUFFER_BIT);
+			}
+			glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0);
+
+			glState.enable(GL_DEPTH_CLAMP);
+			glState.enable(GL_POLYGON_OFFSET_FILL);
+			glPolygonOffset(slopeBias, constantBias);
+
+			//One batch for every dirty cascade, or one per cascade to time them apart
+			uint32_t batches[maxCascades];
+			for (int i = 0; i < activeCount && timeCascades; i++)
+				if (dirty & (1u << i)) {
+					batchCascades[queryFrame][batchCount] = i;
+					batches[batchCount++] = 1u << i;
+				}
+			if (!timeCascades) {
+				batchCascades[queryFrame][0] = wholePass;
+				batches[batchCount++] = dirty;
+			}
+
+			depthShader.use();
+			UniformHandle<glm::mat4> model = depthShader.uniform<glm::mat4>("model");
+			UniformHandle<GLuint> cascadeMask = depthShader.uniform<GLuint>("cascadeMask");
+			for (unsigned int b = 0; b < batchCount; b++) {
+				for (size_t c = 0; c < casters.size(); c++) {
+					uint32_t mask = casterMasks[c] & batches[b];
+					if (!mask) continue;
+
+					cascadeMask = mask;
+					model = casters[c].model;
+					casters[c].mesh->draw();
+				}
+				glQueryCounter(timestampQueries[queryFrame][b + 1], GL_TIMESTAMP);
+			}
+
+			glState.disable(GL_POLYGON_OFFSET_FILL);
+			glState.disable(GL_DEPTH_CLAMP);
+
+			for (int i = 0; i < activeCount; i++) {
+				Cascade& cascade = cascades[i];
+				if (!cascade.dirty) continue;
+				cascade.renderedMatrix = cascade.matrix;
+				cascade.renderedHash = cascade.casterHash;
+				cascade.valid = true;
+				cascade.dirty = false;
+			}
+		}
+		if (rebuild) {
+			buildPyramids(rebuild);
+			batchCascades[queryFrame][batchCount++] = pyramidBatch;
+			glQueryCounter(timestampQueries[queryFrame][batchCount], GL_TIMESTAMP);
+		}
+		batchCounts[queryFrame] = batchCount;
+	}
+
+	GLuint depth() const { return depthArray; }
+	GLuint depthReader() const { return depthSampler; } //Sampler object turning the comparison off
+	GLuint minMax() const { return minMaxArray; }
+	size_t bytes() const {
+		size_t pyramid = 0;
+		for (unsigned int level = 0; minMaxArray && level < pyramidLevels; level++)
+			pyramid += (size_t)((resolution / 2) >> level) * ((resolution / 2) >> level) * maxCascades * 8;
+		return (size_t)resolution * resolution * maxCascades * 4 + pyramid;
+	}
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+#ifndef STATS
+#define STATS
+
+//Per-frame counters shown in the profiling header
+struct RenderStats {
+	unsigned int drawCalls = 0;
+	unsigned int instances = 0;
+	float cpuFrameTime = 0.f; //In ms
+
+	//Frustum culling
+	unsigned int visible = 0;
+	unsigned int culled = 0;
+	float cullTime = 0.f; //In ms
+
+	//Uniform sets that reached GL and the ones dropped because the program already had the value
+	unsigned int uniformUploads = 0;
+	unsigned int uniformsSkipped = 0;
+
+	//Binds and state toggles that reached GL and the ones GLState dropped as redundant
+	unsigned int stateCalls = 0;
+	unsigned int stateCallsFiltered = 0;
+
+	void reset() {
+		drawCalls = 0;
+		instances = 0;
+		visible = 0;
+		culled = 0;
+		cullTime = 0.f;
+		uniformUploads = 0;
+		uniformsSkipped = 0;
+		stateCalls = 0;
+		stateCallsFiltered = 0;
+	}
+	void addCulling(unsigned int visible, unsigned int culled, float time) {
+		this->visible += visible;
+		this->culled += culled;
+		cullTime += time;
+	}
+};
+RenderStats renderStats;
+#endif
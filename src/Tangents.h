@@ -0,0 +1,155 @@
+#pragma once
+#ifndef TANGENTS
+#define TANGENTS
+
+#include <GLM/glm.hpp>
+
+#include "Vertex.h"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+//Per-vertex tangent frames built with MikkTSpace's rules so normal maps baked by Blender/Substance/xNormal decode the same way:
+//  the face tangent and bitangent come from the UV derivatives, get projected into each corner's normal plane, normalized and weighted by the corner angle
+//  the sums are orthogonalized against the normal, w keeps the handedness so the shader rebuilds the bitangent as cross(N, T) * w
+//Unlike MikkTSpace, vertices shared by mirrored triangles aren't split, the index buffer is kept as is.
+//Triangles write their corner contributions to their own slots and vertices gather them, so both passes run on threads without locks.
+class TangentGenerator {
+private:
+	struct alignas(16) Corner {
+		float tangent[4];
+		float bitangent[4];
+	};
+
+	std::vector<Corner> corners;
+	std::vector<unsigned int> cornerOffsets; //Vertex v owns cornerIDs[cornerOffsets[v], cornerOffsets[v + 1])
+	std::vector<unsigned int> cornerIDs;
+
+	template<typename Func>
+	void parallelFor(size_t count, Func func) {
+		unsigned int threads = count < parallelThreshold ? 1 : std::max(1u, threadCount);
+		if (threads == 1) {
+			func(0, count);
+			return;
+		}
+
+		size_t chunk = (count + threads - 1) / threads;
+		std::vector<std::thread> workers;
+		for (unsigned int t = 1; t < threads; t++) {
+			size_t begin = std::min(count, t * chunk);
+			size_t end = std::min(count, begin + chunk);
+			if (begin < end)
+				workers.emplace_back(func, begin, end);
+		}
+		func(0, std::min(count, chunk));
+
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+	static void storeVec(float* dst, glm::vec3 v) {
+		dst[0] = v.x;
+		dst[1] = v.y;
+		dst[2] = v.z;
+		dst[3] = 0.f;
+	}
+	static glm::vec3 orthonormalize(glm::vec3 v, glm::vec3 normal) {
+		v -= normal * glm::dot(normal, v);
+		float lengthSq = glm::dot(v, v);
+		return lengthSq > 1e-20f ? v / std::sqrt(lengthSq) : glm::vec3(0.f);
+	}
+
+	void processTriangles(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, size_t begin, size_t end) {
+		for (size_t tri = begin; tri < end; tri++) {
+			unsigned int ids[3];
+			for (int c = 0; c < 3; c++)
+				ids[c] = indices.empty() ? (unsigned int)(tri * 3 + c) : indices[tri * 3 + c];
+
+			const Vertex& v0 = vertices[ids[0]];
+			const Vertex& v1 = vertices[ids[1]];
+			const Vertex& v2 = vertices[ids[2]];
+
+			glm::vec3 edge1 = v1.position - v0.position;
+			glm::vec3 edge2 = v2.position - v0.position;
+			glm::vec2 deltaUV1 = v1.texCoord - v0.texCoord;
+			glm::vec2 deltaUV2 = v2.texCoord - v0.texCoord;
+
+			//Twice the signed UV area. Its sign is the triangle's handedness, only the direction of the vectors matters after that
+			float area = deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y;
+			float sign = area < 0.f ? -1.f : 1.f;
+			glm::vec3 faceTangent = (edge1 * deltaUV2.y - edge2 * deltaUV1.y) * sign;
+			glm::vec3 faceBitangent = (edge2 * deltaUV1.x - edge1 * deltaUV2.x) * sign;
+			bool degenerate = std::abs(area) < 1e-20f;
+
+			for (int c = 0; c < 3; c++) {
+				Corner& corner = corners[tri * 3 + c];
+				const Vertex& vertex = vertices[ids[c]];
+
+				glm::vec3 toNext = vertices[ids[(c + 1) % 3]].position - vertex.position;
+				glm::vec3 toPrev = vertices[ids[(c + 2) % 3]].position - vertex.position;
+				float lengths = std::sqrt(glm::dot(toNext, toNext) * glm::dot(toPrev, toPrev));
+				float angle = lengths > 0.f ? std::acos(std::clamp(glm::dot(toNext, toPrev) / lengths, -1.f, 1.f)) : 0.f;
+
+				if (degenerate) angle = 0.f; //Contributes nothing, the neighbours decide
+				storeVec(corner.tangent, orthonormalize(faceTangent, vertex.normal) * angle);
+				storeVec(corner.bitangent, orthonormalize(faceBitangent, vertex.normal) * angle);
+			}
+		}
+	}
+	void processVertices(std::vector<Vertex>& vertices, size_t begin, size_t end) {
+		alignas(16) float tangentSum[4];
+		alignas(16) float bitangentSum[4];
+
+		for (size_t v = begin; v < end; v++) {
+			__m128 tangent = _mm_setzero_ps();
+			__m128 bitangent = _mm_setzero_ps();
+			for (unsigned int i = cornerOffsets[v]; i < cornerOffsets[v + 1]; i++) {
+				const Corner& corner = corners[cornerIDs[i]];
+				tangent = _mm_add_ps(tangent, _mm_load_ps(corner.tangent));
+				bitangent = _mm_add_ps(bitangent, _mm_load_ps(corner.bitangent));
+			}
+			_mm_store_ps(tangentSum, tangent);
+			_mm_store_ps(bitangentSum, bitangent);
+
+			Vertex& vertex = vertices[v];
+			glm::vec3 normal = vertex.normal;
+			glm::vec3 T = orthonormalize(glm::vec3(tangentSum[0], tangentSum[1], tangentSum[2]), normal);
+			glm::vec3 B(bitangentSum[0], bitangentSum[1], bitangentSum[2]);
+
+			if (T == glm::vec3(0.f)) //No usable UVs around this vertex, any frame around the normal will do
+				T = orthonormalize(std::abs(normal.x) < .9f ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f), normal);
+
+			vertex.tangent = glm::vec4(T, glm::dot(glm::cross(normal, T), B) < 0.f ? -1.f : 1.f);
+		}
+	}
+public:
+	//Meshes smaller than this(in triangles) are done on the calling thread
+	static const size_t parallelThreshold = 1 << 14;
+
+	unsigned int threadCount = 1;
+
+	//Writes vertex.tangent for every vertex. Without indices every 3 vertices are a triangle
+	void generate(std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices = {}) {
+		size_t triangleCount = (indices.empty() ? vertices.size() : indices.size()) / 3;
+		corners.resize(triangleCount * 3);
+
+		//Corners grouped by vertex(counting sort), so the gather pass reads only its own vertices
+		cornerOffsets.assign(vertices.size() + 1, 0);
+		for (size_t i = 0; i < triangleCount * 3; i++)
+			cornerOffsets[(indices.empty() ? i : indices[i]) + 1]++;
+		for (size_t v = 0; v < vertices.size(); v++)
+			cornerOffsets[v + 1] += cornerOffsets[v];
+
+		cornerIDs.resize(triangleCount * 3);
+		std::vector<unsigned int> cursor(cornerOffsets.begin(), cornerOffsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; i++)
+			cornerIDs[cursor[indices.empty() ? i : indices[i]]++] = (unsigned int)i;
+
+		parallelFor(triangleCount, [&](size_t begin, size_t end) { processTriangles(vertices, indices, begin, end); });
+		parallelFor(vertices.size(), [&](size_t begin, size_t end) { processVertices(vertices, begin, end); });
+	}
+};
+#endif
\ No newline at end of file
@@ -12,6 +12,24 @@
 #include <SOIL2/SOIL2.h>
 #include <chrono>
 
+#include "GLState.h"
+
+//Pixels decoded off the GL thread, waiting for Texture::loadFromImage()
+struct ImageData {
+	std::string path = "";
+	unsigned char* pixels = nullptr; //RGB
+	int width = 0;
+	int height = 0;
+
+	void release() {
+		if (pixels) stbi_image_free(pixels);
+		pixels = nullptr;
+	}
+};
+
+//Path of the 1x1 white texture glTF slots without an image fall back to, it only multiplies the factors by one
+const char* const whiteTexturePath = "white";
+
 class Texture {
 public:
 	int width;
@@ -22,22 +40,34 @@ public:
 	std::string path = "";
 
 	GLuint id = 0;
+	bool owner = true; //False for a slot sharing another texture's id(share()), only the owner deletes it
 
 	GLuint getID() const { return this->id; }
 	void bind(const GLint textureUnit) {
 		if (!this->id) return;
 
-		glActiveTexture(GL_TEXTURE0 + textureUnit);
-		glBindTexture(this->glType, this->id);
+		glState.bindTexture(GL_TEXTURE0 + textureUnit, this->glType, this->id);
 	}
 	void unbind(const GLint texture_unit) {
 		if (!this->id) return;
 
-		glActiveTexture(GL_TEXTURE0 + texture_unit);
-		glBindTexture(this->glType, 0);
+		glState.bindTexture(GL_TEXTURE0 + texture_unit, this->glType, 0);
 	}
 	void deleteTexture() {
-		glDeleteTextures(1, &this->id);
+		glState.deleteTextures(1, &this->id);
+	}
+	//Uses other's GL texture without owning it, other has to outlive this one
+	void share(const Texture& other) {
+		if (id && id == other.id) return; //Already the same texture
+		if (id && owner) deleteTexture();
+
+		width = other.width;
+		height = other.height;
+		glType = other.glType;
+		nrChannels = other.nrChannels;
+		path = other.path;
+		id = other.id;
+		owner = false;
 	}
 	void loadTexture(std::string path, bool invertY = false, GLenum glType = GL_TEXTURE_2D) {
 		//Note: glGenTexture generates n number of texture ids and sends them to the second parameter
@@ -47,12 +77,13 @@ public:
 			return;
 		}
 
-		glActiveTexture(GL_TEXTURE0);
+		glState.activeTexture(GL_TEXTURE0);
 
 		this->path = path;
 		this->glType = glType;
 
 		if (!this->id) glGenTextures(1, &id);
+		glState.bindTexture(glType, this->id); //SOIL binds it with a raw glBindTexture, the tracker has to know it's bound already
 		bool data = SOIL_load_OGL_texture(path.c_str(), SOIL_LOAD_RGB, this->id, invertY ? SOIL_FLAG_INVERT_Y : 0);
 
 		if (data) {
@@ -66,15 +97,71 @@ public:
 		else
 			std::cout << "ERROR::SOIL LAST RESULT: '" << SOIL_last_result() << "' while loading: " << path << std::endl;
 
-		glBindTexture(glType, 0); //Unbind
+		glState.bindTexture(glType, 0); //Unbind
+	}
+
+	//CPU half of loadTexture, safe to call from any thread. Forced to RGB like SOIL_LOAD_RGB
+	static ImageData decodeImage(std::string path) {
+		ImageData image;
+		if (path == "") return image;
+
+		int channels;
+		image.path = path;
+		image.pixels = stbi_load(path.c_str(), &image.width, &image.height, &channels, 3);
+		if (!image.pixels)
+			std::cout << "ERROR::TEXTURE.H::FAILED TO DECODE: '" << stbi_failure_reason() << "' while loading: " << path << std::endl;
+		return image;
+	}
+	//GL half of loadTexture, has to run on the GL thread
+	void loadFromImage(const ImageData& image, GLenum glType = GL_TEXTURE_2D) {
+		if (!image.pixels) return;
+
+		glState.activeTexture(GL_TEXTURE0);
+
+		this->path = image.path;
+		this->glType = glType;
+		this->width = image.width;
+		this->height = image.height;
+		this->nrChannels = 3;
+
+		if (!this->id) glGenTextures(1, &id);
+		glState.bindTexture(glType, this->id);
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1); //RGB rows aren't 4 byte aligned
+		glTexImage2D(glType, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image.pixels);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		glTexParameteri(glType, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(glType, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(glType, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(glType, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+		glGenerateMipmap(glType);
+		glState.bindTexture(glType, 0); //Unbind
 	}
 
 	Texture(std::string path, bool invertY = false, GLenum glType = GL_TEXTURE_2D) {
 		loadTexture(path, invertY, glType);
 	}
 	Texture() {};
+	//Copies share the id instead of owning it, or every copy would delete it
+	Texture(const Texture& other) { share(other); }
+	Texture& operator=(const Texture& other) {
+		if (this != &other) share(other);
+		return *this;
+	}
+	//Moves hand the ownership over
+	Texture(Texture&& other) noexcept { *this = std::move(other); }
+	Texture& operator=(Texture&& other) noexcept {
+		if (this == &other) return *this;
+
+		share(other);
+		owner = other.owner;
+		other.id = 0;
+		return *this;
+	}
 	~Texture() {
-		if (!id) return;
+		if (!id || !owner) return;
 
 		std::cout << "TEXTURE::DELETED::PATH: " << this->path << ", ID: " << this->id << std::endl;
 		this->deleteTexture();
@@ -84,7 +171,7 @@ class CubemapTexture : public Texture {
 public:
 	void loadCubemap(std::vector<std::string> faces) {
 		if (!this->id) glGenTextures(1, &this->id);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, this->id);
+		glState.bindTexture(GL_TEXTURE_CUBE_MAP, this->id);
 
 		for (unsigned int i = 0; i < faces.size(); i++) {
 			unsigned char* data = stbi_load(faces[i].c_str(), &this->width, &this->height, &this->nrChannels, 0);
@@ -118,7 +205,7 @@ public:
 		this->glType = glType;
 
 		if(!id) glGenTextures(1, &id);
-		glBindTexture(GL_TEXTURE_2D, id);
+		glState.bindTexture(GL_TEXTURE_2D, id);
 
 		float* data = stbi_loadf(path.c_str(), &width, &height, &nrChannels, 0);
 		if (data) {
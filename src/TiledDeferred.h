@@ -0,0 +1,115 @@
+#pragma once
+#ifndef TILED_DEFERRED
+#define TILED_DEFERRED
+
+#include <GLEW/glew.h>
+#include <GLAD/gl.h>
+
+#include <GLM/glm.hpp>
+
+#include "Shader.h"
+#include "ShaderVariants.h"
+#include "LightClusters.h"
+#include "GLState.h"
+
+#include <memory>
+#include <unordered_map>
+
+//Compute shader replacement for the fullscreen deferred resolve. The screen is split in tileSize x tileSize tiles, each finds the depth range
+//of its pixels, culls the uploaded light buffer(LightClusters::upload()) against it in shared memory and shades its pixels with only those
+//lights straight into the HDR target. Lights far from any visible surface cost one culling test per tile and nothing per pixel.
+class TiledDeferred {
+private:
+	std::unordered_map<uint32_t, std::unique_ptr<Shader>> variants;
+
+	GLuint timestampQueries[2][2] = {}; //Before and after the dispatch, two frames in flight
+	bool timestampsIssued[2] = { false, false };
+	unsigned int queryFrame = 0;
+
+	//Reads the other frame's timestamps, never waits on the GPU
+	void readTimings() {
+		queryFrame ^= 1;
+		if (!timestampsIssued[queryFrame]) return;
+
+		GLint available = 0;
+		glGetQueryObjectiv(timestampQueries[queryFrame][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) return;
+
+		GLuint64 stamps[2];
+		for (int i = 0; i < 2; i++)
+			glGetQueryObjectui64v(timestampQueries[queryFrame][i], GL_QUERY_RESULT, &stamps[i]);
+		gpuTime = (stamps[1] - stamps[0]) / 1000000.f;
+	}
+public:
+	static const unsigned int tileSize = 16; //TILE_SIZE and MAX_LIGHTS_PER_TILE in tiledDeferred.comp
+	static const unsigned int maxLightsPerTile = 512;
+	//ShaderFeature bits the shader implements, the point and spot lights come from the light buffer
+	static const uint32_t features = ShaderFeature_dirLight | ShaderFeature_bloom | ShaderFeature_clusterHeatmap | ShaderFeature_deferredMSAA | ShaderFeature_dirShadows | ShaderFeature_lightShadows;
+
+	float gpuTime = 0.f; //Of the dispatch in ms, a frame late
+	unsigned int tileCount = 0;
+
+	static bool supported() {
+		return LightClusters::supported() && GLEW_ARB_shader_image_load_store;
+	}
+
+	void init() {
+		glGenQueries(4, &timestampQueries[0][0]);
+	}
+	~TiledDeferred() {
+		if (timestampQueries[0][0])
+			glDeleteQueries(4, &timestampQueries[0][0]);
+	}
+
+	Shader& get(uint32_t features) {
+		features &= TiledDeferred::features;
+		std::unique_ptr<Shader>& variant = variants[features];
+		if (!variant) {
+			variant = std::make_unique<Shader>();
+			variant->loadComputeShader("Shaders/Lighting/tiledDeferred.comp", ShaderVariants::defines(features));
+		}
+		return *variant;
+	}
+	void reload() {
+		for (auto& variant : variants)
+			variant.second->loadComputeShader("Shaders/Lighting/tiledDeferred.comp", ShaderVariants::defines(variant.first));
+	}
+	size_t count() const { return variants.size(); }
+
+	//Shades the packed G-buffer(Shaders/Common/gBuffer.glsl) into hdr, and the bright parts into bright with ShaderFeature_bloom. Sky pixels are
+	//left untouched. With ShaderFeature_deferredMSAA the G-buffer has samples per pixel and edgeMask marks the pixels shaded per sample.
+	//The lights have to be uploaded already, the view comes from the Camera block. shininessExponent is the Blinn-Phong one of every pixel
+	void shade(uint32_t features, GLuint depth, GLuint normal, GLuint albedoMetallic, GLuint edgeMask, int samples, GLuint hdr, GLuint bright,
+		unsigned int width, unsigned int height, const glm::mat4& proj, GLuint lightCount, float shininessExponent) {
+		readTimings();
+		glQueryCounter(timestampQueries[queryFrame][0], GL_TIMESTAMP);
+
+		Shader& shader = get(features);
+		shader.use();
+		shader.setMat4("inverseProj", glm::inverse(proj));
+		shader.set1ui("lightCount", lightCount);
+		shader.set1f("shininessExponent", shininessExponent);
+
+		GLenum target = GL_TEXTURE_2D;
+		if (features & ShaderFeature_deferredMSAA) {
+			target = GL_TEXTURE_2D_MULTISAMPLE;
+			shader.set1i("gBufferSamples", samples);
+			glState.bindTexture(GL_TEXTURE3, GL_TEXTURE_2D, edgeMask);
+		}
+		glState.bindTexture(GL_TEXTURE0, target, depth);
+		glState.bindTexture(GL_TEXTURE1, target, normal);
+		glState.bindTexture(GL_TEXTURE2, target, albedoMetallic);
+		glBindImageTexture(0, hdr, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+		if (features & ShaderFeature_bloom)
+			glBindImageTexture(1, bright, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+
+		unsigned int tilesX = (width + tileSize - 1) / tileSize, tilesY = (height + tileSize - 1) / tileSize;
+		tileCount = tilesX * tilesY;
+		glDispatchCompute(tilesX, tilesY, 1);
+		glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT); //Drawn over and sampled by the post-processing
+
+		glQueryCounter(timestampQueries[queryFrame][1], GL_TIMESTAMP);
+		timestampsIssued[queryFrame] = true;
+	}
+};
+#endif
\ No newline at end of file
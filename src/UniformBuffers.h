@@ -0,0 +1,191 @@
+#pragma once
+#ifndef UNIFORM_BUFFERS
+#define UNIFORM_BUFFERS
+
+#include <GLEW/glew.h>
+#include <GLAD/gl.h>
+
+#include <GLM/glm.hpp>
+
+#include "Light.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+//Binding points of the blocks in Shaders/Common/uniforms.glsl
+enum UniformBinding : GLuint {
+	CAMERA_BINDING = 0,
+	FRAME_BINDING = 1,
+	LIGHTS_BINDING = 2,
+	SHADOWS_BINDING = 3 //Shaders/Common/shadows.glsl
+};
+const unsigned int maxPointLights = 16; //MAX_POINT_LIGHTS in uniforms.glsl
+const unsigned int maxShadowCascades = 4; //MAX_CASCADES in shadows.glsl
+const unsigned int maxShadowedLights = 64; //MAX_SHADOWED_LIGHTS in shadows.glsl
+
+//std140 mirrors of the GLSL blocks. Every vec3 is followed by a float because std140 gives a vec3 the 16 bytes of a vec4
+struct CameraBlock {
+	glm::mat4 view;
+	glm::mat4 proj;
+	glm::mat4 projView;
+	glm::vec3 viewPos;
+	float nearPlane;
+	glm::vec3 viewForward;
+	float farPlane;
+	glm::mat4 inverseProjView;
+};
+static_assert(offsetof(CameraBlock, projView) == 128, "CameraBlock doesn't match std140");
+static_assert(offsetof(CameraBlock, viewPos) == 192, "CameraBlock doesn't match std140");
+static_assert(offsetof(CameraBlock, viewForward) == 208, "CameraBlock doesn't match std140");
+static_assert(offsetof(CameraBlock, inverseProjView) == 224, "CameraBlock doesn't match std140");
+static_assert(sizeof(CameraBlock) == 288, "CameraBlock doesn't match std140");
+
+struct FrameBlock {
+	glm::vec2 screenSize;
+	glm::vec2 inverseScreenSize;
+	float time;
+	float deltaTime;
+	uint32_t frameIndex;
+	float padding;
+};
+static_assert(offsetof(FrameBlock, time) == 16, "FrameBlock doesn't match std140");
+static_assert(sizeof(FrameBlock) == 32, "FrameBlock doesn't match std140");
+
+struct DirLightData {
+	glm::vec3 direction;
+	float intensity;
+	glm::vec3 diffuse;
+	float padding;
+
+	DirLightData() {}
+	DirLightData(const DirLight& light) : direction(light.dir), intensity(light.intensity), diffuse(light.diffuse), padding(0.f) {}
+};
+struct PointLightData {
+	glm::vec3 position;
+	float intensity;
+	glm::vec3 diffuse;
+	float range;
+
+	PointLightData() {}
+	PointLightData(const PointLight& light) : position(light.pos), intensity(light.intensity), diffuse(light.diffuse), range(light.range()) {}
+};
+struct SpotLightData {
+	glm::vec3 position;
+	float intensity;
+	glm::vec3 direction;
+	float cutOff; //Cosines
+	glm::vec3 diffuse;
+	float outerCutOff;
+
+	SpotLightData() {}
+	SpotLightData(const SpotLight& light) : position(light.pos), intensity(light.intensity), direction(light.dir), cutOff(light.cosCutOff), diffuse(light.diffuse), outerCutOff(light.cosOuterCutOff) {}
+};
+//Structs in std140 are rounded up to 16 bytes, array elements too
+static_assert(sizeof(DirLightData) == 32 && offsetof(DirLightData, diffuse) == 16, "DirLightData doesn't match std140");
+static_assert(sizeof(PointLightData) == 32 && offsetof(PointLightData, diffuse) == 16, "PointLightData doesn't match std140");
+static_assert(sizeof(SpotLightData) == 48 && offsetof(SpotLightData, direction) == 16 && offsetof(SpotLightData, diffuse) == 32, "SpotLightData doesn't match std140");
+
+struct LightsBlock {
+	DirLightData dirLight;
+	SpotLightData spotLight;
+	PointLightData pointLights[maxPointLights];
+	int32_t pointLightCount;
+	uint32_t padding[3];
+};
+static_assert(offsetof(LightsBlock, spotLight) == 32, "LightsBlock doesn't match std140");
+static_assert(offsetof(LightsBlock, pointLights) == 80, "LightsBlock doesn't match std140");
+static_assert(offsetof(LightsBlock, pointLightCount) == 80 + 32 * maxPointLights, "LightsBlock doesn't match std140");
+static_assert(sizeof(LightsBlock) % 16 == 0, "LightsBlock doesn't match std140");
+
+struct LightShadowData {
+	glm::mat4 matrix; //World to clip space, spot lights only
+	glm::vec4 rects[6]; //Atlas UV offset and size of each face
+	glm::vec3 position;
+	float nearPlane;
+	float farPlane;
+	uint32_t type;
+	float texelScale; //World size of a texel per unit of distance from the light
+	float padding;
+
+	static const uint32_t pointType = 0, spotType = 1; //SHADOW_POINT_LIGHT and SHADOW_SPOT_LIGHT
+};
+static_assert(sizeof(LightShadowData) == 192 && offsetof(LightShadowData, position) == 160, "LightShadowData doesn't match std140");
+
+struct ShadowsBlock {
+	glm::mat4 cascadeMatrices[maxShadowCascades]; //World to the clip space of each cascade
+	glm::vec4 cascadeSplits; //View depth where each cascade ends
+	glm::vec4 cascadeTexelSizes; //World size of a texel of each cascade
+	int32_t cascadeCount;
+	float normalOffset; //In texels
+	float depthBias;
+	int32_t spotLightShadow; //Index in lightShadows of the Lights block's spot light, -1 unshadowed
+	int32_t filter; //ShadowFilter of the cascades
+	float lightSize; //Tangent of the directional light's angular radius
+	float maxPenumbra; //World units
+	int32_t pyramidLevels; //Of the cascades' min/max pyramid
+	glm::ivec4 pointLightShadows[maxPointLights / 4]; //Same for its point lights, packed four per element
+	LightShadowData lightShadows[maxShadowedLights];
+};
+static_assert(offsetof(ShadowsBlock, cascadeSplits) == 64 * maxShadowCascades, "ShadowsBlock doesn't match std140");
+static_assert(offsetof(ShadowsBlock, cascadeCount) == 64 * maxShadowCascades + 32, "ShadowsBlock doesn't match std140");
+static_assert(offsetof(ShadowsBlock, pointLightShadows) == 64 * maxShadowCascades + 64, "ShadowsBlock doesn't match std140");
+static_assert(offsetof(ShadowsBlock, lightShadows) == 64 * maxShadowCascades + 64 + 4 * maxPointLights, "ShadowsBlock doesn't match std140");
+static_assert(sizeof(ShadowsBlock) <= 16384, "ShadowsBlock is past the smallest GL_MAX_UNIFORM_BLOCK_SIZE");
+static_assert(sizeof(ShadowsBlock) % 16 == 0, "ShadowsBlock doesn't match std140");
+
+//One uniform buffer holding every shared block, each range bound once to its binding point so all programs read the same data.
+//Fill the block structs during the frame, upload() sends them with a single buffer update however many programs or lights there are.
+class FrameUniforms {
+private:
+	GLuint UBO = 0;
+	GLintptr cameraOffset = 0, frameOffset = 0, lightsOffset = 0, shadowsOffset = 0;
+	std::vector<unsigned char> staging;
+
+	static GLintptr alignUp(GLintptr value, GLint alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+public:
+	CameraBlock camera{};
+	FrameBlock frame{};
+	LightsBlock lights{};
+	ShadowsBlock shadows{};
+
+	void init() {
+		//Ranges bound with glBindBufferRange have to start at a multiple of this(usually 256)
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+		cameraOffset = 0;
+		frameOffset = alignUp(cameraOffset + sizeof(CameraBlock), alignment);
+		lightsOffset = alignUp(frameOffset + sizeof(FrameBlock), alignment);
+		shadowsOffset = alignUp(lightsOffset + sizeof(LightsBlock), alignment);
+		staging.assign(shadowsOffset + sizeof(ShadowsBlock), 0);
+
+		glGenBuffers(1, &UBO);
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glBufferData(GL_UNIFORM_BUFFER, staging.size(), nullptr, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+		glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BINDING, UBO, cameraOffset, sizeof(CameraBlock));
+		glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_BINDING, UBO, frameOffset, sizeof(FrameBlock));
+		glBindBufferRange(GL_UNIFORM_BUFFER, LIGHTS_BINDING, UBO, lightsOffset, sizeof(LightsBlock));
+		glBindBufferRange(GL_UNIFORM_BUFFER, SHADOWS_BINDING, UBO, shadowsOffset, sizeof(ShadowsBlock));
+	}
+	~FrameUniforms() {
+		if (UBO) glDeleteBuffers(1, &UBO);
+	}
+
+	void upload() {
+		std::memcpy(staging.data() + cameraOffset, &camera, sizeof(CameraBlock));
+		std::memcpy(staging.data() + frameOffset, &frame, sizeof(FrameBlock));
+		std::memcpy(staging.data() + lightsOffset, &lights, sizeof(LightsBlock));
+		std::memcpy(staging.data() + shadowsOffset, &shadows, sizeof(ShadowsBlock));
+
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, staging.size(), staging.data());
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+};
+#endif
\ No newline at end of file
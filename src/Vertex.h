@@ -7,10 +7,10 @@ struct Vertex {
     glm::vec3 position;
     glm::vec3 normal;
     glm::vec2 texCoord;
-    glm::vec3 tangent;
+    glm::vec4 tangent; //w is the handedness, bitangent = cross(normal, tangent) * w
     //glm::vec3 Bitangent;
 
-    Vertex(glm::vec3 position = glm::vec3(0.f), glm::vec3 normal = glm::vec3(0.f), glm::vec2 texCoord = glm::vec2(0.f), glm::vec3 tangent = glm::vec3(0.f)){//, glm::vec3 tangent = glm::vec3(1.f, 0.f, 0.f)) {//, glm::vec3 bitangent = glm::vec3(0.f, 1.f, 0.f)) {
+    Vertex(glm::vec3 position = glm::vec3(0.f), glm::vec3 normal = glm::vec3(0.f), glm::vec2 texCoord = glm::vec2(0.f), glm::vec4 tangent = glm::vec4(0.f)){//, glm::vec3 tangent = glm::vec3(1.f, 0.f, 0.f)) {//, glm::vec3 bitangent = glm::vec3(0.f, 1.f, 0.f)) {
         this->position = position;
         this->normal = normal;
         this->texCoord = texCoord;
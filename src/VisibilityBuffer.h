@@ -0,0 +1,327 @@
+#pragma once
+#ifndef VISIBILITY_BUFFER
+#define VISIBILITY_BUFFER
+
+#include <GLEW/glew.h>
+#include <GLAD/gl.h>
+
+#include <GLM/glm.hpp>
+
+#include "Shader.h"
+#include "ShaderVariants.h"
+#include "Mesh.h"
+#include "Material.h"
+#include "LightClusters.h"
+#include "GLState.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+//std430 mirrors of Shaders/Common/visibility.glsl
+struct VisibilityVertex {
+	glm::vec4 positionU; //Texture coordinates in the w of the first two
+	glm::vec4 normalV;
+	glm::vec4 tangent;
+};
+struct VisibilityDraw {
+	glm::mat4 model;
+	glm::mat4 normalMatrix;
+	uint32_t firstVertex;
+	uint32_t firstIndex;
+	uint32_t material;
+	uint32_t padding;
+};
+static_assert(sizeof(VisibilityVertex) == 48 && sizeof(VisibilityDraw) == 144 && offsetof(VisibilityDraw, firstVertex) == 128, "Visibility buffer structs don't match std430");
+
+//Visibility buffer rendering. The geometry pass writes nothing but a 32 bit ID per pixel(the draw in the upper drawBits, the triangle of
+//its mesh in the lower triangleBits) and depth. Every mesh drawn is copied once into vertex and index pools, so the shading passes can fetch
+//the pixel's triangle, rebuild its barycentrics and their screen derivatives and run the material once per pixel whatever the overdraw.
+//Without bindless textures the materials are shaded one at a time: a fullscreen pass writes each pixel's material slot as its depth,
+//then each material draws a quad at its slot's depth with GL_EQUAL and early depth testing skips the other materials' pixels.
+class VisibilityBuffer {
+private:
+	struct MeshRange {
+		uint32_t firstVertex;
+		uint32_t firstIndex;
+	};
+	std::unordered_map<const Mesh*, MeshRange> ranges; //Meshes are kept by address, models stay loaded once they are
+	GLuint vertexBuffer = 0, indexBuffer = 0, drawBuffer = 0;
+	size_t vertexCapacity = 0, indexCapacity = 0, drawCapacity = 0; //In elements
+
+	Shader captureShader, geometryShader, materialDepthShader;
+	GLuint geometryFBO = 0, materialFBO = 0, shadeFBO = 0;
+	GLuint idTexture = 0, depthTexture = 0, materialDepthTexture = 0;
+	GLuint shadeTargets[2] = {}; //Colors attached to shadeFBO
+
+	//This frame's draws and the materials they use, by slot
+	std::vector<VisibilityDraw> draws;
+	std::vector<Mesh*> drawMeshes;
+	std::vector<Material*> materials;
+	std::unordered_map<const Material*, uint32_t> materialSlots;
+
+	//Grows buffer to hold needed elements of stride bytes, keeping the first used ones
+	static void reserve(GLuint& buffer, size_t& capacity, size_t used, size_t needed, size_t stride) {
+		if (needed <= capacity) return;
+		capacity = std::max(needed, capacity * 2);
+
+		GLuint grown;
+		glGenBuffers(1, &grown);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+		glBufferData(GL_COPY_WRITE_BUFFER, capacity * stride, NULL, GL_DYNAMIC_DRAW);
+		if (buffer) {
+			if (used) {
+				glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used * stride);
+				glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			}
+			glDeleteBuffers(1, &buffer);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		buffer = grown;
+	}
+	//Element buffer of a mesh that kept no copy of its indices(glTF), widened to 32 bit
+	static void readIndices(const Mesh& mesh, std::vector<uint32_t>& indices) {
+		size_t size = mesh.indexType == GL_UNSIGNED_BYTE ? 1 : mesh.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+		std::vector<unsigned char> raw(indices.size() * size);
+
+		glBindBuffer(GL_COPY_READ_BUFFER, mesh.EBO);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, 0, raw.size(), raw.data());
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+		for (size_t i = 0; i < indices.size(); i++) {
+			if (size == 1) indices[i] = raw[i];
+			else if (size == 2) { uint16_t index; std::memcpy(&index, &raw[i * 2], 2); indices[i] = index; }
+			else std::memcpy(&indices[i], &raw[i * 4], 4);
+		}
+	}
+	//Copies the mesh's vertices and indices into the pools the first time it's drawn
+	const MeshRange& registerMesh(Mesh& mesh) {
+		auto found = ranges.find(&mesh);
+		if (found != ranges.end()) return found->second;
+
+		MeshRange range = { (uint32_t)pooledVertices, (uint32_t)pooledIndices };
+		unsigned int indexCount = mesh.indexCount ? mesh.indexCount : mesh.vertexCount;
+		if (indexCount / 3 > maxTriangles)
+			std::cout << "ERROR::VISIBILITYBUFFER.H::MESH HAS MORE TRIANGLES THAN THE ID HOLDS, THE REST SHADE AS THE FIRST ONES" << std::endl;
+
+		//The capture vertex shader reads the mesh through its own VAO and writes what it reads, nothing is rasterized
+		reserve(vertexBuffer, vertexCapacity, pooledVertices, pooledVertices + mesh.vertexCount, sizeof(VisibilityVertex));
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBILITY_VERTICES_BINDING, vertexBuffer);
+		captureShader.use();
+		captureShader.set1ui("firstVertex", range.firstVertex);
+		glState.enable(GL_RASTERIZER_DISCARD);
+		glState.bindVertexArray(mesh.VAO);
+		glDrawArrays(GL_POINTS, 0, mesh.vertexCount);
+		glState.disable(GL_RASTERIZER_DISCARD);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		std::vector<uint32_t> indices(indexCount);
+		if (!mesh.indexCount)
+			std::iota(indices.begin(), indices.end(), 0u);
+		else if (!mesh.indices.empty())
+			indices.assign(mesh.indices.begin(), mesh.indices.end());
+		else
+			readIndices(mesh, indices);
+
+		reserve(indexBuffer, indexCapacity, pooledIndices, pooledIndices + indexCount, sizeof(uint32_t));
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, pooledIndices * sizeof(uint32_t), indexCount * sizeof(uint32_t), indices.data());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		pooledVertices += mesh.vertexCount;
+		pooledIndices += indexCount;
+		return ranges[&mesh] = range;
+	}
+	void bindBuffers() {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBILITY_VERTICES_BINDING, vertexBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBILITY_INDICES_BINDING, indexBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBILITY_DRAWS_BINDING, drawBuffer);
+	}
+public:
+	//VISIBILITY_TRIANGLE_BITS and VISIBILITY_MATERIAL_SLOTS in visibility.glsl
+	static const unsigned int triangleBits = 20, drawBits = 12;
+	static const unsigned int maxTriangles = 1u << triangleBits, maxDraws = 1u << drawBits;
+	static const unsigned int maxMaterials = 65535;
+	static const unsigned int bytesPerPixel = 10; //ID, depth and the 16 bit material depth
+
+	//Of the last frame
+	unsigned int drawCount = 0;
+	unsigned int materialCount = 0; //Shading passes
+	unsigned int droppedDraws = 0; //Past maxDraws or maxMaterials, not drawn
+	size_t pooledVertices = 0, pooledIndices = 0;
+
+	//The capture pass writes storage buffers from a vertex shader
+	static bool supported() {
+		if (!GLEW_ARB_shader_storage_buffer_object) return false;
+
+		static GLint vertexStorageBlocks = -1;
+		if (vertexStorageBlocks < 0)
+			glGetIntegerv(GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS, &vertexStorageBlocks);
+		return vertexStorageBlocks > 0;
+	}
+
+	void init(unsigned int width, unsigned int height) {
+		captureShader.loadShader("Shaders/Visibility/capture.vert", "Shaders/Visibility/visibility.frag");
+		geometryShader.loadShader("Shaders/Visibility/visibility.vert", "Shaders/Visibility/visibility.frag");
+		materialDepthShader.loadShader("Shaders/renderQuad.vert", "Shaders/Visibility/materialDepth.frag");
+
+		glGenFramebuffers(1, &geometryFBO);
+		glGenFramebuffers(1, &materialFBO);
+		glGenFramebuffers(1, &shadeFBO);
+		glGenTextures(1, &idTexture);
+		glGenTextures(1, &depthTexture);
+		glGenTextures(1, &materialDepthTexture);
+		glGenBuffers(1, &drawBuffer);
+		resize(width, height);
+	}
+	~VisibilityBuffer() {
+		if (!geometryFBO) return;
+
+		GLuint framebuffers[3] = { geometryFBO, materialFBO, shadeFBO };
+		GLuint textures[3] = { idTexture, depthTexture, materialDepthTexture };
+		GLuint buffers[3] = { vertexBuffer, indexBuffer, drawBuffer };
+		glState.deleteFramebuffers(3, framebuffers);
+		glState.deleteTextures(3, textures);
+		glDeleteBuffers(3, buffers);
+	}
+	void resize(unsigned int width, unsigned int height) {
+		struct Target {
+			GLuint texture;
+			GLint internalFormat;
+			GLenum format, type;
+		};
+		const Target targets[3] = {
+			{ idTexture, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT },
+			{ depthTexture, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_FLOAT },
+			{ materialDepthTexture, GL_DEPTH_COMPONENT16, GL_DEPTH_COMPONENT, GL_FLOAT }
+		};
+		for (const Target& target : targets) {
+			glState.bindTexture(GL_TEXTURE_2D, target.texture);
+			glTexImage2D(GL_TEXTURE_2D, 0, target.internalFormat, width, height, 0, target.format, target.type, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		}
+
+		glState.bindFramebuffer(GL_FRAMEBUFFER, geometryFBO);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, idTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::VISIBILITYBUFFER.H::GEOMETRY FRAMEBUFFER IS NOT COMPLETE" << std::endl;
+
+		glState.bindFramebuffer(GL_FRAMEBUFFER, materialFBO);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, materialDepthTexture, 0);
+		glDrawBuffer(GL_NONE);
+
+		glState.bindFramebuffer(GL_FRAMEBUFFER, shadeFBO);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, materialDepthTexture, 0);
+		shadeTargets[0] = shadeTargets[1] = 0xFFFFFFFF; //Attached again by the next shade()
+
+		glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void clear() {
+		draws.clear();
+		drawMeshes.clear();
+		materials.clear();
+		materialSlots.clear();
+		droppedDraws = 0;
+	}
+	void add(MaterialMesh& mesh, const glm::mat4& model) {
+		auto slot = materialSlots.find(mesh.currentMaterial);
+		bool full = draws.size() >= maxDraws || (slot == materialSlots.end() && materials.size() >= maxMaterials);
+		if (full) {
+			droppedDraws++;
+			return;
+		}
+		if (slot == materialSlots.end()) {
+			slot = materialSlots.emplace(mesh.currentMaterial, (uint32_t)materials.size()).first;
+			materials.push_back(mesh.currentMaterial);
+		}
+
+		VisibilityDraw draw;
+		draw.model = model;
+		draw.normalMatrix = glm::mat4(glm::transpose(glm::inverse(glm::mat3(model))));
+		draw.material = slot->second;
+		draw.padding = 0;
+		draws.push_back(draw);
+		drawMeshes.push_back(&mesh);
+	}
+
+	//Geometry pass of the added draws into the ID and depth targets, registering the meshes it hasn't seen yet
+	void render() {
+		for (size_t i = 0; i < draws.size(); i++) {
+			const MeshRange& range = registerMesh(*drawMeshes[i]);
+			draws[i].firstVertex = range.firstVertex;
+			draws[i].firstIndex = range.firstIndex;
+		}
+		drawCount = (unsigned int)draws.size();
+		materialCount = (unsigned int)materials.size();
+
+		if (draws.size() > drawCapacity) {
+			drawCapacity = std::max(draws.size(), drawCapacity * 2);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawBuffer);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, drawCapacity * sizeof(VisibilityDraw), NULL, GL_DYNAMIC_DRAW);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawBuffer);
+		if (!draws.empty())
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, draws.size() * sizeof(VisibilityDraw), draws.data());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		glState.bindFramebuffer(GL_FRAMEBUFFER, geometryFBO);
+		const GLuint empty[4] = { 0xFFFFFFFF, 0, 0, 0 }; //VISIBILITY_EMPTY
+		glClearBufferuiv(GL_COLOR, 0, empty);
+		glState.depthMask(GL_TRUE);
+		glClear(GL_DEPTH_BUFFER_BIT);
+
+		geometryShader.use();
+		for (size_t i = 0; i < draws.size(); i++) {
+			geometryShader.set1ui("drawID", (GLuint)i);
+			geometryShader.setMat4("model", draws[i].model);
+			drawMeshes[i]->draw();
+		}
+		glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+	//Shades every pixel of the last render() into hdr, and bright when it isn't 0(the second output of the surface shaders).
+	//Each material runs the variant of variants for features plus its maps in mapMask with ShaderFeature_visibilityResolve, through quad.
+	//Pixels nothing covers are left untouched. Leaves shadeFBO bound
+	void shade(ShaderVariants& variants, uint32_t features, uint32_t mapMask, GLuint hdr, GLuint bright, RenderQuad& quad) {
+		bindBuffers();
+
+		//Material slots as depth
+		glState.bindFramebuffer(GL_FRAMEBUFFER, materialFBO);
+		glState.depthMask(GL_TRUE);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		quad.Draw(materialDepthShader, { idTexture });
+
+		glState.bindFramebuffer(GL_FRAMEBUFFER, shadeFBO);
+		if (shadeTargets[0] != hdr || shadeTargets[1] != bright) {
+			shadeTargets[0] = hdr;
+			shadeTargets[1] = bright;
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, hdr, 0);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, bright, 0);
+			unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+			glDrawBuffers(bright ? 2 : 1, attachments);
+		}
+
+		glState.depthFunc(GL_EQUAL);
+		glState.depthMask(GL_FALSE);
+		glState.bindTexture(GL_TEXTURE13, GL_TEXTURE_2D, idTexture);
+		for (uint32_t slot = 0; slot < materials.size(); slot++) {
+			Shader& shader = variants.get(features | ShaderFeature_visibilityResolve | (materials[slot]->features() & mapMask));
+			materials[slot]->bind(shader);
+			shader.set1f("materialDepth", slot / float(maxMaterials));
+			quad.draw();
+		}
+		glState.depthMask(GL_TRUE);
+		glState.depthFunc(GL_LESS);
+	}
+
+	GLuint depth() const { return depthTexture; }
+	GLuint ids() const { return idTexture; }
+};
+#endif
\ No newline at end of file
@@ -28,6 +28,23 @@
 #include "Flags.h"
 #include "Material.h"
 #include "Query.h"
+#include "InstanceBuffer.h"
+#include "Stats.h"
+#include "Scene.h"
+#include "Benchmarks.h"
+#include "HiZCulling.h"
+#include "OcclusionQueries.h"
+#include "AsyncLoader.h"
+#include "UniformBuffers.h"
+#include "ShaderVariants.h"
+#include "ShaderBuildQueue.h"
+#include "RenderQueue.h"
+#include "CommandList.h"
+#include "LightClusters.h"
+#include "TiledDeferred.h"
+#include "VisibilityBuffer.h"
+#include "ShadowCascades.h"
+#include "ShadowAtlas.h"
 #include<thread>
 #include<chrono>
 
@@ -100,22 +117,26 @@ void initBloom();
 void initPostProc();
 void initMSAA();
 void initDeferredShading();
+void classifyEdges();
+void bindGBuffer(GLenum firstUnit, GLenum edgeMaskUnit);
 void setupPBR();
 void initImGui();
 void loadModels();
+void setupScene();
 
 //On state change(buttons, resize, keys, etc.)
 
 	//--UI
 void updateIBL();
-void updateModelMatrices();
-void updateObjectMatrices();
 void updateCurrentModel();
+Task<void> streamModel(int index);
+void showModel(int index);
 void updateMaterial();
 
 	//--Window and OS
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
 void setupBloom();
 void setupPostProc();
 void setupMSAA();
@@ -123,8 +144,30 @@ void setupDeferredShading();
 
 //Every frame
 void processInput(GLFWwindow* window);
-void updateUniforms(Shader& shader);
-void renderScene(Shader& shader, Shader& PBRShader);
+void updateFrameUniforms();
+void gatherLights();
+void moveDemoLights();
+void updateLightClusters();
+bool shadowsActive();
+bool lightShadowsActive();
+void updateShadows();
+void renderShadows();
+void generateDemoLights();
+uint32_t passFeatures();
+uint32_t materialMapMask();
+Shader& surfaceShader(const Model& model);
+void bindIBLMaps();
+bool visibilityPipeline();
+void renderDeferred();
+void renderVisibility();
+void renderScene(ShaderVariants& mainShaders, ShaderVariants& PBRShaders);
+void runPipelineBenchmark();
+void runShadowBenchmark();
+void renderStressTest();
+void renderStressTestGPU(const AABB& localBox);
+void renderStressTestQueries(InstanceData* instances, const glm::mat4& localMat, const AABB& localBox);
+void renderStressTestCommandLists(const glm::mat4& localMat, const BoundingSphere& localSphere, unsigned int side, float halfExtent);
+void renderLightBoxes();
 void beginPostProcess();
 void endPostProcess();
 void updateImGui();
@@ -135,7 +178,6 @@ unsigned int SCR_WIDTH = 920; //1280
 unsigned int SCR_HEIGHT = 720; //720
 
 float fov = 45.f;
-glm::mat4 model(1.f);
 glm::mat4 view(1.f);
 glm::mat4 proj(1.f);
 
@@ -150,19 +192,39 @@ std::string vendor;
 std::string gpuVersion;
 
 //Shaders
-Shader shader;
+ShaderVariants mainShaders; //Compiled per feature combination, see passFeatures() and materialMapMask()
 //Shader skyboxShader;
-Shader deferredShader;
+ShaderVariants gBufferShaders; //Deferred geometry pass, only the material maps and SRGB_TEXTURES
 Shader postprocShader;
 Shader blurShader;
 Shader debugQuadShader;
-Shader PBRShader;
+ShaderVariants PBRShaders;
 Shader equirectangularToCubemapShader;
 Shader hdrSkyboxShader;
 Shader irradianceShader;
 Shader prefilterShader;
 Shader brdfShader;
 Shader lightBoxShader;
+Shader deferredEdgesShader;
+//Programs built at startup through shaderQueue, also what the shader build benchmark compiles
+struct StartupProgram {
+	Shader* shader;
+	ProgramSources sources;
+};
+const StartupProgram startupPrograms[] = {
+	{ &postprocShader, { "Shaders/renderQuad.vert", "Shaders/postProc.frag" } },
+	{ &blurShader, { "Shaders/renderQuad.vert", "Shaders/blur.frag" } },
+	{ &debugQuadShader, { "Shaders/renderQuad.vert", "Shaders/renderQuad.frag" } },
+	{ &equirectangularToCubemapShader, { "Shaders/cubemap.vert", "Shaders/PBR/EquirectangularToCubemap.frag" } },
+	{ &hdrSkyboxShader, { "Shaders/skybox.vert", "Shaders/PBR/hdrSkybox.frag" } },
+	{ &irradianceShader, { "Shaders/cubemap.vert", "Shaders/PBR/irradianceConvolution.frag" } },
+	{ &prefilterShader, { "Shaders/cubemap.vert", "Shaders/PBR/prefilter.frag" } },
+	{ &brdfShader, { "Shaders/renderQuad.vert", "Shaders/PBR/brdfShader.frag" } },
+	{ &lightBoxShader, { "Shaders/lightBox.vert", "Shaders/lightBox.frag" } },
+	{ &deferredEdgesShader, { "Shaders/renderQuad.vert", "Shaders/deferredEdges.frag" } }
+};
+ShaderBuildQueue shaderQueue;
+float shaderStartupTime = 0.f; //In ms, the loads in main(). Mostly binary cache reads on a warm start
 
 //Primitives
 std::vector<Vertex> cubeVertices = { // positions          // texture Coords
@@ -255,14 +317,52 @@ bool dirLightEnabled = true;
 bool pointLightEnabled = false;
 bool spotLightEnabled = false;
 
-DirLight dirLight(glm::vec3(-1.f, -1.f, -1.f), glm::vec3(1.f), 1.f);//(glm::vec3(-1.f, -1.f, -1.f), glm::vec3(.1f), glm::vec3(1.f), glm::vec3(.3f));
-PointLight pointLight(glm::vec3(0.f, .5f, 3.f), glm::vec3(1.f), 1.f);//(glm::vec3(0.f, .5f, 3.f), glm::vec3(.05f), glm::vec3(1.f), glm::vec3(.3f), 1.f, .014f, .000007f);
-SpotLight spotLight(cam.getPos(), cam.camFront, glm::vec3(1.f), 1.f, 12.5f, 15.f);//(cam.getPos(), cam.camFront, glm::vec3(0.f), glm::vec3(1.f), glm::vec3(.3f), 1.f, .09f, .032f, 12.5f, 15.f);
+//The lights live in the scene. The light block takes the dir and spot light from these entities and every PointLight there is
+Entity dirLightEntity = nullEntity;
+Entity pointLightEntity = nullEntity;
+Entity spotLightEntity = nullEntity;
+
+FrameUniforms frameUniforms;
+
+//Clustered lighting(PBR only). Lights every point and spot light in the scene plus the demo lights, which orbit the origin
+bool clusteredLighting = false;
+bool clusterHeatmap = false;
+LightClusters lightClusters;
+int demoLightCount = 0;
+float demoLightIntensity = .05f;
+bool demoLightsMoving = true;
+std::vector<PointLight> demoLights;
+std::vector<float> demoLightSpeeds; //Radians per second around the Y axis
 
 //Deferred shading
 unsigned int gBuffer;
-unsigned int gPosition, gNormal, gAlbedoSpec;
-unsigned int deferredRBO;
+unsigned int gAlbedoMetallic, gNormal, gMaterial, gDepth; //Packed layout of Shaders/Common/gBuffer.glsl
+int gBufferSamples = 1; //msaaSampleCount with MSAA on, the targets are multisampled then
+unsigned int edgeFBO, gEdgeMask; //Pixels whose samples see different surfaces, shaded per sample
+Query edgePass; //Samples passed, the edge pixel count
+const unsigned int gBufferBytesPerPixel = 4 + 4 + 2 + 4; //Was 8 + 8 + 4 + 4 with the world position and full normals in RGBA16F
+Query gBufferPass;
+Query deferredLightingPass;
+//Tiled compute resolve, lights the same list as the clusters
+bool tiledDeferredEnabled = true;
+bool tiledHeatmap = false;
+TiledDeferred tiledDeferred;
+float deferredShininess = 32.f; //The G-buffer keeps no shininess, the Blinn-Phong resolves use this for every pixel
+
+//Visibility buffer, replaces the forward and deferred passes when on
+bool visibilityBufferEnabled = false;
+VisibilityBuffer visibilityBuffer;
+Query visibilityPass;
+Query visibilityShadePass;
+
+//Cascaded shadow maps of the dir light, on for every pipeline
+bool shadowsEnabled = true;
+ShadowCascades shadowCascades;
+//Atlas of the point and spot lights' shadows
+bool lightShadowsEnabled = true;
+ShadowAtlas shadowAtlas;
+bool pipelineBenchmarkPending = false; //Run at the start of the next frame, outside the pass queries
+bool shadowBenchmarkPending = false;
 
 //PBR & IBL
 HDRMap hdrTexture;
@@ -294,7 +394,6 @@ float windowAlpha;
 bool pbrEnabled = true;
 bool iblEnabled = true;
 int materialState = 5;
-bool demoRotation = false;
 bool transformSRGB = true;
 bool useAlbedo = true;
 bool useNormalMap = true;
@@ -330,29 +429,28 @@ float SUBPIXEL_QUALITY = .25f;
 Model gun;
 Model suzanne;
 Model backpack;
-Model* modelPtr;
+Model placeholder; //Cube shown until the first model is resident
+
+//Models selectable in the UI, streamed in on first use
+enum AssetState { ASSET_UNLOADED, ASSET_LOADING, ASSET_RESIDENT, ASSET_FAILED };
+struct ModelAsset {
+	Model* model;
+	std::string path;
+	std::vector<std::string> textures; //Replace the first mesh's material(albedo, normal, metallic, roughness, AO) when not empty
+	Transform local;
+	AssetState state = ASSET_UNLOADED;
+};
+ModelAsset modelAssets[] = {
+	{ &gun, "Objects/Cerberus_by_Andrew_Maximov/Cerberus_LP.FBX", { "Objects/Cerberus_by_Andrew_Maximov/Textures/Cerberus_A.tga", "Objects/Cerberus_by_Andrew_Maximov/Textures/Cerberus_N.tga", "Objects/Cerberus_by_Andrew_Maximov/Textures/Cerberus_M.tga", "Objects/Cerberus_by_Andrew_Maximov/Textures/Cerberus_R.tga", "Objects/Cerberus_by_Andrew_Maximov/Textures/Raw/Cerberus_AO.tga" }, Transform(glm::vec3(0.f), glm::vec3(270.f, 0.f, 0.f), glm::vec3(0.02f)) },
+	{ &suzanne, "Objects/suzanne/scene.gltf", {}, Transform(glm::vec3(0.f), glm::vec3(0.f), glm::vec3(1.f)) }, //Its glTF material is used as is
+	{ &backpack, "Objects/SurvivalBackpack/Survival_BackPack_2.fbx", { "Objects/SurvivalBackpack/albedo.jpg", "Objects/SurvivalBackpack/normal.png", "Objects/SurvivalBackpack/metallic.jpg", "Objects/SurvivalBackpack/roughness.jpg", "Objects/SurvivalBackpack/AO.jpg" }, Transform(glm::vec3(0.f), glm::vec3(270.f, 0.f, 0.f), glm::vec3(1.f)) }
+};
+float uploadBudget = 2.f; //ms of GL uploads per frame for streamed assets
 
 Material material;
 
-glm::vec3 modelPos(0.f);
-glm::vec3 modelScale(1.f);
-glm::vec3 modelRot(0.f);
-
-glm::vec3 objectPos(0.f);
-glm::vec3 objectScale(1.f);
-glm::vec3 objectRot(0.f);
-
-glm::mat4 modelScaleMat(1.f);
-glm::mat4 modelTransMat(1.f);
-glm::mat4 modelRotMat(1.f);
-glm::mat4 modelRotScaleMat(1.f);
-glm::mat4 objectScaleMat(1.f);
-glm::mat4 objectTransMat(1.f);
-glm::mat4 objectRotMat(1.f);
-
-glm::mat4 objectDemoRot(1.f);
-
-float demoRotSpeed = .75f;
+Scene scene;
+Entity modelEntity = nullEntity;
 
 //Query
 Query guiPass;
@@ -361,6 +459,36 @@ Query postprocPass;
 
 //Light box
 ClassicMesh lightBox;
+InstanceBuffer lightBoxInstances;
+
+//Stress test
+bool stressTestEnabled = false;
+int stressInstanceCount = 10000;
+int stressObject = 0;
+float stressSpacing = 3.f;
+InstanceBuffer stressInstances;
+std::vector<glm::mat4> stressMatrices;
+int stressDrawMode = 0; //0: instanced, 1: a draw per copy recorded into command lists on worker threads
+CommandRecorder stressRecorder;
+
+//Frustum culling
+bool frustumCulling = true;
+int cullingMode = 0; //0: SIMD spheres, 1: BVH, 2: GPU Hi-Z, 3: occlusion queries(2 and 3 only apply to the stress test, the scene falls back to SIMD spheres)
+FrustumCuller sceneCuller;
+FrustumCuller stressCuller;
+BVH stressBVH;
+std::vector<AABB> stressBoxes;
+std::vector<uint32_t> stressVisible;
+HiZCuller hiZCuller;
+OcclusionQueryCuller queryCuller;
+const unsigned int stressChunkSize = 16; //Occlusion queries test the grid in chunks of 16x16 instances
+
+//Draws of the forward pass, rebuilt and sorted every frame
+RenderQueue renderQueue;
+
+//Picking
+double cursorX = 0.0, cursorY = 0.0;
+Entity pickedEntity = nullEntity;
 
 int main() {
 	//Change the current path (in case the file is run outside the IDE). Also this should be changed if i would release a seperate built .exe file(Now the current dir is being set to the solution path.
@@ -368,41 +496,36 @@ int main() {
 	
 	if(setupDependencies()) return -1;
 
+	setupScene();
+
 	//Shaders
-	shader.loadShader("Shaders/main.vert", "Shaders/main.frag");
+	//Every compile and link is issued before any status is read, the driver builds them on its threads meanwhile
+	ShaderBuildQueue::init();
+	auto shaderStart = std::chrono::high_resolution_clock::now();
+	mainShaders.load("Shaders/main.vert", "Shaders/main.frag",
+		ShaderFeature_albedoMap | ShaderFeature_normalMap | ShaderFeature_metallicMap | ShaderFeature_dirLight | ShaderFeature_pointLights | ShaderFeature_spotLight |
+		ShaderFeature_bloom | ShaderFeature_SRGBTextures | ShaderFeature_deferredResolve | ShaderFeature_deferredMSAA | ShaderFeature_dirShadows | ShaderFeature_lightShadows);
+	PBRShaders.load("Shaders/PBR/PBR.vert", "Shaders/PBR/PBR.frag", ~0u);
+	gBufferShaders.load("Shaders/main.vert", "Shaders/deferred.frag", ShaderFeature_materialMaps | ShaderFeature_SRGBTextures);
 	//skyboxShader = Shader("Shaders/skybox.vert", "Shaders/skybox.frag");
-	deferredShader.loadShader("Shaders/main.vert", "Shaders/deferred.frag");
-	postprocShader.loadShader("Shaders/renderQuad.vert", "Shaders/postProc.frag");
-	blurShader.loadShader("Shaders/renderQuad.vert", "Shaders/blur.frag");
-	debugQuadShader.loadShader("Shaders/renderQuad.vert", "Shaders/renderQuad.frag");
-	PBRShader.loadShader("Shaders/PBR/PBR.vert", "Shaders/PBR/PBR.frag");
-	equirectangularToCubemapShader.loadShader("Shaders/cubemap.vert", "Shaders/PBR/EquirectangularToCubemap.frag");
-	hdrSkyboxShader.loadShader("Shaders/skybox.vert", "Shaders/PBR/hdrSkybox.frag");
-	irradianceShader.loadShader("Shaders/cubemap.vert", "Shaders/PBR/irradianceConvolution.frag");
-	prefilterShader.loadShader("Shaders/cubemap.vert", "Shaders/PBR/prefilter.frag");
-	brdfShader.loadShader("Shaders/renderQuad.vert", "Shaders/PBR/brdfShader.frag");
-	lightBoxShader.loadShader("Shaders/lightBox.vert", "Shaders/lightBox.frag");
+	for (const StartupProgram& program : startupPrograms)
+		shaderQueue.submit(*program.shader, program.sources);
+	mainShaders.request(passFeatures() | ShaderFeature_materialMaps, shaderQueue); //The variants the first frame most likely uses
+	PBRShaders.request(passFeatures() | ShaderFeature_materialMaps, shaderQueue);
+	shaderQueue.wait();
+	shaderStartupTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - shaderStart).count();
 
 	//Matrices
 	proj = glm::perspective(glm::radians(fov), SCR_WIDTH / (float)SCR_HEIGHT, .1f, 100.f);
 
-	shader.use();
-	shader.setMat4("proj", proj);
-
-	renderQuad = RenderQuad(quadVertices);
-
-	//Lights
-	dirLight.set(shader, "dirLight");
-	pointLight.set(shader, "pointLights[0]");
-	spotLight.set(shader, "spotLight");
+	shadowCascades.init(2048);
+	shadowAtlas.init(4096);
 
-	shader.set1b("dirLightEnabled", dirLightEnabled);
-	shader.set1b("pointLightEnabled", pointLightEnabled);
-	shader.set1b("spotLightEnabled", spotLightEnabled);
+	//Camera, frame, light and shadow blocks shared by every program
+	frameUniforms.init();
+	updateFrameUniforms();
 
-	lightBoxShader.use();
-	lightBoxShader.setVec3("pos", pointLight.pos);
-	lightBoxShader.setVec3("diffuse", pointLight.diffuse);
+	renderQuad = RenderQuad(quadVertices);
 
 	initBloom();
 	initDeferredShading();
@@ -412,6 +535,7 @@ int main() {
 	setupPBR();
 	updateIBL();
 
+	asyncScheduler.start(std::max(2u, std::thread::hardware_concurrency()) - 1); //The GL thread keeps a core
 	loadModels();
 	updateCurrentModel();
 
@@ -424,6 +548,11 @@ int main() {
 	guiPass.loadQuery(GL_TIME_ELAPSED);
 	renderPass.loadQuery(GL_TIME_ELAPSED);
 	postprocPass.loadQuery(GL_TIME_ELAPSED);
+	gBufferPass.loadQuery(GL_TIME_ELAPSED);
+	edgePass.loadQuery(GL_SAMPLES_PASSED);
+	deferredLightingPass.loadQuery(GL_TIME_ELAPSED);
+	visibilityPass.loadQuery(GL_TIME_ELAPSED);
+	visibilityShadePass.loadQuery(GL_TIME_ELAPSED);
 
 	//Software & Hardware Info
 	openGLVersion = (char*)glGetString(GL_VERSION);
@@ -433,53 +562,87 @@ int main() {
 
 	//Light box
 	lightBox = ClassicMesh(cubeVertices);
+	lightBoxInstances.loadBuffer(64);
+
+	//Stress test
+	stressInstances.loadBuffer(100000);
+	stressMatrices.reserve(stressInstances.capacity);
+	stressCuller.reserve(stressInstances.capacity);
+	stressCuller.threadCount = std::max(1u, std::thread::hardware_concurrency() / 2);
+	stressRecorder.threadCount = std::max(1u, std::thread::hardware_concurrency() / 2);
+	if (HiZCuller::supported())
+		hiZCuller.init(SCR_WIDTH, SCR_HEIGHT, stressInstances.capacity);
+	queryCuller.init();
+	if (LightClusters::supported())
+		lightClusters.init();
+	if (TiledDeferred::supported())
+		tiledDeferred.init();
+	if (VisibilityBuffer::supported())
+		visibilityBuffer.init(SCR_WIDTH, SCR_HEIGHT);
 
 	while (!glfwWindowShouldClose(window)) {
 		//glCheckError();
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-				
-		if (deferredShadingEnabled) {
-			deferredShader.use();
-			glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		
-			deferredShader.setMat4("proj", proj);
+		auto frameStart = std::chrono::high_resolution_clock::now();
+		renderStats.reset();
 
-			deferredShader.use();
-			modelPtr->Draw(deferredShader);
-		
-			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if (pipelineBenchmarkPending) {
+			pipelineBenchmarkPending = false;
+			runPipelineBenchmark();
+			renderStats.reset();
+		}
+		if (shadowBenchmarkPending) {
+			shadowBenchmarkPending = false;
+			runShadowBenchmark();
+			renderStats.reset();
+		}
 
-			beginPostProcess();
+		if (frustumCulling) {
+			if (cullingMode != 1) {
+				scene.cull(Frustum(proj * view), sceneCuller);
+				renderStats.addCulling(sceneCuller.visibleCount, sceneCuller.culledCount, sceneCuller.cullTime);
+			}
+			else {
+				unsigned int visibleCount, culledCount;
+				auto cullStart = std::chrono::high_resolution_clock::now();
+				scene.cullBVH(Frustum(proj * view), visibleCount, culledCount);
+				renderStats.addCulling(visibleCount, culledCount, std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - cullStart).count());
+			}
+		}
 
-			shader.use();
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-			shader.set1b("deferredEnabled", true);
-			renderQuad.Draw(shader, { gPosition, gNormal, gAlbedoSpec }, 5);
-			shader.set1b("deferredEnabled", false);
-		}
+		if (shadowsActive() || lightShadowsActive())
+			renderShadows();
+				
+		bool forwardRendering = !deferredShadingEnabled && !visibilityPipeline();
+		if (visibilityPipeline())
+			renderVisibility();
+		else if (deferredShadingEnabled)
+			renderDeferred();
 		else {
 			//Begin MSAA
 			if (antiAliasing == 1) {
-				glBindFramebuffer(GL_FRAMEBUFFER, msaaFBO);
+				glState.bindFramebuffer(GL_FRAMEBUFFER, msaaFBO);
 				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 			}
 			else
 				beginPostProcess();
 
-			renderScene(shader, PBRShader);
+			if (pbrEnabled && (passFeatures() & ShaderFeature_clusteredLights))
+				updateLightClusters();
+			renderScene(mainShaders, PBRShaders);
 		}
 
-		if (pointLightEnabled)
-			lightBox.Draw(lightBoxShader);
+		if (pointLightEnabled && !forwardRendering) //The forward pass queues them with the scene
+			renderLightBoxes();
 
 
-		if (!deferredShadingEnabled && antiAliasing == 1) { //MSAA doesn't work with deferred rendering
+		if (forwardRendering && antiAliasing == 1) { //Deferred shading resolves its own multisampled G-buffer
 			//End MSAA
-			glBindFramebuffer(GL_READ_FRAMEBUFFER, msaaFBO);
-			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, intermediateFBO);
+			glState.bindFramebuffer(GL_READ_FRAMEBUFFER, msaaFBO);
+			glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, intermediateFBO);
 			glBlitFramebuffer(0, 0, SCR_WIDTH, SCR_HEIGHT, 0, 0, SCR_WIDTH, SCR_HEIGHT, GL_COLOR_BUFFER_BIT, GL_NEAREST);
-			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
 
 			//Post-processing
 			beginPostProcess();
@@ -500,22 +663,21 @@ int main() {
 		cam.updateView();
 		view = cam.getView();
 
-		if (demoRotation)
-			objectDemoRot = glm::rotate(objectDemoRot, demoRotSpeed * dt.deltaTime, glm::vec3(0.f, 1.f, 0.f));
-		model = modelTransMat * objectDemoRot * modelRotScaleMat;
+		asyncScheduler.pumpMainThread(uploadBudget); //Before the transforms so a model swapped in gets its bounds this frame
+		scene.updateTransforms(dt.deltaTime);
+		scene.updateBVH();
+		moveDemoLights();
 
-		lightBoxShader.use();
-		lightBoxShader.setMat4("PVMat", proj * view);
+		updateFrameUniforms();
 
-		updateUniforms(shader);
-		updateUniforms(PBRShader);
-		updateUniforms(deferredShader);
+		renderStats.cpuFrameTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - frameStart).count();
 
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
 
 	//End of program
+	asyncScheduler.stop();
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
@@ -555,6 +717,7 @@ int setupDependencies() {
 		return -1;
 	}
 
+	glewExperimental = GL_TRUE; //Needed to load the post 3.3 functions(instancing, buffer storage) in a core profile
 	GLenum err = glewInit();
 	if (err != GLEW_OK) {
 		/* Problem: glewInit failed, something is seriously wrong. */
@@ -566,8 +729,8 @@ int setupDependencies() {
 	//Debugging
 	int flags; glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
 	if (flags & GL_CONTEXT_FLAG_DEBUG_BIT) {
-		glEnable(GL_DEBUG_OUTPUT);
-		glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+		glState.enable(GL_DEBUG_OUTPUT);
+		glState.enable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
 		glDebugMessageCallback(glDebugOutput, nullptr);
 		//glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
 		glDebugMessageControl(GL_DEBUG_SOURCE_API,
@@ -578,19 +741,20 @@ int setupDependencies() {
 
 	//Configure GL options
 	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); //or GL_LINE
-	glEnable(GL_DEPTH_TEST);
+	glState.enable(GL_DEPTH_TEST);
 
 	//Face cull
-	glEnable(GL_CULL_FACE);
-	glCullFace(GL_BACK);
+	glState.enable(GL_CULL_FACE);
+	glState.cullFace(GL_BACK);
 	glFrontFace(GL_CCW);
 
 	//Remove visible edges of cube maps (Todo: this doesnt work for some cubemaps
-	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+	glState.enable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
 	//Input setup
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 	glfwSetCursorPosCallback(window, mouse_callback);
+	glfwSetMouseButtonCallback(window, mouse_button_callback);
 
 	//Background Color
 	glClearColor(0.f, 0.f, 0.f, 1.f);
@@ -621,15 +785,11 @@ void initMSAA() {
 }
 void initDeferredShading() {
 	glGenFramebuffers(1, &gBuffer);
-	glGenTextures(1, &gPosition);
-	glGenTextures(1, &gNormal);
-	glGenTextures(1, &gAlbedoSpec);
-	glGenRenderbuffers(1, &deferredRBO);
+	glGenFramebuffers(1, &edgeFBO);
+	glGenTextures(1, &gEdgeMask);
 	setupDeferredShading();
 }
 void setupPBR() {
-	PBRShader.use();
-
 	//Init
 	PBRSkybox.setup();
 	PBRSkybox.texturePtr = &hdrTexture;
@@ -645,30 +805,6 @@ void setupPBR() {
 	else if (currentSkybox == 4)
 		hdrTexture.loadHDRMap("Images/HDRI/thatch_chapel_4k.hdr");
 
-	//Set uniforms
-	PBRShader.use();
-	PBRShader.setMat4("proj", proj);
-	PBRShader.setMat4("model", glm::mat4(1.f));
-
-	dirLight.set(PBRShader, "dirLight");
-	pointLight.set(PBRShader, "pointLights[0]");
-	spotLight.set(PBRShader, "spotLight");
-
-	PBRShader.set1b("pointLightEnabled", pointLightEnabled);
-	PBRShader.set1b("dirLightEnabled", dirLightEnabled);
-	PBRShader.set1b("spotLightEnabled", spotLightEnabled);
-
-	PBRShader.set1b("iblEnabled", iblEnabled);
-
-	PBRShader.set1b("useAlbedo", useAlbedo);
-	PBRShader.set1b("useNormalMap", useNormalMap);
-	PBRShader.set1b("useMetallic", useMetallic);
-	PBRShader.set1b("useRoughness", useRoughness);
-	PBRShader.set1b("useAlbedo", useAmbientMap);
-
-	hdrSkyboxShader.use();
-	hdrSkyboxShader.setMat4("proj", proj);
-
 	glm::mat4 captureProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
 	equirectangularToCubemapShader.use();
 	equirectangularToCubemapShader.setMat4("proj", captureProjection);
@@ -685,7 +821,7 @@ void setupPBR() {
 
 	//Environment Cubemap init
 	glGenTextures(1, &envCubemap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
+	glState.bindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
 	for (unsigned int i = 0; i < 6; ++i) {
 		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 1024, 1024, 0, GL_RGB, GL_FLOAT, nullptr);
 	}
@@ -697,7 +833,7 @@ void setupPBR() {
 
 	//Irradiance Cubemap init
 	glGenTextures(1, &irradianceMap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, irradianceMap);
+	glState.bindTexture(GL_TEXTURE_CUBE_MAP, irradianceMap);
 
 	for (unsigned int i = 0; i < 6; ++i)
 		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 32, 32, 0, GL_RGB, GL_FLOAT, nullptr);
@@ -710,7 +846,7 @@ void setupPBR() {
 
 	//Prefilter Cubemap init
 	glGenTextures(1, &prefilterMap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, prefilterMap);
+	glState.bindTexture(GL_TEXTURE_CUBE_MAP, prefilterMap);
 
 	for (unsigned int i = 0; i < 6; ++i)
 		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 128, 128, 0, GL_RGB, GL_FLOAT, nullptr);
@@ -725,14 +861,14 @@ void setupPBR() {
 
 	//BRDF calculation
 	glGenTextures(1, &brdfLUTTexture);
-	glBindTexture(GL_TEXTURE_2D, brdfLUTTexture);
+	glState.bindTexture(GL_TEXTURE_2D, brdfLUTTexture);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, 512, 512, 0, GL_RG, GL_FLOAT, 0);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+	glState.bindFramebuffer(GL_FRAMEBUFFER, captureFBO);
 	glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
 	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 512, 512);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, brdfLUTTexture, 0);
@@ -747,8 +883,8 @@ void setupPBR() {
 
 	//Clean up
 	glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+	glState.bindTexture(GL_TEXTURE_2D, 0);
 }
 void initImGui() {
 	IMGUI_CHECKVERSION();
@@ -769,14 +905,31 @@ void initImGui() {
 	style->Alpha = .3f;
 }
 void loadModels() {
-	//gun.loadModel("Objects/Cerberus_by_Andrew_Maximov/Cerberus_LP.FBX");
-	//gun.meshes[0].material.loadTextures("Objects/Cerberus_by_Andrew_Maximov/Textures/Cerberus_A.tga", "Objects/Cerberus_by_Andrew_Maximov/Textures/Cerberus_N.tga", "Objects/Cerberus_by_Andrew_Maximov/Textures/Cerberus_M.tga", "Objects/Cerberus_by_Andrew_Maximov/Textures/Cerberus_R.tga", "Objects/Cerberus_by_Andrew_Maximov/Textures/Raw/Cerberus_AO.tga");
+	//The real models are streamed by updateCurrentModel(), this one is drawn meanwhile
+	placeholder.meshes.reserve(1);
+	placeholder.meshes.emplace_back(cubeVertices);
+	placeholder.meshes[0].material.loadTextures("Images/White.png", "", "", "Images/White.png", "Images/White.png");
+	placeholder.bounds = placeholder.meshes[0].bounds;
+
+	MeshRenderer& renderer = scene.get<MeshRenderer>(modelEntity);
+	renderer.model = &placeholder;
+	renderer.local = Transform(glm::vec3(0.f), glm::vec3(0.f), glm::vec3(.5f));
+}
+void setupScene() {
+	modelEntity = scene.create();
+	scene.add<Transform>(modelEntity);
+	scene.add<Spinner>(modelEntity);
+	scene.add<MeshRenderer>(modelEntity);
+	scene.add<Bounds>(modelEntity);
 
-	suzanne.loadModel("Objects/suzanne/scene.gltf");
-	suzanne.meshes[0].material.loadTextures("Images/White.png", "", "", "Images/White.png", "Images/White.png");
-	
-	//backpack.loadModel("Objects/SurvivalBackpack/Survival_BackPack_2.fbx");
-	//backpack.meshes[0].material.loadTextures("Objects/SurvivalBackpack/albedo.jpg", "Objects/SurvivalBackpack/normal.png", "Objects/SurvivalBackpack/metallic.jpg", "Objects/SurvivalBackpack/roughness.jpg", "Objects/SurvivalBackpack/AO.jpg");
+	dirLightEntity = scene.create();
+	scene.add<DirLight>(dirLightEntity, DirLight(glm::vec3(-1.f, -1.f, -1.f), glm::vec3(1.f), 1.f));
+
+	pointLightEntity = scene.create();
+	scene.add<PointLight>(pointLightEntity, PointLight(glm::vec3(0.f, .5f, 3.f), glm::vec3(1.f), 1.f));
+
+	spotLightEntity = scene.create();
+	scene.add<SpotLight>(spotLightEntity, SpotLight(cam.getPos(), cam.camFront, glm::vec3(1.f), 1.f, 12.5f, 15.f));
 }
 
 //On state change(buttons, resize, keys, etc.)
@@ -788,7 +941,7 @@ void updateIBL() {
 
 	glViewport(0, 0, 1024, 1024);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+	glState.bindFramebuffer(GL_FRAMEBUFFER, captureFBO);
 	glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
 	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 1024, 1024);
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, captureRBO);
@@ -801,15 +954,15 @@ void updateIBL() {
 
 		PBRSkybox.Draw(equirectangularToCubemapShader);
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	//Calculate convolution for irradiance cubemap
 	glViewport(0, 0, 32, 32);
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+	glState.bindFramebuffer(GL_FRAMEBUFFER, captureFBO);
 
 	irradianceShader.use();
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
+	glState.activeTexture(GL_TEXTURE0);
+	glState.bindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
 
 	for (unsigned int i = 0; i < 6; ++i){
 		irradianceShader.setMat4("view", captureViews[i]);
@@ -819,17 +972,17 @@ void updateIBL() {
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		PBRSkybox.Draw(irradianceShader);
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	//Quasi monte-carlo simulation for prefilter cubemap
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+	glState.bindFramebuffer(GL_FRAMEBUFFER, captureFBO);
 	glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
 	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 32, 32);
 
 	prefilterShader.use();
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
+	glState.activeTexture(GL_TEXTURE0);
+	glState.bindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
 
 	unsigned int maxMipLevels = 5;
 	for (unsigned int mip = 0; mip < maxMipLevels; ++mip) {
@@ -855,63 +1008,46 @@ void updateIBL() {
 			PBRSkybox.Draw(prefilterShader);
 		}
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	//Revert framebuffer default screen dimentions
 	glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 }
-void updateModelMatrices() {
-	modelScaleMat = objectScaleMat * glm::scale(glm::mat4(1.f), modelScale);
-	modelTransMat = objectTransMat * glm::translate(glm::mat4(1.f), modelPos);
-	if (modelRot != glm::vec3(0.f)) {
-		modelRotMat = glm::rotate(glm::mat4(1.f), glm::radians(modelRot.x), glm::vec3(1.f, 0.f, 0.f));
-		modelRotMat = glm::rotate(modelRotMat, glm::radians(modelRot.y), glm::vec3(0.f, 1.f, 0.f));
-		modelRotMat = glm::rotate(modelRotMat, glm::radians(modelRot.z), glm::vec3(0.f, 0.f, 1.f));
-	}
-	else
-		modelRotMat = glm::mat4(1.f);
-	modelRotMat = objectRotMat * modelRotMat;
-	modelRotScaleMat = modelRotMat * modelScaleMat; //Optimization
-}
-void updateObjectMatrices() {
-	objectScaleMat = glm::scale(glm::mat4(1.f), objectScale);
-	objectTransMat = glm::translate(glm::mat4(1.f), objectPos);
-	if (objectRot != glm::vec3(0.f)) {
-		objectRotMat = glm::rotate(glm::mat4(1.f), glm::radians(objectRot.x), glm::vec3(1.f, 0.f, 0.f));
-		objectRotMat = glm::rotate(objectRotMat, glm::radians(objectRot.y), glm::vec3(0.f, 1.f, 0.f));
-		objectRotMat = glm::rotate(objectRotMat, glm::radians(objectRot.z), glm::vec3(0.f, 0.f, 1.f));
-	}
-	else
-		objectRotMat = glm::mat4(1.f);
-	updateModelMatrices();
-}
+//The model on screen stays until the selected one is resident
 void updateCurrentModel() {
-	switch (currentModel) {
-	case 0:
-		modelPtr = &gun;
-
-		modelPos = glm::vec3(0.f);
-		modelScale = glm::vec3(0.02f);
-		modelRot = glm::vec3(270.f, 0.f, 0.f);
+	switch (modelAssets[currentModel].state) {
+	case ASSET_UNLOADED:
+		asyncScheduler.spawn(streamModel(currentModel));
 		break;
-	case 1:
-		modelPtr = &suzanne;
-
-		modelPos = glm::vec3(0.f);
-		modelScale = glm::vec3(1.f);
-		modelRot = glm::vec3(0.f);
+	case ASSET_RESIDENT:
+		showModel(currentModel);
 		break;
-	case 2:
-		modelPtr = &backpack;
-
-		modelPos = glm::vec3(0.f);
-		modelScale = glm::vec3(1.f);
-		modelRot = glm::vec3(270.f, 0.f, 0.f);
+	default: //Loading shows it when done, failed keeps the current one
 		break;
 	}
+}
+Task<void> streamModel(int index) {
+	ModelAsset& asset = modelAssets[index];
+	asset.state = ASSET_LOADING;
+	auto start = std::chrono::high_resolution_clock::now();
+
+	bool loaded = co_await asset.model->loadModelAsync(asset.path);
+	if (loaded && !asset.model->meshes.empty() && !asset.textures.empty())
+		co_await asset.model->meshes[0].material.loadTexturesAsync(asset.textures[0], asset.textures[1], asset.textures[2], asset.textures[3], asset.textures[4]);
+
+	//Back on the GL thread here, both tasks finish there
+	asset.state = loaded && !asset.model->meshes.empty() ? ASSET_RESIDENT : ASSET_FAILED;
+	std::cout << "MODEL::" << (asset.state == ASSET_RESIDENT ? "LOADED" : "FAILED") << "::PATH: " << asset.path << " in " << std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count() << " ms" << std::endl;
+
+	if (asset.state == ASSET_RESIDENT && currentModel == index)
+		showModel(index);
+}
+void showModel(int index) {
+	MeshRenderer& renderer = scene.get<MeshRenderer>(modelEntity);
+	renderer.model = modelAssets[index].model;
+	renderer.local = modelAssets[index].local;
 
 	updateMaterial();
-	updateObjectMatrices();
 }
 void updateMaterial() {
 	if (materialState == 0)
@@ -926,6 +1062,7 @@ void updateMaterial() {
 		material.loadTextures("Images/Wall/albedo.png", "Images/Wall/normal.png", "Images/Wall/metallic.png", "Images/Wall/roughness.png", "Images/Wall/ao.png");
 
 	//Apply the material
+	Model* modelPtr = scene.get<MeshRenderer>(modelEntity).model;
 	if (modelPtr->meshes.size() == 0) { //If it has no meshes just print an error
 		std::cout << "ERROR::MAIN.H::UPDATE_MATERIAL::MODEL HAS NO MESHES!\n";
 		return;
@@ -945,24 +1082,23 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
 	SCR_HEIGHT = height;
 	glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 
-	proj = glm::perspective(glm::radians(fov), SCR_WIDTH / (float)SCR_HEIGHT, .1f, 100.f);
-	
-	shader.use();
-	shader.setMat4("proj", proj);
-	
-	PBRShader.use();
-	PBRShader.setMat4("proj", proj);
-
-	hdrSkyboxShader.use();
-	hdrSkyboxShader.setMat4("proj", proj);
+	proj = glm::perspective(glm::radians(fov), SCR_WIDTH / (float)SCR_HEIGHT, .1f, 100.f); //Reaches the shaders with the next frame's uniform update
 	
 	//Update effects' frame buffer
 	setupBloom();
 	setupPostProc();
 	setupDeferredShading();
 	setupMSAA();
+
+	if (HiZCuller::supported())
+		hiZCuller.resize(SCR_WIDTH, SCR_HEIGHT);
+	if (VisibilityBuffer::supported())
+		visibilityBuffer.resize(SCR_WIDTH, SCR_HEIGHT);
 }
 void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
+	cursorX = xpos;
+	cursorY = ypos;
+
 	if (mouseLocked)
 		cam.processMouse(xpos, ypos);
 	else {
@@ -970,11 +1106,24 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
 		cam.lastY = ypos;
 	}
 }
+//Right click while the cursor is free picks the entity under it
+void mouse_button_callback(GLFWwindow*, int button, int action, int) {
+	if (button != GLFW_MOUSE_BUTTON_RIGHT || action != GLFW_PRESS || mouseLocked || io.WantCaptureMouse) return;
+
+	glm::vec2 ndc(2.f * (float)cursorX / SCR_WIDTH - 1.f, 1.f - 2.f * (float)cursorY / SCR_HEIGHT);
+	glm::mat4 invPV = glm::inverse(proj * view);
+	glm::vec4 nearPoint = invPV * glm::vec4(ndc, -1.f, 1.f);
+	glm::vec4 farPoint = invPV * glm::vec4(ndc, 1.f, 1.f);
+	nearPoint /= nearPoint.w;
+	farPoint /= farPoint.w;
+
+	pickedEntity = scene.pick(Ray(glm::vec3(nearPoint), glm::normalize(glm::vec3(farPoint - nearPoint))));
+}
 void setupBloom() {
-	glBindFramebuffer(GL_FRAMEBUFFER, bloomFBO);
+	glState.bindFramebuffer(GL_FRAMEBUFFER, bloomFBO);
 	for (unsigned int i = 0; i < 2; i++)
 	{
-		glBindTexture(GL_TEXTURE_2D, colorBuffers[i]);
+		glState.bindTexture(GL_TEXTURE_2D, colorBuffers[i]);
 		glTexImage2D(
 			GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL
 		);
@@ -997,14 +1146,14 @@ void setupBloom() {
 	// finally check if framebuffer is complete
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 		std::cout << "Framebuffer not complete!" << std::endl;
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	//PingPong
 	for (unsigned int i = 0; i < 2; i++)
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, pingpongBuffers[i]);
+		glState.bindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
+		glState.activeTexture(GL_TEXTURE0);
+		glState.bindTexture(GL_TEXTURE_2D, pingpongBuffers[i]);
 		glTexImage2D(
 			GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL
 		);
@@ -1015,22 +1164,16 @@ void setupBloom() {
 		glFramebufferTexture2D(
 			GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pingpongBuffers[i], 0
 		);
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
 	}
-	shader.use();
-	shader.set1b("bloomOn", bloomOn);
-
-	PBRShader.use();
-	PBRShader.set1b("bloomOn", bloomOn);
-
 	hdrSkyboxShader.use();
 	hdrSkyboxShader.set1b("bloomOn", bloomOn);
 }
 void setupPostProc() {
 	//Post process
-	glBindFramebuffer(GL_FRAMEBUFFER, postprocFBO);
+	glState.bindFramebuffer(GL_FRAMEBUFFER, postprocFBO);
 
-	glBindTexture(GL_TEXTURE_2D, postprocColorBuffer);
+	glState.bindTexture(GL_TEXTURE_2D, postprocColorBuffer);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -1043,7 +1186,7 @@ void setupPostProc() {
 	//Check for errors
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 		std::cout << "Framebuffer not complete!" << std::endl;
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	postprocShader.use();
 	postprocShader.set1b("gammaOn", gammaOn);
@@ -1057,26 +1200,18 @@ void setupPostProc() {
 
 	//FXAA
 	postprocShader.set1b("fxaaEnabled", antiAliasing == 2);
-	postprocShader.setVec2("inverseScreenSize", glm::vec2(1.f / SCR_WIDTH, 1.f / SCR_HEIGHT));
 	postprocShader.set1f("EDGE_THRESHOLD_MIN", EDGE_THRESHOLD_MIN);
 	postprocShader.set1f("EDGE_THRESHOLD_MAX", EDGE_THRESHOLD_MAX);
 	postprocShader.set1i("ITERATIONS", ITERATIONS);
 	postprocShader.set1f("SUBPIXEL_QUALITY", SUBPIXEL_QUALITY);
-
-	//SRGB
-	PBRShader.use();
-	PBRShader.set1b("transformSRGB", transformSRGB);
-
-	shader.use();
-	shader.set1b("transformSRGB", transformSRGB);
 }
 void setupMSAA() {
-	glBindFramebuffer(GL_FRAMEBUFFER, msaaFBO);
+	glState.bindFramebuffer(GL_FRAMEBUFFER, msaaFBO);
 
 	//Multisampled texture
-	glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, msaaColorBuffer);
+	glState.bindTexture(GL_TEXTURE_2D_MULTISAMPLE, msaaColorBuffer);
 	glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, msaaSampleCount, GL_RGB, SCR_WIDTH, SCR_HEIGHT, GL_TRUE);
-	glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+	glState.bindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, msaaColorBuffer, 0);
 	
 	//Multisampled RBO
@@ -1087,12 +1222,12 @@ void setupMSAA() {
 
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 		cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << endl;
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	//Intermediate post-processing FBO
-	glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
+	glState.bindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
 
-	glBindTexture(GL_TEXTURE_2D, msaaTexture);
+	glState.bindTexture(GL_TEXTURE_2D, msaaTexture);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -1100,48 +1235,88 @@ void setupMSAA() {
 
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 		cout << "ERROR::FRAMEBUFFER:: Intermediate framebuffer is not complete!" << endl;
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
 }
+//Recreates the targets, at msaaSampleCount samples with MSAA on(a texture can't change between multisampled and not)
 void setupDeferredShading() {
 	/*Deferred rendering*/
-	glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
-
-	// - position color buffer
-	glBindTexture(GL_TEXTURE_2D, gPosition);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gPosition, 0);
-
-	// - normal color buffer
-	glBindTexture(GL_TEXTURE_2D, gNormal);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormal, 0);
-
-	// - color + specular color buffer
-	glBindTexture(GL_TEXTURE_2D, gAlbedoSpec);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, gAlbedoSpec, 0);
+	if (gAlbedoMetallic) {
+		GLuint textures[4] = { gAlbedoMetallic, gNormal, gMaterial, gDepth };
+		glState.deleteTextures(4, textures);
+	}
+	glGenTextures(1, &gAlbedoMetallic);
+	glGenTextures(1, &gNormal);
+	glGenTextures(1, &gMaterial);
+	glGenTextures(1, &gDepth);
+	gBufferSamples = antiAliasing == 1 ? std::max(msaaSampleCount, 1) : 1;
+
+	glState.bindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+
+	//Layout of Shaders/Common/gBuffer.glsl
+	struct Target {
+		GLuint texture;
+		GLenum internalFormat, format, type, attachment;
+	};
+	const Target targets[] = {
+		{ gAlbedoMetallic, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, GL_COLOR_ATTACHMENT0 }, //Albedo + metallic
+		{ gNormal, GL_RG16_SNORM, GL_RG, GL_SHORT, GL_COLOR_ATTACHMENT1 }, //Octahedral normal
+		{ gMaterial, GL_RG8, GL_RG, GL_UNSIGNED_BYTE, GL_COLOR_ATTACHMENT2 }, //Roughness + AO
+		{ gDepth, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, GL_DEPTH_ATTACHMENT } //The position is rebuilt from it
+	};
+	for (const Target& target : targets) {
+		if (gBufferSamples > 1) {
+			glState.bindTexture(GL_TEXTURE_2D_MULTISAMPLE, target.texture);
+			glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, gBufferSamples, target.internalFormat, SCR_WIDTH, SCR_HEIGHT, GL_TRUE);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, target.attachment, GL_TEXTURE_2D_MULTISAMPLE, target.texture, 0);
+			continue;
+		}
+		glState.bindTexture(GL_TEXTURE_2D, target.texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, target.internalFormat, SCR_WIDTH, SCR_HEIGHT, 0, target.format, target.type, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, target.attachment, GL_TEXTURE_2D, target.texture, 0);
+	}
 
 	// - tell OpenGL which color attachments we'll use (of this framebuffer) for rendering 
 	unsigned int gAttachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
 	glDrawBuffers(3, gAttachments);
-	glBindRenderbuffer(GL_RENDERBUFFER, deferredRBO);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, deferredRBO);
-
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	deferredShader.use();
-	deferredShader.set1b("deferredEnabled", false);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "ERROR::FRAMEBUFFER:: G-buffer is not complete!" << std::endl;
 
-	shader.use();
-	shader.set1i("deferredState", deferredState);
-	shader.set1b("deferredEnabled", false);
+	//Edge mask of deferredEdges.frag
+	glState.bindFramebuffer(GL_FRAMEBUFFER, edgeFBO);
+	glState.bindTexture(GL_TEXTURE_2D, gEdgeMask);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, SCR_WIDTH, SCR_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gEdgeMask, 0);
 
+	glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+//Marks the pixels of the multisampled G-buffer that need every sample shaded, counting them
+void classifyEdges() {
+	glState.bindFramebuffer(GL_FRAMEBUFFER, edgeFBO);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	edgePass.begin();
+	deferredEdgesShader.use();
+	deferredEdgesShader.set1i("gBufferSamples", gBufferSamples);
+	glState.bindTexture(GL_TEXTURE0, GL_TEXTURE_2D_MULTISAMPLE, gDepth);
+	glState.bindTexture(GL_TEXTURE1, GL_TEXTURE_2D_MULTISAMPLE, gNormal);
+	renderQuad.Draw(deferredEdgesShader, {});
+	edgePass.end();
+
+	glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+//Depth, normal, albedo + metallic and material on consecutive units from firstUnit, the edge mask when multisampled
+void bindGBuffer(GLenum firstUnit, GLenum edgeMaskUnit) {
+	GLenum target = gBufferSamples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+	glState.bindTexture(firstUnit, target, gDepth);
+	glState.bindTexture(firstUnit + 1, target, gNormal);
+	glState.bindTexture(firstUnit + 2, target, gAlbedoMetallic);
+	glState.bindTexture(firstUnit + 3, target, gMaterial);
+	if (gBufferSamples > 1)
+		glState.bindTexture(edgeMaskUnit, GL_TEXTURE_2D, gEdgeMask);
 }
 
 //Every frame
@@ -1159,57 +1334,622 @@ void processInput(GLFWwindow* window) {
 		style->Alpha = 0.3f;
 	}
 }
-void updateUniforms(Shader& shader) {
-	shader.use();
-	shader.setMat4("view", view);
-
-	shader.setVec3("viewPos", cam.getPos());
-	if (spotLightEnabled) {
-		shader.setVec3("spotLight.position", cam.getPos());
-		shader.setVec3("spotLight.direction", cam.camFront);
+//Fills the shared blocks from the camera and the scene's lights, then sends them in one buffer update
+void updateFrameUniforms() {
+	CameraBlock& camera = frameUniforms.camera;
+	camera.view = view;
+	camera.proj = proj;
+	camera.projView = proj * view;
+	camera.viewPos = cam.getPos();
+	camera.nearPlane = .1f;
+	camera.viewForward = cam.camFront;
+	camera.farPlane = 100.f;
+	camera.inverseProjView = glm::inverse(camera.projView);
+
+	FrameBlock& frame = frameUniforms.frame;
+	frame.screenSize = glm::vec2(SCR_WIDTH, SCR_HEIGHT);
+	frame.inverseScreenSize = 1.f / frame.screenSize;
+	frame.time = (float)glfwGetTime();
+	frame.deltaTime = dt.deltaTime;
+	frame.frameIndex++;
+
+	LightsBlock& lights = frameUniforms.lights;
+	lights.dirLight = DirLightData(scene.get<DirLight>(dirLightEntity));
+
+	//The spot light is the camera's flashlight
+	SpotLight& spotLight = scene.get<SpotLight>(spotLightEntity);
+	spotLight.pos = cam.getPos();
+	spotLight.dir = cam.camFront;
+	lights.spotLight = SpotLightData(spotLight);
+
+	lights.pointLightCount = 0;
+	scene.each<PointLight>([&lights](Entity, PointLight& light) {
+		if (lights.pointLightCount < (int)maxPointLights)
+			lights.pointLights[lights.pointLightCount++] = PointLightData(light);
+	});
+
+	updateShadows();
+
+	frameUniforms.upload();
+}
+//Fills lightClusters with the lights that are on, with their atlas shadows
+void gatherLights() {
+	lightClusters.clear();
+	if (pointLightEnabled)
+		scene.each<PointLight>([](Entity, PointLight& light) { lightClusters.add(light, shadowAtlas.shadowIndex(light)); });
+	if (spotLightEnabled)
+		scene.each<SpotLight>([](Entity, SpotLight& light) { lightClusters.add(light, shadowAtlas.shadowIndex(light)); });
+
+	for (const PointLight& light : demoLights)
+		lightClusters.add(light, shadowAtlas.shadowIndex(light));
+}
+//Moves the demo lights along their orbit, once a frame before the shadows are placed
+void moveDemoLights() {
+	if (!demoLightsMoving) return;
+
+	for (size_t i = 0; i < demoLights.size(); i++) {
+		glm::vec3& pos = demoLights[i].pos;
+		pos = glm::vec3(glm::rotate(glm::mat4(1.f), demoLightSpeeds[i] * dt.deltaTime, glm::vec3(0.f, 1.f, 0.f)) * glm::vec4(pos, 1.f));
 	}
+}
+//Rebuilds the clusters from the lights that are on, for the camera of this frame
+void updateLightClusters() {
+	gatherLights();
+	lightClusters.update(proj);
+}
+bool shadowsActive() {
+	return shadowsEnabled && dirLightEnabled;
+}
+bool lightShadowsActive() {
+	return lightShadowsEnabled;
+}
+//Fits the cascades to the camera and picks and places the shadowed point and spot lights, marking what their light or casters changed,
+//into the Shadows block
+void updateShadows() {
+	ShadowsBlock& shadows = frameUniforms.shadows;
+	if (shadowsActive()) {
+		shadowCascades.clear();
+		scene.submit(shadowCascades);
+		shadowCascades.update(scene.get<DirLight>(dirLightEntity), view, glm::radians(fov), SCR_WIDTH / (float)SCR_HEIGHT, .1f);
+		shadowCascades.fill(shadows);
+	}
+	if (!lightShadowsActive()) return;
+
+	shadowAtlas.clear();
+	if (pointLightEnabled)
+		scene.each<PointLight>([](Entity, PointLight& light) { shadowAtlas.add(light); });
+	if (spotLightEnabled)
+		scene.each<SpotLight>([](Entity, SpotLight& light) { shadowAtlas.add(light); });
+	if ((passFeatures() & ShaderFeature_clusteredLights) || (deferredShadingEnabled && tiledDeferredEnabled)) //Only the light buffer passes light them
+		for (const PointLight& light : demoLights)
+			shadowAtlas.add(light);
+
+	shadowAtlas.allocate(proj * view, cam.getPos(), glm::radians(fov), SCR_HEIGHT);
+	scene.submit(shadowAtlas);
+	shadowAtlas.update();
+	shadowAtlas.fill(shadows);
+
+	//The Lights block's ones in the order updateFrameUniforms() put them
+	shadows.spotLightShadow = shadowAtlas.shadowIndex(scene.get<SpotLight>(spotLightEntity));
+	int index = 0;
+	scene.each<PointLight>([&shadows, &index](Entity, PointLight& light) {
+		if (index < (int)maxPointLights)
+			shadows.pointLightShadows[index >> 2][index & 3] = shadowAtlas.shadowIndex(light);
+		index++;
+	});
+}
+//Redraws the cascades and atlas tiles update() marked and binds the shadow maps for the surface shaders
+void renderShadows() {
+	if (shadowsActive())
+		shadowCascades.render();
+	if (lightShadowsActive())
+		shadowAtlas.render();
+	glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT); //Also every viewport the atlas set
+	glState.bindTexture(GL_TEXTURE14, GL_TEXTURE_2D_ARRAY, shadowCascades.depth());
+	glState.bindTexture(GL_TEXTURE17, GL_TEXTURE_2D_ARRAY, shadowCascades.minMax());
+	glState.bindTexture(GL_TEXTURE18, GL_TEXTURE_2D_ARRAY, shadowCascades.depth()); //Raw depths for the PCSS blocker search
+	glBindSampler(18, shadowCascades.depthReader());
+	glState.bindTexture(GL_TEXTURE15, GL_TEXTURE_2D, shadowAtlas.depth());
+}
+//Scatters demoLightCount lights with random colors over the ground around the origin
+void generateDemoLights() {
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+	demoLights.resize(demoLightCount);
+	demoLightSpeeds.resize(demoLightCount);
+	for (int i = 0; i < demoLightCount; i++) {
+		float angle = unit(rng) * glm::two_pi<float>();
+		float radius = std::sqrt(unit(rng)) * 30.f;
+		glm::vec3 pos(std::cos(angle) * radius, unit(rng) * 4.f - 1.f, std::sin(angle) * radius);
+		glm::vec3 color = glm::clamp(glm::abs(glm::mod(unit(rng) * 6.f + glm::vec3(0.f, 4.f, 2.f), 6.f) - 3.f) - 1.f, 0.f, 1.f); //Random hue
+
+		demoLights[i] = PointLight(pos, color, demoLightIntensity);
+		demoLightSpeeds[i] = (unit(rng) - .5f) * .5f;
+	}
+}
+//Compile time features of the surface variants this frame, from the GUI options. Material maps are added per mesh
+uint32_t passFeatures() {
+	ShaderFeatures features;
+	features.setFlag(ShaderFeature_dirLight, dirLightEnabled);
+	features.setFlag(ShaderFeature_pointLights, pointLightEnabled);
+	features.setFlag(ShaderFeature_spotLight, spotLightEnabled);
+	features.setFlag(ShaderFeature_IBL, iblEnabled);
+	features.setFlag(ShaderFeature_bloom, bloomOn);
+	features.setFlag(ShaderFeature_SRGBTextures, transformSRGB);
+	features.setFlag(ShaderFeature_dirShadows, shadowsActive());
+	features.setFlag(ShaderFeature_lightShadows, lightShadowsActive());
+
+	bool clustered = clusteredLighting && LightClusters::supported();
+	features.setFlag(ShaderFeature_clusteredLights, clustered);
+	features.setFlag(ShaderFeature_clusterHeatmap, clustered && clusterHeatmap);
+	return features.getFlags();
+}
+//Material maps the GUI lets through
+uint32_t materialMapMask() {
+	ShaderFeatures mask;
+	mask.setFlag(ShaderFeature_albedoMap, useAlbedo);
+	mask.setFlag(ShaderFeature_normalMap, useNormalMap);
+	mask.setFlag(ShaderFeature_metallicMap, useMetallic);
+	mask.setFlag(ShaderFeature_roughnessMap, useRoughness);
+	mask.setFlag(ShaderFeature_AOMap, useAmbientMap);
+	return mask.getFlags();
+}
+//Variant drawing every mesh of model with one program, only the maps all of them have
+Shader& surfaceShader(const Model& model) {
+	ShaderVariants& variants = pbrEnabled ? PBRShaders : mainShaders;
+	return variants.get(passFeatures() | (model.commonFeatures() & materialMapMask()));
+}
+//Units 5-7 of the PBR shaders
+void bindIBLMaps() {
+	glState.activeTexture(GL_TEXTURE5);
+	glState.bindTexture(GL_TEXTURE_CUBE_MAP, irradianceMap);
+
+	glState.activeTexture(GL_TEXTURE6);
+	glState.bindTexture(GL_TEXTURE_CUBE_MAP, prefilterMap);
+
+	glState.activeTexture(GL_TEXTURE7);
+	glState.bindTexture(GL_TEXTURE_2D, brdfLUTTexture);
+}
+//G-buffer pass and the resolve picked in the UI into the post-processing target
+void renderDeferred() {
+	gBufferPass.begin();
+	glState.bindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	scene.draw(gBufferShaders, passFeatures(), materialMapMask());
+
+	glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+	gBufferPass.end();
+
+	if (gBufferSamples > 1)
+		classifyEdges();
+
+	beginPostProcess();
 
-	shader.setMat4("model", model);
+	deferredLightingPass.begin();
+	uint32_t resolveFeatures = passFeatures() | ShaderFeature_deferredResolve | (gBufferSamples > 1 ? (uint32_t)ShaderFeature_deferredMSAA : 0u);
+	if (deferredState == 4 && pbrEnabled) {
+		if (passFeatures() & ShaderFeature_clusteredLights)
+			updateLightClusters();
+		bindIBLMaps();
+
+		Shader& resolveShader = PBRShaders.get(resolveFeatures);
+		resolveShader.use();
+		resolveShader.set1i("gBufferSamples", gBufferSamples);
+		bindGBuffer(GL_TEXTURE8, GL_TEXTURE12);
+		renderQuad.Draw(resolveShader, {});
+	}
+	else if (deferredState == 4 && tiledDeferredEnabled && TiledDeferred::supported()) {
+		gatherLights();
+		lightClusters.upload();
+
+		ShaderFeatures features(resolveFeatures);
+		features.setFlag(ShaderFeature_clusterHeatmap, tiledHeatmap);
+		tiledDeferred.shade(features.getFlags(), gDepth, gNormal, gAlbedoMetallic, gEdgeMask, gBufferSamples, bloomOn ? colorBuffers[0] : postprocColorBuffer, colorBuffers[1],
+			SCR_WIDTH, SCR_HEIGHT, proj, (GLuint)lightClusters.lightCount(), deferredShininess);
+	}
+	else { //Also draws the buffer views
+		Shader& resolveShader = mainShaders.get(resolveFeatures);
+		resolveShader.use();
+		resolveShader.set1i("deferredState", deferredState);
+		resolveShader.set1i("gBufferSamples", gBufferSamples);
+		resolveShader.set1f("shininessExponent", deferredShininess);
+		bindGBuffer(GL_TEXTURE5, GL_TEXTURE8);
+		renderQuad.Draw(resolveShader, {});
+	}
+	deferredLightingPass.end();
+}
+bool visibilityPipeline() {
+	return visibilityBufferEnabled && VisibilityBuffer::supported();
+}
+//Visibility buffer pass and one PBR pass per material into the post-processing target. Always PBR, single sampled
+void renderVisibility() {
+	visibilityPass.begin();
+	visibilityBuffer.clear();
+	scene.submit(visibilityBuffer);
+	visibilityBuffer.render();
+	visibilityPass.end();
+
+	beginPostProcess();
+
+	visibilityShadePass.begin();
+	if (passFeatures() & ShaderFeature_clusteredLights)
+		updateLightClusters();
+	bindIBLMaps();
+	visibilityBuffer.shade(PBRShaders, passFeatures(), materialMapMask(), bloomOn ? colorBuffers[0] : postprocColorBuffer, bloomOn ? colorBuffers[1] : 0, renderQuad);
+	visibilityShadePass.end();
+
+	glState.bindFramebuffer(GL_FRAMEBUFFER, bloomOn ? bloomFBO : postprocFBO); //Back on the target's own depth for the light boxes
+}
+//Forward, deferred and visibility buffer with the current settings on every bundled model already loaded, then the shown one is put back
+void runPipelineBenchmark() {
+	MeshRenderer& renderer = scene.get<MeshRenderer>(modelEntity);
+	Model* shownModel = renderer.model;
+	Transform shownLocal = renderer.local;
+
+	std::vector<BenchmarkPipeline> pipelines = {
+		{ "forward", []() {
+			beginPostProcess();
+			if (pbrEnabled && (passFeatures() & ShaderFeature_clusteredLights))
+				updateLightClusters();
+			renderScene(mainShaders, PBRShaders);
+		} },
+		{ "deferred", []() { renderDeferred(); } }
+	};
+	if (VisibilityBuffer::supported())
+		pipelines.push_back({ "visibility", []() { renderVisibility(); } });
+
+	benchmarkPipelines(sizeof(modelAssets) / sizeof(modelAssets[0]), [&](unsigned int i) {
+		const ModelAsset& asset = modelAssets[i];
+		if (asset.state != ASSET_RESIDENT) return std::string();
+
+		renderer.model = asset.model;
+		renderer.local = asset.local;
+		scene.updateTransforms(0.f);
+		return asset.path.substr(asset.path.find_last_of('/') + 1);
+	}, pipelines);
+
+	renderer.model = shownModel;
+	renderer.local = shownLocal;
+	scene.updateTransforms(0.f);
 }
-void renderScene(Shader& shader, Shader& PBRShader) {
+//The current pipeline on the current view with the directional light unshadowed, then with each cascade filter
+void runShadowBenchmark() {
+	if (!shadowsActive()) {
+		logBenchmark("Shadow filters: the directional light and its shadows have to be on");
+		return;
+	}
+	int shownFilter = shadowCascades.filter;
+
+	const char* names[] = { "unshadowed", "PCF", "PCSS brute force", "PCSS min/max" };
+	benchmarkShadowFilters(ShadowCascades::pyramidSupported() ? 4 : 3, [&names](unsigned int i) {
+		shadowsEnabled = i > 0;
+		if (i > 0)
+			shadowCascades.filter = i - 1;
+		updateFrameUniforms(); //The filter is read from the Shadows block
+		if (shadowsActive())
+			renderShadows(); //Builds the pyramids for PCSS
+		return std::string(names[i]);
+	}, []() {
+		if (visibilityPipeline())
+			renderVisibility();
+		else if (deferredShadingEnabled)
+			renderDeferred();
+		else {
+			beginPostProcess();
+			if (pbrEnabled && (passFeatures() & ShaderFeature_clusteredLights))
+				updateLightClusters();
+			renderScene(mainShaders, PBRShaders);
+		}
+	});
+
+	shadowsEnabled = true;
+	shadowCascades.filter = shownFilter;
+	updateFrameUniforms();
+}
+void renderScene(ShaderVariants& mainShaders, ShaderVariants& PBRShaders) {
 	renderPass.begin();
 
-	if (pbrEnabled) {
-		//Assign textures
-		PBRShader.use();
-		glActiveTexture(GL_TEXTURE5);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, irradianceMap);
+	if (pbrEnabled)
+		bindIBLMaps();
 
-		glActiveTexture(GL_TEXTURE6);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, prefilterMap);
+	const CameraBlock& camera = frameUniforms.camera;
+	renderQueue.clear();
+	scene.submit(renderQueue, pbrEnabled ? PBRShaders : mainShaders, passFeatures(), materialMapMask(), camera.viewPos, camera.viewForward, camera.farPlane);
+	if (stressTestEnabled)
+		renderQueue.addCallback(DrawPass_opaque, [](void*) { renderStressTest(); });
+	if (pointLightEnabled)
+		renderQueue.addCallback(DrawPass_opaque, [](void*) { renderLightBoxes(); }, nullptr, lightBoxShader.ID);
+	renderQueue.addCallback(DrawPass_sky, [](void*) {
+		hdrSkyboxShader.use();
+		PBRSkybox.Draw(hdrSkyboxShader);
+	});
 
-		glActiveTexture(GL_TEXTURE7);
-		glBindTexture(GL_TEXTURE_2D, brdfLUTTexture);
+	renderQueue.sort();
+	renderQueue.submit();
 
-		modelPtr->Draw(PBRShader);
+	renderPass.end();
+}
+void renderStressTest() {
+	MeshRenderer& renderer = scene.get<MeshRenderer>(modelEntity);
+	stressInstanceCount = std::clamp(stressInstanceCount, 0, (int)stressInstances.capacity); //Every loop below writes that many instances into a region
+
+	//Lay the copies on a grid in front of the camera
+	unsigned int side = (unsigned int)std::ceil(std::sqrt((float)stressInstanceCount));
+	float halfExtent = (side - 1) * stressSpacing * .5f;
+	glm::mat4 localMat = stressObject == 0 ? glm::mat4(glm::mat3(renderer.worldMatrix)) : glm::scale(glm::mat4(1.f), glm::vec3(.2f));
+	const BoundingSphere& localSphere = stressObject == 0 ? renderer.model->bounds.sphere : lightBox.bounds.sphere;
+
+	if (stressDrawMode == 1) {
+		renderStressTestCommandLists(localMat, localSphere, side, halfExtent);
+		return;
+	}
+	InstanceData* instances = stressInstances.map();
+
+	const AABB& localBox = stressObject == 0 ? renderer.model->bounds.box : lightBox.bounds.box;
+	bool useBVH = frustumCulling && cullingMode == 1;
+	bool useGPU = frustumCulling && cullingMode == 2 && HiZCuller::supported();
+
+	if (frustumCulling && cullingMode == 3) {
+		renderStressTestQueries(instances, localMat, localBox);
+		stressInstances.endFrame();
+		return;
+	}
+
+	stressMatrices.clear();
+	stressCuller.clear();
+	stressBoxes.resize(stressInstanceCount);
+	for (int i = 0; i < stressInstanceCount; i++) {
+		unsigned int x = i % side;
+		unsigned int z = i / side;
+
+		glm::vec3 pos(x * stressSpacing - halfExtent, 0.f, -(z * stressSpacing) - stressSpacing);
+		stressMatrices.push_back(glm::translate(glm::mat4(1.f), pos) * localMat);
+		if (useBVH)
+			stressBoxes[i] = localBox.transformed(stressMatrices.back());
+		else if (!useGPU)
+			stressCuller.add(localSphere.transformed(stressMatrices.back()));
+	}
+
+	if (useGPU) {
+		for (int i = 0; i < stressInstanceCount; i++) {
+			unsigned int x = i % side;
+			unsigned int z = i / side;
+			instances[i] = InstanceData(stressMatrices[i], glm::vec3(.25f + .75f * x / side, .5f, .25f + .75f * z / side));
+		}
+		stressInstances.unmap(stressInstanceCount);
+
+		renderStressTestGPU(localBox);
+		stressInstances.endFrame();
+		return;
+	}
+
+	if (useBVH) {
+		auto cullStart = std::chrono::high_resolution_clock::now();
+
+		//The grid only moves when the UI changes it, so this is a refit on almost every frame
+		stressBVH.update(stressBoxes);
+		stressVisible.clear();
+		stressBVH.queryFrustum(Frustum(proj * view), stressVisible);
+		std::sort(stressVisible.begin(), stressVisible.end()); //Keeps the draw order front to back like the grid
+
+		renderStats.addCulling((unsigned int)stressVisible.size(), stressInstanceCount - (unsigned int)stressVisible.size(), std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - cullStart).count());
+	}
+	else if (frustumCulling) {
+		stressCuller.cull(Frustum(proj * view));
+		renderStats.addCulling(stressCuller.visibleCount, stressCuller.culledCount, stressCuller.cullTime);
+	}
+
+	//Only the visible instances are written, so the buffer stays packed
+	unsigned int count = 0;
+	size_t nextVisible = 0;
+	for (int i = 0; i < stressInstanceCount; i++) {
+		if (useBVH) {
+			if (nextVisible >= stressVisible.size() || stressVisible[nextVisible] != (uint32_t)i) continue;
+			nextVisible++;
+		}
+		else if (frustumCulling && !stressCuller.visible[i]) continue;
+
+		unsigned int x = i % side;
+		unsigned int z = i / side;
+		glm::vec3 tint(.25f + .75f * x / side, .5f, .25f + .75f * z / side);
+
+		instances[count++] = InstanceData(stressMatrices[i], tint);
+	}
+	stressInstances.unmap(count);
+
+	if (stressObject == 0) {
+		Shader& objectShader = surfaceShader(*renderer.model);
+
+		objectShader.use();
+		objectShader.set1b("instanced", true);
+		renderer.model->DrawInstanced(objectShader, stressInstances);
+		objectShader.set1b("instanced", false);
 	}
 	else {
-		shader.use();
-		modelPtr->Draw(shader);
+		lightBoxShader.use();
+		lightBoxShader.set1b("instanced", true);
+		lightBox.DrawInstanced(lightBoxShader, stressInstances);
+		lightBoxShader.set1b("instanced", false);
 	}
 
-	hdrSkyboxShader.use();
-	hdrSkyboxShader.setMat4("view", view);
-	PBRSkybox.Draw(hdrSkyboxShader);
+	stressInstances.endFrame();
+}
+//A draw per copy instead of one instanced draw. Workers lay out, cull and record their part of the grid, the GL thread only replays the lists
+void renderStressTestCommandLists(const glm::mat4& localMat, const BoundingSphere& localSphere, unsigned int side, float halfExtent) {
+	MeshRenderer& renderer = scene.get<MeshRenderer>(modelEntity);
+	Shader& objectShader = stressObject == 0 ? surfaceShader(*renderer.model) : lightBoxShader; //Variants can compile, so not on the workers
+	Frustum frustum(proj * view);
+
+	stressRecorder.record(stressInstanceCount, [&](CommandList& list, size_t begin, size_t end) {
+		std::vector<glm::mat4> matrices;
+		std::vector<glm::vec3> tints;
+		matrices.reserve(end - begin);
+		tints.reserve(end - begin);
+		for (size_t i = begin; i < end; i++) {
+			unsigned int x = (unsigned int)i % side;
+			unsigned int z = (unsigned int)i / side;
+
+			glm::vec3 pos(x * stressSpacing - halfExtent, 0.f, -(z * stressSpacing) - stressSpacing);
+			glm::mat4 matrix = glm::translate(glm::mat4(1.f), pos) * localMat;
+			if (frustumCulling && !frustum.testSphere(localSphere.transformed(matrix))) continue;
+
+			matrices.push_back(matrix);
+			tints.emplace_back(.25f + .75f * x / side, .5f, .25f + .75f * z / side);
+		}
 
-	renderPass.end();
+		list.useProgram(objectShader);
+		if (stressObject == 0) {
+			for (MaterialMesh& mesh : renderer.model->meshes) { //Mesh by mesh so each material is bound once per list
+				list.bindMaterial(*mesh.currentMaterial);
+				for (const glm::mat4& matrix : matrices) {
+					list.setMat4("model", matrix);
+					list.draw(mesh);
+				}
+			}
+		}
+		else {
+			for (size_t i = 0; i < matrices.size(); i++) {
+				list.setVec3("pos", glm::vec3(matrices[i][3]));
+				list.setVec3("diffuse", tints[i]);
+				list.draw(lightBox);
+			}
+		}
+	});
+	stressRecorder.execute();
+
+	unsigned int meshCount = stressObject == 0 ? std::max(1u, (unsigned int)renderer.model->meshes.size()) : 1u;
+	unsigned int visible = stressRecorder.drawCount() / meshCount;
+	renderStats.addCulling(visible, stressInstanceCount - visible, 0.f);
+}
+//Two phase occlusion culling on the GPU. The current region of stressInstances holds every instance
+void renderStressTestGPU(const AABB& localBox) {
+	MeshRenderer& renderer = scene.get<MeshRenderer>(modelEntity);
+	Shader& objectShader = stressObject == 0 ? surfaceShader(*renderer.model) : lightBoxShader;
+
+	std::vector<const Mesh*> meshes;
+	if (stressObject == 0)
+		for (const MaterialMesh& mesh : renderer.model->meshes)
+			meshes.push_back(&mesh);
+	else
+		meshes.push_back(&lightBox);
+	hiZCuller.setMeshes(meshes);
+
+	for (unsigned int phase = 0; phase < 2; phase++) {
+		if (phase == 1)
+			hiZCuller.buildPyramid();
+		hiZCuller.cull(phase, stressInstances, stressInstanceCount, proj * view, localBox);
+
+		objectShader.use();
+		objectShader.set1b("instanced", true);
+		if (stressObject == 0)
+			hiZCuller.draw(phase, renderer.model->meshes.data(), renderer.model->meshes.size(), objectShader);
+		else
+			hiZCuller.draw(phase, &lightBox, 1, objectShader);
+		objectShader.set1b("instanced", false);
+	}
+}
+//Writes the grid chunk by chunk so each chunk is one instanced range with one occlusion query
+void renderStressTestQueries(InstanceData* instances, const glm::mat4& localMat, const AABB& localBox) {
+	struct Chunk {
+		unsigned int first, count;
+		AABB box;
+		float distance;
+	};
+	static std::vector<Chunk> chunks;
+	static std::vector<unsigned int> order;
+
+	unsigned int side = (unsigned int)std::ceil(std::sqrt((float)stressInstanceCount));
+	unsigned int chunksPerSide = (side + stressChunkSize - 1) / stressChunkSize;
+	float halfExtent = (side - 1) * stressSpacing * .5f;
+
+	chunks.clear();
+	unsigned int count = 0;
+	for (unsigned int chunkZ = 0; chunkZ < chunksPerSide; chunkZ++)
+		for (unsigned int chunkX = 0; chunkX < chunksPerSide; chunkX++) {
+			Chunk chunk{ count, 0, AABB(), 0.f };
+
+			for (unsigned int z = chunkZ * stressChunkSize; z < std::min(side, (chunkZ + 1) * stressChunkSize); z++)
+				for (unsigned int x = chunkX * stressChunkSize; x < std::min(side, (chunkX + 1) * stressChunkSize); x++) {
+					if (z * side + x >= (unsigned int)stressInstanceCount) continue;
+
+					glm::vec3 pos(x * stressSpacing - halfExtent, 0.f, -(z * stressSpacing) - stressSpacing);
+					glm::mat4 modelMat = glm::translate(glm::mat4(1.f), pos) * localMat;
+					chunk.box.expand(localBox.transformed(modelMat));
+
+					instances[count++] = InstanceData(modelMat, glm::vec3(.25f + .75f * x / side, .5f, .25f + .75f * z / side));
+					chunk.count++;
+				}
+
+			chunk.distance = glm::length(chunk.box.center() - cam.getPos());
+			chunks.push_back(chunk);
+		}
+	stressInstances.unmap(count);
+
+	//Front to back so near chunks occlude the far ones within the same frame
+	Frustum frustum(proj * view);
+	order.clear();
+	for (unsigned int i = 0; i < chunks.size(); i++)
+		if (chunks[i].count && frustum.testAABB(chunks[i].box))
+			order.push_back(i);
+	std::sort(order.begin(), order.end(), [](unsigned int a, unsigned int b) { return chunks[a].distance < chunks[b].distance; });
+
+	MeshRenderer& renderer = scene.get<MeshRenderer>(modelEntity);
+	Shader& objectShader = stressObject == 0 ? surfaceShader(*renderer.model) : lightBoxShader;
+	auto drawChunk = [&](const Chunk& chunk) {
+		if (stressObject == 0)
+			renderer.model->DrawInstanced(objectShader, stressInstances, chunk.first, chunk.count);
+		else
+			lightBox.DrawInstanced(lightBoxShader, stressInstances, chunk.first, chunk.count);
+	};
+
+	queryCuller.beginFrame(chunks.size());
+
+	objectShader.use();
+	objectShader.set1b("instanced", true);
+	for (unsigned int i : order)
+		queryCuller.drawVisible(i, chunks[i].box, cam.getPos(), [&]() { drawChunk(chunks[i]); });
+
+	queryCuller.drawProxies(proj * view);
+
+	for (unsigned int i : order)
+		queryCuller.drawConditional(i, [&]() { drawChunk(chunks[i]); });
+	objectShader.use();
+	objectShader.set1b("instanced", false);
+
+	unsigned int visibleChunks = (unsigned int)order.size() - queryCuller.proxiesDrawn;
+	renderStats.addCulling(visibleChunks, (unsigned int)chunks.size() - visibleChunks, 0.f);
+}
+void renderLightBoxes() {
+	InstanceData* instances = lightBoxInstances.map();
+	unsigned int count = 0;
+
+	scene.each<PointLight>([&](Entity, PointLight& light) {
+		if (count < lightBoxInstances.capacity)
+			instances[count++] = InstanceData(glm::scale(glm::translate(glm::mat4(1.f), light.pos), glm::vec3(.2f)), light.diffuse);
+	});
+	lightBoxInstances.unmap(count);
+
+	lightBoxShader.use();
+	lightBoxShader.set1b("instanced", true);
+	lightBox.DrawInstanced(lightBoxShader, lightBoxInstances);
+	lightBoxShader.set1b("instanced", false);
+
+	lightBoxInstances.endFrame();
 }
 void beginPostProcess() {
 	if (bloomOn)
-		glBindFramebuffer(GL_FRAMEBUFFER, bloomFBO);
+		glState.bindFramebuffer(GL_FRAMEBUFFER, bloomFBO);
 	else
-		glBindFramebuffer(GL_FRAMEBUFFER, postprocFBO);
+		glState.bindFramebuffer(GL_FRAMEBUFFER, postprocFBO);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 void endPostProcess() {
 	postprocPass.begin();
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	if (bloomOn) {
@@ -1221,7 +1961,7 @@ void endPostProcess() {
 
 		for (unsigned int i = 0; i < amount; i++)
 		{
-			glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
+			glState.bindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
 
 			blurShader.set1i("horizontal", horizontal);
 
@@ -1231,7 +1971,7 @@ void endPostProcess() {
 			if (first_iteration)
 				first_iteration = false;
 		}
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
 
 		renderQuad.Draw(postprocShader, { colorBuffers[0], pingpongBuffers[1] });
 	}
@@ -1259,15 +1999,20 @@ void updateImGui() {
 	
 	if (CollapsingHeader("Rendering", ImGuiTreeNodeFlags_DefaultOpen)) {
 		if (TreeNode("Objects")) {
-			Checkbox("Demo Rotation", &demoRotation);
-			SliderFloat("Speed", &demoRotSpeed, 0.f, 10.f);
+			Transform& transform = scene.get<Transform>(modelEntity);
+			Spinner& spinner = scene.get<Spinner>(modelEntity);
+			MeshRenderer& renderer = scene.get<MeshRenderer>(modelEntity);
+
+			Text(pickedEntity == nullEntity ? "Picked: none (right click with a free cursor)" : ("Picked: entity " + std::to_string(entityIndex(pickedEntity))).c_str());
+			Checkbox("Demo Rotation", &spinner.enabled);
+			SliderFloat("Speed", &spinner.speed, 0.f, 10.f);
 			NewLine();
 
-			bool updatePos = SliderFloat3("Position", glm::value_ptr(objectPos), -10.f, 10.f);
-			bool updateScale = SliderFloat3("Scale", glm::value_ptr(objectScale), 0.f, 1.f);
-			bool updateRot = SliderFloat3("Rotation", glm::value_ptr(objectRot), 0.f, 360.f);
+			bool updatePos = SliderFloat3("Position", glm::value_ptr(transform.position), -10.f, 10.f);
+			bool updateScale = SliderFloat3("Scale", glm::value_ptr(transform.scale), 0.f, 1.f);
+			bool updateRot = SliderFloat3("Rotation", glm::value_ptr(transform.rotation), 0.f, 360.f);
 			if (updatePos || updateScale || updateRot)
-				updateObjectMatrices();
+				transform.dirty = true;
 			NewLine();
 
 			if (TreeNode("Material")) {
@@ -1296,26 +2041,54 @@ void updateImGui() {
 				NewLine();
 				if (Button("Apply"))
 					updateCurrentModel();
+				if (modelAssets[currentModel].state == ASSET_LOADING)
+					Text("Loading...");
+				else if (modelAssets[currentModel].state == ASSET_FAILED)
+					Text("Failed to load, see the console");
 				
 				NewLine();
-				bool updatePos = SliderFloat3("Local Position", glm::value_ptr(modelPos), -10.f, 10.f);
-				bool updateScale = SliderFloat3("Local Scale", glm::value_ptr(modelScale), 0.f, 1.f);
-				bool updateRot = SliderFloat3("Local Rotation", glm::value_ptr(modelRot), 0.f, 360.f);
+				bool updatePos = SliderFloat3("Local Position", glm::value_ptr(renderer.local.position), -10.f, 10.f);
+				bool updateScale = SliderFloat3("Local Scale", glm::value_ptr(renderer.local.scale), 0.f, 1.f);
+				bool updateRot = SliderFloat3("Local Rotation", glm::value_ptr(renderer.local.rotation), 0.f, 360.f);
 				if (updatePos || updateScale || updateRot)
-					updateModelMatrices();
+					renderer.local.dirty = true;
 				TreePop();
 			}
 
 			TreePop();
 		}
+		if (TreeNode("Stress Test")) {
+			Checkbox("Enable Stress Test", &stressTestEnabled);
+			BeginDisabled(!stressTestEnabled);
+
+			const char* stressObjects[] = { "Current Model", "Light Box" };
+			Combo("Object##0", &stressObject, stressObjects, 2);
+			SliderInt("Instances", &stressInstanceCount, 10000, stressInstances.capacity, "%d", ImGuiSliderFlags_AlwaysClamp); //Ctrl+click typing is clamped too
+			SliderFloat("Spacing", &stressSpacing, .5f, 10.f);
+			NewLine();
+
+			SliderInt("Culling Threads", (int*)&stressCuller.threadCount, 1, std::max(1u, std::thread::hardware_concurrency()));
+			NewLine();
+
+			const char* drawModes[] = { "Instanced", "Command Lists(a draw per copy)" };
+			Combo("Draws", &stressDrawMode, drawModes, 2);
+			if (stressDrawMode == 1) {
+				SliderInt("Recording Threads", (int*)&stressRecorder.threadCount, 1, std::max(1u, std::thread::hardware_concurrency()));
+				Text("Culled with the CPU spheres test while recording");
+				Text(("Record: " + std::to_string(stressRecorder.recordTime) + " ms  replay: " + std::to_string(stressRecorder.executeTime) + " ms  commands: " + std::to_string(stressRecorder.commandCount())).c_str());
+				for (size_t i = 0; i < stressRecorder.recordTimes.size(); i++)
+					Text(("    thread " + std::to_string(i) + ": " + std::to_string(stressRecorder.recordTimes[i]) + " ms").c_str());
+			}
+
+			EndDisabled();
+			TreePop();
+		}
 		if (TreeNode("PBR")) {
 			Checkbox("Use PBR", &pbrEnabled);
 			NewLine();
 
 			BeginDisabled(!pbrEnabled);
 
-			PBRShader.use();
-
 			//bool nodeOpened;
 			//
 			////Remove hover and active colors
@@ -1387,51 +2160,68 @@ void updateImGui() {
 			//style.Colors[ImGuiCol_HeaderActive].w = oldW.y;
 
 
-			if (Checkbox("Use IBL", &iblEnabled))
-				PBRShader.set1b("iblEnabled", iblEnabled);
+			//Each toggle picks another variant, compiled the first time it's needed
+			Checkbox("Use IBL", &iblEnabled);
 			NewLine();
 
-			if (Checkbox("Use Albedo Texture", &useAlbedo)) {
-				PBRShader.use();
-				PBRShader.set1b("useAlbedo", useAlbedo);
-			}
-			if (Checkbox("Use Normal Map", &useNormalMap)) {
-				PBRShader.use();
-				PBRShader.set1b("useNormalMap", useNormalMap);
-			}
-			if (Checkbox("Use Metallic Texture", &useMetallic)) {
-				PBRShader.use();
-				PBRShader.set1b("useMetallic", useMetallic);
-			}
-			if (Checkbox("Use Roughness Texture", &useRoughness)) {
-				PBRShader.use();
-				PBRShader.set1b("useRoughness", useRoughness);
-			}
-			if (Checkbox("Use Ambient Map", &useAmbientMap)) {
-				PBRShader.use();
-				PBRShader.set1b("useAmbientMap", useAmbientMap);
-			}
+			Checkbox("Use Albedo Texture", &useAlbedo);
+			Checkbox("Use Normal Map", &useNormalMap);
+			Checkbox("Use Metallic Texture", &useMetallic);
+			Checkbox("Use Roughness Texture", &useRoughness);
+			Checkbox("Use Ambient Map", &useAmbientMap);
 
 			EndDisabled();
 			TreePop();
 		}
 		if (TreeNode("Deferred Shading/Rendering")) {
-			Checkbox("Enable Deferred Shading", &deferredShadingEnabled); //Doesn't work with pbr
+			Checkbox("Enable Deferred Shading", &deferredShadingEnabled); //Resolved with PBR when it's enabled
 			BeginDisabled(!deferredShadingEnabled);
 
-			bool updatePos  = RadioButton("Display Position Buffer", &deferredState, 0);
-			bool updateNorm = RadioButton("Display Normal Buffer", &deferredState, 1);
-			bool updateAlbed= RadioButton("Display Albedo Buffer", &deferredState, 2);
-			bool updateSpec = RadioButton("Display Specular Buffer", &deferredState, 3);
-			bool updateComb = RadioButton("Display Combined Buffer", &deferredState, 4);
-			if (updatePos || updateNorm || updateAlbed || updateSpec || updateComb) {
-				shader.use();
-				shader.set1i("deferredState", deferredState);
-			}
+			RadioButton("Display Position Buffer", &deferredState, 0); //Set on the resolve variant when it draws
+			RadioButton("Display Normal Buffer", &deferredState, 1);
+			RadioButton("Display Albedo Buffer", &deferredState, 2);
+			RadioButton("Display Specular Buffer", &deferredState, 3);
+			RadioButton("Display Combined Buffer", &deferredState, 4);
+			SliderFloat("Shininess", &deferredShininess, 1.f, 256.f); //Blinn-Phong resolves, PBR reads the roughness from the G-buffer
+			Text(("G-buffer: " + std::to_string(gBufferBytesPerPixel * gBufferSamples) + " bytes per pixel, " +
+				std::to_string((size_t)gBufferBytesPerPixel * gBufferSamples * SCR_WIDTH * SCR_HEIGHT / (1024 * 1024)) + " MB").c_str());
+			Text(("Geometry pass: " + std::to_string(gBufferPass.result / 1000000.0) + " ms  lighting: " + std::to_string(deferredLightingPass.result / 1000000.0) + " ms").c_str());
+			if (gBufferSamples > 1) //MSAA in Post-processing
+				Text(("MSAA x" + std::to_string(gBufferSamples) + ": " + std::to_string(100.0 * edgePass.result / (SCR_WIDTH * SCR_HEIGHT)) + "% edge pixels shaded per sample").c_str());
+			NewLine();
+
+			if (!TiledDeferred::supported())
+				Text("Tiled lighting needs compute shaders and image load/store");
+			BeginDisabled(!TiledDeferred::supported());
+			Checkbox("Tiled Compute Lighting", &tiledDeferredEnabled); //Blinn-Phong only, lights the point and spot lights of the scene plus the demo lights(Clustered Lighting)
+			Checkbox("Tile Light Count Heatmap", &tiledHeatmap);
+			Text((std::to_string(TiledDeferred::tileSize) + "x" + std::to_string(TiledDeferred::tileSize) + " tiles: " + std::to_string(tiledDeferred.tileCount) +
+				", up to " + std::to_string(TiledDeferred::maxLightsPerTile) + " lights per tile").c_str());
+			Text(("Lights: " + std::to_string(lightClusters.lightCount()) + "  lighting: " + std::to_string(tiledDeferred.gpuTime) + " ms").c_str());
+			EndDisabled();
+
+			EndDisabled();
+			TreePop();
+		}
+		if (TreeNode("Visibility Buffer")) {
+			if (!VisibilityBuffer::supported())
+				Text("Needs storage buffer writes from vertex shaders");
+			BeginDisabled(!VisibilityBuffer::supported());
+			Checkbox("Enable Visibility Buffer", &visibilityBufferEnabled); //Takes over from forward and deferred, always PBR and single sampled
+
+			Text((std::to_string(VisibilityBuffer::bytesPerPixel) + " bytes per pixel, " + std::to_string(VisibilityBuffer::bytesPerPixel * SCR_WIDTH * SCR_HEIGHT / (1024 * 1024)) + " MB").c_str());
+			Text(("Draws: " + std::to_string(visibilityBuffer.drawCount) + "(" + std::to_string(visibilityBuffer.droppedDraws) + " dropped)  material passes: " +
+				std::to_string(visibilityBuffer.materialCount)).c_str());
+			Text(("Pooled vertices: " + std::to_string(visibilityBuffer.pooledVertices) + "  indices: " + std::to_string(visibilityBuffer.pooledIndices)).c_str());
+			Text(("Geometry pass: " + std::to_string(visibilityPass.result / 1000000.0) + " ms  shading: " + std::to_string(visibilityShadePass.result / 1000000.0) + " ms").c_str());
 			EndDisabled();
 			TreePop();
 		}
 		if (TreeNode("Lights")) {
+			DirLight& dirLight = scene.get<DirLight>(dirLightEntity);
+			PointLight& pointLight = scene.get<PointLight>(pointLightEntity);
+			SpotLight& spotLight = scene.get<SpotLight>(spotLightEntity);
+
 			/*
 			bool changed;
 			Text("Directional Light");
@@ -1487,28 +2277,12 @@ void updateImGui() {
 			nodeOpened = TreeNodeEx("Dir Light");
 
 			SameLine();
-			if (Checkbox("##0", &dirLightEnabled)) {
-				shader.use();
-				shader.set1b("dirLightEnabled", dirLightEnabled);
-				PBRShader.use();
-				PBRShader.set1b("dirLightEnabled", dirLightEnabled);
-			}
+			Checkbox("##0", &dirLightEnabled); //The light block picks the edits up next frame
 
 			BeginDisabled(!dirLightEnabled);
 			if (nodeOpened) {
-				if (ColorEdit3("Diffuse##0", glm::value_ptr(dirLight.diffuse))) {
-					shader.use();
-					shader.setVec3("dirLight.diffuse", dirLight.diffuse);
-					PBRShader.use();
-					PBRShader.setVec3("dirLight.diffuse", dirLight.diffuse);
-				}
-
-				if (SliderFloat3("Dir##0", glm::value_ptr(dirLight.dir), -1.f, 1.f)) {
-					shader.use();
-					shader.setVec3("dirLight.direction", dirLight.dir);
-					PBRShader.use();
-					PBRShader.setVec3("dirLight.direction", dirLight.dir);
-				}
+				ColorEdit3("Diffuse##0", glm::value_ptr(dirLight.diffuse));
+				SliderFloat3("Dir##0", glm::value_ptr(dirLight.dir), -1.f, 1.f);
 				NewLine(); //If opened make some space
 				TreePop();
 			}
@@ -1518,29 +2292,16 @@ void updateImGui() {
 			//Point Light
 			nodeOpened = TreeNodeEx("Point Light");
 			SameLine();
-			if (Checkbox("##1", &pointLightEnabled)) {
-				shader.use();
-				shader.set1b("pointLightEnabled", pointLightEnabled);
-				PBRShader.use();
-				PBRShader.set1b("pointLightEnabled", pointLightEnabled);
-			}
+			Checkbox("##1", &pointLightEnabled);
 
 			BeginDisabled(!pointLightEnabled);
 			if (nodeOpened) {
-				if (ColorEdit3("Diffuse##1", glm::value_ptr(pointLight.diffuse))) {
-					shader.use();
-					shader.setVec3("pointLights[0].diffuse", pointLight.diffuse);
-					PBRShader.use();
-					PBRShader.setVec3("pointLights[0].diffuse", pointLight.diffuse);
-				}
+				ColorEdit3("Diffuse##1", glm::value_ptr(pointLight.diffuse));
+				SliderFloat3("Pos##1", glm::value_ptr(pointLight.pos), -10, 10);
 
-				if (SliderFloat3("Pos##1", glm::value_ptr(pointLight.pos), -10, 10)) {
-					shader.use();
-					shader.setVec3("pointLights[0].position", pointLight.pos);
-
-					PBRShader.use();
-					PBRShader.setVec3("pointLights[0].position", pointLight.pos);
-				}
+				std::vector<Entity> litEntities;
+				scene.querySphere(pointLight.pos, pointLight.range(), litEntities);
+				Text(("Range: " + std::to_string(pointLight.range()) + "  Objects in range: " + std::to_string(litEntities.size())).c_str());
 				NewLine(); //If opened make some space
 				TreePop();
 			}
@@ -1550,30 +2311,16 @@ void updateImGui() {
 			//Spot Light
 			nodeOpened = TreeNodeEx("Spot Light");
 			SameLine();
-			if (Checkbox("##2", &spotLightEnabled)) {
-				shader.use();
-				shader.set1b("spotLightEnabled", spotLightEnabled);
-				PBRShader.use();
-				PBRShader.set1b("spotLightEnabled", spotLightEnabled);
-			}
+			Checkbox("##2", &spotLightEnabled);
 
 			BeginDisabled(!spotLightEnabled);
 			if (nodeOpened) {
-				if (ColorEdit3("Diffuse##2", glm::value_ptr(spotLight.diffuse))) {
-					shader.use();
-					shader.setVec3("spotLight.diffuse", spotLight.diffuse);
-					PBRShader.use();
-					PBRShader.setVec3("spotLight.diffuse", spotLight.diffuse);
-				}
+				ColorEdit3("Diffuse##2", glm::value_ptr(spotLight.diffuse));
 
-				if (SliderFloat("Inner Cutoff", &spotLight.cutOff, 0.f, 180.f)) {
+				if (SliderFloat("Inner Cutoff", &spotLight.cutOff, 0.f, 180.f))
 					spotLight.updateCosCutOff();
-					PBRShader.set1f("spotLight.cutOff", spotLight.cosCutOff);
-				}
-				if (SliderFloat("Outer Cutoff", &spotLight.outerCutOff, 0.f, 180.f)) {
+				if (SliderFloat("Outer Cutoff", &spotLight.outerCutOff, 0.f, 180.f))
 					spotLight.updateCosOuterCutOff();
-					PBRShader.set1f("spotLight.outerCutOff", spotLight.cosOuterCutOff);
-				}
 				NewLine(); //If opened make some space
 				TreePop();
 			}
@@ -1583,6 +2330,91 @@ void updateImGui() {
 
 			TreePop();
 		}
+		if (TreeNode("Shadows")) {
+			Checkbox("Cascaded Shadow Maps(Dir Light)", &shadowsEnabled);
+			BeginDisabled(!shadowsEnabled);
+
+			SliderInt("Cascades", &shadowCascades.cascadeCount, 1, ShadowCascades::maxCascades);
+			SliderFloat("Distance", &shadowCascades.distance, 5.f, 100.f);
+			SliderFloat("Split Lambda(uniform-log)", &shadowCascades.splitLambda, 0.f, 1.f);
+			const char* resolutions[] = { "1024", "2048", "4096" };
+			int resolutionIndex = shadowCascades.resolution >= 4096 ? 2 : shadowCascades.resolution >= 2048 ? 1 : 0;
+			if (Combo("Resolution", &resolutionIndex, resolutions, 3))
+				shadowCascades.resize(1024 << resolutionIndex);
+			SliderFloat("Normal Offset(texels)", &shadowCascades.normalOffset, 0.f, 4.f);
+			SliderFloat("Depth Bias", &shadowCascades.depthBias, 0.f, .005f, "%.5f");
+			Checkbox("Cache Static Cascades", &shadowCascades.caching); //Redrawn only when their light view or casters change
+			Checkbox("Time Cascades Separately", &shadowCascades.timeCascades); //A pass per cascade instead of the layered one
+			if (!ShadowCascades::pyramidSupported())
+				Text("The min/max pyramid needs compute shaders and image load/store");
+			const char* filters[] = { "PCF(3x3 tent)", "PCSS(brute force search)", "PCSS(min/max pyramid)" };
+			if (Combo("Filter", &shadowCascades.filter, filters, 3) && shadowCascades.filter == ShadowFilter_PCSS && !ShadowCascades::pyramidSupported())
+				shadowCascades.filter = ShadowFilter_PCSSBruteForce;
+			BeginDisabled(shadowCascades.filter == ShadowFilter_PCF);
+			SliderFloat("Light Size(tan of the angular radius)", &shadowCascades.lightSize, .001f, .1f, "%.3f");
+			SliderFloat("Max Penumbra(m)", &shadowCascades.maxPenumbra, .1f, 4.f);
+			EndDisabled();
+			NewLine();
+
+			Text(("Shadow map: " + std::to_string(shadowCascades.bytes() / (1024 * 1024)) + " MB  drawing: " + std::to_string(shadowCascades.gpuTime) + " ms" +
+				(shadowCascades.filter == ShadowFilter_PCSS ? "(pyramids " + std::to_string(shadowCascades.pyramidTime) + " ms)" : "")).c_str());
+			for (int i = 0; i < shadowCascades.activeCount; i++) {
+				const ShadowCascades::Cascade& cascade = shadowCascades.cascades[i];
+				Text(("Cascade " + std::to_string(i) + ": " + std::to_string(cascade.nearDepth) + "-" + std::to_string(cascade.farDepth) + " m, " +
+					std::to_string(cascade.casters) + " casters, " + std::to_string(cascade.triangles) + " triangles").c_str());
+				if (cascade.cachedFrames)
+					Text(("    cached for " + std::to_string(cascade.cachedFrames) + " frames").c_str());
+				else if (shadowCascades.timeCascades)
+					Text(("    drawn: " + std::to_string(cascade.gpuTime) + " ms").c_str());
+				else
+					Text("    drawn");
+			}
+			EndDisabled();
+			NewLine();
+
+			Checkbox("Shadow Atlas(Point & Spot Lights)", &lightShadowsEnabled);
+			BeginDisabled(!lightShadowsEnabled);
+
+			const char* atlasSizes[] = { "2048", "4096", "8192" };
+			int atlasIndex = shadowAtlas.size >= 8192 ? 2 : shadowAtlas.size >= 4096 ? 1 : 0;
+			if (Combo("Atlas Size", &atlasIndex, atlasSizes, 3))
+				shadowAtlas.resize(2048 << atlasIndex);
+			SliderFloat("Tile Texels per Screen Pixel", &shadowAtlas.tileScale, .25f, 2.f);
+			Checkbox("Cache Static Lights", &shadowAtlas.caching); //Redrawn only when the light, its tiles or its casters change
+			NewLine();
+
+			Text(("Atlas: " + std::to_string(shadowAtlas.bytes() / (1024 * 1024)) + " MB, " + std::to_string((int)(shadowAtlas.occupancy() * 100.f)) + "% in use  drawing: " +
+				std::to_string(shadowAtlas.gpuTime) + " ms").c_str());
+			Text(("Shadowed lights: " + std::to_string(shadowAtlas.shadowedLights) + "  without tiles: " + std::to_string(shadowAtlas.unshadowedLights) +
+				"  evicted: " + std::to_string(shadowAtlas.evictions)).c_str());
+			Text(("Redrawn: " + std::to_string(shadowAtlas.redrawnLights) + " lights, " + std::to_string(shadowAtlas.redrawnFaces) + " faces").c_str());
+			Text(shadowAtlas.instancedFaces() ? "Cube faces: one instanced pass, viewport from the vertex shader" : "Cube faces: a pass per face");
+
+			EndDisabled();
+			TreePop();
+		}
+		if (TreeNode("Clustered Lighting")) {
+			if (!LightClusters::supported())
+				Text("Needs compute shaders and storage buffers");
+			BeginDisabled(!LightClusters::supported());
+
+			Checkbox("Enable##clusters", &clusteredLighting);
+			Checkbox("Light Count Heatmap", &clusterHeatmap);
+			if (SliderInt("Demo Lights", &demoLightCount, 0, 8192))
+				generateDemoLights();
+			if (SliderFloat("Demo Light Intensity", &demoLightIntensity, .01f, 1.f))
+				for (PointLight& light : demoLights)
+					light.intensity = demoLightIntensity;
+			Checkbox("Move Demo Lights", &demoLightsMoving);
+
+			Text(("Grid: " + std::to_string(LightClusters::gridX) + "x" + std::to_string(LightClusters::gridY) + "x" + std::to_string(LightClusters::gridZ) + ", up to " +
+				std::to_string(LightClusters::maxLightsPerCluster) + " lights per cluster").c_str());
+			Text(("Lights: " + std::to_string(lightClusters.lightCount()) + "  culling: " + std::to_string(lightClusters.gpuTime) + " ms").c_str());
+			Text("Used by the PBR forward pass, the tiled deferred lighting takes the same lights");
+
+			EndDisabled();
+			TreePop();
+		}
 		if (TreeNode("Skybox")) {
 			if (RadioButton("Abandoned Room 2K", &currentSkybox, 0)) {
 				hdrTexture.loadHDRMap("Images/HDRI/abandoned_tiled_room_2k.hdr");
@@ -1608,32 +2440,31 @@ void updateImGui() {
 			TreePop();
 		}
 		if (TreeNode("Post-processing")) {
-			if (Checkbox("Using textures in sRGB color space?", &transformSRGB)) {
-				PBRShader.use();
-				PBRShader.set1b("transformSRGB", transformSRGB);
-
-				shader.use();
-				shader.set1b("transformSRGB", transformSRGB);
-			}
+			Checkbox("Using textures in sRGB color space?", &transformSRGB);
 			NewLine();
 
 			Text("Anti-Aliasing");
 			if (RadioButton("Off", &antiAliasing, 0)) {
 				postprocShader.use();
 				postprocShader.set1b("fxaaEnabled", false);
+				setupDeferredShading();
 			}
 			if (RadioButton("MSAA", &antiAliasing, 1)) {
 				postprocShader.use();
 				postprocShader.set1b("fxaaEnabled", false);
+				setupDeferredShading();
 			}
 			if(RadioButton("FXAA", &antiAliasing, 2)) {
 				postprocShader.use();
 				postprocShader.set1b("fxaaEnabled", true);
+				setupDeferredShading();
 			}
 			
 			BeginDisabled(antiAliasing != 1);
-			if (SliderInt("MSAA Sample Count", &msaaSampleCount, 1, 8))
+			if (SliderInt("MSAA Sample Count", &msaaSampleCount, 1, 8)) {
 				setupMSAA();
+				setupDeferredShading();
+			}
 			EndDisabled();
 			NewLine();
 
@@ -1719,22 +2550,9 @@ void updateImGui() {
 		}
 	}
 	if (CollapsingHeader("Shaders")) {
-		if (Button("Reload")) {
-			shader.loadShader("Shaders/main.vert", "Shaders/main.frag");
-
-			shader.use();
-			dirLight.set(shader, "dirLight");
-			pointLight.set(shader, "pointLights[0]");
-			spotLight.set(shader, "spotLight");
-
-			shader.set1b("dirLightEnabled", dirLightEnabled);
-			shader.set1b("pointLightEnabled", pointLightEnabled);
-			shader.set1b("spotLightEnabled", spotLightEnabled);
-			shader.setMat4("proj", proj);
-			
-			shader.set1b("transformSRGB", transformSRGB);
-		}
-		SameLine(); Text("Main Shader");
+		if (Button("Reload"))
+			mainShaders.reload();
+		SameLine(); Text(("Main Shader(" + std::to_string(mainShaders.count()) + " variants)").c_str());
 
 		if (Button("Reload##0")) {
 			postprocShader.loadShader("Shaders/renderQuad.vert", "Shaders/postProc.frag");
@@ -1752,7 +2570,6 @@ void updateImGui() {
 
 			//FXAA
 			postprocShader.set1b("fxaaEnabled", antiAliasing == 2);
-			postprocShader.setVec2("inverseScreenSize", glm::vec2(1.f / SCR_WIDTH, 1.f / SCR_HEIGHT));
 			postprocShader.set1f("EDGE_THRESHOLD_MIN", EDGE_THRESHOLD_MIN);
 			postprocShader.set1f("EDGE_THRESHOLD_MAX", EDGE_THRESHOLD_MAX);
 			postprocShader.set1i("ITERATIONS", ITERATIONS);
@@ -1760,36 +2577,67 @@ void updateImGui() {
 		}
 		SameLine(); Text("Post-processing Shader");
 
-		if (Button("Reload##1")) {
-			PBRShader.loadShader("Shaders/PBR/PBR.vert", "Shaders/PBR/PBR.frag");
-
-			PBRShader.use();
-			PBRShader.setMat4("proj", proj);
-			
-			dirLight.set(PBRShader, "dirLight");
-			pointLight.set(PBRShader, "pointLights[0]");
-			spotLight.set(PBRShader, "spotLight");
+		if (Button("Reload##1"))
+			PBRShaders.reload();
+		SameLine(); Text(("PBR Shader(" + std::to_string(PBRShaders.count()) + " variants)").c_str());
 
-			PBRShader.set1b("pointLightEnabled", pointLightEnabled);
-			PBRShader.set1b("dirLightEnabled", dirLightEnabled);
-			PBRShader.set1b("spotLightEnabled", spotLightEnabled);
+		if (Button("Reload##2"))
+			tiledDeferred.reload();
+		SameLine(); Text(("Tiled Deferred Shader(" + std::to_string(tiledDeferred.count()) + " variants)").c_str());
 
-			PBRShader.set1b("iblEnabled", iblEnabled);
+		if (Button("Reload##3"))
+			gBufferShaders.reload();
+		SameLine(); Text(("G-Buffer Shader(" + std::to_string(gBufferShaders.count()) + " variants)").c_str());
+		NewLine();
 
-			PBRShader.set1b("useAlbedo", useAlbedo);
-			PBRShader.set1b("useNormalMap", useNormalMap);
-			PBRShader.set1b("useMetallic", useMetallic);
-			PBRShader.set1b("useRoughness", useRoughness);
-			PBRShader.set1b("useAlbedo", useAmbientMap);
+		Text(("Startup shader loading: " + std::to_string(shaderStartupTime) + " ms(" + std::to_string(shaderQueue.built) + " programs, " +
+			(Shader::parallelCompileSupported() ? "parallel compile" : "no parallel compile") + ")").c_str());
+		Checkbox("Use program binary cache", &programCache.enabled);
+		SameLine();
+		if (Button("Clear cache")) programCache.clear();
+		Text(("Binary cache hits: " + std::to_string(programCache.hits) + "  misses: " + std::to_string(programCache.misses) + "  rejected: " + std::to_string(programCache.rejected)).c_str());
+		if (!programCache.supported() && programCache.enabled) Text("The driver has no program binary formats");
 
-			PBRShader.set1b("transformSRGB", transformSRGB);
-		}
-		SameLine(); Text("PBR Shader");
+		Text(("Variants compiled: " + std::to_string(ShaderVariants::totalCompiled) + " in " + std::to_string(ShaderVariants::totalCompileTime) + " ms").c_str());
+		Text(("Main: " + std::to_string(mainShaders.compileTime) + " ms  PBR: " + std::to_string(PBRShaders.compileTime) + " ms").c_str());
 	}
 	if (CollapsingHeader("Profiling", ImGuiTreeNodeFlags_DefaultOpen)) {
 		Text(("IMGUI Average framerate: " + std::to_string((int)io.Framerate) + " FPS").c_str());
 		Text(("IMGUI Average frametime: " + std::to_string(1000 / io.Framerate) + " ms").c_str());
 		Text(("Delta Time: " + std::to_string(dt.deltaTime * 1000) + " ms").c_str());
+		Text(("CPU frametime: " + std::to_string(renderStats.cpuFrameTime) + " ms").c_str());
+		NewLine();
+
+		Text(("Draw calls: " + std::to_string(renderStats.drawCalls)).c_str());
+		Text(("Instances: " + std::to_string(renderStats.instances)).c_str());
+		Text(("Uniform uploads: " + std::to_string(renderStats.uniformUploads) + "  skipped: " + std::to_string(renderStats.uniformsSkipped)).c_str());
+		Text(("GL state calls: " + std::to_string(renderStats.stateCalls) + "  filtered: " + std::to_string(renderStats.stateCallsFiltered)).c_str());
+		Text(("Render queue: " + std::to_string(renderQueue.size()) + " packets, sort " + std::to_string(renderQueue.sortTime) + " ms, submit " + std::to_string(renderQueue.submitTime) + " ms").c_str());
+		Text(("    program/material/mesh changes: " + std::to_string(renderQueue.programChanges) + "/" + std::to_string(renderQueue.materialChanges) + "/" + std::to_string(renderQueue.meshChanges)).c_str());
+		Text(("Loading tasks: " + std::to_string(asyncScheduler.activeTasks)).c_str());
+		SliderFloat("Upload Budget(ms)", &uploadBudget, .5f, 16.f);
+		NewLine();
+
+		Checkbox("Frustum Culling", &frustumCulling);
+		const char* cullingModes[] = { "SIMD Spheres", "BVH", "GPU Hi-Z(Stress Test)", "Occlusion Queries(Stress Test)" };
+		Combo("Culling Mode", &cullingMode, cullingModes, 4);
+		if (cullingMode == 2 && !HiZCuller::supported())
+			Text("Hi-Z culling needs compute shaders, falling back to SIMD spheres");
+		if (cullingMode == 2) {
+			Checkbox("Occlusion(Hi-Z)", &hiZCuller.occlusionEnabled);
+			Text(("GPU culling: " + std::to_string(hiZCuller.gpuTime) + " ms, counts stay on the GPU").c_str());
+		}
+		if (cullingMode == 3) {
+			Text(("Chunks(" + std::to_string(stressChunkSize) + "x" + std::to_string(stressChunkSize) + "): " + std::to_string(queryCuller.proxiesDrawn) + " proxies, " + std::to_string(queryCuller.conditionalDraws) + " conditional draws").c_str());
+			Text(OcclusionQueryCuller::queryType() == GL_ANY_SAMPLES_PASSED_CONSERVATIVE ? "Query: ANY_SAMPLES_PASSED_CONSERVATIVE" : "Query: ANY_SAMPLES_PASSED");
+		}
+		if (Checkbox("SIMD Culling", &sceneCuller.useSIMD))
+			stressCuller.useSIMD = sceneCuller.useSIMD;
+		if (!frustumCulling)
+			scene.resetVisibility();
+		Text(("Visible: " + std::to_string(renderStats.visible) + "  Culled: " + std::to_string(renderStats.culled)).c_str());
+		Text(("Culling time: " + std::to_string(renderStats.cullTime) + " ms (" + std::to_string(FrustumCuller::simdWidth) + "-wide)").c_str());
+		Text(("BVH nodes: " + std::to_string(scene.bvh.nodeCount() + stressBVH.nodeCount())).c_str());
 		NewLine();
 
 		Text("Query Time");
@@ -1802,6 +2650,42 @@ void updateImGui() {
 		Text(("GUI Pass:		" + std::to_string(guiPass.result / 1000000.0) + "  ms").c_str());
 		Text(("Post-Proc Pass:	" + std::to_string(postprocPass.result / 1000000.0) + "  ms").c_str());
 	}
+	if (CollapsingHeader("Benchmarks")) {
+		if (Button("ECS Iteration & Churn"))
+			benchmarkECS();
+		if (Button("Frustum Culling(1M spheres)"))
+			benchmarkCulling();
+		if (Button("BVH Build/Refit/Query(1k-1M)"))
+			benchmarkBVH();
+		if (Button("Tangent Generation(Assimp vs ours)"))
+			benchmarkTangents();
+		if (Button("glTF Loading(native vs Assimp)"))
+			benchmarkGLTF();
+		if (Button("Uniform Updates(strings vs reflected)"))
+			benchmarkUniforms(PBRShaders.get(passFeatures() | ShaderFeature_materialMaps), frameUniforms);
+		if (Button("Shader Build(one by one vs queued)")) {
+			std::vector<ProgramSources> programs = { { "Shaders/main.vert", "Shaders/main.frag" }, { "Shaders/PBR/PBR.vert", "Shaders/PBR/PBR.frag" },
+				{ "Shaders/main.vert", "Shaders/deferred.frag" } };
+			for (const StartupProgram& program : startupPrograms)
+				programs.push_back(program.sources);
+			benchmarkShaderBuild(programs);
+		}
+		if (Button("Render Queue(100k packets)")) {
+			MeshRenderer& renderer = scene.get<MeshRenderer>(modelEntity);
+			if (renderer.model)
+				benchmarkRenderQueue(*renderer.model, pbrEnabled ? PBRShaders : mainShaders, passFeatures());
+		}
+		if (Button("G-Buffer Layout(wide vs packed)"))
+			benchmarkGBuffer(scene, gBufferShaders, passFeatures(), materialMapMask(), gBuffer, SCR_WIDTH, SCR_HEIGHT, gBufferSamples);
+		if (Button("Pipelines(forward vs deferred vs visibility)"))
+			pipelineBenchmarkPending = true;
+		if (Button("Shadow Filters(PCF vs PCSS)"))
+			shadowBenchmarkPending = true;
+		NewLine();
+
+		for (const std::string& result : benchmarkResults)
+			TextWrapped("%s", result.c_str());
+	}
 	if (CollapsingHeader("OpenGL Options")) {
 		if (Checkbox("VSync", &vsyncOn))
 			glfwSwapInterval(vsyncOn);
@@ -1841,6 +2725,7 @@ void updateImGui() {
 
 	ImGui::Render();
 	ImGui_ImplOpenGL3_RenderDrawData(GetDrawData());
+	glState.invalidate(); //ImGui sets and restores state with raw GL calls
 	
 	guiPass.end();
 }
\ No newline at end of file